@@ -0,0 +1,110 @@
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <vector>
+
+#include "sst/sst.h"
+#ifdef USE_VERBS_API
+#include "sst/verbs.h"
+#else
+#include "sst/lf.h"
+#endif
+
+using namespace sst;
+using std::cin;
+using std::cout;
+
+/**
+ * Compares writing a set of counters with one put() per counter (the way
+ * MulticastGroup updates seq_num, delivered_num, num_received, ...) against
+ * recording them with put_deferred() and writing them with a single flush().
+ */
+class CounterSST : public SST<CounterSST> {
+public:
+    SSTFieldVector<int64_t> counters;
+    CounterSST(const SSTParams& params, uint32_t num_counters)
+            : SST<CounterSST>(this, params),
+              counters(num_counters) {
+        SSTInit(counters);
+    }
+};
+
+// number of rounds of counter updates
+const long long int num_reruns = 100000;
+
+int main() {
+    std::vector<uint32_t> num_counters_arr = {1, 2, 4, 8, 16, 32, 64};
+
+    // input number of nodes and the local node id
+    std::cout << "Enter node_rank and num_nodes" << std::endl;
+    uint32_t node_rank, num_nodes;
+    cin >> node_rank >> num_nodes;
+
+    std::cout << "Input the IP addresses" << std::endl;
+    uint16_t port = 32567;
+    // input the ip addresses
+    std::map<uint32_t, std::pair<std::string, uint16_t>> ip_addrs_and_ports;
+    for(uint i = 0; i < num_nodes; ++i) {
+        std::string ip;
+        cin >> ip;
+        ip_addrs_and_ports[i] = {ip, port};
+    }
+    std::cout << "Using the default port value of " << port << std::endl;
+
+    // initialize the rdma resources
+#ifdef USE_VERBS_API
+    verbs_initialize(ip_addrs_and_ports, node_rank);
+#else
+    lf_initialize(ip_addrs_and_ports, node_rank);
+#endif
+
+    std::vector<uint32_t> members(num_nodes);
+    for(uint i = 0; i < num_nodes; ++i) {
+        members[i] = i;
+    }
+
+    cout << "num_counters per_field_put_us coalesced_put_us deferred_writes posted_writes" << std::endl;
+    for(auto num_counters : num_counters_arr) {
+        CounterSST sst(SSTParams(members, node_rank, nullptr, {}, true, 1, {}, true), num_counters);
+        for(uint j = 0; j < num_counters; ++j) {
+            sst.counters[node_rank][j] = 0;
+        }
+        sst.put();
+        sst.sync_with_members();
+
+        auto offset_of = [&](uint32_t j) {
+            return (char*)std::addressof(sst.counters[0][j]) - sst.getBaseAddress();
+        };
+
+        // one put per updated counter
+        auto start_time = std::chrono::steady_clock::now();
+        for(long long int i = 0; i < num_reruns; ++i) {
+            for(uint j = 0; j < num_counters; ++j) {
+                sst.counters[node_rank][j]++;
+                sst.put(offset_of(j), sizeof(int64_t));
+            }
+        }
+        auto end_time = std::chrono::steady_clock::now();
+        double per_field_us = std::chrono::duration<double, std::micro>(end_time - start_time).count() / num_reruns;
+        sst.sync_with_members();
+
+        // record every counter as dirty, then write them all at once
+        start_time = std::chrono::steady_clock::now();
+        for(long long int i = 0; i < num_reruns; ++i) {
+            for(uint j = 0; j < num_counters; ++j) {
+                sst.counters[node_rank][j]++;
+                sst.put_deferred(offset_of(j), sizeof(int64_t));
+            }
+            sst.flush();
+        }
+        end_time = std::chrono::steady_clock::now();
+        double coalesced_us = std::chrono::duration<double, std::micro>(end_time - start_time).count() / num_reruns;
+        sst.sync_with_members();
+
+        WriteCombiningCounters wc_counters = sst.get_write_combining_counters();
+        cout << num_counters << " " << per_field_us << " " << coalesced_us << " "
+             << wc_counters.num_deferred_writes << " " << wc_counters.num_posted_writes << std::endl;
+    }
+
+    return 0;
+}
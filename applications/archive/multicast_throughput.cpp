@@ -116,8 +116,8 @@ int main(int argc, char* argv[]) {
                 uint32_t slot = num_received % window_size;
                 if((int64_t&)sst.slots[row_offset + j][(max_msg_size + 2 * sizeof(uint64_t)) * (slot + 1) - sizeof(uint64_t)] == (num_received / window_size + 1)) {
                     sst_receive_handler(j, num_received,
-                                        &sst.slots[row_offset + j][(max_msg_size + 2 * sizeof(uint64_t)) * slot],
-                                        sst.slots[row_offset + j][(max_msg_size + 2 * sizeof(uint64_t)) * (slot + 1) - 2 * sizeof(uint64_t)]);
+                                        &sst.slots[row_offset + j][(max_msg_size + 2 * sizeof(uint64_t)) * slot + sizeof(uint64_t)],
+                                        (uint64_t&)sst.slots[row_offset + j][(max_msg_size + 2 * sizeof(uint64_t)) * slot]);
                     sst.num_received_sst[node_rank][j]++;
                 }
             }
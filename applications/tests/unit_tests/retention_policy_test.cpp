@@ -0,0 +1,77 @@
+/**
+ * @file retention_policy_test.cpp
+ *
+ * Tests of VersionHistory::versions_to_trim(), which picks the versions the
+ * background trimming of PersistenceManager removes under a retention policy.
+ */
+#include <iostream>
+
+#include "derecho/persistence_manager.h"
+#include "utils/test_check.hpp"
+
+using derecho::RetentionPolicy;
+using derecho::VersionHistory;
+
+// versions 1..n, version v made at v seconds
+static VersionHistory make_history(const RetentionPolicy& policy, int64_t n) {
+    VersionHistory history{policy, {}};
+    for(int64_t v = 1; v <= n; v++) {
+        history.versions.emplace_back(v, v * 1000000);
+    }
+    return history;
+}
+
+// versions are only trimmed once the whole shard persisted them, and
+// persisted_margin versions before the frontier are kept
+static void test_persisted_frontier() {
+    std::cout << "persisted frontier" << std::endl;
+    VersionHistory history = make_history({1, 0, 0}, 10);
+    CHECK(history.versions_to_trim(INVALID_VERSION, 0) == 0);
+    CHECK(history.versions_to_trim(0, 0) == 0);
+    CHECK(history.versions_to_trim(5, 0) == 5);
+    history.policy.persisted_margin = 3;
+    CHECK(history.versions_to_trim(5, 0) == 2);
+    CHECK(history.versions_to_trim(2, 0) == 0);
+    // the frontier may fall between two versions
+    VersionHistory sparse{{1, 0, 0}, {{2, 0}, {4, 0}, {6, 0}}};
+    CHECK(sparse.versions_to_trim(5, 0) == 2);
+    CHECK(sparse.versions_to_trim(1, 0) == 0);
+    const VersionHistory empty{{1, 0, 0}, {}};
+    CHECK(empty.versions_to_trim(5, 0) == 0);
+}
+
+// the latest versions are kept, and always the latest one
+static void test_version_count() {
+    std::cout << "version count" << std::endl;
+    VersionHistory history = make_history({3, 0, 0}, 10);
+    CHECK(history.versions_to_trim(10, 0) == 7);
+    CHECK(history.versions_to_trim(4, 0) == 4);
+    history.policy.versions = 20;
+    CHECK(history.versions_to_trim(10, 0) == 0);
+    history.policy.versions = 0;
+    CHECK(history.versions_to_trim(10, 0) == 9);
+}
+
+// the versions of the last seconds are kept
+static void test_age() {
+    std::cout << "age" << std::endl;
+    VersionHistory history = make_history({1, 3, 0}, 10);
+    // versions 8 to 10 are younger than 3 seconds
+    CHECK(history.versions_to_trim(10, 10500000) == 7);
+    CHECK(history.versions_to_trim(10, 11000000) == 7);
+    CHECK(history.versions_to_trim(10, 11000001) == 8);
+    // the other limits still apply
+    CHECK(history.versions_to_trim(4, 10500000) == 4);
+    history.policy.versions = 5;
+    CHECK(history.versions_to_trim(10, 10500000) == 5);
+    // the whole history is younger
+    history.policy.seconds = 100;
+    CHECK(history.versions_to_trim(10, 10500000) == 0);
+}
+
+int main(int argc, char* argv[]) {
+    test_persisted_frontier();
+    test_version_count();
+    test_age();
+    return check_results();
+}
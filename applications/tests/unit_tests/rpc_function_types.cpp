@@ -51,10 +51,16 @@ public:
         state.append(text);
     }
 
+    //The view borrows the delivered message, so the bytes must be copied out
+    //before the function returns
+    void append_bytes(const derecho::BufferView& bytes) {
+        state.append(bytes.data, bytes.size);
+    }
+
     ReferenceTest(const std::string& initial_state = "") : state(initial_state) {}
 
     DEFAULT_SERIALIZATION_SUPPORT(ReferenceTest, state);
-    REGISTER_RPC_FUNCTIONS(ReferenceTest, get_state, set_state, append_string);
+    REGISTER_RPC_FUNCTIONS(ReferenceTest, get_state, set_state, append_string, append_bytes);
 };
 
 using derecho::even_sharding_policy;
@@ -98,6 +104,13 @@ int main(int argc, char** argv) {
         derecho::Replicated<ReferenceTest>& reference_test = group.get_subgroup<ReferenceTest>();
         reference_test.ordered_send<RPC_NAME(set_state)>("Hello, testing.");
         reference_test.ordered_send<RPC_NAME(append_string)>(" Another string. ");
+        const std::string more_bytes = "Some borrowed bytes.";
+        reference_test.ordered_send<RPC_NAME(append_bytes)>(derecho::BufferView(more_bytes.data(), more_bytes.size()));
+        //Several invocations, even of different functions, can share one multicast
+        auto batch = reference_test.make_batch();
+        batch.add<RPC_NAME(append_string)>(" Batched string. ");
+        batch.add<RPC_NAME(append_bytes)>(derecho::BufferView(more_bytes.data(), more_bytes.size()));
+        batch.send();
         derecho::rpc::QueryResults<std::string> results = reference_test.ordered_send<RPC_NAME(get_state)>();
         decltype(results)::ReplyMap& replies = results.get();
         for(auto& reply_pair : replies) {
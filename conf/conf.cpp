@@ -35,6 +35,21 @@ struct option Conf::long_options[] = {
         MAKE_LONG_OPT_ENTRY(CONF_DERECHO_WINDOW_SIZE),
         MAKE_LONG_OPT_ENTRY(CONF_DERECHO_TIMEOUT_MS),
         MAKE_LONG_OPT_ENTRY(CONF_DERECHO_RDMC_SEND_ALGORITHM),
+        MAKE_LONG_OPT_ENTRY(CONF_DERECHO_RDMC_SEND_DEPTH),
+        MAKE_LONG_OPT_ENTRY(CONF_DERECHO_SST_DETECTOR_THREADS),
+        MAKE_LONG_OPT_ENTRY(CONF_DERECHO_SST_IDLE_SPIN_US),
+        MAKE_LONG_OPT_ENTRY(CONF_DERECHO_SST_IDLE_YIELD_US),
+        MAKE_LONG_OPT_ENTRY(CONF_DERECHO_SST_IDLE_PARK_US),
+        MAKE_LONG_OPT_ENTRY(CONF_DERECHO_SST_WRITE_COMBINING),
+        MAKE_LONG_OPT_ENTRY(CONF_DERECHO_P2P_IDLE_SPIN_US),
+        MAKE_LONG_OPT_ENTRY(CONF_DERECHO_P2P_IDLE_PARK_US),
+        MAKE_LONG_OPT_ENTRY(CONF_DERECHO_P2P_WORKER_THREADS),
+        MAKE_LONG_OPT_ENTRY(CONF_DERECHO_ORDERED_SEND_BATCH_BYTES),
+        MAKE_LONG_OPT_ENTRY(CONF_DERECHO_ORDERED_SEND_BATCH_DELAY_US),
+        MAKE_LONG_OPT_ENTRY(CONF_DERECHO_MESSAGE_BUFFER_HUGE_PAGES),
+        MAKE_LONG_OPT_ENTRY(CONF_DERECHO_SENDER_LANES),
+        MAKE_LONG_OPT_ENTRY(CONF_DERECHO_SENDER_SUBGROUP_WEIGHTS),
+        MAKE_LONG_OPT_ENTRY(CONF_DERECHO_DELIVERY_THREADS),
         // [RDMA]
         MAKE_LONG_OPT_ENTRY(CONF_RDMA_PROVIDER),
         MAKE_LONG_OPT_ENTRY(CONF_RDMA_DOMAIN),
@@ -42,8 +57,20 @@ struct option Conf::long_options[] = {
         MAKE_LONG_OPT_ENTRY(CONF_RDMA_RX_DEPTH),
         // [PERS]
         MAKE_LONG_OPT_ENTRY(CONF_PERS_FILE_PATH),
+        MAKE_LONG_OPT_ENTRY(CONF_PERS_FILE_PATHS),
         MAKE_LONG_OPT_ENTRY(CONF_PERS_RAMDISK_PATH),
         MAKE_LONG_OPT_ENTRY(CONF_PERS_RESET),
+        MAKE_LONG_OPT_ENTRY(CONF_PERS_BACKEND),
+        MAKE_LONG_OPT_ENTRY(CONF_PERS_CHECKPOINT_ENTRIES),
+        MAKE_LONG_OPT_ENTRY(CONF_PERS_CHECKPOINT_BYTES),
+        MAKE_LONG_OPT_ENTRY(CONF_PERS_VERSION_CACHE_SIZE),
+        MAKE_LONG_OPT_ENTRY(CONF_PERS_LOG_SEGMENT_ENTRIES),
+        MAKE_LONG_OPT_ENTRY(CONF_PERS_DATA_SEGMENT_SIZE),
+        MAKE_LONG_OPT_ENTRY(CONF_PERS_TRIM_INTERVAL_MS),
+        MAKE_LONG_OPT_ENTRY(CONF_PERS_RETAIN_VERSIONS),
+        MAKE_LONG_OPT_ENTRY(CONF_PERS_RETAIN_SECONDS),
+        MAKE_LONG_OPT_ENTRY(CONF_PERS_RETAIN_PERSISTED_MARGIN),
+        MAKE_LONG_OPT_ENTRY(CONF_PERS_PERSIST_THREADS),
         {0, 0, 0, 0}};
 
 void Conf::initialize(int argc, char* argv[], const char* conf_file) {
@@ -33,13 +33,40 @@ private:
 #define CONF_DERECHO_WINDOW_SIZE "DERECHO/window_size"
 #define CONF_DERECHO_TIMEOUT_MS "DERECHO/timeout_ms"
 #define CONF_DERECHO_RDMC_SEND_ALGORITHM "DERECHO/rdmc_send_algorithm"
+#define CONF_DERECHO_RDMC_SEND_DEPTH "DERECHO/rdmc_send_depth"
+#define CONF_DERECHO_SST_DETECTOR_THREADS "DERECHO/sst_detector_threads"
+#define CONF_DERECHO_SST_IDLE_SPIN_US "DERECHO/sst_idle_spin_us"
+#define CONF_DERECHO_SST_IDLE_YIELD_US "DERECHO/sst_idle_yield_us"
+#define CONF_DERECHO_SST_IDLE_PARK_US "DERECHO/sst_idle_park_us"
+#define CONF_DERECHO_SST_WRITE_COMBINING "DERECHO/sst_write_combining"
+#define CONF_DERECHO_P2P_IDLE_SPIN_US "DERECHO/p2p_idle_spin_us"
+#define CONF_DERECHO_P2P_IDLE_PARK_US "DERECHO/p2p_idle_park_us"
+#define CONF_DERECHO_P2P_WORKER_THREADS "DERECHO/p2p_worker_threads"
+#define CONF_DERECHO_ORDERED_SEND_BATCH_BYTES "DERECHO/ordered_send_batch_bytes"
+#define CONF_DERECHO_ORDERED_SEND_BATCH_DELAY_US "DERECHO/ordered_send_batch_delay_us"
+#define CONF_DERECHO_MESSAGE_BUFFER_HUGE_PAGES "DERECHO/message_buffer_huge_pages"
+#define CONF_DERECHO_SENDER_LANES "DERECHO/sender_lanes"
+#define CONF_DERECHO_SENDER_SUBGROUP_WEIGHTS "DERECHO/sender_subgroup_weights"
+#define CONF_DERECHO_DELIVERY_THREADS "DERECHO/delivery_threads"
 #define CONF_RDMA_PROVIDER "RDMA/provider"
 #define CONF_RDMA_DOMAIN "RDMA/domain"
 #define CONF_RDMA_TX_DEPTH "RDMA/tx_depth"
 #define CONF_RDMA_RX_DEPTH "RDMA/rx_depth"
 #define CONF_PERS_FILE_PATH "PERS/file_path"
+#define CONF_PERS_FILE_PATHS "PERS/file_paths"
 #define CONF_PERS_RAMDISK_PATH "PERS/ramdisk_path"
 #define CONF_PERS_RESET "PERS/reset"
+#define CONF_PERS_BACKEND "PERS/backend"
+#define CONF_PERS_CHECKPOINT_ENTRIES "PERS/checkpoint_entries"
+#define CONF_PERS_CHECKPOINT_BYTES "PERS/checkpoint_bytes"
+#define CONF_PERS_VERSION_CACHE_SIZE "PERS/version_cache_size"
+#define CONF_PERS_LOG_SEGMENT_ENTRIES "PERS/log_segment_entries"
+#define CONF_PERS_DATA_SEGMENT_SIZE "PERS/data_segment_size"
+#define CONF_PERS_TRIM_INTERVAL_MS "PERS/trim_interval_ms"
+#define CONF_PERS_RETAIN_VERSIONS "PERS/retain_versions"
+#define CONF_PERS_RETAIN_SECONDS "PERS/retain_seconds"
+#define CONF_PERS_RETAIN_PERSISTED_MARGIN "PERS/retain_persisted_margin"
+#define CONF_PERS_PERSIST_THREADS "PERS/persist_threads"
 #define CONF_LOGGER_DEFAULT_LOG_NAME "LOGGER/default_log_name"
 #define CONF_LOGGER_DEFAULT_LOG_LEVEL "LOGGER/default_log_level"
 
@@ -59,6 +86,21 @@ private:
             {CONF_DERECHO_WINDOW_SIZE, "16"},
             {CONF_DERECHO_TIMEOUT_MS, "1"},
             {CONF_DERECHO_RDMC_SEND_ALGORITHM, "binomial_send"},
+            {CONF_DERECHO_RDMC_SEND_DEPTH, "1"},
+            {CONF_DERECHO_SST_DETECTOR_THREADS, "1"},
+            {CONF_DERECHO_SST_IDLE_SPIN_US, "1000"},
+            {CONF_DERECHO_SST_IDLE_YIELD_US, "0"},
+            {CONF_DERECHO_SST_IDLE_PARK_US, "1000"},
+            {CONF_DERECHO_SST_WRITE_COMBINING, "false"},
+            {CONF_DERECHO_P2P_IDLE_SPIN_US, "1000"},
+            {CONF_DERECHO_P2P_IDLE_PARK_US, "0"},
+            {CONF_DERECHO_P2P_WORKER_THREADS, "1"},
+            {CONF_DERECHO_ORDERED_SEND_BATCH_BYTES, "0"},
+            {CONF_DERECHO_ORDERED_SEND_BATCH_DELAY_US, "100"},
+            {CONF_DERECHO_MESSAGE_BUFFER_HUGE_PAGES, "true"},
+            {CONF_DERECHO_SENDER_LANES, "1"},
+            {CONF_DERECHO_SENDER_SUBGROUP_WEIGHTS, ""},
+            {CONF_DERECHO_DELIVERY_THREADS, "0"},
             // [RDMA]
             {CONF_RDMA_PROVIDER, "sockets"},
             {CONF_RDMA_DOMAIN, "eth0"},
@@ -66,8 +108,20 @@ private:
             {CONF_RDMA_RX_DEPTH, "256"},
             // [PERS]
             {CONF_PERS_FILE_PATH, ".plog"},
+            {CONF_PERS_FILE_PATHS, ""},
             {CONF_PERS_RAMDISK_PATH, "/dev/shm/volatile_t"},
             {CONF_PERS_RESET, "false"},
+            {CONF_PERS_BACKEND, "mmap"},
+            {CONF_PERS_CHECKPOINT_ENTRIES, "1024"},
+            {CONF_PERS_CHECKPOINT_BYTES, "67108864"},
+            {CONF_PERS_VERSION_CACHE_SIZE, "16"},
+            {CONF_PERS_LOG_SEGMENT_ENTRIES, "65536"},
+            {CONF_PERS_DATA_SEGMENT_SIZE, "67108864"},
+            {CONF_PERS_TRIM_INTERVAL_MS, "0"},
+            {CONF_PERS_RETAIN_VERSIONS, "1"},
+            {CONF_PERS_RETAIN_SECONDS, "0"},
+            {CONF_PERS_RETAIN_PERSISTED_MARGIN, "0"},
+            {CONF_PERS_PERSIST_THREADS, "1"},
             // [LOGGER]
             {CONF_LOGGER_DEFAULT_LOG_NAME, "derecho_debug"},
             {CONF_LOGGER_DEFAULT_LOG_LEVEL, "info"}};
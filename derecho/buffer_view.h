@@ -0,0 +1,65 @@
+/**
+ * @file buffer_view.h
+ *
+ * @date Oct 18, 2026
+ */
+
+#pragma once
+
+#include <cstring>
+#include <functional>
+#include <memory>
+
+#include <mutils-serialization/SerializationSupport.hpp>
+
+namespace derecho {
+
+/**
+ * A read-only view of a byte array that does not own the bytes. An RPC
+ * function that takes a const BufferView& is handed the bytes in place, in
+ * the buffer the message was delivered in, instead of a copy of them. The
+ * view is only valid until the RPC function returns, so a function that
+ * needs to keep the data must copy it.
+ *
+ * On the sending side, a BufferView can wrap any memory owned by the caller;
+ * it is serialized exactly like a length-prefixed byte array.
+ */
+class BufferView : public mutils::ByteRepresentable {
+public:
+    const char* data;
+    std::size_t size;
+
+    BufferView(const char* const data, const std::size_t size) : data(data), size(size) {}
+    BufferView() : data(nullptr), size(0) {}
+
+    std::size_t to_bytes(char* v) const {
+        ((std::size_t*)(v))[0] = size;
+        if(size > 0) {
+            memcpy(v + sizeof(size), data, size);
+        }
+        return size + sizeof(size);
+    }
+
+    std::size_t bytes_size() const {
+        return size + sizeof(size);
+    }
+
+    void post_object(const std::function<void(char const* const, std::size_t)>& f) const {
+        f((char*)&size, sizeof(size));
+        f(data, size);
+    }
+
+    void ensure_registered(mutils::DeserializationManager&) {}
+
+    /** Returns a view of the serialized bytes; nothing is copied. */
+    static std::unique_ptr<BufferView> from_bytes(mutils::DeserializationManager*, const char* const v) {
+        return std::make_unique<BufferView>(v + sizeof(std::size_t), ((std::size_t*)(v))[0]);
+    }
+
+    /** Like from_bytes(), but returns the view by value. */
+    static BufferView from_bytes_borrowed(mutils::DeserializationManager*, const char* const v) {
+        return BufferView(v + sizeof(std::size_t), ((std::size_t*)(v))[0]);
+    }
+};
+
+}  // namespace derecho
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "buffer_view.h"
 #include "derecho_exception.h"
 #include "derecho_internal.h"
 #include "derecho_type_definitions.h"
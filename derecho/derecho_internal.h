@@ -40,7 +40,9 @@ using subgroup_type_id_t = uint32_t;
 // using message_callback_t = std::function<void(subgroup_id_t, node_id_t, message_id_t, char*, long long int, persistent::version_t)>;
 using message_callback_t = std::function<void(subgroup_id_t, node_id_t, message_id_t, std::optional<std::pair<char*, long long int>>, persistent::version_t)>;
 using persistence_callback_t = std::function<void(subgroup_id_t, persistent::version_t)>;
-using rpc_handler_t = std::function<void(subgroup_id_t, node_id_t, char*, uint32_t)>;
+/** Handles an RPC message: the subgroup, the sender, the message and its size,
+ * and the one invocation of the message to run, or -1 to run all of them. */
+using rpc_handler_t = std::function<void(subgroup_id_t, node_id_t, char*, uint32_t, int32_t)>;
 
 /** The type of factory function the user must provide to the Group constructor,
  * to construct each Replicated Object that is assigned to a subgroup */
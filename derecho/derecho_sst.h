@@ -95,6 +95,10 @@ public:
     /** for SST multicast */
     SSTFieldVector<char> slots;
     SSTFieldVector<int32_t> num_received_sst;
+    /** For each sender, the latest range of its message indices it skipped
+     * instead of sending null messages, packed as (first << 32) | end, with
+     * end exclusive. Only the entry of the row's own node is written. */
+    SSTFieldVector<uint64_t> skipped_indices;
 
     /** to check for failures - used by the thread running check_failures_loop in derecho_group **/
     SSTFieldVector<uint64_t> local_stability_frontier;
@@ -124,13 +128,14 @@ public:
               global_min_ready(num_subgroups),
               slots((sst_max_msg_size)*window_size * num_subgroups),
               num_received_sst(num_received_size),
+              skipped_indices(num_received_size),
               local_stability_frontier(num_subgroups) {
         SSTInit(seq_num, delivered_num,
                 persisted_num, vid, suspected, changes, joiner_ips,
                 joiner_gms_ports, joiner_rpc_ports, joiner_sst_ports, joiner_rdmc_ports,
                 num_changes, num_committed, num_acked, num_installed,
                 num_received, wedged, global_min, global_min_ready,
-                slots, num_received_sst, local_stability_frontier, rip);
+                slots, num_received_sst, skipped_indices, local_stability_frontier, rip);
         //Once superclass constructor has finished, table entries can be initialized
         for(unsigned int row = 0; row < get_num_rows(); ++row) {
             vid[row] = 0;
@@ -289,6 +289,11 @@ public:
      * of any shard in the specified subgroup. */
     template <typename SubgroupType>
     std::int32_t get_my_shard(uint32_t subgroup_index = 0);
+    /** Sets the retention policy of the logs of the specified subgroup (by
+     * subgroup type and index), used when PERS/trim_interval_ms enables
+     * automatic trimming. */
+    template <typename SubgroupType>
+    void set_retention_policy(const RetentionPolicy& policy, uint32_t subgroup_index = 0);
     /** Reports to the GMS that the given node has failed. */
     void report_failure(const node_id_t who);
     /** Waits until all members of the group have called this function. */
@@ -130,6 +130,9 @@ Group<ReplicatedTypes...>::Group(const CallbackSet& callbacks,
 
 template <typename... ReplicatedTypes>
 Group<ReplicatedTypes...>::~Group() {
+    // fail any ordered_sends still waiting to be batched while their
+    // Replicated objects, which own their QueryResults' promises, still exist
+    rpc_manager.shutdown_auto_batching();
     // shutdown the persistence manager
     // TODO-discussion:
     // Will a node be able to come back once it leaves? if not, maybe we should
@@ -224,8 +227,8 @@ void Group<ReplicatedTypes...>::set_up_components() {
     persistence_manager.set_view_manager(view_manager);
     //Now that MulticastGroup is constructed, tell it about RPCManager's message handler
     SharedLockedReference<View> curr_view = view_manager.get_current_view();
-    curr_view.get().multicast_group->register_rpc_callback([this](subgroup_id_t subgroup, node_id_t sender, char* buf, uint32_t size) {
-        rpc_manager.rpc_message_handler(subgroup, sender, buf, size);
+    curr_view.get().multicast_group->register_rpc_callback([this](subgroup_id_t subgroup, node_id_t sender, char* buf, uint32_t size, int32_t invocation) {
+        rpc_manager.rpc_message_handler(subgroup, sender, buf, size, invocation);
     });
     view_manager.add_view_upcall([this](const View& new_view) {
         rpc_manager.new_view_callback(new_view);
@@ -334,6 +337,15 @@ int32_t Group<ReplicatedTypes...>::get_my_shard(uint32_t subgroup_index) {
     return view_manager.get_my_shard(index_of_type<SubgroupType, ReplicatedTypes...>, subgroup_index);
 }
 
+template <typename... ReplicatedTypes>
+template <typename SubgroupType>
+void Group<ReplicatedTypes...>::set_retention_policy(const RetentionPolicy& policy, uint32_t subgroup_index) {
+    View& curr_view = view_manager.get_current_view().get();
+    subgroup_id_t subgroup_id = curr_view.subgroup_ids_by_type_id.at(index_of_type<SubgroupType, ReplicatedTypes...>)
+                                        .at(subgroup_index);
+    persistence_manager.set_retention_policy(subgroup_id, policy);
+}
+
 template <typename... ReplicatedTypes>
 int32_t Group<ReplicatedTypes...>::get_my_rank() {
     return view_manager.get_my_rank();
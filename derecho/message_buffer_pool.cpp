@@ -0,0 +1,220 @@
+/**
+ * @file message_buffer_pool.cpp
+ *
+ * @date Oct 18, 2026
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+#include <sys/mman.h>
+
+#include "message_buffer_pool.h"
+
+namespace derecho {
+
+/** The huge page size slabs are rounded up to when huge pages are used. */
+static const std::size_t huge_page_size = 2 << 20;
+
+MessageBufferPool::slab::slab(std::size_t length, bool try_huge_pages)
+        : memory(nullptr), length(length), huge_pages(false) {
+    void* addr = MAP_FAILED;
+    if(try_huge_pages) {
+        std::size_t huge_length = ((length - 1) / huge_page_size + 1) * huge_page_size;
+        addr = mmap(nullptr, huge_length, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if(addr != MAP_FAILED) {
+            this->length = huge_length;
+            huge_pages = true;
+        }
+    }
+    if(addr == MAP_FAILED) {
+        // no huge pages reserved (or not asked for): fall back to normal pages
+        addr = mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(addr == MAP_FAILED) {
+            throw std::bad_alloc();
+        }
+    }
+    memory = (char*)addr;
+    mr = std::make_unique<rdma::memory_region>(memory, this->length);
+}
+
+MessageBufferPool::slab::~slab() {
+    // deregister before unmapping
+    mr.reset();
+    munmap(memory, length);
+}
+
+MessageBufferPool::MessageBufferPool(std::size_t block_size, std::size_t max_msg_size, bool use_huge_pages)
+        : block_size(block_size),
+          max_msg_size(max_msg_size),
+          use_huge_pages(use_huge_pages) {
+    assert(block_size > 0);
+    for(std::size_t class_size = block_size; class_size < max_msg_size; class_size *= 2) {
+        size_classes.push_back(class_size);
+    }
+    size_classes.push_back(max_msg_size);
+    free_buffers.resize(size_classes.size());
+    num_buffers.resize(size_classes.size(), 0);
+    needs_growth.resize(size_classes.size(), false);
+    growth_thread = std::thread(&MessageBufferPool::growth_loop, this);
+}
+
+MessageBufferPool::~MessageBufferPool() {
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        growth_shutdown = true;
+    }
+    growth_cv.notify_all();
+    growth_thread.join();
+}
+
+void MessageBufferPool::add_slab(uint32_t size_class, std::shared_ptr<slab> new_slab) {
+    const std::size_t buffer_size = size_classes[size_class];
+    const std::size_t slab_buffers = new_slab->length / buffer_size;
+    // every buffer shares ownership of the slab through its memory region pointer
+    std::shared_ptr<rdma::memory_region> slab_mr(new_slab, new_slab->mr.get());
+    for(std::size_t i = 0; i < slab_buffers; ++i) {
+        MessageBuffer message_buffer;
+        message_buffer.offset = i * buffer_size;
+        message_buffer.buffer = new_slab->memory + message_buffer.offset;
+        message_buffer.mr = slab_mr;
+        message_buffer.size_class = size_class;
+        free_buffers[size_class].push_back(std::move(message_buffer));
+    }
+    num_buffers[size_class] += slab_buffers;
+    registered_bytes += new_slab->length;
+    slabs.push_back(std::move(new_slab));
+}
+
+std::size_t MessageBufferPool::slab_length(uint32_t size_class) const {
+    const std::size_t buffer_size = size_classes[size_class];
+    return std::max<std::size_t>(1, SLAB_SIZE / buffer_size) * buffer_size;
+}
+
+void MessageBufferPool::reserve(std::size_t num_reserved) {
+    const uint32_t largest_class = size_classes.size() - 1;
+    std::unique_lock<std::mutex> lock(pool_mutex);
+    max_registered_bytes = std::max<uint64_t>(max_registered_bytes, num_reserved * size_classes[largest_class]);
+    for(uint32_t size_class = 0; size_class < size_classes.size(); ++size_class) {
+        const std::size_t buffer_size = size_classes[size_class];
+        // the classes larger than a slab borrow from the largest one until they grow
+        std::size_t wanted = 0;
+        if(buffer_size <= SLAB_SIZE) {
+            wanted = std::min(num_reserved, SLAB_SIZE / buffer_size);
+        } else if(size_class == largest_class) {
+            wanted = std::min<std::size_t>(num_reserved, 1);
+        }
+        if(num_buffers[size_class] >= wanted) {
+            continue;
+        }
+        const std::size_t missing = wanted - num_buffers[size_class];
+        lock.unlock();
+        auto new_slab = std::make_shared<slab>(missing * buffer_size, use_huge_pages);
+        lock.lock();
+        add_slab(size_class, std::move(new_slab));
+    }
+}
+
+void MessageBufferPool::growth_loop() {
+    std::unique_lock<std::mutex> lock(pool_mutex);
+    while(true) {
+        growth_cv.wait(lock, [this]() {
+            return growth_shutdown || std::find(needs_growth.begin(), needs_growth.end(), true) != needs_growth.end();
+        });
+        if(growth_shutdown) {
+            return;
+        }
+        const uint32_t size_class = std::find(needs_growth.begin(), needs_growth.end(), true) - needs_growth.begin();
+        needs_growth[size_class] = false;
+        const std::size_t length = slab_length(size_class);
+        if(registered_bytes + length > max_registered_bytes) {
+            // at the limit: the class keeps borrowing from larger ones, and
+            // senders wait for buffers to be released
+            continue;
+        }
+        // allocate and register without the lock, so acquire() never waits for it
+        lock.unlock();
+        std::shared_ptr<slab> new_slab;
+        try {
+            new_slab = std::make_shared<slab>(length, use_huge_pages);
+        } catch(...) {
+            // out of memory for now; the larger classes still have buffers
+        }
+        lock.lock();
+        if(new_slab) {
+            add_slab(size_class, std::move(new_slab));
+        }
+    }
+}
+
+uint32_t MessageBufferPool::size_class_for(std::size_t msg_size) const {
+    if(msg_size > max_msg_size) {
+        throw std::length_error("Message is larger than the largest message buffer");
+    }
+    uint32_t size_class = 0;
+    while(size_classes[size_class] < msg_size) {
+        ++size_class;
+    }
+    return size_class;
+}
+
+MessageBuffer MessageBufferPool::take_free_buffer(subgroup_id_t subgroup_num, uint32_t size_class) {
+    uint32_t found_class = size_class;
+    while(found_class < size_classes.size() && free_buffers[found_class].empty()) {
+        ++found_class;
+    }
+    if(found_class != size_class && !needs_growth[size_class]) {
+        needs_growth[size_class] = true;
+        growth_cv.notify_one();
+    }
+    if(found_class == size_classes.size()) {
+        return MessageBuffer();
+    }
+    MessageBuffer message_buffer = std::move(free_buffers[found_class].back());
+    free_buffers[found_class].pop_back();
+    bytes_in_use[subgroup_num] += size_classes[found_class];
+    return message_buffer;
+}
+
+MessageBuffer MessageBufferPool::acquire(subgroup_id_t subgroup_num, std::size_t msg_size) {
+    const uint32_t size_class = size_class_for(msg_size);
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    return take_free_buffer(subgroup_num, size_class);
+}
+
+MessageBuffer MessageBufferPool::acquire_or_allocate(subgroup_id_t subgroup_num, std::size_t msg_size) {
+    const uint32_t size_class = size_class_for(msg_size);
+    std::unique_lock<std::mutex> lock(pool_mutex);
+    MessageBuffer message_buffer = take_free_buffer(subgroup_num, size_class);
+    while(!message_buffer.buffer) {
+        lock.unlock();
+        auto new_slab = std::make_shared<slab>(slab_length(size_class), use_huge_pages);
+        lock.lock();
+        add_slab(size_class, std::move(new_slab));
+        message_buffer = take_free_buffer(subgroup_num, size_class);
+    }
+    return message_buffer;
+}
+
+void MessageBufferPool::release(subgroup_id_t subgroup_num, MessageBuffer&& message_buffer) {
+    if(!message_buffer.mr) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    bytes_in_use[subgroup_num] -= size_classes[message_buffer.size_class];
+    free_buffers[message_buffer.size_class].push_back(std::move(message_buffer));
+}
+
+std::map<subgroup_id_t, uint64_t> MessageBufferPool::get_bytes_in_use() const {
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    return bytes_in_use;
+}
+
+uint64_t MessageBufferPool::get_registered_bytes() const {
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    return registered_bytes;
+}
+
+}  // namespace derecho
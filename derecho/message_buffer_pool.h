@@ -0,0 +1,195 @@
+/**
+ * @file message_buffer_pool.h
+ *
+ * @date Oct 18, 2026
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "derecho_internal.h"
+#include "rdmc/rdmc.h"
+
+namespace derecho {
+
+/**
+ * Represents a block of memory used to store a message. The bytes are a slice
+ * of a larger RDMA memory region that is owned by a MessageBufferPool, and
+ * stay valid as long as some MessageBuffer refers to that region.
+ * This is a move-only type; a MessageBuffer should be handed back to the pool
+ * it came from when the message is no longer needed.
+ */
+struct MessageBuffer {
+    /** The first byte of the buffer. */
+    char* buffer = nullptr;
+    /** The registered memory region that contains the buffer. */
+    std::shared_ptr<rdma::memory_region> mr;
+    /** The offset of the buffer within mr. */
+    std::size_t offset = 0;
+    /** The index of the buffer's size class in the pool it came from. */
+    uint32_t size_class = 0;
+
+    MessageBuffer() {}
+    MessageBuffer(const MessageBuffer&) = delete;
+    MessageBuffer(MessageBuffer&&) = default;
+    MessageBuffer& operator=(const MessageBuffer&) = delete;
+    MessageBuffer& operator=(MessageBuffer&&) = default;
+};
+
+/**
+ * A pool of RDMA-registered message buffers, shared by a MulticastGroup and
+ * all the MulticastGroups that replace it in later views, so that buffers are
+ * registered once and survive view changes.
+ *
+ * Memory is allocated in slabs, preferably backed by huge pages, and each slab
+ * is registered as a single memory region and carved into equal buffers of
+ * one size class. The size classes are the RDMC block size times powers of
+ * two, up to the maximum message size, so a message usually only pins a
+ * buffer rounded up to the next class rather than one of the maximum size.
+ *
+ * acquire() never allocates or registers memory, since it is called on the
+ * send and receive paths. reserve() registers a slab of every size class no
+ * larger than a slab (less if fewer messages can be outstanding) and one
+ * buffer of the largest class, rather than a buffer of the largest class for
+ * every message that can be outstanding. acquire() falls back to a larger
+ * class when a smaller one has run out, and a background thread then grows
+ * the class that ran out, as long as the pool stays within what a buffer of
+ * the largest class for every outstanding message would take. When nothing
+ * large enough is free, a sender waits for a buffer to be released, while a
+ * receive, which cannot wait, allocates one with acquire_or_allocate().
+ * Freed buffers are kept for reuse; the pool never shrinks.
+ */
+class MessageBufferPool {
+    /** A chunk of memory registered as one memory region. */
+    struct slab {
+        char* memory;
+        std::size_t length;
+        /** True if memory was mmap'ed with huge pages. */
+        bool huge_pages;
+        std::unique_ptr<rdma::memory_region> mr;
+
+        slab(std::size_t length, bool try_huge_pages);
+        ~slab();
+    };
+
+    const std::size_t block_size;
+    const std::size_t max_msg_size;
+    const bool use_huge_pages;
+    /** The buffer size of each size class, in increasing order. */
+    std::vector<std::size_t> size_classes;
+
+    mutable std::mutex pool_mutex;
+    /** Every slab allocated so far. */
+    std::vector<std::shared_ptr<slab>> slabs;
+    /** The free buffers of each size class. */
+    std::vector<std::vector<MessageBuffer>> free_buffers;
+    /** The number of buffers of each size class, free or not. */
+    std::vector<std::size_t> num_buffers;
+    /** The number of bytes of buffers handed out to each subgroup and not yet released. */
+    std::map<subgroup_id_t, uint64_t> bytes_in_use;
+    /** The total size of all slabs. */
+    uint64_t registered_bytes = 0;
+    /**
+     * The most memory the growth thread may register in total: enough for
+     * every outstanding message to have a buffer of the largest class.
+     */
+    uint64_t max_registered_bytes = 0;
+    /** True for each size class that ran out of buffers and should be grown. */
+    std::vector<bool> needs_growth;
+    bool growth_shutdown = false;
+    /** Notified when a size class needs to grow, and at shutdown. */
+    std::condition_variable growth_cv;
+    /** Grows the size classes that have run out, off the receive path. */
+    std::thread growth_thread;
+
+    /** Body of growth_thread. */
+    void growth_loop();
+
+    /**
+     * Adds the buffers of a new slab for the given size class to the free
+     * list. pool_mutex must be held; the slab is allocated beforehand,
+     * without it.
+     */
+    void add_slab(uint32_t size_class, std::shared_ptr<slab> new_slab);
+
+    /** @return The length of a slab of buffers of the given size class. */
+    std::size_t slab_length(uint32_t size_class) const;
+
+    /** @return The smallest size class whose buffers can hold msg_size bytes. */
+    uint32_t size_class_for(std::size_t msg_size) const;
+
+    /**
+     * Takes a free buffer of size_class or, failing that, of a larger class,
+     * asking the growth thread to grow size_class in that case. pool_mutex
+     * must be held.
+     * @return The buffer, or an empty MessageBuffer if none is free
+     */
+    MessageBuffer take_free_buffer(subgroup_id_t subgroup_num, uint32_t size_class);
+
+public:
+    /** The amount of memory the pool allocates at once to grow a size class. */
+    static constexpr std::size_t SLAB_SIZE = 4 << 20;
+
+    /**
+     * @param block_size The RDMC block size. RDMC may write whole blocks into
+     * a receive buffer, so every buffer is a multiple of this size.
+     * @param max_msg_size The largest message (including its header) that
+     * will be stored in a buffer from this pool.
+     * @param use_huge_pages True to back slabs with huge pages when the system
+     * has them available.
+     */
+    MessageBufferPool(std::size_t block_size, std::size_t max_msg_size, bool use_huge_pages);
+    ~MessageBufferPool();
+
+    /**
+     * Makes sure each size class no larger than a slab has, in use or not,
+     * num_buffers buffers or one slab of them, whichever is fewer, and the
+     * largest class has one buffer, allocating and registering them now if
+     * they are missing. Lets the pool grow up to the size of num_buffers
+     * buffers of the largest class. num_buffers should be the number of
+     * messages that can hold a buffer at the same time.
+     */
+    void reserve(std::size_t num_buffers);
+
+    /**
+     * Takes a free buffer large enough for a message of msg_size bytes out
+     * of the pool: one of the smallest class that fits if there is one free,
+     * otherwise one of a larger class. This never allocates memory.
+     * @param subgroup_num The subgroup the buffer will be used for, for the
+     * memory usage accounting.
+     * @param msg_size The size of the message, including its header.
+     * @return The buffer, or an empty MessageBuffer (whose buffer is nullptr)
+     * if every buffer large enough is in use; the caller should wait for
+     * one to be released.
+     * @throws std::length_error if the message is too large for the pool
+     */
+    MessageBuffer acquire(subgroup_id_t subgroup_num, std::size_t msg_size);
+
+    /**
+     * Like acquire(), but for a message that cannot wait for a buffer, such as
+     * one RDMC has started receiving: if no buffer large enough is free, it
+     * allocates and registers a slab of the smallest class that fits right
+     * away, even past the pool's size limit.
+     * @throws std::length_error if the message is too large for the pool
+     * @throws std::bad_alloc if the system is out of memory
+     */
+    MessageBuffer acquire_or_allocate(subgroup_id_t subgroup_num, std::size_t msg_size);
+
+    /** Returns a buffer acquired for the given subgroup to the pool. */
+    void release(subgroup_id_t subgroup_num, MessageBuffer&& message_buffer);
+
+    /** @return The number of bytes of buffers each subgroup is currently using. */
+    std::map<subgroup_id_t, uint64_t> get_bytes_in_use() const;
+
+    /** @return The total amount of registered memory owned by the pool. */
+    uint64_t get_registered_bytes() const;
+};
+
+}  // namespace derecho
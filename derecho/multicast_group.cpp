@@ -1,9 +1,12 @@
 #include <algorithm>
 #include <cassert>
+#include <cctype>
 #include <chrono>
 #include <limits>
+#include <sstream>
 #include <thread>
 
+#include "derecho_exception.h"
 #include "derecho_internal.h"
 #include "multicast_group.h"
 #include "persistent/Persistent.hpp"
@@ -25,6 +28,38 @@ size_t index_of(T container, U elem) {
     return container.size();
 }
 
+/**
+ * Parses the sender_subgroup_weights option: positive integers, listed by
+ * subgroup ID and separated by commas.
+ * @throws derecho_exception naming the option and the bad entry if it is
+ * not such a list
+ */
+static std::vector<uint32_t> parse_subgroup_weights(const std::string& weights_option) {
+    std::vector<uint32_t> weights;
+    std::istringstream weights_stream(weights_option);
+    std::string weight;
+    while(std::getline(weights_stream, weight, ',')) {
+        std::size_t parsed = 0;
+        unsigned long value = 0;
+        try {
+            value = std::stoul(weight, &parsed);
+        } catch(const std::logic_error&) {
+            parsed = 0;
+        }
+        // stoul skips leading spaces; allow trailing ones too
+        while(parsed < weight.size() && std::isspace(static_cast<unsigned char>(weight[parsed]))) {
+            ++parsed;
+        }
+        if(parsed == 0 || parsed != weight.size() || value == 0 || value > std::numeric_limits<uint32_t>::max()
+           || weight.find('-') != std::string::npos) {
+            throw derecho_exception("Invalid weight \"" + weight + "\" for subgroup " + std::to_string(weights.size())
+                                    + " in " CONF_DERECHO_SENDER_SUBGROUP_WEIGHTS ": weights must be positive integers");
+        }
+        weights.push_back(value);
+    }
+    return weights;
+}
+
 MulticastGroup::MulticastGroup(
         std::vector<node_id_t> _members, node_id_t my_node_id,
         std::shared_ptr<DerechoSST> sst,
@@ -46,16 +81,20 @@ MulticastGroup::MulticastGroup(
           sst_max_msg_size(derecho_params.max_smc_payload_size + sizeof(header)),
           rdmc_send_algorithm(derecho_params.rdmc_send_algorithm),
           window_size(derecho_params.window_size),
+          rdmc_send_depth(std::max(1u, std::min(window_size, getConfUInt32(CONF_DERECHO_RDMC_SEND_DEPTH)))),
           callbacks(callbacks),
           total_num_subgroups(total_num_subgroups),
           subgroup_settings(subgroup_settings_by_id),
-          received_intervals(sst->num_received.size(), {-1, -1}),
+          received_indices(sst->num_received.size()),
           rdmc_group_num_offset(0),
+          buffer_pool(std::make_shared<MessageBufferPool>(block_size, max_msg_size,
+                                                          getConfBoolean(CONF_DERECHO_MESSAGE_BUFFER_HUGE_PAGES))),
           future_message_indices(total_num_subgroups, 0),
           next_sends(total_num_subgroups),
           pending_sends(total_num_subgroups),
           current_sends(total_num_subgroups),
           next_message_to_deliver(total_num_subgroups),
+          last_stable_seq_nums(total_num_subgroups, -1),
           sender_timeout(derecho_params.timeout_ms),
           sst(sst),
           sst_multicast_group_ptrs(total_num_subgroups),
@@ -67,13 +106,9 @@ MulticastGroup::MulticastGroup(
     for(uint i = 0; i < num_members; ++i) {
         node_id_to_sst_index[members[i]] = i;
     }
-
-    for(const auto p : subgroup_settings_by_id) {
-        auto num_shard_members = p.second.members.size();
-        while(free_message_buffers[p.first].size() < window_size * num_shard_members) {
-            free_message_buffers[p.first].emplace_back(max_msg_size);
-        }
-    }
+    reserve_message_buffers();
+    initialize_sender_lanes();
+    initialize_delivery_workers();
 
     initialize_sst_row();
     bool no_member_failed = true;
@@ -90,7 +125,7 @@ MulticastGroup::MulticastGroup(
         rdmc_sst_groups_created = create_rdmc_sst_groups();
     }
     register_predicates();
-    sender_thread = std::thread(&MulticastGroup::send_loop, this);
+    start_sender_lanes();
     timeout_thread = std::thread(&MulticastGroup::check_failures_loop, this);
 }
 
@@ -112,17 +147,20 @@ MulticastGroup::MulticastGroup(
           sst_max_msg_size(old_group.sst_max_msg_size),
           rdmc_send_algorithm(old_group.rdmc_send_algorithm),
           window_size(old_group.window_size),
+          rdmc_send_depth(old_group.rdmc_send_depth),
           callbacks(old_group.callbacks),
           total_num_subgroups(total_num_subgroups),
           subgroup_settings(subgroup_settings_by_id),
-          received_intervals(sst->num_received.size(), {-1, -1}),
+          received_indices(sst->num_received.size()),
           rpc_callback(old_group.rpc_callback),
           rdmc_group_num_offset(old_group.rdmc_group_num_offset + old_group.num_members),
+          buffer_pool(old_group.buffer_pool),
           future_message_indices(total_num_subgroups, 0),
           next_sends(total_num_subgroups),
           pending_sends(total_num_subgroups),
           current_sends(total_num_subgroups),
           next_message_to_deliver(total_num_subgroups),
+          last_stable_seq_nums(total_num_subgroups, -1),
           sender_timeout(old_group.sender_timeout),
           sst(sst),
           sst_multicast_group_ptrs(total_num_subgroups),
@@ -138,12 +176,18 @@ MulticastGroup::MulticastGroup(
     for(uint i = 0; i < num_members; ++i) {
         node_id_to_sst_index[members[i]] = i;
     }
+    reserve_message_buffers();
+    initialize_sender_lanes();
+    initialize_delivery_workers();
 
     // Convience function that takes a msg from the old group and
     // produces one suitable for this group.
     auto convert_msg = [this](RDMCMessage& msg, subgroup_id_t subgroup_num) {
+        header* h = (header*)msg.message_buffer.buffer;
         msg.sender_id = members[member_index];
-        msg.index = future_message_indices[subgroup_num]++;
+        msg.index = future_message_indices[subgroup_num];
+        h->index = msg.index;
+        future_message_indices[subgroup_num] += h->num_indices;
         return std::move(msg);
     };
 
@@ -155,30 +199,14 @@ MulticastGroup::MulticastGroup(
         return std::move(msg);
     };
 
-    for(const auto p : subgroup_settings_by_id) {
-        auto num_shard_members = p.second.members.size();
-        while(free_message_buffers[p.first].size() < window_size * num_shard_members) {
-            free_message_buffers[p.first].emplace_back(max_msg_size);
-        }
-    }
-
-    // Reclaim RDMCMessageBuffers from the old group, and supplement them with
-    // additional if the group has grown.
+    // The message buffers are shared with the old group through buffer_pool,
+    // so they are already registered; just return the ones it was receiving into.
     std::lock_guard<std::mutex> lock(old_group.msg_state_mtx);
-    for(const auto p : subgroup_settings_by_id) {
-        const auto subgroup_num = p.first;
-        auto num_shard_members = p.second.members.size();
-        // for later: don't move extra message buffers
-        free_message_buffers[subgroup_num].swap(old_group.free_message_buffers[subgroup_num]);
-        while(free_message_buffers[subgroup_num].size() < old_group.window_size * num_shard_members) {
-            free_message_buffers[subgroup_num].emplace_back(max_msg_size);
-        }
-    }
-
     for(auto& msg : old_group.current_receives) {
-        free_message_buffers[msg.first.first].push_back(std::move(msg.second.message_buffer));
+        buffer_pool->release(msg.first.first, std::move(msg.second.message_buffer));
     }
     old_group.current_receives.clear();
+    whenlog(logger->debug("Message buffer pool has {} bytes registered", buffer_pool->get_registered_bytes()););
 
     // Assume that any locally stable messages failed. If we were the sender
     // than re-attempt, otherwise discard. TODO: Presumably the ragged edge
@@ -192,12 +220,25 @@ MulticastGroup::MulticastGroup(
             if(q.second.sender_id == members[member_index]) {
                 pending_sends[p.first].push(convert_msg(q.second, p.first));
             } else {
-                free_message_buffers[p.first].push_back(std::move(q.second.message_buffer));
+                buffer_pool->release(p.first, std::move(q.second.message_buffer));
             }
         }
     }
     old_group.locally_stable_rdmc_messages.clear();
 
+    // The ragged edge cleanup delivers every part of a message that uses
+    // several indices, or none; return the buffers of any left over.
+    for(auto& p : old_group.locally_stable_message_parts) {
+        for(auto& q : p.second) {
+            delivery_item& msg = *q.second.first;
+            if(msg.rdmc_msg) {
+                buffer_pool->release(p.first, std::move(msg.rdmc_msg->message_buffer));
+                msg.rdmc_msg.reset();
+            }
+        }
+    }
+    old_group.locally_stable_message_parts.clear();
+
     for(auto& p : old_group.locally_stable_sst_messages) {
         if(p.second.size() == 0) {
             continue;
@@ -208,8 +249,11 @@ MulticastGroup::MulticastGroup(
     // Any messages that were being sent should be re-attempted.
     for(const auto& p : subgroup_settings_by_id) {
         auto subgroup_num = p.first;
-        if(old_group.current_sends.size() > subgroup_num && old_group.current_sends[subgroup_num]) {
-            pending_sends[subgroup_num].push(convert_msg(*old_group.current_sends[subgroup_num], subgroup_num));
+        if(old_group.current_sends.size() > subgroup_num) {
+            for(auto& msg : old_group.current_sends[subgroup_num]) {
+                pending_sends[subgroup_num].push(convert_msg(msg, subgroup_num));
+            }
+            old_group.current_sends[subgroup_num].clear();
         }
 
         if(old_group.pending_sends.size() > subgroup_num) {
@@ -250,10 +294,21 @@ MulticastGroup::MulticastGroup(
         rdmc_sst_groups_created = create_rdmc_sst_groups();
     }
     register_predicates();
-    sender_thread = std::thread(&MulticastGroup::send_loop, this);
+    start_sender_lanes();
     timeout_thread = std::thread(&MulticastGroup::check_failures_loop, this);
 }
 
+void MulticastGroup::reserve_message_buffers() {
+    // Each member of a shard can have up to window_size messages in flight
+    // in it, so this is the most buffers that can be in use at once. The
+    // pool only registers some of them up front, and grows up to this many.
+    std::size_t num_buffers = 0;
+    for(const auto& p : subgroup_settings) {
+        num_buffers += window_size * p.second.members.size();
+    }
+    buffer_pool->reserve(num_buffers);
+}
+
 bool MulticastGroup::create_rdmc_sst_groups() {
     for(const auto& p : subgroup_settings) {
         uint32_t subgroup_num = p.first;
@@ -289,9 +344,10 @@ bool MulticastGroup::create_rdmc_sst_groups() {
                 whenlog(logger->trace("Locally received message in subgroup {}, sender rank {}, index {}", subgroup_num, shard_rank, index););
                 // Move message from current_receives to locally_stable_rdmc_messages.
                 if(node_id == members[member_index]) {
-                    assert(current_sends[subgroup_num]);
-                    locally_stable_rdmc_messages[subgroup_num][sequence_number] = std::move(*current_sends[subgroup_num]);
-                    current_sends[subgroup_num] = std::nullopt;
+                    // RDMC completes this node's sends in the order they were made
+                    assert(!current_sends[subgroup_num].empty());
+                    locally_stable_rdmc_messages[subgroup_num][sequence_number] = std::move(current_sends[subgroup_num].front());
+                    current_sends[subgroup_num].pop_front();
                 } else {
                     auto it = current_receives.find({subgroup_num, node_id});
                     assert(it != current_receives.end());
@@ -301,20 +357,8 @@ bool MulticastGroup::create_rdmc_sst_groups() {
                     current_receives.erase(it);
                 }
 
-                auto new_num_received = resolve_num_received(index, curr_subgroup_settings.num_received_offset + sender_rank);
-                /* NULL Send Scheme */
-                // only if I am a sender in the subgroup and the subgroup is not in UNORDERED mode
-                if(curr_subgroup_settings.sender_rank >= 0 && curr_subgroup_settings.mode != Mode::UNORDERED) {
-                    if(curr_subgroup_settings.sender_rank < (int)sender_rank) {
-                        while(future_message_indices[subgroup_num] <= new_num_received) {
-                            get_buffer_and_send_auto_null(subgroup_num);
-                        }
-                    } else if(curr_subgroup_settings.sender_rank > (int)sender_rank) {
-                        while(future_message_indices[subgroup_num] < new_num_received) {
-                            get_buffer_and_send_auto_null(subgroup_num);
-                        }
-                    }
-                }
+                auto new_num_received = received_indices[curr_subgroup_settings.num_received_offset + sender_rank].insert(index, h->num_indices);
+                fill_null_rounds(subgroup_num, curr_subgroup_settings, sender_rank, new_num_received);
 
                 // deliver immediately if in UNORDERED mode
                 if(curr_subgroup_settings.mode == Mode::UNORDERED) {
@@ -343,7 +387,7 @@ bool MulticastGroup::create_rdmc_sst_groups() {
                             auto it2 = locally_stable_rdmc_messages[subgroup_num].begin();
                             assert(it2->first == seq_num);
                             auto& msg = it2->second;
-                            char* buf = msg.message_buffer.buffer.get();
+                            char* buf = msg.message_buffer.buffer;
                             header* h = (header*)(buf);
                             // no delivery for a NULL message
                             if(msg.size > h->header_size && callbacks.global_stability_callback) {
@@ -352,7 +396,7 @@ bool MulticastGroup::create_rdmc_sst_groups() {
                                                                     {{buf + h->header_size, msg.size - h->header_size}},
                                                                     INVALID_VERSION);
                             }
-                            free_message_buffers[subgroup_num].push_back(std::move(msg.message_buffer));
+                            buffer_pool->release(subgroup_num, std::move(msg.message_buffer));
                             if(node_id == members[member_index]) {
                                 pending_message_timestamps[subgroup_num].erase(h->timestamp);
                             }
@@ -382,10 +426,10 @@ bool MulticastGroup::create_rdmc_sst_groups() {
             };
             // Capture rdmc_receive_handler by copy! The reference to it won't be valid after this constructor ends!
             auto receive_handler_plus_notify =
-                    [this, rdmc_receive_handler](char* data, size_t size) {
+                    [this, rdmc_receive_handler, subgroup_num](char* data, size_t size) {
                         rdmc_receive_handler(data, size);
                         // signal background writer thread
-                        sender_cv.notify_all();
+                        notify_sender_lane(subgroup_num);
                     };
 
             // Create a "rotated" vector of members in which the currently selected shard member (shard_rank) is first
@@ -408,7 +452,8 @@ bool MulticastGroup::create_rdmc_sst_groups() {
                                return {nullptr, 0};
                            },
                            receive_handler_plus_notify,
-                           [](std::optional<uint32_t>) {})) {
+                           [](std::optional<uint32_t>) {},
+                           rdmc_send_depth)) {
                     return false;
                 }
                 subgroup_to_rdmc_group[subgroup_num] = rdmc_group_num_offset;
@@ -418,15 +463,14 @@ bool MulticastGroup::create_rdmc_sst_groups() {
                            rdmc_group_num_offset, rotated_shard_members, block_size, rdmc_send_algorithm,
                            [this, subgroup_num, node_id, sender_rank, num_shard_senders](size_t length) {
                                std::lock_guard<std::mutex> lock(msg_state_mtx);
-                               assert(!free_message_buffers[subgroup_num].empty());
                                //Create a Message struct to receive the data into.
                                RDMCMessage msg;
                                msg.sender_id = node_id;
                                msg.size = length;
-                               msg.message_buffer = std::move(free_message_buffers[subgroup_num].back());
-                               free_message_buffers[subgroup_num].pop_back();
+                               // RDMC is already sending the message, so it cannot wait for a free buffer
+                               msg.message_buffer = buffer_pool->acquire_or_allocate(subgroup_num, length);
 
-                               rdmc::receive_destination ret{msg.message_buffer.mr, 0};
+                               rdmc::receive_destination ret{msg.message_buffer.mr, msg.message_buffer.offset};
                                current_receives[{subgroup_num, node_id}] = std::move(msg);
 
                                assert(ret.mr->buffer != nullptr);
@@ -448,6 +492,7 @@ void MulticastGroup::initialize_sst_row() {
     for(uint i = 0; i < num_members; ++i) {
         for(uint j = 0; j < num_received_size; ++j) {
             sst->num_received[i][j] = -1;
+            sst->skipped_indices[i][j] = 0;
         }
         for(uint j = 0; j < seq_num_size; ++j) {
             sst->seq_num[i][j] = -1;
@@ -459,15 +504,15 @@ void MulticastGroup::initialize_sst_row() {
     sst->sync_with_members();
 }
 
-void MulticastGroup::deliver_message(RDMCMessage& msg, subgroup_id_t subgroup_num, persistent::version_t version) {
-    char* buf = msg.message_buffer.buffer.get();
+void MulticastGroup::deliver_message(RDMCMessage& msg, subgroup_id_t subgroup_num, persistent::version_t version, int32_t part) {
+    char* buf = msg.message_buffer.buffer;
     header* h = (header*)(buf);
     // cooked send
     if(h->cooked_send) {
         buf += h->header_size;
         auto payload_size = msg.size - h->header_size;
         post_next_version_callback(subgroup_num, version);
-        rpc_callback(subgroup_num, msg.sender_id, buf, payload_size);
+        rpc_callback(subgroup_num, msg.sender_id, buf, payload_size, part);
         if(callbacks.global_stability_callback) {
             callbacks.global_stability_callback(subgroup_num, msg.sender_id, msg.index, {},
                                                 version);
@@ -479,7 +524,7 @@ void MulticastGroup::deliver_message(RDMCMessage& msg, subgroup_id_t subgroup_nu
     }
 }
 
-void MulticastGroup::deliver_message(SSTMessage& msg, subgroup_id_t subgroup_num, persistent::version_t version) {
+void MulticastGroup::deliver_message(SSTMessage& msg, subgroup_id_t subgroup_num, persistent::version_t version, int32_t part) {
     char* buf = const_cast<char*>(msg.buf);
     header* h = (header*)(buf);
     // cooked send
@@ -487,7 +532,7 @@ void MulticastGroup::deliver_message(SSTMessage& msg, subgroup_id_t subgroup_num
         buf += h->header_size;
         auto payload_size = msg.size - h->header_size;
         post_next_version_callback(subgroup_num, version);
-        rpc_callback(subgroup_num, msg.sender_id, buf, payload_size);
+        rpc_callback(subgroup_num, msg.sender_id, buf, payload_size, part);
         if(callbacks.global_stability_callback) {
             callbacks.global_stability_callback(subgroup_num, msg.sender_id, msg.index, {},
                                                 version);
@@ -500,15 +545,12 @@ void MulticastGroup::deliver_message(SSTMessage& msg, subgroup_id_t subgroup_num
 }
 
 bool MulticastGroup::version_message(RDMCMessage& msg, subgroup_id_t subgroup_num, persistent::version_t version, uint64_t msg_timestamp) {
-    char* buf = msg.message_buffer.buffer.get();
+    char* buf = msg.message_buffer.buffer;
     header* h = (header*)(buf);
     // null message filter
     if(msg.size == h->header_size) {
         return false;
     }
-    if(msg.sender_id == members[member_index]) {
-        pending_persistence[subgroup_num][locally_stable_rdmc_messages[subgroup_num].begin()->first] = msg_timestamp;
-    }
     // make a version for persistent<t>/volatile<t>
     uint64_t msg_ts_us = msg_timestamp / 1e3;
     if(msg_ts_us == 0) {
@@ -527,9 +569,6 @@ bool MulticastGroup::version_message(SSTMessage& msg, subgroup_id_t subgroup_num
     if(msg.size == h->header_size) {
         return false;
     }
-    if(msg.sender_id == members[member_index]) {
-        pending_persistence[subgroup_num][locally_stable_sst_messages[subgroup_num].begin()->first] = msg_timestamp;
-    }
     // make a version for persistent<t>/volatile<t>
     uint64_t msg_ts_us = msg_timestamp / 1e3;
     if(msg_ts_us == 0) {
@@ -544,7 +583,6 @@ bool MulticastGroup::version_message(SSTMessage& msg, subgroup_id_t subgroup_num
 void MulticastGroup::deliver_messages_upto(
         const std::vector<int32_t>& max_indices_for_senders,
         subgroup_id_t subgroup_num, uint32_t num_shard_senders) {
-    bool non_null_msgs_delivered = false;
     assert(max_indices_for_senders.size() == (size_t)num_shard_senders);
     std::lock_guard<std::mutex> lock(msg_state_mtx);
     int32_t curr_seq_num = sst->delivered_num[member_index][subgroup_num];
@@ -553,7 +591,7 @@ void MulticastGroup::deliver_messages_upto(
         max_seq_num = std::max(max_seq_num,
                                static_cast<int32_t>(max_indices_for_senders[sender] * num_shard_senders + sender));
     }
-    persistent::version_t assigned_version = INVALID_VERSION;
+    delivery_batch batch{subgroup_num, max_seq_num, {}};
     for(int32_t seq_num = curr_seq_num + 1; seq_num <= max_seq_num; seq_num++) {
         //determine if this sequence number should actually be skipped
         int32_t index = seq_num / num_shard_senders;
@@ -561,80 +599,159 @@ void MulticastGroup::deliver_messages_upto(
         if(index > max_indices_for_senders[sender_rank]) {
             continue;
         }
-        auto rdmc_msg_ptr = locally_stable_rdmc_messages[subgroup_num].find(seq_num);
-        assigned_version = persistent::combine_int32s(sst->vid[member_index], seq_num);
-        if(rdmc_msg_ptr != locally_stable_rdmc_messages[subgroup_num].end()) {
-            auto& msg = rdmc_msg_ptr->second;
-            char* buf = msg.message_buffer.buffer.get();
-            uint64_t msg_ts = ((header*)buf)->timestamp;
-            //Note: deliver_message frees the RDMC buffer in msg, which is why the timestamp must be saved before calling this
-            deliver_message(msg, subgroup_num, assigned_version);
-            non_null_msgs_delivered |= version_message(msg, subgroup_num, assigned_version, msg_ts);
-            // free the message buffer only after it version_message has been called
-            free_message_buffers[subgroup_num].push_back(std::move(msg.message_buffer));
-            locally_stable_rdmc_messages[subgroup_num].erase(rdmc_msg_ptr);
-        } else {
-            auto& msg = locally_stable_sst_messages[subgroup_num].at(seq_num);
-            char* buf = (char*)msg.buf;
-            uint64_t msg_ts = ((header*)buf)->timestamp;
-            deliver_message(msg, subgroup_num, assigned_version);
-            non_null_msgs_delivered |= version_message(msg, subgroup_num, assigned_version, msg_ts);
-            locally_stable_sst_messages[subgroup_num].erase(seq_num);
+        // an index its sender skipped has no message
+        if(locally_stable_rdmc_messages[subgroup_num].count(seq_num) == 0
+           && locally_stable_sst_messages[subgroup_num].count(seq_num) == 0
+           && locally_stable_message_parts[subgroup_num].count(seq_num) == 0) {
+            continue;
         }
+        batch.items.emplace_back(take_stable_message(subgroup_num, seq_num,
+                                                     persistent::combine_int32s(sst->vid[member_index], seq_num),
+                                                     false));
     }
-    gmssst::set(sst->delivered_num[member_index][subgroup_num], max_seq_num);
+    deliver_batch(batch);
     sst->put(get_shard_sst_indices(subgroup_num),
              (char*)std::addressof(sst->delivered_num[0][subgroup_num]) - sst->getBaseAddress(),
              sizeof(decltype(sst->delivered_num)::value_type));
-    if(non_null_msgs_delivered) {
-        //Call the persistence_manager_post_persist_func
-        std::get<1>(persistence_manager_callbacks)(subgroup_num, assigned_version);
-    }
 }
 
-int32_t MulticastGroup::resolve_num_received(int32_t index, uint32_t num_received_entry) {
-    auto it = received_intervals[num_received_entry].end();
-    it--;
-    while(*it > index) {
-        it--;
+MulticastGroup::delivery_item MulticastGroup::take_stable_message(subgroup_id_t subgroup_num, message_id_t seq_num,
+                                                                  persistent::version_t version, bool copy_sst_message) {
+    delivery_item item{version, std::nullopt, {}, {}, nullptr, 0};
+    // a later part of a message whose first part has been taken
+    auto part_ptr = locally_stable_message_parts[subgroup_num].find(seq_num);
+    if(part_ptr != locally_stable_message_parts[subgroup_num].end()) {
+        item.multi_index_msg = std::move(part_ptr->second.first);
+        item.part = part_ptr->second.second;
+        locally_stable_message_parts[subgroup_num].erase(part_ptr);
+        return item;
     }
-    if(std::next(it) == received_intervals[num_received_entry].end()) {
-        if(*it == index - 1) {
-            *it = index;
-        } else {
-            received_intervals[num_received_entry].push_back(index);
-            received_intervals[num_received_entry].push_back(index);
-        }
+    const char* buf;
+    uint32_t sender_id;
+    long long unsigned int size;
+    auto rdmc_msg_ptr = locally_stable_rdmc_messages[subgroup_num].find(seq_num);
+    if(rdmc_msg_ptr != locally_stable_rdmc_messages[subgroup_num].end()) {
+        item.rdmc_msg = std::move(rdmc_msg_ptr->second);
+        locally_stable_rdmc_messages[subgroup_num].erase(rdmc_msg_ptr);
+        buf = item.rdmc_msg->message_buffer.buffer;
+        sender_id = item.rdmc_msg->sender_id;
+        size = item.rdmc_msg->size;
     } else {
-        auto next_it = std::next(it);
-        if(*it != index - 1) {
-            received_intervals[num_received_entry].insert(next_it, index);
-            if(*next_it != index + 1) {
-                received_intervals[num_received_entry].insert(next_it, index);
+        auto sst_msg_ptr = locally_stable_sst_messages[subgroup_num].find(seq_num);
+        assert(sst_msg_ptr != locally_stable_sst_messages[subgroup_num].end());
+        item.sst_msg = sst_msg_ptr->second;
+        locally_stable_sst_messages[subgroup_num].erase(sst_msg_ptr);
+        if(copy_sst_message || ((const header*)const_cast<const char*>(item.sst_msg.buf))->num_indices > 1) {
+            const char* slot = const_cast<const char*>(item.sst_msg.buf);
+            item.sst_msg_copy.assign(slot, slot + item.sst_msg.size);
+            item.sst_msg.buf = item.sst_msg_copy.data();
+        }
+        buf = const_cast<const char*>(item.sst_msg.buf);
+        sender_id = item.sst_msg.sender_id;
+        size = item.sst_msg.size;
+    }
+    // remember when this node sent the message, until it is persisted
+    const header* h = (const header*)buf;
+    if(sender_id == members[member_index] && size > h->header_size) {
+        pending_persistence[subgroup_num][seq_num] = h->timestamp;
+    }
+    const uint32_t num_indices = h->num_indices;
+    if(num_indices > 1) {
+        // the other parts are delivered as the messages of the indices that follow
+        const uint32_t num_shard_senders = get_num_senders(subgroup_settings.at(subgroup_num).senders);
+        auto multi_index_msg = std::make_shared<delivery_item>(std::move(item));
+        for(uint32_t part = 1; part < num_indices; ++part) {
+            locally_stable_message_parts[subgroup_num].emplace(seq_num + part * num_shard_senders,
+                                                               std::make_pair(multi_index_msg, part));
+        }
+        return delivery_item{version, std::nullopt, {}, {}, std::move(multi_index_msg), 0};
+    }
+    return item;
+}
+
+void MulticastGroup::deliver_batch(delivery_batch& batch) {
+    const subgroup_id_t subgroup_num = batch.subgroup_num;
+    bool non_null_msgs_delivered = false;
+    for(auto& item : batch.items) {
+        if(item.multi_index_msg) {
+            delivery_item& whole = *item.multi_index_msg;
+            if(whole.rdmc_msg) {
+                RDMCMessage& msg = *whole.rdmc_msg;
+                const header* h = (header*)msg.message_buffer.buffer;
+                const bool last_part = item.part + 1 == h->num_indices;
+                deliver_message(msg, subgroup_num, item.version, item.part);
+                non_null_msgs_delivered |= version_message(msg, subgroup_num, item.version, h->timestamp);
+                if(last_part) {
+                    buffer_pool->release(subgroup_num, std::move(msg.message_buffer));
+                }
             } else {
-                received_intervals[num_received_entry].erase(next_it);
+                SSTMessage& msg = whole.sst_msg;
+                msg.buf = whole.sst_msg_copy.data();
+                uint64_t msg_ts = ((header*)msg.buf)->timestamp;
+                deliver_message(msg, subgroup_num, item.version, item.part);
+                non_null_msgs_delivered |= version_message(msg, subgroup_num, item.version, msg_ts);
             }
+        } else if(item.rdmc_msg) {
+            RDMCMessage& msg = *item.rdmc_msg;
+            uint64_t msg_ts = ((header*)msg.message_buffer.buffer)->timestamp;
+            deliver_message(msg, subgroup_num, item.version);
+            non_null_msgs_delivered |= version_message(msg, subgroup_num, item.version, msg_ts);
+            // free the message buffer only after it version_message has been called
+            buffer_pool->release(subgroup_num, std::move(msg.message_buffer));
         } else {
-            if(*next_it != index + 1) {
-                received_intervals[num_received_entry].insert(next_it, index);
-            } else {
-                received_intervals[num_received_entry].erase(next_it);
+            SSTMessage& msg = item.sst_msg;
+            if(!item.sst_msg_copy.empty()) {
+                msg.buf = item.sst_msg_copy.data();
             }
-            received_intervals[num_received_entry].erase(it);
+            uint64_t msg_ts = ((header*)msg.buf)->timestamp;
+            deliver_message(msg, subgroup_num, item.version);
+            non_null_msgs_delivered |= version_message(msg, subgroup_num, item.version, msg_ts);
         }
     }
-    return *std::next(received_intervals[num_received_entry].begin());
+    gmssst::set(sst->delivered_num[member_index][subgroup_num], batch.last_seq_num);
+    if(non_null_msgs_delivered) {
+        //Call the persistence_manager_post_persist_func
+        std::get<1>(persistence_manager_callbacks)(subgroup_num, batch.items.back().version);
+    }
+}
+
+int32_t ReceivedIndices::insert(int32_t index, uint32_t count) {
+    const int32_t end = index + static_cast<int32_t>(count);
+    if(end - 1 <= last_in_order) {
+        return last_in_order;
+    }
+    for(int32_t i = std::max(index, last_in_order + 1); i < end; ++i) {
+        const uint32_t word = (i - first_index) / 64;
+        if(bits.size() <= word) {
+            bits.resize(word + 1, 0);
+        }
+        bits[word] |= uint64_t(1) << ((i - first_index) % 64);
+    }
+    // move last_in_order over the run of received indices that follows it,
+    // dropping the words it leaves behind
+    while(!bits.empty()) {
+        const uint32_t offset = last_in_order + 1 - first_index;
+        const uint64_t missing = ~bits.front() >> offset;
+        const uint32_t run = std::min(missing ? (uint32_t)__builtin_ctzll(missing) : 64u, 64 - offset);
+        last_in_order += run;
+        if(offset + run < 64) {
+            break;
+        }
+        bits.pop_front();
+        first_index += 64;
+    }
+    return last_in_order;
 }
 
 bool MulticastGroup::receiver_predicate(subgroup_id_t subgroup_num, const SubgroupSettings& curr_subgroup_settings,
                                         const std::map<uint32_t, uint32_t>& shard_ranks_by_sender_rank,
                                         uint32_t num_shard_senders, const DerechoSST& sst) {
-    for(uint sender_count = 0; sender_count < num_shard_senders; ++sender_count) {
-        int32_t num_received = sst.num_received_sst[member_index][curr_subgroup_settings.num_received_offset + sender_count] + 1;
+    const receive_plan& plan = receive_plans[subgroup_num];
+    for(uint sender_count = 0; sender_count < plan.num_senders; ++sender_count) {
+        int32_t num_received = plan.num_received_sst[sender_count] + 1;
         uint32_t slot = num_received % window_size;
-        if(static_cast<long long int>((uint64_t&)sst.slots[node_id_to_sst_index.at(curr_subgroup_settings.members[shard_ranks_by_sender_rank.at(sender_count)])]
-                                                          [(sst_max_msg_size + 2 * sizeof(uint64_t)) * (subgroup_num * window_size + slot + 1) - sizeof(uint64_t)])
-           == num_received / window_size + 1) {
+        if(static_cast<long long int>(plan.next_seq(sender_count, slot)) == num_received / window_size + 1
+           || *plan.sender_skips[sender_count] != plan.received_skips[sender_count]) {
             return true;
         }
     }
@@ -649,24 +766,12 @@ void MulticastGroup::sst_receive_handler(subgroup_id_t subgroup_num, const Subgr
     const int32_t index = h->index;
 
     message_id_t sequence_number = index * num_shard_senders + sender_rank;
-    node_id_t node_id = curr_subgroup_settings.members[shard_ranks_by_sender_rank.at(sender_rank)];
+    node_id_t node_id = receive_plans[subgroup_num].sender_ids[sender_rank];
 
     locally_stable_sst_messages[subgroup_num][sequence_number] = {node_id, index, size, data};
 
-    auto new_num_received = resolve_num_received(index, curr_subgroup_settings.num_received_offset + sender_rank);
-    /* NULL Send Scheme */
-    // only if I am a sender in the subgroup and the subgroup is not in UNORDERED mode
-    if(curr_subgroup_settings.sender_rank >= 0 && curr_subgroup_settings.mode != Mode::UNORDERED) {
-        if(curr_subgroup_settings.sender_rank < (int)sender_rank) {
-            while(future_message_indices[subgroup_num] <= new_num_received) {
-                get_buffer_and_send_auto_null(subgroup_num);
-            }
-        } else if(curr_subgroup_settings.sender_rank > (int)sender_rank) {
-            while(future_message_indices[subgroup_num] < new_num_received) {
-                get_buffer_and_send_auto_null(subgroup_num);
-            }
-        }
-    }
+    auto new_num_received = received_indices[curr_subgroup_settings.num_received_offset + sender_rank].insert(index, h->num_indices);
+    fill_null_rounds(subgroup_num, curr_subgroup_settings, sender_rank, new_num_received);
 
     if(curr_subgroup_settings.mode == Mode::UNORDERED) {
         // issue stability upcalls for the recently sequenced messages
@@ -692,7 +797,7 @@ void MulticastGroup::sst_receive_handler(subgroup_id_t subgroup_num, const Subgr
                 auto it2 = locally_stable_rdmc_messages[subgroup_num].begin();
                 assert(it2->first == seq_num);
                 auto& msg = it2->second;
-                char* buf = msg.message_buffer.buffer.get();
+                char* buf = msg.message_buffer.buffer;
                 header* h = (header*)(buf);
                 if(msg.size > h->header_size && callbacks.global_stability_callback) {
                     callbacks.global_stability_callback(subgroup_num, msg.sender_id,
@@ -700,7 +805,7 @@ void MulticastGroup::sst_receive_handler(subgroup_id_t subgroup_num, const Subgr
                                                         {{buf + h->header_size, msg.size - h->header_size}},
                                                         INVALID_VERSION);
                 }
-                free_message_buffers[subgroup_num].push_back(std::move(msg.message_buffer));
+                buffer_pool->release(subgroup_num, std::move(msg.message_buffer));
                 if(node_id == members[member_index]) {
                     pending_message_timestamps[subgroup_num].erase(h->timestamp);
                 }
@@ -716,26 +821,30 @@ void MulticastGroup::receiver_function(subgroup_id_t subgroup_num, const Subgrou
                                        uint32_t num_shard_senders, DerechoSST& sst, unsigned int batch_size,
                                        const std::function<void(uint32_t, volatile char*, uint32_t)>& sst_receive_handler_lambda) {
     std::lock_guard<std::mutex> lock(msg_state_mtx);
+    const receive_plan& plan = receive_plans[subgroup_num];
+    for(uint sender_count = 0; sender_count < plan.num_senders; ++sender_count) {
+        const uint64_t skip = *plan.sender_skips[sender_count];
+        if(skip != plan.received_skips[sender_count]) {
+            receive_skipped_indices(subgroup_num, curr_subgroup_settings, sender_count, skip);
+        }
+    }
     for(uint i = 0; i < batch_size; ++i) {
-        for(uint sender_count = 0; sender_count < num_shard_senders; ++sender_count) {
-            auto num_received = sst.num_received_sst[member_index][curr_subgroup_settings.num_received_offset + sender_count] + 1;
+        for(uint sender_count = 0; sender_count < plan.num_senders; ++sender_count) {
+            auto num_received = plan.num_received_sst[sender_count] + 1;
             uint32_t slot = num_received % window_size;
-            message_id_t next_seq = (uint64_t&)sst.slots[node_id_to_sst_index.at(curr_subgroup_settings.members[shard_ranks_by_sender_rank.at(sender_count)])]
-                                                        [(sst_max_msg_size + 2 * sizeof(uint64_t)) * (subgroup_num * window_size + slot + 1) - sizeof(uint64_t)];
+            message_id_t next_seq = plan.next_seq(sender_count, slot);
             if(next_seq == num_received / static_cast<int32_t>(window_size) + 1) {
-                whenlog(logger->trace("receiver_trig calling sst_receive_handler_lambda. next_seq = {}, num_received = {}, sender rank = {}. Reading from SST row {}, slot {}",
-                                      next_seq, num_received, sender_count, node_id_to_sst_index.at(curr_subgroup_settings.members[shard_ranks_by_sender_rank.at(sender_count)]), (subgroup_num * window_size + slot)););
-                sst_receive_handler_lambda(sender_count,
-                                           &sst.slots[node_id_to_sst_index.at(curr_subgroup_settings.members[shard_ranks_by_sender_rank.at(sender_count)])]
-                                                     [(sst_max_msg_size + 2 * sizeof(uint64_t)) * (subgroup_num * window_size + slot)],
-                                           (uint64_t&)sst.slots[node_id_to_sst_index.at(curr_subgroup_settings.members[shard_ranks_by_sender_rank.at(sender_count)])]
-                                                               [(sst_max_msg_size + 2 * sizeof(uint64_t)) * (subgroup_num * window_size + slot + 1) - 2 * sizeof(uint64_t)]);
-                sst.num_received_sst[member_index][curr_subgroup_settings.num_received_offset + sender_count] = num_received;
+                whenlog(logger->trace("receiver_trig calling sst_receive_handler_lambda. next_seq = {}, num_received = {}, sender rank = {}. Reading from node {}, slot {}",
+                                      next_seq, num_received, sender_count, plan.sender_ids[sender_count], (subgroup_num * window_size + slot)););
+                // the slot starts with the message size, followed by the message
+                volatile char* slot_start = plan.slot(sender_count, slot);
+                sst_receive_handler_lambda(sender_count, slot_start + sizeof(uint64_t), *(volatile uint64_t*)slot_start);
+                plan.num_received_sst[sender_count] = num_received;
             }
         }
     }
-    sst.put((char*)std::addressof(sst.num_received_sst[0][curr_subgroup_settings.num_received_offset]) - sst.getBaseAddress(),
-            sizeof(decltype(sst.num_received_sst)::value_type) * num_shard_senders);
+    sst.put_deferred((char*)std::addressof(sst.num_received_sst[0][curr_subgroup_settings.num_received_offset]) - sst.getBaseAddress(),
+                     sizeof(decltype(sst.num_received_sst)::value_type) * num_shard_senders);
     // std::atomic_signal_fence(std::memory_order_acq_rel);
     auto* min_ptr = std::min_element(&sst.num_received[member_index][curr_subgroup_settings.num_received_offset],
                                      &sst.num_received[member_index][curr_subgroup_settings.num_received_offset + num_shard_senders]);
@@ -744,11 +853,11 @@ void MulticastGroup::receiver_function(subgroup_id_t subgroup_num, const Subgrou
     if(new_seq_num > sst.seq_num[member_index][subgroup_num]) {
         whenlog(logger->trace("Updating seq_num for subgroup {} to {}", subgroup_num, new_seq_num););
         sst.seq_num[member_index][subgroup_num] = new_seq_num;
-        sst.put((char*)std::addressof(sst.seq_num[0][subgroup_num]) - sst.getBaseAddress(),
-                sizeof(decltype(sst.seq_num)::value_type));
+        sst.put_deferred((char*)std::addressof(sst.seq_num[0][subgroup_num]) - sst.getBaseAddress(),
+                         sizeof(decltype(sst.seq_num)::value_type));
     }
-    sst.put((char*)std::addressof(sst.num_received[0][curr_subgroup_settings.num_received_offset]) - sst.getBaseAddress(),
-            sizeof(decltype(sst.num_received)::value_type) * num_shard_senders);
+    sst.put_deferred((char*)std::addressof(sst.num_received[0][curr_subgroup_settings.num_received_offset]) - sst.getBaseAddress(),
+                     sizeof(decltype(sst.num_received)::value_type) * num_shard_senders);
 }
 
 void MulticastGroup::delivery_trigger(subgroup_id_t subgroup_num, const SubgroupSettings& curr_subgroup_settings,
@@ -762,63 +871,80 @@ void MulticastGroup::delivery_trigger(subgroup_id_t subgroup_num, const Subgroup
         min_stable_num = std::min(min_stable_num, (message_id_t)sst.seq_num[node_id_to_sst_index.at(curr_subgroup_settings.members[i])][subgroup_num]);
     }
 
-    bool update_sst = false;
-    bool non_null_msgs_delivered = false;
-    persistent::version_t assigned_version = INVALID_VERSION;
+    const bool use_delivery_worker = !delivery_workers.empty();
+    if(use_delivery_worker && delivery_workers_stopped) {
+        // wedged: the ragged edge cleanup delivers the rest
+        return;
+    }
+    if(min_stable_num <= last_stable_seq_nums[subgroup_num]) {
+        // nothing new is stable
+        return;
+    }
+    delivery_batch batch{subgroup_num, -1, {}};
     while(true) {
-        if(locally_stable_rdmc_messages[subgroup_num].empty() && locally_stable_sst_messages[subgroup_num].empty()) {
+        if(locally_stable_rdmc_messages[subgroup_num].empty() && locally_stable_sst_messages[subgroup_num].empty()
+           && locally_stable_message_parts[subgroup_num].empty()) {
             break;
         }
-        int32_t least_undelivered_rdmc_seq_num, least_undelivered_sst_seq_num;
-        least_undelivered_rdmc_seq_num = least_undelivered_sst_seq_num = std::numeric_limits<int32_t>::max();
+        int32_t least_undelivered_rdmc_seq_num, least_undelivered_sst_seq_num, least_undelivered_part_seq_num;
+        least_undelivered_rdmc_seq_num = least_undelivered_sst_seq_num = least_undelivered_part_seq_num
+                = std::numeric_limits<int32_t>::max();
         if(!locally_stable_rdmc_messages[subgroup_num].empty()) {
             least_undelivered_rdmc_seq_num = locally_stable_rdmc_messages[subgroup_num].begin()->first;
         }
         if(!locally_stable_sst_messages[subgroup_num].empty()) {
             least_undelivered_sst_seq_num = locally_stable_sst_messages[subgroup_num].begin()->first;
         }
-        if(least_undelivered_rdmc_seq_num < least_undelivered_sst_seq_num && least_undelivered_rdmc_seq_num <= min_stable_num) {
-            update_sst = true;
+        if(!locally_stable_message_parts[subgroup_num].empty()) {
+            least_undelivered_part_seq_num = locally_stable_message_parts[subgroup_num].begin()->first;
+        }
+        int32_t least_undelivered_seq_num;
+        if(least_undelivered_part_seq_num < least_undelivered_rdmc_seq_num
+           && least_undelivered_part_seq_num < least_undelivered_sst_seq_num
+           && least_undelivered_part_seq_num <= min_stable_num) {
+            whenlog(logger->trace("Subgroup {}, can deliver a part of a locally stable message: min_stable_num={} and least_undelivered_seq_num={}",
+                                  subgroup_num, min_stable_num, least_undelivered_part_seq_num););
+            least_undelivered_seq_num = least_undelivered_part_seq_num;
+        } else if(least_undelivered_rdmc_seq_num < least_undelivered_sst_seq_num && least_undelivered_rdmc_seq_num <= min_stable_num) {
             whenlog(logger->trace("Subgroup {}, can deliver a locally stable RDMC message: min_stable_num={} and least_undelivered_seq_num={}",
                                   subgroup_num, min_stable_num, least_undelivered_rdmc_seq_num););
-            RDMCMessage& msg = locally_stable_rdmc_messages[subgroup_num].begin()->second;
-            char* buf = msg.message_buffer.buffer.get();
-            uint64_t msg_ts = ((header*)buf)->timestamp;
-            //Note: deliver_message frees the RDMC buffer in msg, which is why the timestamp must be saved before calling this
-            assigned_version = persistent::combine_int32s(sst.vid[member_index], least_undelivered_rdmc_seq_num);
-            deliver_message(msg, subgroup_num, assigned_version);
-            non_null_msgs_delivered |= version_message(msg, subgroup_num, assigned_version, msg_ts);
-            // free the message buffer only after it version_message has been called
-            free_message_buffers[subgroup_num].push_back(std::move(msg.message_buffer));
-            sst.delivered_num[member_index][subgroup_num] = least_undelivered_rdmc_seq_num;
-            locally_stable_rdmc_messages[subgroup_num].erase(locally_stable_rdmc_messages[subgroup_num].begin());
+            least_undelivered_seq_num = least_undelivered_rdmc_seq_num;
         } else if(least_undelivered_sst_seq_num < least_undelivered_rdmc_seq_num && least_undelivered_sst_seq_num <= min_stable_num) {
-            update_sst = true;
             whenlog(logger->trace("Subgroup {}, can deliver a locally stable SST message: min_stable_num={} and least_undelivered_seq_num={}",
                                   subgroup_num, min_stable_num, least_undelivered_sst_seq_num););
-            SSTMessage& msg = locally_stable_sst_messages[subgroup_num].begin()->second;
-            char* buf = (char*)msg.buf;
-            uint64_t msg_ts = ((header*)buf)->timestamp;
-            assigned_version = persistent::combine_int32s(sst.vid[member_index], least_undelivered_sst_seq_num);
-            deliver_message(msg, subgroup_num, assigned_version);
-            non_null_msgs_delivered |= version_message(msg, subgroup_num, assigned_version, msg_ts);
-            sst.delivered_num[member_index][subgroup_num] = least_undelivered_sst_seq_num;
-            locally_stable_sst_messages[subgroup_num].erase(locally_stable_sst_messages[subgroup_num].begin());
+            least_undelivered_seq_num = least_undelivered_sst_seq_num;
         } else {
             break;
         }
+        batch.items.emplace_back(take_stable_message(subgroup_num, least_undelivered_seq_num,
+                                                     persistent::combine_int32s(sst.vid[member_index], least_undelivered_seq_num),
+                                                     use_delivery_worker));
     }
-    if(update_sst) {
-        sst.put(get_shard_sst_indices(subgroup_num),
-                (char*)std::addressof(sst.delivered_num[0][subgroup_num]) - sst.getBaseAddress(),
-                sizeof(decltype(sst.delivered_num)::value_type));
-        // post persistence request for ordered mode.
-        if(non_null_msgs_delivered) {
-            std::get<1>(persistence_manager_callbacks)(subgroup_num, assigned_version);
+    // every sequence number up to min_stable_num has now been taken; the ones
+    // without a message were skipped by their senders
+    batch.last_seq_num = min_stable_num;
+    last_stable_seq_nums[subgroup_num] = min_stable_num;
+    if(use_delivery_worker) {
+        // the worker delivers the batch and pushes delivered_num, while this
+        // thread goes on receiving and detecting stability
+        delivery_worker& worker = *delivery_workers[subgroup_to_delivery_worker[subgroup_num]];
+        {
+            std::lock_guard<std::mutex> worker_lock(worker.mtx);
+            worker.batches.emplace_back(std::move(batch));
         }
+        worker.cv.notify_one();
+        return;
     }
+    deliver_batch(batch);
+    sst.put_deferred(get_shard_sst_indices(subgroup_num),
+                     (char*)std::addressof(sst.delivered_num[0][subgroup_num]) - sst.getBaseAddress(),
+                     sizeof(decltype(sst.delivered_num)::value_type));
 }
+
 void MulticastGroup::register_predicates() {
+    // Each subgroup's predicates use the subgroup ID as their affinity, so that
+    // with several SST detector threads, different subgroups are evaluated in parallel
+    receive_plans.resize(total_num_subgroups);
     for(const auto& p : subgroup_settings) {
         subgroup_id_t subgroup_num = p.first;
         const SubgroupSettings& curr_subgroup_settings = p.second;
@@ -833,6 +959,18 @@ void MulticastGroup::register_predicates() {
             }
         }
 
+        receive_plan& plan = receive_plans[subgroup_num];
+        plan.num_senders = num_shard_senders;
+        plan.slot_size = sst_max_msg_size + 2 * sizeof(uint64_t);
+        plan.num_received_sst = &sst->num_received_sst[member_index][curr_subgroup_settings.num_received_offset];
+        for(uint32_t sender_rank = 0; sender_rank < num_shard_senders; ++sender_rank) {
+            const node_id_t sender_id = curr_subgroup_settings.members[shard_ranks_by_sender_rank.at(sender_rank)];
+            plan.sender_ids.push_back(sender_id);
+            plan.sender_slots.push_back(&sst->slots[node_id_to_sst_index.at(sender_id)][plan.slot_size * subgroup_num * window_size]);
+            plan.sender_skips.push_back(&sst->skipped_indices[node_id_to_sst_index.at(sender_id)][curr_subgroup_settings.num_received_offset + sender_rank]);
+            plan.received_skips.push_back(0);
+        }
+
         auto receiver_pred = [=](const DerechoSST& sst) {
             return receiver_predicate(subgroup_num, curr_subgroup_settings,
                                       shard_ranks_by_sender_rank, num_shard_senders, sst);
@@ -852,7 +990,8 @@ void MulticastGroup::register_predicates() {
                               batch_size, sst_receive_handler_lambda);
         };
         receiver_pred_handles.emplace_back(sst->predicates.insert(receiver_pred, receiver_trig,
-                                                                  sst::PredicateType::RECURRENT));
+                                                                  sst::PredicateType::RECURRENT,
+                                                                  subgroup_num));
 
         if(curr_subgroup_settings.mode != Mode::UNORDERED) {
             auto delivery_pred = [this](const DerechoSST& sst) { return true; };
@@ -861,7 +1000,8 @@ void MulticastGroup::register_predicates() {
             };
 
             delivery_pred_handles.emplace_back(sst->predicates.insert(delivery_pred, delivery_trig,
-                                                                      sst::PredicateType::RECURRENT));
+                                                                      sst::PredicateType::RECURRENT,
+                                                                      subgroup_num));
 
             auto persistence_pred = [this](const DerechoSST& sst) { return true; };
             auto persistence_trig = [this, subgroup_num, curr_subgroup_settings, num_shard_members, version_seen = (persistent::version_t)INVALID_VERSION](DerechoSST& sst) mutable {
@@ -881,7 +1021,9 @@ void MulticastGroup::register_predicates() {
                 }
             };
 
-            persistence_pred_handles.emplace_back(sst->predicates.insert(persistence_pred, persistence_trig, sst::PredicateType::RECURRENT));
+            persistence_pred_handles.emplace_back(sst->predicates.insert(persistence_pred, persistence_trig,
+                                                                         sst::PredicateType::RECURRENT,
+                                                                         subgroup_num));
 
             if(curr_subgroup_settings.sender_rank >= 0) {
                 auto sender_pred = [this, subgroup_num, curr_subgroup_settings, num_shard_members, num_shard_senders](const DerechoSST& sst) {
@@ -895,11 +1037,12 @@ void MulticastGroup::register_predicates() {
                     return true;
                 };
                 auto sender_trig = [this, subgroup_num](DerechoSST& sst) {
-                    sender_cv.notify_all();
+                    notify_sender_lane(subgroup_num);
                     next_message_to_deliver[subgroup_num]++;
                 };
                 sender_pred_handles.emplace_back(sst->predicates.insert(sender_pred, sender_trig,
-                                                                        sst::PredicateType::RECURRENT));
+                                                                        sst::PredicateType::RECURRENT,
+                                                                        subgroup_num));
             }
         } else {
             //This subgroup is in UNORDERED mode
@@ -915,10 +1058,11 @@ void MulticastGroup::register_predicates() {
                     return true;
                 };
                 auto sender_trig = [this, subgroup_num](DerechoSST& sst) {
-                    sender_cv.notify_all();
+                    notify_sender_lane(subgroup_num);
                 };
                 sender_pred_handles.emplace_back(sst->predicates.insert(sender_pred, sender_trig,
-                                                                        sst::PredicateType::RECURRENT));
+                                                                        sst::PredicateType::RECURRENT,
+                                                                        subgroup_num));
             }
         }
     }
@@ -968,19 +1112,138 @@ void MulticastGroup::wedge() {
         handle_iter = persistence_pred_handles.erase(handle_iter);
     }
 
+    {
+        std::lock_guard<std::mutex> lock(msg_state_mtx);
+        delivery_workers_stopped = true;
+    }
+    // Let the workers deliver what was already handed to them, so that the
+    // ragged edge cleanup starts from their delivered_num. This does not hold
+    // msg_state_mtx, which an upcall may be waiting for.
+    stop_delivery_workers();
+
     for(uint i = 0; i < num_members; ++i) {
         rdmc::destroy_group(i + rdmc_group_num_offset);
     }
 
-    sender_cv.notify_all();
-    if(sender_thread.joinable()) {
-        sender_thread.join();
+    for(auto& lane : sender_lanes) {
+        lane->cv.notify_all();
+    }
+    for(auto& lane : sender_lanes) {
+        if(lane->thread.joinable()) {
+            lane->thread.join();
+        }
+    }
+}
+
+void MulticastGroup::initialize_sender_lanes() {
+    const uint32_t num_lanes = std::max(1u, getConfUInt32(CONF_DERECHO_SENDER_LANES));
+    // the weights are listed by subgroup ID; missing ones are 1
+    const std::vector<uint32_t> weights = parse_subgroup_weights(getConfString(CONF_DERECHO_SENDER_SUBGROUP_WEIGHTS));
+    for(uint32_t i = 0; i < num_lanes; ++i) {
+        sender_lanes.emplace_back(std::make_unique<sender_lane>());
+    }
+    sender_flow_states.resize(total_num_subgroups);
+    subgroup_to_sender_lane.resize(total_num_subgroups, 0);
+    uint32_t next_lane = 0;
+    for(const auto& p : subgroup_settings) {
+        const subgroup_id_t subgroup_num = p.first;
+        const SubgroupSettings& settings = p.second;
+        if(settings.sender_rank < 0) {
+            continue;
+        }
+        sender_flow_state flow;
+        flow.shard_sender_index = settings.sender_rank;
+        flow.num_shard_senders = get_num_senders(settings.senders);
+        flow.num_received_offset = settings.num_received_offset;
+        flow.mode = settings.mode;
+        for(auto node_id : settings.members) {
+            flow.shard_sst_indices.push_back(node_id_to_sst_index.at(node_id));
+        }
+        flow.weight = subgroup_num < weights.size() ? weights[subgroup_num] : 1;
+        sender_flow_states[subgroup_num] = std::move(flow);
+        // spread the subgroups this node sends in evenly over the lanes
+        subgroup_to_sender_lane[subgroup_num] = next_lane;
+        sender_lanes[next_lane]->subgroups.push_back(subgroup_num);
+        next_lane = (next_lane + 1) % num_lanes;
+    }
+}
+
+void MulticastGroup::start_sender_lanes() {
+    for(uint32_t lane_index = 0; lane_index < sender_lanes.size(); ++lane_index) {
+        sender_lanes[lane_index]->thread = std::thread(&MulticastGroup::send_loop, this, lane_index);
+    }
+}
+
+void MulticastGroup::notify_sender_lane(subgroup_id_t subgroup_num) {
+    sender_lanes[subgroup_to_sender_lane[subgroup_num]]->cv.notify_all();
+}
+
+void MulticastGroup::initialize_delivery_workers() {
+    const uint32_t num_workers = getConfUInt32(CONF_DERECHO_DELIVERY_THREADS);
+    if(num_workers == 0) {
+        return;
+    }
+    subgroup_to_delivery_worker.resize(total_num_subgroups, 0);
+    uint32_t next_worker = 0;
+    for(const auto& p : subgroup_settings) {
+        // UNORDERED subgroups deliver as they receive, not in delivery_trigger
+        if(p.second.mode == Mode::UNORDERED) {
+            continue;
+        }
+        if(delivery_workers.size() < num_workers) {
+            delivery_workers.emplace_back(std::make_unique<delivery_worker>());
+        }
+        subgroup_to_delivery_worker[p.first] = next_worker;
+        next_worker = (next_worker + 1) % num_workers;
+    }
+    for(uint32_t worker_index = 0; worker_index < delivery_workers.size(); ++worker_index) {
+        delivery_workers[worker_index]->thread = std::thread(&MulticastGroup::delivery_loop, this, worker_index);
+    }
+}
+
+void MulticastGroup::delivery_loop(uint32_t worker_index) {
+    pthread_setname_np(pthread_self(), "delivery_thread");
+    delivery_worker& worker = *delivery_workers[worker_index];
+    std::unique_lock<std::mutex> lock(worker.mtx);
+    while(true) {
+        worker.cv.wait(lock, [&worker]() { return worker.shutdown || !worker.batches.empty(); });
+        if(worker.batches.empty()) {
+            // shut down, and every batch has been delivered
+            return;
+        }
+        delivery_batch batch = std::move(worker.batches.front());
+        worker.batches.pop_front();
+        lock.unlock();
+        deliver_batch(batch);
+        sst->put(get_shard_sst_indices(batch.subgroup_num),
+                 (char*)std::addressof(sst->delivered_num[0][batch.subgroup_num]) - sst->getBaseAddress(),
+                 sizeof(decltype(sst->delivered_num)::value_type));
+        lock.lock();
+    }
+}
+
+void MulticastGroup::stop_delivery_workers() {
+    for(auto& worker : delivery_workers) {
+        {
+            std::lock_guard<std::mutex> worker_lock(worker->mtx);
+            worker->shutdown = true;
+        }
+        worker->cv.notify_all();
+    }
+    for(auto& worker : delivery_workers) {
+        if(worker->thread.joinable()) {
+            worker->thread.join();
+        }
     }
 }
 
-void MulticastGroup::send_loop() {
+void MulticastGroup::send_loop(uint32_t lane_index) {
     pthread_setname_np(pthread_self(), "sender_thread");
-    subgroup_id_t subgroup_to_send = 0;
+    sender_lane& lane = *sender_lanes[lane_index];
+    // position in lane.subgroups of the subgroup being served, and how many
+    // messages it has sent since it started being served
+    std::size_t current = 0;
+    uint32_t sent_in_a_row = 0;
     auto should_send_to_subgroup = [&](subgroup_id_t subgroup_num) {
         if(!rdmc_sst_groups_created) {
             return false;
@@ -989,31 +1252,29 @@ void MulticastGroup::send_loop() {
             return false;
         }
         RDMCMessage& msg = pending_sends[subgroup_num].front();
+        const sender_flow_state& flow = *sender_flow_states[subgroup_num];
 
-        int shard_sender_index = subgroup_settings.at(subgroup_num).sender_rank;
-        std::vector<int> shard_senders = subgroup_settings.at(subgroup_num).senders;
-        uint32_t num_shard_senders = get_num_senders(shard_senders);
-        assert(shard_sender_index >= 0);
-
-        if(sst->num_received[member_index][subgroup_settings.at(subgroup_num).num_received_offset + shard_sender_index] < msg.index - 1) {
+        // Up to rdmc_send_depth messages may be in flight, so this one can go
+        // once everything older than the last rdmc_send_depth - 1 has been
+        // received locally.
+        if(sst->num_received[member_index][flow.num_received_offset + flow.shard_sender_index]
+           < msg.index - static_cast<message_id_t>(rdmc_send_depth)) {
             return false;
         }
 
-        std::vector<node_id_t> shard_members = subgroup_settings.at(subgroup_num).members;
-        auto num_shard_members = shard_members.size();
-        assert(num_shard_members >= 1);
-        if(subgroup_settings.at(subgroup_num).mode != Mode::UNORDERED) {
-            for(uint i = 0; i < num_shard_members; ++i) {
-                if(sst->delivered_num[node_id_to_sst_index.at(shard_members[i])][subgroup_num] < static_cast<message_id_t>((msg.index - window_size) * num_shard_senders + shard_sender_index)
-                   || (sst->persisted_num[node_id_to_sst_index.at(shard_members[i])][subgroup_num] < static_cast<message_id_t>((msg.index - window_size) * num_shard_senders + shard_sender_index))) {
+        if(flow.mode != Mode::UNORDERED) {
+            const message_id_t min_delivered = static_cast<message_id_t>(
+                    (msg.index - window_size) * flow.num_shard_senders + flow.shard_sender_index);
+            for(auto sst_index : flow.shard_sst_indices) {
+                if(sst->delivered_num[sst_index][subgroup_num] < min_delivered
+                   || sst->persisted_num[sst_index][subgroup_num] < min_delivered) {
                     return false;
                 }
             }
         } else {
-            for(uint i = 0; i < num_shard_members; ++i) {
-                auto num_received_offset = subgroup_settings.at(subgroup_num).num_received_offset;
-                if(sst->num_received[node_id_to_sst_index.at(shard_members[i])][num_received_offset + shard_sender_index]
-                   < static_cast<int32_t>(future_message_indices[subgroup_num] - 1 - window_size)) {
+            const int32_t min_received = static_cast<int32_t>(future_message_indices[subgroup_num] - 1 - window_size);
+            for(auto sst_index : flow.shard_sst_indices) {
+                if(sst->num_received[sst_index][flow.num_received_offset + flow.shard_sender_index] < min_received) {
                     return false;
                 }
             }
@@ -1021,11 +1282,23 @@ void MulticastGroup::send_loop() {
 
         return true;
     };
+    // Weighted round robin: the current subgroup keeps sending until it has
+    // sent its weight in messages, then the next ready subgroup gets a turn
     auto should_send = [&]() {
-        for(uint i = 1; i <= total_num_subgroups; ++i) {
-            auto subgroup_num = (subgroup_to_send + i) % total_num_subgroups;
-            if(should_send_to_subgroup(subgroup_num)) {
-                subgroup_to_send = subgroup_num;
+        const std::size_t num_subgroups = lane.subgroups.size();
+        if(num_subgroups == 0) {
+            return false;
+        }
+        const subgroup_id_t current_subgroup = lane.subgroups[current];
+        if(sent_in_a_row < sender_flow_states[current_subgroup]->weight
+           && should_send_to_subgroup(current_subgroup)) {
+            return true;
+        }
+        for(std::size_t i = 1; i <= num_subgroups; ++i) {
+            const std::size_t candidate = (current + i) % num_subgroups;
+            if(should_send_to_subgroup(lane.subgroups[candidate])) {
+                current = candidate;
+                sent_in_a_row = 0;
                 return true;
             }
         }
@@ -1034,16 +1307,35 @@ void MulticastGroup::send_loop() {
     auto should_wake = [&]() { return thread_shutdown || should_send(); };
     std::unique_lock<std::mutex> lock(msg_state_mtx);
     while(!thread_shutdown) {
-        sender_cv.wait(lock, should_wake);
+        lane.cv.wait(lock, should_wake);
         if(!thread_shutdown) {
-            current_sends[subgroup_to_send] = std::move(pending_sends[subgroup_to_send].front());
-            whenlog(logger->trace("Calling send in subgroup {} on message {} from sender {}", subgroup_to_send, current_sends[subgroup_to_send]->index, current_sends[subgroup_to_send]->sender_id););
-            if(!rdmc::send(subgroup_to_rdmc_group[subgroup_to_send],
-                           current_sends[subgroup_to_send]->message_buffer.mr, 0,
-                           current_sends[subgroup_to_send]->size)) {
+            const subgroup_id_t subgroup_to_send = lane.subgroups[current];
+            current_sends[subgroup_to_send].push_back(std::move(pending_sends[subgroup_to_send].front()));
+            pending_sends[subgroup_to_send].pop();
+            ++sent_in_a_row;
+            const RDMCMessage& msg = current_sends[subgroup_to_send].back();
+            whenlog(logger->trace("Calling send in subgroup {} on message {} from sender {}", subgroup_to_send, msg.index, msg.sender_id););
+            const uint32_t rdmc_group = subgroup_to_rdmc_group[subgroup_to_send];
+            std::shared_ptr<rdma::memory_region> mr = msg.message_buffer.mr;
+            const std::size_t offset = msg.message_buffer.offset;
+            const std::size_t size = msg.size;
+            // Posting the send doesn't touch the message state, so other lanes
+            // (and the receive handlers) can go ahead in the meantime. The
+            // message stays in current_sends until its self-receive; if RDMC
+            // is still sending an earlier one, it queues this one behind it.
+            lock.unlock();
+            const bool sent = rdmc::send(rdmc_group, mr, offset, size);
+            lock.lock();
+            // A wedge may have started while the lock was released: it sets
+            // thread_shutdown before destroying the RDMC groups, so a failed
+            // send is only an error if it is still not set. Either way the
+            // lane must not pick another subgroup from state that is now stale.
+            if(thread_shutdown) {
+                break;
+            }
+            if(!sent) {
                 throw std::runtime_error("rdmc::send returned false");
             }
-            pending_sends[subgroup_to_send].pop();
         }
     }
 }
@@ -1113,22 +1405,23 @@ void MulticastGroup::get_buffer_and_send_auto_null(subgroup_id_t subgroup_num) {
         msg.sender_id = members[member_index];
         msg.index = future_message_indices[subgroup_num];
         msg.size = msg_size;
-        msg.message_buffer = std::move(free_message_buffers[subgroup_num].back());
-        free_message_buffers[subgroup_num].pop_back();
+        // a null message fills a round other senders are waiting for, so it cannot wait for a free buffer
+        msg.message_buffer = buffer_pool->acquire_or_allocate(subgroup_num, msg_size);
 
         auto current_time = get_time();
         pending_message_timestamps[subgroup_num].insert(current_time);
 
         // Fill header
-        char* buf = msg.message_buffer.buffer.get();
+        char* buf = msg.message_buffer.buffer;
         ((header*)buf)->header_size = sizeof(header);
         ((header*)buf)->index = msg.index;
         ((header*)buf)->timestamp = current_time;
         ((header*)buf)->cooked_send = false;
+        ((header*)buf)->num_indices = 1;
 
         future_message_indices[subgroup_num]++;
         pending_sends[subgroup_num].push(std::move(msg));
-        sender_cv.notify_all();
+        notify_sender_lane(subgroup_num);
     } else {
         char* buf = (char*)sst_multicast_group_ptrs[subgroup_num]->get_buffer(msg_size);
 
@@ -1141,15 +1434,87 @@ void MulticastGroup::get_buffer_and_send_auto_null(subgroup_id_t subgroup_num) {
         ((header*)buf)->index = future_message_indices[subgroup_num];
         ((header*)buf)->timestamp = current_time;
         ((header*)buf)->cooked_send = false;
+        ((header*)buf)->num_indices = 1;
 
         future_message_indices[subgroup_num]++;
         sst_multicast_group_ptrs[subgroup_num]->send();
     }
 }
 
+void MulticastGroup::fill_null_rounds(subgroup_id_t subgroup_num, const SubgroupSettings& curr_subgroup_settings,
+                                      uint32_t sender_rank, int32_t new_num_received) {
+    // only if I am a sender in the subgroup and the subgroup is not in UNORDERED mode
+    if(curr_subgroup_settings.sender_rank < 0 || curr_subgroup_settings.mode == Mode::UNORDERED) {
+        return;
+    }
+    // a round starts with the lowest sender rank, so a sender ranked before
+    // this node needs one more of its messages
+    int32_t last_index;
+    if(curr_subgroup_settings.sender_rank < (int)sender_rank) {
+        last_index = new_num_received;
+    } else if(curr_subgroup_settings.sender_rank > (int)sender_rank) {
+        last_index = new_num_received - 1;
+    } else {
+        return;
+    }
+    if(future_message_indices[subgroup_num] > last_index
+       || skip_indices_upto(subgroup_num, curr_subgroup_settings, last_index)) {
+        return;
+    }
+    while(future_message_indices[subgroup_num] <= last_index) {
+        get_buffer_and_send_auto_null(subgroup_num);
+    }
+}
+
+bool MulticastGroup::skip_indices_upto(subgroup_id_t subgroup_num, const SubgroupSettings& curr_subgroup_settings,
+                                       int32_t last_index) {
+    const uint32_t entry = curr_subgroup_settings.num_received_offset + curr_subgroup_settings.sender_rank;
+    const uint64_t skip = sst->skipped_indices[member_index][entry];
+    int32_t first = static_cast<int32_t>(skip >> 32);
+    const int32_t end = static_cast<int32_t>(skip & 0xffffffff);
+    const int32_t next_index = future_message_indices[subgroup_num];
+    // if no message was sent since the last range, it can just grow
+    if(end != next_index) {
+        for(auto sst_index : sender_flow_states[subgroup_num]->shard_sst_indices) {
+            if(sst->num_received[sst_index][entry] < end - 1) {
+                return false;
+            }
+        }
+        first = next_index;
+    }
+    gmssst::set(sst->skipped_indices[member_index][entry],
+                (static_cast<uint64_t>(first) << 32) | static_cast<uint32_t>(last_index + 1));
+    future_message_indices[subgroup_num] = last_index + 1;
+    sst->put(sender_flow_states[subgroup_num]->shard_sst_indices,
+             (char*)std::addressof(sst->skipped_indices[0][entry]) - sst->getBaseAddress(),
+             sizeof(decltype(sst->skipped_indices)::value_type));
+    return true;
+}
+
+void MulticastGroup::receive_skipped_indices(subgroup_id_t subgroup_num, const SubgroupSettings& curr_subgroup_settings,
+                                             uint32_t sender_rank, uint64_t skip) {
+    receive_plan& plan = receive_plans[subgroup_num];
+    const uint64_t received_skip = plan.received_skips[sender_rank];
+    plan.received_skips[sender_rank] = skip;
+    int32_t first = static_cast<int32_t>(skip >> 32);
+    const int32_t end = static_cast<int32_t>(skip & 0xffffffff);
+    // of a range that has grown since it was last received, only the new
+    // indices are new
+    if((received_skip >> 32) == (skip >> 32)) {
+        first = std::max(first, static_cast<int32_t>(received_skip & 0xffffffff));
+    }
+    if(first >= end) {
+        return;
+    }
+    const uint32_t entry = curr_subgroup_settings.num_received_offset + sender_rank;
+    const int32_t new_num_received = received_indices[entry].insert(first, end - first);
+    fill_null_rounds(subgroup_num, curr_subgroup_settings, sender_rank, new_num_received);
+    sst->num_received[member_index][entry] = new_num_received;
+}
+
 char* MulticastGroup::get_sendbuffer_ptr(subgroup_id_t subgroup_num,
                                          long long unsigned int payload_size,
-                                         bool cooked_send) {
+                                         bool cooked_send, uint32_t num_indices) {
     long long unsigned int msg_size = payload_size + sizeof(header);
     if(msg_size > max_msg_size) {
         std::cout << "Can't send messages of size larger than the maximum message "
@@ -1189,10 +1554,6 @@ char* MulticastGroup::get_sendbuffer_ptr(subgroup_id_t subgroup_num,
             return nullptr;
         }
 
-        if(free_message_buffers[subgroup_num].empty()) {
-            return nullptr;
-        }
-
         if(pending_sst_sends[subgroup_num] || next_sends[subgroup_num]) {
             return nullptr;
         }
@@ -1202,21 +1563,25 @@ char* MulticastGroup::get_sendbuffer_ptr(subgroup_id_t subgroup_num,
         msg.sender_id = members[member_index];
         msg.index = future_message_indices[subgroup_num];
         msg.size = msg_size;
-        msg.message_buffer = std::move(free_message_buffers[subgroup_num].back());
-        free_message_buffers[subgroup_num].pop_back();
+        msg.message_buffer = buffer_pool->acquire(subgroup_num, msg_size);
+        if(!msg.message_buffer.buffer) {
+            // every buffer large enough is in use: wait for a delivery to release one
+            return nullptr;
+        }
 
         auto current_time = get_time();
         pending_message_timestamps[subgroup_num].insert(current_time);
 
         // Fill header
-        char* buf = msg.message_buffer.buffer.get();
+        char* buf = msg.message_buffer.buffer;
         ((header*)buf)->header_size = sizeof(header);
         ((header*)buf)->index = msg.index;
         ((header*)buf)->timestamp = current_time;
         ((header*)buf)->cooked_send = cooked_send;
+        ((header*)buf)->num_indices = num_indices;
 
         next_sends[subgroup_num] = std::move(msg);
-        future_message_indices[subgroup_num]++;
+        future_message_indices[subgroup_num] += num_indices;
 
         last_transfer_medium[subgroup_num] = true;
         return buf + sizeof(header);
@@ -1242,7 +1607,8 @@ char* MulticastGroup::get_sendbuffer_ptr(subgroup_id_t subgroup_num,
         ((header*)buf)->index = future_message_indices[subgroup_num];
         ((header*)buf)->timestamp = current_time;
         ((header*)buf)->cooked_send = cooked_send;
-        future_message_indices[subgroup_num]++;
+        ((header*)buf)->num_indices = num_indices;
+        future_message_indices[subgroup_num] += num_indices;
         whenlog(logger->trace("Subgroup {}: get_sendbuffer_ptr increased future_message_indices to {}", subgroup_num, future_message_indices[subgroup_num]););
 
         last_transfer_medium[subgroup_num] = false;
@@ -1251,13 +1617,20 @@ char* MulticastGroup::get_sendbuffer_ptr(subgroup_id_t subgroup_num,
 }
 
 bool MulticastGroup::send(subgroup_id_t subgroup_num, long long unsigned int payload_size,
-                          const std::function<void(char* buf)>& msg_generator, bool cooked_send) {
+                          const std::function<void(char* buf)>& msg_generator, bool cooked_send,
+                          uint32_t num_indices) {
     if(!rdmc_sst_groups_created) {
         return false;
     }
+    // UNORDERED mode delivers every index as a message, and has no versions
+    // to give the parts of a message
+    assert(num_indices == 1 || (cooked_send && num_indices > 1));
+    if(subgroup_settings.at(subgroup_num).mode == Mode::UNORDERED) {
+        num_indices = 1;
+    }
     std::unique_lock<std::mutex> lock(msg_state_mtx);
 
-    char* buf = get_sendbuffer_ptr(subgroup_num, payload_size, cooked_send);
+    char* buf = get_sendbuffer_ptr(subgroup_num, payload_size, cooked_send, num_indices);
     while(!buf) {
         // Don't want any deadlocks. For example, this thread cannot get a buffer because delivery is lagging
         // but the SST detect thread cannot proceed (and deliver) because it requires the same lock
@@ -1268,7 +1641,7 @@ bool MulticastGroup::send(subgroup_id_t subgroup_num, long long unsigned int pay
             return false;
         }
         lock.lock();
-        buf = get_sendbuffer_ptr(subgroup_num, payload_size, cooked_send);
+        buf = get_sendbuffer_ptr(subgroup_num, payload_size, cooked_send, num_indices);
     }
 
     // call to the user supplied message generator
@@ -1278,7 +1651,7 @@ bool MulticastGroup::send(subgroup_id_t subgroup_num, long long unsigned int pay
         assert(next_sends[subgroup_num]);
         pending_sends[subgroup_num].push(std::move(*next_sends[subgroup_num]));
         next_sends[subgroup_num] = std::nullopt;
-        sender_cv.notify_all();
+        notify_sender_lane(subgroup_num);
         return true;
     } else {
         sst_multicast_group_ptrs[subgroup_num]->send();
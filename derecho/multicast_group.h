@@ -2,6 +2,7 @@
 
 #include <assert.h>
 #include <condition_variable>
+#include <deque>
 #include <functional>
 #include <list>
 #include <map>
@@ -19,6 +20,7 @@
 #include "derecho_internal.h"
 #include "derecho_modes.h"
 #include "derecho_sst.h"
+#include "message_buffer_pool.h"
 #include "mutils-serialization/SerializationMacros.hpp"
 #include "mutils-serialization/SerializationSupport.hpp"
 #include "rdmc/rdmc.h"
@@ -106,29 +108,11 @@ struct __attribute__((__packed__)) header {
     int32_t index;
     uint64_t timestamp;
     bool cooked_send;
-};
-
-/**
- * Represents a block of memory used to store a message. This object contains
- * both the array of bytes in which the message is stored and the corresponding
- * RDMA memory region (which has registered that array of bytes as its buffer).
- * This is a move-only type, since memory regions can't be copied.
- */
-struct MessageBuffer {
-    std::unique_ptr<char[]> buffer;
-    std::shared_ptr<rdma::memory_region> mr;
-
-    MessageBuffer() {}
-    MessageBuffer(size_t size) {
-        if(size != 0) {
-            buffer = std::unique_ptr<char[]>(new char[size]);
-            mr = std::make_shared<rdma::memory_region>(buffer.get(), size);
-        }
-    }
-    MessageBuffer(const MessageBuffer&) = delete;
-    MessageBuffer(MessageBuffer&&) = default;
-    MessageBuffer& operator=(const MessageBuffer&) = delete;
-    MessageBuffer& operator=(MessageBuffer&&) = default;
+    /** The number of consecutive indices, starting at index, that the message
+     * uses. A message that uses more than one is a batch of RPC invocations
+     * that each need their own version; invocation i is delivered as the
+     * message of index + i. */
+    uint32_t num_indices;
 };
 
 /**
@@ -182,6 +166,29 @@ struct SubgroupSettings {
     Mode mode;
 };
 
+/**
+ * Tracks the indices of the messages received from one sender, which can
+ * arrive out of order since some come through RDMC and others through SST,
+ * and finds up to which index all of them have been received. Only the
+ * indices past that point are kept, as a bitmap.
+ */
+class ReceivedIndices {
+    /** Every index up to this one has been received */
+    int32_t last_in_order = -1;
+    /** Bit i of word j is set if index first_index + 64 * j + i has been received */
+    std::deque<uint64_t> bits;
+    /** The index of bit 0 of the first word, a multiple of 64 */
+    int32_t first_index = 0;
+
+public:
+    /**
+     * Records that the count indices starting at this one have been received,
+     * which is one index unless a message uses several.
+     * @return the index up to which all messages have been received
+     */
+    int32_t insert(int32_t index, uint32_t count = 1);
+};
+
 /** Implements the low-level mechanics of tracking multicasts in a Derecho group,
  * using RDMC to deliver messages and SST to track their arrival and stability.
  * This class should only be used as part of a Group, since it does not know how
@@ -212,6 +219,9 @@ public:
      *  Binomial pipeline by default. */
     const rdmc::send_algorithm rdmc_send_algorithm;
     const unsigned int window_size;
+    /** Maximum number of RDMC messages this node has in flight in a subgroup,
+     * at most window_size. */
+    const unsigned int rdmc_send_depth;
 
 private:
     /** Message-delivery event callbacks, supplied by the client, for "raw" sends */
@@ -220,8 +230,8 @@ private:
     /** Maps subgroup IDs (for subgroups this node is a member of) to an immutable
      * set of configuration options for that subgroup. */
     const std::map<subgroup_id_t, SubgroupSettings> subgroup_settings;
-    /** Used for synchronizing receives by RDMC and SST */
-    std::vector<std::list<int32_t>> received_intervals;
+    /** Used for synchronizing receives by RDMC and SST, indexed like num_received */
+    std::vector<ReceivedIndices> received_indices;
     /** Maps subgroup IDs for which this node is a sender to the RDMC group it should use to send.
      * Constructed incrementally in create_rdmc_sst_groups(), so it can't be const.  */
     std::map<subgroup_id_t, uint32_t> subgroup_to_rdmc_group;
@@ -232,9 +242,9 @@ private:
     uint16_t rdmc_group_num_offset;
     /** false if RDMC groups haven't been created successfully */
     bool rdmc_sst_groups_created = false;
-    /** Stores message buffers not currently in use. Protected by
-     * msg_state_mtx */
-    std::map<uint32_t, std::vector<MessageBuffer>> free_message_buffers;
+    /** The pool message buffers are taken from, shared with the
+     * MulticastGroups of earlier and later views. */
+    std::shared_ptr<MessageBufferPool> buffer_pool;
 
     /** Index to be used the next time get_sendbuffer_ptr is called.
      * When next_message is not none, then next_message.index = future_message_index-1 */
@@ -246,9 +256,9 @@ private:
     std::map<uint32_t, bool> pending_sst_sends;
     /** Messages that are ready to be sent, but must wait until the current send finishes. */
     std::vector<std::queue<RDMCMessage>> pending_sends;
-    /** Vector of messages that are currently being sent out using RDMC, or boost::none otherwise. */
-    /** one per subgroup */
-    std::vector<std::optional<RDMCMessage>> current_sends;
+    /** Messages that are currently being sent out using RDMC, oldest first;
+     * one queue per subgroup, holding at most rdmc_send_depth messages. */
+    std::vector<std::deque<RDMCMessage>> current_sends;
 
     /** Messages that are currently being received. */
     std::map<std::pair<subgroup_id_t, node_id_t>, RDMCMessage> current_receives;
@@ -266,16 +276,100 @@ private:
     std::map<subgroup_id_t, std::map<message_id_t, SSTMessage>> non_persistent_sst_messages;
 
     std::vector<message_id_t> next_message_to_deliver;
+    /** The sequence number up to which delivery_trigger has taken the stable
+     * messages of each subgroup; delivered_num reaches it once they have
+     * been delivered. Indices skipped by their senders have no message. */
+    std::vector<message_id_t> last_stable_seq_nums;
     std::mutex msg_state_mtx;
-    std::condition_variable sender_cv;
 
     /** The time, in milliseconds, that a sender can wait to send a message before it is considered failed. */
     unsigned int sender_timeout;
 
     /** Indicates that the group is being destroyed. */
     std::atomic<bool> thread_shutdown{false};
-    /** The background thread that sends messages with RDMC. */
-    std::thread sender_thread;
+    /**
+     * The flow-control parameters of a subgroup this node sends in, looked up
+     * once per view instead of on every check of whether it can send.
+     */
+    struct sender_flow_state {
+        int shard_sender_index;
+        uint32_t num_shard_senders;
+        uint32_t num_received_offset;
+        Mode mode;
+        /** The SST row of each member of this node's shard */
+        std::vector<uint32_t> shard_sst_indices;
+        /** How many messages in a row the subgroup may send before its
+         * sender lane moves on to another subgroup */
+        uint32_t weight;
+    };
+    /** Indexed by subgroup ID; empty for subgroups this node does not send in. */
+    std::vector<std::optional<sender_flow_state>> sender_flow_states;
+
+    /**
+     * A background thread that sends messages with RDMC for a fixed set of
+     * subgroups, and the condition variable (used with msg_state_mtx) that
+     * wakes it up when one of them might be able to send.
+     */
+    struct sender_lane {
+        std::thread thread;
+        std::condition_variable cv;
+        std::vector<subgroup_id_t> subgroups;
+    };
+    std::vector<std::unique_ptr<sender_lane>> sender_lanes;
+    /** The index of each subgroup's lane in sender_lanes, indexed by subgroup ID. */
+    std::vector<uint32_t> subgroup_to_sender_lane;
+
+    /**
+     * A stable message taken out of locally_stable_rdmc_messages or
+     * locally_stable_sst_messages to be delivered, with the version assigned
+     * to it. An SST message that is handed to a delivery worker is copied,
+     * since its SST slot may be reused before the worker gets to it.
+     */
+    struct delivery_item {
+        persistent::version_t version;
+        std::optional<RDMCMessage> rdmc_msg;
+        SSTMessage sst_msg;
+        std::vector<char> sst_msg_copy;
+        /** For a message that uses several indices, the message itself, shared
+         * by the items that deliver each of its parts; the item's own message
+         * fields are then unused. */
+        std::shared_ptr<delivery_item> multi_index_msg;
+        /** Which of the indices of multi_index_msg this item delivers */
+        uint32_t part;
+    };
+    /**
+     * The parts that remain to be delivered of messages that use several
+     * indices, whose first part has been taken by take_stable_message.
+     * Organized by [subgroup number] -> [sequence number] -> [message, part]
+     */
+    std::map<subgroup_id_t, std::map<message_id_t, std::pair<std::shared_ptr<delivery_item>, uint32_t>>> locally_stable_message_parts;
+    /** Consecutive stable messages of one subgroup, in delivery order, and
+     * the sequence number delivered_num is set to once they are delivered. */
+    struct delivery_batch {
+        subgroup_id_t subgroup_num;
+        message_id_t last_seq_num;
+        std::vector<delivery_item> items;
+    };
+    /**
+     * A background thread that delivers the stable messages of a fixed set of
+     * subgroups, so that upcalls don't run on the SST predicate thread. The
+     * batches are queued under its own mutex, not msg_state_mtx.
+     */
+    struct delivery_worker {
+        std::thread thread;
+        std::mutex mtx;
+        std::condition_variable cv;
+        std::deque<delivery_batch> batches;
+        bool shutdown = false;
+    };
+    /** Empty if messages are delivered by the predicate thread */
+    std::vector<std::unique_ptr<delivery_worker>> delivery_workers;
+    /** The index of each subgroup's worker in delivery_workers, indexed by subgroup ID. */
+    std::vector<uint32_t> subgroup_to_delivery_worker;
+    /** Set under msg_state_mtx by wedge(). After that, no more batches are
+     * handed to the delivery workers; the ragged edge cleanup delivers the
+     * remaining stable messages. */
+    bool delivery_workers_stopped = false;
 
     std::thread timeout_thread;
 
@@ -285,6 +379,36 @@ private:
     /** The SSTs for multicasts **/
     std::vector<std::unique_ptr<sst::multicast_group<DerechoSST>>> sst_multicast_group_ptrs;
 
+    /**
+     * Where the receive predicate and trigger of a subgroup find each
+     * sender's SMC messages, computed once per view so that checking for new
+     * messages takes a few loads and no map lookups. Indexed by sender rank.
+     */
+    struct receive_plan {
+        uint32_t num_senders;
+        /** The node ID of each sender */
+        std::vector<node_id_t> sender_ids;
+        /** The subgroup's first slot in each sender's row of the SST */
+        std::vector<volatile char*> sender_slots;
+        /** This node's num_received_sst entries for the subgroup's senders */
+        volatile int32_t* num_received_sst;
+        /** The skipped_indices entry of each sender, in its own row */
+        std::vector<volatile uint64_t*> sender_skips;
+        /** The value of each sender's skipped_indices entry last received */
+        std::vector<uint64_t> received_skips;
+        /** The size of a slot, including its size and next_seq words */
+        uint64_t slot_size;
+
+        volatile char* slot(uint32_t sender_rank, uint32_t slot_index) const {
+            return sender_slots[sender_rank] + slot_size * slot_index;
+        }
+        uint64_t next_seq(uint32_t sender_rank, uint32_t slot_index) const {
+            return *(volatile uint64_t*)(slot(sender_rank, slot_index + 1) - sizeof(uint64_t));
+        }
+    };
+    /** Indexed by subgroup ID; empty for subgroups this node is not a member of */
+    std::vector<receive_plan> receive_plans;
+
     using pred_handle = typename sst::Predicates<DerechoSST>::pred_handle;
     std::list<pred_handle> receiver_pred_handles;
     std::list<pred_handle> stability_pred_handles;
@@ -301,9 +425,56 @@ private:
     /** persistence manager callbacks */
     persistence_manager_callbacks_t persistence_manager_callbacks;
 
-    /** Continuously waits for a new pending send, then sends it. This function
-     * implements the sender thread. */
-    void send_loop();
+    /** Continuously waits for a new pending send in one of the lane's
+     * subgroups, then sends it. This function implements a sender lane. */
+    void send_loop(uint32_t lane_index);
+
+    /** Computes sender_flow_states and assigns the subgroups this node
+     * sends in to sender lanes, according to the configured lane count and
+     * subgroup weights. */
+    void initialize_sender_lanes();
+
+    /** Starts the thread of every sender lane. */
+    void start_sender_lanes();
+
+    /** Wakes up the sender lane of a subgroup. Call with msg_state_mtx held
+     * or right after changing state protected by it. */
+    void notify_sender_lane(subgroup_id_t subgroup_num);
+
+    /** Assigns the ordered subgroups to delivery workers, according to the
+     * configured number of delivery threads, and starts the workers. */
+    void initialize_delivery_workers();
+
+    /** Delivers the batches queued for a delivery worker, in order, until
+     * it is shut down. This function implements a delivery worker. */
+    void delivery_loop(uint32_t worker_index);
+
+    /** Stops the delivery workers once they have delivered every batch
+     * queued for them, and waits for them. */
+    void stop_delivery_workers();
+
+    /**
+     * Removes a stable message from locally_stable_rdmc_messages or
+     * locally_stable_sst_messages, or a part of one from
+     * locally_stable_message_parts, to be delivered. The first part of a
+     * message that uses several indices registers its other parts (and
+     * always copies an SST message, whose slot is reused before they are
+     * delivered). Call with msg_state_mtx held.
+     * @param subgroup_num The ID of the subgroup the message is in
+     * @param seq_num The sequence number of the message
+     * @param version The version assigned to the message
+     * @param copy_sst_message Whether to copy an SST message out of its slot
+     */
+    delivery_item take_stable_message(subgroup_id_t subgroup_num, message_id_t seq_num,
+                                      persistent::version_t version, bool copy_sst_message);
+
+    /**
+     * Delivers and versions the messages of a batch, releases their buffers
+     * (that of a message that uses several indices after its last part),
+     * advances this node's delivered_num and posts a persistence request. It
+     * does not push delivered_num to the other members.
+     */
+    void deliver_batch(delivery_batch& batch);
 
     uint64_t get_time();
 
@@ -311,6 +482,13 @@ private:
      * implements the timeout thread. */
     void check_failures_loop();
 
+    /**
+     * Tells the message buffer pool how many messages can be in flight in
+     * this view, so that it registers its initial buffers before any message
+     * can be received and knows how far it may grow.
+     */
+    void reserve_message_buffers();
+
     bool create_rdmc_sst_groups();
     void initialize_sst_row();
     void register_predicates();
@@ -321,15 +499,19 @@ private:
      * @param msg A reference to the message
      * @param subgroup_num The ID of the subgroup this message is in
      * @param version The version assigned to the message
+     * @param part For a message that uses several indices, the one of its
+     * RPC invocations to deliver; -1 to deliver the whole message
      */
-    void deliver_message(RDMCMessage& msg, subgroup_id_t subgroup_num, persistent::version_t version);
+    void deliver_message(RDMCMessage& msg, subgroup_id_t subgroup_num, persistent::version_t version, int32_t part = -1);
     /**
      * Same as the other deliver_message, but for the SSTMessage type
      * @param msg A reference to the message to deliver
      * @param subgroup_num The ID of the subgroup this message is in
      * @param version The version assigned to the message
+     * @param part For a message that uses several indices, the one of its
+     * RPC invocations to deliver; -1 to deliver the whole message
      */
-    void deliver_message(SSTMessage& msg, subgroup_id_t subgroup_num, persistent::version_t version);
+    void deliver_message(SSTMessage& msg, subgroup_id_t subgroup_num, persistent::version_t version, int32_t part = -1);
 
     /**
      * Enqueues a single message for persistence with the persistence manager.
@@ -364,7 +546,6 @@ private:
         return num;
     };
 
-    int32_t resolve_num_received(int32_t index, uint32_t num_received_entry);
 
     /* Predicate functions for receiving and delivering messages, parameterized by subgroup.
      * register_predicates will create and bind one of these for each subgroup. */
@@ -388,9 +569,35 @@ private:
 
     // Internally used to automatically send a NULL message
     void get_buffer_and_send_auto_null(subgroup_id_t subgroup_num);
+
+    /**
+     * The null-send scheme: after receiving up to index new_num_received from
+     * another sender, makes sure this node has used all its message indices of
+     * the rounds that must be delivered before that message, so that an idle
+     * sender does not hold up delivery. The indices are skipped if possible,
+     * and filled with null messages otherwise. Call with msg_state_mtx held.
+     */
+    void fill_null_rounds(subgroup_id_t subgroup_num, const SubgroupSettings& curr_subgroup_settings,
+                          uint32_t sender_rank, int32_t new_num_received);
+
+    /**
+     * Skips this node's message indices in a subgroup up to last_index by
+     * advertising them in its skipped_indices entry, which takes one SST
+     * write however many indices are skipped. A new range of indices can only
+     * replace the previous one once every shard member has received it.
+     * @return false if the indices could not be skipped yet
+     */
+    bool skip_indices_upto(subgroup_id_t subgroup_num, const SubgroupSettings& curr_subgroup_settings,
+                           int32_t last_index);
+
+    /** Marks the indices a sender skipped as received, when its
+     * skipped_indices entry changes. Call with msg_state_mtx held. */
+    void receive_skipped_indices(subgroup_id_t subgroup_num, const SubgroupSettings& curr_subgroup_settings,
+                                 uint32_t sender_rank, uint64_t skip);
     /* Get a pointer into the current buffer, to write data into it before sending
      * Now this is a private function, called by send internally */
-    char* get_sendbuffer_ptr(subgroup_id_t subgroup_num, long long unsigned int payload_size, bool cooked_send);
+    char* get_sendbuffer_ptr(subgroup_id_t subgroup_num, long long unsigned int payload_size, bool cooked_send,
+                             uint32_t num_indices);
 
 public:
     /**
@@ -445,9 +652,13 @@ public:
 
     void deliver_messages_upto(const std::vector<int32_t>& max_indices_for_senders, subgroup_id_t subgroup_num, uint32_t num_shard_senders);
     /** Send now internally calls get_sendbuffer_ptr.
-	The user function that generates the message is supplied to send */
+	The user function that generates the message is supplied to send.
+	A cooked send of several RPC invocations can give each its own message
+	index, and so its own version, with num_indices equal to the number of
+	invocations; this is ignored in UNORDERED mode, which has no versions. */
     bool send(subgroup_id_t subgroup_num, long long unsigned int payload_size,
-              const std::function<void(char* buf)>& msg_generator, bool cooked_send);
+              const std::function<void(char* buf)>& msg_generator, bool cooked_send,
+              uint32_t num_indices = 1);
     bool check_pending_sst_sends(subgroup_id_t subgroup_num);
 
     const uint64_t compute_global_stability_frontier(subgroup_id_t subgroup_num);
@@ -461,6 +672,16 @@ public:
             const long long unsigned int block_size,
             bool using_rdmc);
 
+    /** @return The number of bytes of message buffers in use by each subgroup. */
+    std::map<subgroup_id_t, uint64_t> get_message_buffer_usage() const {
+        return buffer_pool->get_bytes_in_use();
+    }
+
+    /** @return The total amount of memory registered for message buffers. */
+    uint64_t get_registered_message_buffer_bytes() const {
+        return buffer_pool->get_registered_bytes();
+    }
+
     /**
      * @return a map from subgroup ID to SubgroupSettings for only those subgroups
      * that this node belongs to.
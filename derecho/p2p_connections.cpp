@@ -204,15 +204,28 @@ char* P2PConnections::probe(uint32_t rank) {
     return nullptr;
 }
 
-// check if there's a new request from any node
-std::optional<std::pair<uint32_t, char*>> P2PConnections::probe_all() {
-    for(uint rank = 0; rank < num_members; ++rank) {
-        auto buf = probe(rank);
-        if(buf) {
-            return std::pair<uint32_t, char*>(members[rank], buf);
+// collect the new requests from all nodes
+uint32_t P2PConnections::probe_all(std::vector<std::pair<uint32_t, char*>>& ready_msgs) {
+    const uint32_t start_rank = next_probe_rank;
+    next_probe_rank = (next_probe_rank + 1) % num_members;
+    uint32_t num_ready = 0;
+    // each member has at most 4 * window_size unread slots
+    for(uint32_t round = 0; round < 4 * window_size; ++round) {
+        uint32_t num_ready_in_round = 0;
+        for(uint32_t i = 0; i < num_members; ++i) {
+            const uint32_t rank = (start_rank + i) % num_members;
+            auto buf = probe(rank);
+            if(buf) {
+                ready_msgs.emplace_back(members[rank], buf);
+                num_ready_in_round++;
+            }
+        }
+        if(num_ready_in_round == 0) {
+            break;
         }
+        num_ready += num_ready_in_round;
     }
-    return {};
+    return num_ready;
 }
 
 char* P2PConnections::get_sendbuffer_ptr(uint32_t rank, REQUEST_TYPE type) {
@@ -51,6 +51,8 @@ class P2PConnections {
     uint64_t getOffsetBuf(REQUEST_TYPE type, uint64_t& seq_num);
     uint64_t getOffsetBufNoIncrement(REQUEST_TYPE type, uint64_t seq_num);
     char* probe(uint32_t rank);
+    /** The rank probe_all() starts from; rotated on every call for fairness. */
+    uint32_t next_probe_rank = 0;
     uint32_t num_rdma_writes = 0;
     void check_failures_loop();
 
@@ -61,7 +63,14 @@ public:
     void shutdown_failures_thread();
     uint32_t get_node_rank(uint32_t node_id);
     uint64_t get_max_p2p_size();
-    std::optional<std::pair<uint32_t, char*>> probe_all();
+    /**
+     * Collects every message that has arrived from any member into
+     * ready_msgs, as (sender node ID, buffer) pairs. Members are visited
+     * round-robin, one message at a time, starting from a different member on
+     * each call, so a busy sender cannot starve the others.
+     * @return The number of messages appended to ready_msgs.
+     */
+    uint32_t probe_all(std::vector<std::pair<uint32_t, char*>>& ready_msgs);
     char* get_sendbuffer_ptr(uint32_t rank, REQUEST_TYPE type);
     void send(uint32_t rank);
 };
@@ -16,12 +16,12 @@ PersistenceManager::PersistenceManager(
         : whenlog(logger(LoggerFactory::getDefaultLogger()), )
           thread_shutdown(false),
           persistence_callback(_persistence_callback),
-          ptr_objects_by_subgroup_id(pro) {
-    // initialize semaphore
-    if(sem_init(&persistence_request_sem, 1, 0) != 0) {
-        throw derecho_exception("Cannot initialize persistent_request_sem:errno=" + std::to_string(errno));
-    }
-}
+          ptr_objects_by_subgroup_id(pro),
+          view_manager(nullptr),
+          trim_interval_ms(getConfUInt64(CONF_PERS_TRIM_INTERVAL_MS)),
+          default_retention_policy{getConfUInt64(CONF_PERS_RETAIN_VERSIONS),
+                                   getConfUInt64(CONF_PERS_RETAIN_SECONDS),
+                                   getConfUInt64(CONF_PERS_RETAIN_PERSISTED_MARGIN)} {}
 
 /** default Constructor
  */
@@ -30,9 +30,7 @@ PersistenceManager(nullptr, _persistence_callback) {}
 
 /** default Destructor
  */
-PersistenceManager::~PersistenceManager() {
-    sem_destroy(&persistence_request_sem);
-}
+PersistenceManager::~PersistenceManager() {}
 
 /**
  * Set the 'objects_by_subgroup_id' in case we can't get the replicated_object
@@ -46,78 +44,102 @@ void PersistenceManager::set_view_manager(ViewManager& view_manager) {
     this->view_manager = &view_manager;
 }
 
-/** Start the persistent thread. */
+/** Start the persistent threads. */
 void PersistenceManager::start() {
     //skip for raw subgroups -- NO, DON'T
     // if(replicated_objects == nullptr) return;
 
-    this->persist_thread = std::thread{[this]() {
-        do {
-            // wait for semaphore
-            sem_wait(&persistence_request_sem);
-            while(prq_lock.test_and_set(std::memory_order_acquire))  // acquire lock
-                ;                                                    // spin
-            if(this->persistence_request_queue.empty()) {
-                prq_lock.clear(std::memory_order_release);  // release lock
-                if(this->thread_shutdown) {
-                    break;
-                }
-                continue;
-            }
+    const uint64_t num_threads = std::max<uint64_t>(getConfUInt64(CONF_PERS_PERSIST_THREADS), 1);
+    for(uint64_t i = 0; i < num_threads; i++) {
+        this->persist_threads.emplace_back([this]() { persist_loop(); });
+    }
 
-            subgroup_id_t subgroup_id = std::get<0>(persistence_request_queue.front());
-            persistent::version_t version = std::get<1>(persistence_request_queue.front());
-            persistence_request_queue.pop();
-            prq_lock.clear(std::memory_order_release);  // release lock
-
-            // persist
-            try {
-                auto search = ptr_objects_by_subgroup_id->find(subgroup_id);
-                if(search != ptr_objects_by_subgroup_id->end()) {
-                    search->second.get().persist(version);
-                }
-                // read lock the view
-                std::shared_lock<std::shared_timed_mutex> read_lock(view_manager->view_mutex);
-                // update the persisted_num in SST
-
-                View& Vc = *view_manager->curr_view;
-                Vc.gmsSST->persisted_num[Vc.gmsSST->get_local_index()][subgroup_id] = version;
-                Vc.gmsSST->put(Vc.multicast_group->get_shard_sst_indices(subgroup_id),
-                               (char*)std::addressof(Vc.gmsSST->persisted_num[0][subgroup_id]) - Vc.gmsSST->getBaseAddress(),
-                               sizeof(long long int));
-            } catch(uint64_t exp) {
-                whenlog(logger->debug("exception on persist():subgroup={},ver={},exp={}.", subgroup_id, version, exp););
-                std::cout
-                        << "exception on persistent:subgroup=" << subgroup_id << ",ver=" << version << "exception=0x" << std::hex << exp << std::endl;
+    if(trim_interval_ms > 0) {
+        this->trim_thread = std::thread{[this]() {
+            std::unique_lock<std::mutex> lock(trim_mutex);
+            while(!trim_thread_cv.wait_for(lock, std::chrono::milliseconds(trim_interval_ms),
+                                           [this]() { return this->thread_shutdown.load(); })) {
+                lock.unlock();
+                trim_logs();
+                lock.lock();
             }
+        }};
+    }
+}
 
-            // callback
-            if(this->persistence_callback != nullptr) {
-                this->persistence_callback(subgroup_id, version);
-            }
+void PersistenceManager::persist_loop() {
+    std::unique_lock<std::mutex> lock(persistence_request_mutex);
+    while(true) {
+        persistence_request_cv.wait(lock, [this]() { return this->thread_shutdown || !this->ready_subgroups.empty(); });
+        if(ready_subgroups.empty()) {
+            // shutdown, and every request is taken. A busy subgroup is
+            // persisted again by its own thread if it has a new request.
+            break;
+        }
+        // Take the latest version requested for the subgroup: persisting a
+        // subgroup makes all of its versions made so far durable, so the
+        // requests posted before are persisted together.
+        const subgroup_id_t subgroup_id = ready_subgroups.front();
+        ready_subgroups.pop_front();
+        auto pending = pending_versions.find(subgroup_id);
+        const persistent::version_t version = pending->second;
+        pending_versions.erase(pending);
+        busy_subgroups.insert(subgroup_id);
+        lock.unlock();
 
-            if(this->thread_shutdown) {
-                while(prq_lock.test_and_set(std::memory_order_acquire))  // acquire lock
-                    ;                                                    // spin
-                if(persistence_request_queue.empty()) {
-                    prq_lock.clear(std::memory_order_release);  // release lock
-                    break;                                      // finish
-                }
-                prq_lock.clear(std::memory_order_release);  // release lock
-            }
-        } while(true);
-    }};
+        persist_subgroup(subgroup_id, version);
+
+        lock.lock();
+        busy_subgroups.erase(subgroup_id);
+        // requests posted meanwhile were held back to keep the order of the
+        // versions reported for the subgroup.
+        if(pending_versions.find(subgroup_id) != pending_versions.end()) {
+            ready_subgroups.push_back(subgroup_id);
+            persistence_request_cv.notify_one();
+        }
+    }
+}
+
+void PersistenceManager::persist_subgroup(const subgroup_id_t& subgroup_id, const persistent::version_t& version) {
+    // persist
+    try {
+        auto search = ptr_objects_by_subgroup_id->find(subgroup_id);
+        if(search != ptr_objects_by_subgroup_id->end()) {
+            search->second.get().persist(version);
+        }
+        // read lock the view
+        std::shared_lock<std::shared_timed_mutex> read_lock(view_manager->view_mutex);
+        // update the persisted_num in SST
+
+        View& Vc = *view_manager->curr_view;
+        Vc.gmsSST->persisted_num[Vc.gmsSST->get_local_index()][subgroup_id] = version;
+        Vc.gmsSST->put(Vc.multicast_group->get_shard_sst_indices(subgroup_id),
+                       (char*)std::addressof(Vc.gmsSST->persisted_num[0][subgroup_id]) - Vc.gmsSST->getBaseAddress(),
+                       sizeof(long long int));
+    } catch(persistent::persist_exception_t exp) {
+        whenlog(logger->error("exception on persist():subgroup={},ver={},exp={:#x}.", subgroup_id, version, exp););
+    }
+
+    // callback
+    if(this->persistence_callback != nullptr) {
+        this->persistence_callback(subgroup_id, version);
+    }
 }
 
 /** post a persistence request */
 void PersistenceManager::post_persist_request(const subgroup_id_t& subgroup_id, const persistent::version_t& version) {
-    // request enqueue
-    while(prq_lock.test_and_set(std::memory_order_acquire))  // acquire lock
-        ;                                                    // spin
-    persistence_request_queue.push(std::make_tuple(subgroup_id, version));
-    prq_lock.clear(std::memory_order_release);  // release lock
-    // post semaphore
-    sem_post(&persistence_request_sem);
+    std::lock_guard<std::mutex> lock(persistence_request_mutex);
+    auto pending = pending_versions.emplace(subgroup_id, version);
+    if(!pending.second) {
+        // coalesce with the pending request
+        pending.first->second = std::max(pending.first->second, version);
+        return;
+    }
+    // a busy subgroup is queued again by its thread when it is done.
+    if(busy_subgroups.find(subgroup_id) == busy_subgroups.end()) {
+        ready_subgroups.push_back(subgroup_id);
+        persistence_request_cv.notify_one();
+    }
 }
 
 /** make a version */
@@ -127,19 +149,136 @@ void PersistenceManager::make_version(const subgroup_id_t& subgroup_id,
     if(search != ptr_objects_by_subgroup_id->end()) {
         search->second.get().make_version(version, mhlc);
     }
+    if(trim_interval_ms > 0) {
+        std::lock_guard<std::mutex> lock(trim_mutex);
+        auto& history = version_histories.try_emplace(subgroup_id, VersionHistory{default_retention_policy, {}}).first->second;
+        // versions after a truncation are made again
+        while(!history.versions.empty() && history.versions.back().first >= version) {
+            history.versions.pop_back();
+        }
+        history.versions.emplace_back(version, mhlc.m_rtc_us);
+    }
+}
+
+void PersistenceManager::set_retention_policy(const subgroup_id_t& subgroup_id, const RetentionPolicy& policy) {
+    std::lock_guard<std::mutex> lock(trim_mutex);
+    version_histories.try_emplace(subgroup_id, VersionHistory{policy, {}}).first->second.policy = policy;
 }
 
-/** shutdown the thread 
- * @wait - wait till the thread finished or not.
+size_t VersionHistory::versions_to_trim(const persistent::version_t& persisted_frontier,
+                                        const uint64_t& now_us) const {
+    // only what the whole shard has persisted, but persisted_margin versions
+    size_t n = std::upper_bound(versions.begin(), versions.end(), persisted_frontier,
+                                [](const persistent::version_t& v, const auto& entry) { return v < entry.first; })
+               - versions.begin();
+    n -= std::min<size_t>(n, policy.persisted_margin);
+    // but the latest versions
+    n = std::min<size_t>(n, versions.size() - std::min<size_t>(versions.size(), std::max<uint64_t>(policy.versions, 1)));
+    // but the last seconds of history
+    if(policy.seconds > 0) {
+        const uint64_t keep_after_us = now_us - std::min<uint64_t>(now_us, policy.seconds * 1000000);
+        size_t old = 0;
+        while(old < n && versions[old].second < keep_after_us) {
+            old++;
+        }
+        n = old;
+    }
+    return n;
+}
+
+void PersistenceManager::trim_logs() {
+    if(view_manager == nullptr || ptr_objects_by_subgroup_id == nullptr) {
+        return;
+    }
+    std::vector<subgroup_id_t> subgroup_ids;
+    {
+        std::lock_guard<std::mutex> lock(trim_mutex);
+        for(const auto& history : version_histories) {
+            subgroup_ids.push_back(history.first);
+        }
+    }
+    const uint64_t now_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                                    std::chrono::system_clock::now().time_since_epoch())
+                                    .count();
+    for(const subgroup_id_t& subgroup_id : subgroup_ids) {
+        // read lock the view, so that the object and the shard do not change
+        // while the subgroup is trimmed. It is taken for one subgroup at a
+        // time: a view change waits for a single trim at most.
+        std::shared_lock<std::shared_timed_mutex> read_lock(view_manager->view_mutex);
+        View& Vc = *view_manager->curr_view;
+        auto search = ptr_objects_by_subgroup_id->find(subgroup_id);
+        if(search == ptr_objects_by_subgroup_id->end() || !search->second.get().is_persistent()
+           || Vc.my_subgroups.find(subgroup_id) == Vc.my_subgroups.end()) {
+            continue;
+        }
+        // the persistence frontier of the shard
+        persistent::version_t persisted_frontier = INVALID_VERSION;
+        bool first = true;
+        for(const uint32_t row : Vc.multicast_group->get_shard_sst_indices(subgroup_id)) {
+            persistent::version_t persisted = Vc.gmsSST->persisted_num[row][subgroup_id];
+            persisted_frontier = first ? persisted : std::min(persisted_frontier, persisted);
+            first = false;
+        }
+        if(first) {
+            continue;
+        }
+
+        persistent::version_t trim_version;
+        {
+            std::lock_guard<std::mutex> lock(trim_mutex);
+            const VersionHistory& history = version_histories.at(subgroup_id);
+            size_t n = history.versions_to_trim(persisted_frontier, now_us);
+            if(n == 0) {
+                continue;
+            }
+            trim_version = history.versions[n - 1].first;
+        }
+        // trim() takes the lock of each log, and appends wait only for that
+        try {
+            search->second.get().trim(trim_version);
+            whenlog(logger->debug("trimmed the logs of subgroup {} to version {}.", subgroup_id, trim_version););
+        } catch(persistent::persist_exception_t exp) {
+            whenlog(logger->error("exception on trim():subgroup={},ver={},exp={:#x}.", subgroup_id, trim_version, exp););
+            continue;
+        }
+        // the versions are only forgotten once they are trimmed, so that a
+        // failed trim is retried. Versions may have been made or truncated
+        // meanwhile.
+        std::lock_guard<std::mutex> lock(trim_mutex);
+        auto& versions = version_histories.at(subgroup_id).versions;
+        while(!versions.empty() && versions.front().first <= trim_version) {
+            versions.pop_front();
+        }
+    }
+}
+
+/** shutdown the threads
+ * @wait - wait till the threads finished or not.
  */
 void PersistenceManager::shutdown(bool wait) {
     // if(replicated_objects == nullptr) return;  //skip for raw subgroups - NO DON'T
 
-    thread_shutdown = true;
-    sem_post(&persistence_request_sem);  // kick the persistence thread in case it is sleeping
+    {
+        std::scoped_lock lock(persistence_request_mutex, trim_mutex);
+        thread_shutdown = true;
+    }
+    persistence_request_cv.notify_all();  // kick the persistence threads in case they are sleeping
+    trim_thread_cv.notify_all();
 
     if(wait) {
-        this->persist_thread.join();
+        for(auto& persist_thread : this->persist_threads) {
+            persist_thread.join();
+        }
+        if(this->trim_thread.joinable()) {
+            this->trim_thread.join();
+        }
+    } else {
+        for(auto& persist_thread : this->persist_threads) {
+            persist_thread.detach();
+        }
+        if(this->trim_thread.joinable()) {
+            this->trim_thread.detach();
+        }
     }
 }
 
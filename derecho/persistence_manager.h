@@ -5,12 +5,19 @@
  */
 #pragma once
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <errno.h>
-#include <queue>
-#include <semaphore.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
 #include <thread>
+#include <tuple>
+#include <vector>
 
 #include "derecho_internal.h"
 #include "replicated.h"
@@ -20,10 +27,40 @@
 
 namespace derecho {
 
-using persistence_request_t = std::tuple<subgroup_id_t, persistent::version_t>;
+/**
+ * The retention policy of the logs of a subgroup, applied by the background
+ * trimming of PersistenceManager. A version is trimmed once every member of
+ * its shard has persisted it, and none of the fields below keeps it.
+ */
+struct RetentionPolicy {
+    /** keep the latest versions versions; at least 1 is always kept */
+    uint64_t versions;
+    /** keep the versions of the last seconds seconds by HLC time, 0 for no limit */
+    uint64_t seconds;
+    /** keep persisted_margin versions before the persistence frontier of the shard */
+    uint64_t persisted_margin;
+};
+
+/** The versions made and not trimmed yet in a subgroup, with their retention policy */
+struct VersionHistory {
+    RetentionPolicy policy;
+    /** (version, HLC real time in microseconds), in version order */
+    std::deque<std::pair<persistent::version_t, uint64_t>> versions;
+
+    /** The number of the oldest versions to trim now
+     * @param persisted_frontier - the latest version persisted by the whole shard
+     * @param now_us - the current time in microseconds
+     */
+    size_t versions_to_trim(const persistent::version_t& persisted_frontier,
+                            const uint64_t& now_us) const;
+};
 
 /**
  * PersistenceManager is responsible for persisting all the data in a group.
+ * The subgroups are persisted by a pool of PERS/persist_threads threads: a
+ * subgroup is persisted by one thread at a time, up to the latest version
+ * requested when the thread picks it, so that the requests posted meanwhile
+ * are coalesced into the next round.
  */
 class PersistenceManager {
 private:
@@ -32,16 +69,20 @@ private:
     std::shared_ptr<spdlog::logger> logger;
 #endif
 
-    /** Thread handle */
-    std::thread persist_thread;
+    /** Thread handles */
+    std::vector<std::thread> persist_threads;
     /** A flag to singal the persistent thread to shutdown; set to true when the group is destroyed. */
     std::atomic<bool> thread_shutdown;
-    /** The semaphore for persistence request the persistent thread */
-    sem_t persistence_request_sem;
-    /** a queue for the requests */
-    std::queue<persistence_request_t> persistence_request_queue;
-    /** lock for persistence request queue */
-    std::atomic_flag prq_lock = ATOMIC_FLAG_INIT;
+    /** The latest version requested for each subgroup with a pending request */
+    std::map<subgroup_id_t, persistent::version_t> pending_versions;
+    /** The subgroups with a pending request that no thread is persisting, in request order */
+    std::deque<subgroup_id_t> ready_subgroups;
+    /** The subgroups being persisted */
+    std::set<subgroup_id_t> busy_subgroups;
+    /** lock for the requests */
+    std::mutex persistence_request_mutex;
+    /** Wakes up the persist threads */
+    std::condition_variable persistence_request_cv;
 
     /** persistence callback */
     persistence_callback_t persistence_callback;
@@ -50,6 +91,26 @@ private:
     /** View Manager pointer. Need to access the SST for the purpose of updating persisted_num*/
     ViewManager* view_manager;
 
+    /** The period of the trim thread in milliseconds, 0 if it is disabled */
+    const uint64_t trim_interval_ms;
+    /** The retention policy of the subgroups without one of their own */
+    const RetentionPolicy default_retention_policy;
+    /** The trim thread */
+    std::thread trim_thread;
+    /** Wakes up the trim thread on shutdown */
+    std::condition_variable trim_thread_cv;
+    /** The version histories by subgroup */
+    std::map<subgroup_id_t, VersionHistory> version_histories;
+    /** lock for version_histories and the trim thread */
+    std::mutex trim_mutex;
+
+    /** Trim the logs of every subgroup to their retention policies */
+    void trim_logs();
+    /** The loop of a persist thread */
+    void persist_loop();
+    /** Persist a subgroup up to a version, and report it in the SST */
+    void persist_subgroup(const subgroup_id_t& subgroup_id, const persistent::version_t& version);
+
 public:
     /** Constructor
      * @param pro pointer to the objects_by_subgroup_id.
@@ -74,7 +135,7 @@ public:
 
     void set_view_manager(ViewManager& view_manager);
 
-    /** Start the persistent thread. */
+    /** Start the persistent threads. */
     void start(); 
     
     /** post a persistence request */
@@ -84,8 +145,14 @@ public:
     void make_version(const subgroup_id_t& subgroup_id,
                       const persistent::version_t& version, const HLC& mhlc);
 
-    /** shutdown the thread 
-     * @wait - wait till the thread finished or not.
+    /** Set the retention policy of the logs of a subgroup, which replaces the
+     * configured one. It takes effect if automatic trimming is enabled by
+     * PERS/trim_interval_ms.
+     */
+    void set_retention_policy(const subgroup_id_t& subgroup_id, const RetentionPolicy& policy);
+
+    /** shutdown the threads
+     * @wait - wait till the threads finished or not.
      */
     void shutdown(bool wait); 
 
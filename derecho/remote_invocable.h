@@ -6,7 +6,9 @@
 
 #pragma once
 
+#include <cstring>
 #include <functional>
+#include <memory>
 #include <numeric>
 #include <type_traits>
 
@@ -15,6 +17,7 @@
 #include "mutils/tuple_extras.hpp"
 #include <spdlog/spdlog.h>
 #include "utils/logger.hpp"
+#include "buffer_view.h"
 #include "rpc_utils.h"
 
 namespace derecho {
@@ -53,9 +56,15 @@ struct RemoteInvoker<Tag, std::function<Ret(Args...)>> {
         return nullptr;
     }
 
-    //Maps invocation-instance IDs to results sets
-    std::map<std::size_t, PendingResults<Ret>> results_map;
-    std::atomic<short> invocation_id_sequencer;
+    /**
+     * The results sets of recent calls, indexed by invocation-instance ID.
+     * Grows up to the 64K IDs the sequencer hands out, after which each call
+     * replaces the one made 64K calls earlier. The results set of a call is
+     * shared with the RPCManager, which keeps it until the call is delivered.
+     */
+    std::vector<std::shared_ptr<PendingResults<Ret>>> results_ring;
+    std::atomic<uint16_t> invocation_id_sequencer;
+    /** Guards results_ring. */
     std::mutex map_lock;
     using lock_t = std::unique_lock<std::mutex>;
 
@@ -92,7 +101,7 @@ struct RemoteInvoker<Tag, std::function<Ret(Args...)>> {
         std::size_t size;
         char* buf;
         QueryResults<Ret> results;
-        PendingResults<Ret>& pending;
+        std::shared_ptr<PendingResults<Ret>> pending;
     };
 
     /**
@@ -118,12 +127,16 @@ struct RemoteInvoker<Tag, std::function<Ret(Args...)>> {
             assert_always(check_size == size);
         }
 
-        lock_t l{map_lock};
-        // default-initialize the maps
-        results_map.erase(invocation_id); // TODO:release it as soon as possible
-        PendingResults<Ret>& pending_results = results_map[invocation_id];
+        auto pending_results = std::make_shared<PendingResults<Ret>>();
+        {
+            lock_t l{map_lock};
+            if(invocation_id >= results_ring.size()) {
+                results_ring.resize(invocation_id + 1);
+            }
+            results_ring[invocation_id] = pending_results;
+        }
 
-        return send_return{size, serialized_args, pending_results.get_future(),
+        return send_return{size, serialized_args, pending_results->get_future(),
                            pending_results};
     }
 
@@ -142,32 +155,21 @@ struct RemoteInvoker<Tag, std::function<Ret(Args...)>> {
         //note: find where this exception is set on the sending side!
         bool is_exception = response[0];
         long int invocation_id = ((long int*)(response + 1))[0];
-        lock_t l{map_lock};
-        assert(results_map.count(invocation_id) != 0);
-        // we unlock the map here to avoid the deadlock: 
-        // The p2p handler thread, on receiving an RPC REPLY may get this lock
-        // before sst_detect thread finish handling the corresponding ordered
-        // send locally. However, sst_detect thread may be so slow that it 
-        // hasn't finish deliverying of a previous ordered send, therefore waits
-        // for the map_lock in the following call stack: 
-        // - RPCManager::rpc_message_handler() ->
-        // - RPCManager::parse_and_receive() ->
-        // - RPCManager::receive_message()->
-        // - receivers->at(indx)->
-        // - RemoteInvoker::receive_response().
-        // therefore, the promise for the next ordered_send, on which the 
-        // p2p handler thread is waiting for, cannot be fulfilled.
-        // dead lock!!!
-        // We use this workaround by just release the results_map lock as early
-        // because we have 64K slots and we assume after 64K messages, this
-        // corresponding ordered_send has been finished already. 
-        // TODO: make a better plan along with garbage collection.
-        l.unlock();
-        // TODO: garbage collection for the responses.
+        // The lock is only held to copy out the results set. Setting a reply
+        // may wait for the call's delivery (in the sst_detect thread), which
+        // may itself be waiting for map_lock to deliver an earlier call.
+        std::shared_ptr<PendingResults<Ret>> pending_results;
+        {
+            lock_t l{map_lock};
+            if(static_cast<std::size_t>(invocation_id) < results_ring.size()) {
+                pending_results = results_ring[invocation_id];
+            }
+        }
+        assert(pending_results);
         if(is_exception) {
-            results_map.at(invocation_id).set_exception(nid, std::make_exception_ptr(remote_exception_occurred{nid}));
+            pending_results->set_exception(nid, std::make_exception_ptr(remote_exception_occurred{nid}));
         } else {
-            results_map.at(invocation_id).set_value(nid, *mutils::from_bytes<Ret>(dsm, response + 1 + sizeof(invocation_id)));
+            pending_results->set_value(nid, *mutils::from_bytes<Ret>(dsm, response + 1 + sizeof(invocation_id)));
         }
         return recv_ret{Opcode(), 0, nullptr, nullptr};
     }
@@ -212,7 +214,7 @@ struct RemoteInvoker<Tag, std::function<Ret(Args...)>> {
     inline void fulfill_pending_results_map(long int invocation_id, const node_list_t& who) {
         // I think this function is never called
         assert_always(false);
-        results_map.at(invocation_id).fulfill_map(who);
+        results_ring.at(invocation_id)->fulfill_map(who);
     }
 
     /**
@@ -237,6 +239,96 @@ struct RemoteInvoker<Tag, std::function<Ret(Args...)>> {
     }
 };
 
+/**
+ * Detects whether a type provides a static from_bytes_borrowed(), which
+ * returns an instance by value that refers to the bytes it was serialized
+ * into instead of copying them.
+ */
+template <typename T, typename = void>
+struct has_from_bytes_borrowed : std::false_type {};
+
+template <typename T>
+struct has_from_bytes_borrowed<T, std::void_t<decltype(T::from_bytes_borrowed(
+                                          std::declval<mutils::DeserializationManager*>(),
+                                          std::declval<const char*>()))>>
+        : std::true_type {};
+
+/**
+ * Holds one argument of an RPC call, deserialized from the message buffer,
+ * for the duration of the upcall. By default the argument is deserialized
+ * with mutils::from_bytes_noalloc, which lets the type refer to the message
+ * buffer instead of copying it; the context_ptr it returns is kept here, so
+ * whatever the type did allocate lives exactly until the upcall returns.
+ * The specializations below keep the argument itself in this object, so
+ * that it lives on the caller's stack and nothing is allocated.
+ */
+template <typename T, typename = void>
+struct deserialized_arg {
+    mutils::context_ptr<T> arg;
+    deserialized_arg(mutils::DeserializationManager* dsm, const char* buf)
+            : arg(mutils::from_bytes_noalloc<T>(dsm, buf)) {}
+    T& get() { return *arg; }
+};
+
+/** POD arguments are read directly out of the buffer into a local. */
+template <typename T>
+struct deserialized_arg<T, std::enable_if_t<std::is_pod<T>::value>> {
+    T arg;
+    deserialized_arg(mutils::DeserializationManager*, const char* buf) {
+        memcpy(&arg, buf, sizeof(T));
+    }
+    T& get() { return arg; }
+};
+
+/**
+ * Types with a from_bytes_borrowed() (such as BufferView and
+ * objectstore::Object) are built in place and may borrow the bytes of the
+ * message buffer instead of copying them.
+ */
+template <typename T>
+struct deserialized_arg<T, std::enable_if_t<!std::is_pod<T>::value
+                                            && has_from_bytes_borrowed<T>::value>> {
+    T arg;
+    deserialized_arg(mutils::DeserializationManager* dsm, const char* buf)
+            : arg(T::from_bytes_borrowed(dsm, buf)) {}
+    T& get() { return arg; }
+};
+
+/**
+ * Deserializes the arguments of an RPC call one at a time, keeping each one
+ * on the stack, and then calls the function with all of them. This replaces
+ * mutils::deserialize_and_run on the receive path: arguments that support it
+ * refer directly to the received message, which stays valid until the
+ * function returns. If deserializing an argument throws, the ones already
+ * deserialized are destroyed as the stack unwinds.
+ */
+template <typename... Args>
+struct noalloc_invoker;
+
+template <>
+struct noalloc_invoker<> {
+    template <typename Ret, typename F, typename... Held>
+    static Ret run(const F& fun, mutils::DeserializationManager*, const char*, Held&... held) {
+        return fun(held.get()...);
+    }
+};
+
+template <typename First, typename... Rest>
+struct noalloc_invoker<First, Rest...> {
+    template <typename Ret, typename F, typename... Held>
+    static Ret run(const F& fun, mutils::DeserializationManager* dsm, const char* buf, Held&... held) {
+        deserialized_arg<First> arg(dsm, buf);
+        const char* next_buf = buf + mutils::bytes_size(arg.get());
+        return noalloc_invoker<Rest...>::template run<Ret>(fun, dsm, next_buf, held..., arg);
+    }
+};
+
+template <typename Ret, typename... Args>
+Ret deserialize_and_run_noalloc(mutils::DeserializationManager* dsm, const char* buf,
+                                const std::function<Ret(Args...)>& fun) {
+    return noalloc_invoker<std::decay_t<Args>...>::template run<Ret>(fun, dsm, buf);
+}
+
 /**
  * Provides functions to implement handling RPC calls to a single function,
  * identified by its compile-time "tag" or opcode. Many versions of this class
@@ -277,7 +369,7 @@ struct RemoteInvocable<Tag, std::function<Ret(Args...)>> {
         long int invocation_id = ((long int*)_recv_buf)[0];
         auto recv_buf = _recv_buf + sizeof(long int);
         try {
-            const auto result = mutils::deserialize_and_run(dsm, recv_buf, remote_invocable_function);
+            const auto result = deserialize_and_run_noalloc(dsm, recv_buf, remote_invocable_function);
             const auto result_size = mutils::bytes_size(result) + sizeof(long int) + 1;
             auto out = out_alloc(result_size);
             out[0] = false;
@@ -303,7 +395,7 @@ struct RemoteInvocable<Tag, std::function<Ret(Args...)>> {
                                  const std::function<char*(int)>&) {
         //TODO: Need to catch exceptions here, and possibly send them back, since void functions can still throw exceptions!
         auto recv_buf = _recv_buf + sizeof(long int);
-        mutils::deserialize_and_run(dsm, recv_buf, remote_invocable_function);
+        deserialize_and_run_noalloc(dsm, recv_buf, remote_invocable_function);
         return recv_ret{reply_opcode, 0, nullptr};
     }
 
@@ -645,7 +737,7 @@ public:
         */
         struct send_return {
             QueryResults<Ret> results;
-            PendingResults<Ret>& pending;
+            std::shared_ptr<PendingResults<Ret>> pending;
 	  //LifeTracker
 	  /*
 class LifeTracker {
@@ -779,7 +871,7 @@ public:
         */
         struct send_return {
             QueryResults<Ret> results;
-            PendingResults<Ret>& pending;
+            std::shared_ptr<PendingResults<Ret>> pending;
         };
         return send_return{std::move(sent_return.results),
                            sent_return.pending};
@@ -80,6 +80,7 @@ public:
     virtual void make_version(const persistent::version_t& ver, const HLC& hlc) noexcept(false) = 0;
     virtual const persistent::version_t get_minimum_latest_persisted_version() noexcept(false) = 0;
     virtual void persist(const persistent::version_t version) noexcept(false) = 0;
+    virtual void trim(const persistent::version_t& earliest_version) noexcept(false) = 0;
     virtual void truncate(const persistent::version_t& latest_version) = 0;
     virtual void post_next_version(const persistent::version_t& version) = 0;
 };
@@ -162,7 +163,7 @@ public:
      */
     Replicated(subgroup_type_id_t type_id, node_id_t nid, subgroup_id_t subgroup_id, uint32_t subgroup_index, uint32_t shard_num,
                rpc::RPCManager& group_rpc_manager, Factory<T> client_object_factory, _Group* group)
-            : persistent_registry_ptr(std::make_unique<PersistentRegistry>(this, std::type_index(typeid(T)), subgroup_index, shard_num)),
+            : persistent_registry_ptr(std::make_unique<PersistentRegistry>(this, std::type_index(typeid(T)), subgroup_index, shard_num, getPersFilePath(subgroup_id))),
               user_object_ptr(std::make_unique<std::unique_ptr<T>>(client_object_factory(persistent_registry_ptr.get()))),
               node_id(nid),
               subgroup_id(subgroup_id),
@@ -190,7 +191,7 @@ public:
      */
     Replicated(subgroup_type_id_t type_id, node_id_t nid, subgroup_id_t subgroup_id, uint32_t subgroup_index, uint32_t shard_num,
                rpc::RPCManager& group_rpc_manager, _Group* group)
-            : persistent_registry_ptr(std::make_unique<PersistentRegistry>(this, std::type_index(typeid(T)), subgroup_index, shard_num)),
+            : persistent_registry_ptr(std::make_unique<PersistentRegistry>(this, std::type_index(typeid(T)), subgroup_index, shard_num, getPersFilePath(subgroup_id))),
               user_object_ptr(std::make_unique<std::unique_ptr<T>>(nullptr)),
               node_id(nid),
               subgroup_id(subgroup_id),
@@ -263,9 +264,40 @@ public:
 
             using Ret = typename std::remove_pointer<decltype(wrapped_this->template getReturnType<tag>(std::forward<Args>(args)...))>::type;
             rpc::QueryResults<Ret>* results_ptr;
-            rpc::PendingResults<Ret>* pending_ptr;
 
+            // in a subgroup with persistent fields, each batched invocation still
+            // gets its own version, since it gets its own index in the message
+            if(group_rpc_manager.auto_batching_enabled() && !rpc::in_rpc_handler()) {
+                const std::size_t invocation_size = rpc::remote_invocation_utilities::header_space() + msg_size;
+                if(invocation_size <= group_rpc_manager.get_max_batch_size()) {
+                    std::unique_ptr<rpc::QueryResults<Ret>> batched_results;
+                    group_rpc_manager.add_to_auto_batch(
+                            subgroup_id, is_persistent(), invocation_size, [&](char* buffer) -> std::shared_ptr<rpc::PendingBase> {
+                                auto send_return_struct = wrapped_this->template send<tag>(
+                                        [&buffer](size_t) -> char* { return buffer; },
+                                        std::forward<Args>(args)...);
+                                batched_results = std::make_unique<rpc::QueryResults<Ret>>(std::move(send_return_struct.results));
+                                return send_return_struct.pending;
+                            });
+                    return std::move(*batched_results);
+                }
+                // too large to batch: send anything batched before it first, to keep the order
+                group_rpc_manager.flush_auto_batch(subgroup_id);
+            }
+
+            // claimed before taking the view lock, since it may wait for earlier sends to be delivered
+            uint64_t pending_results_seq;
+            if(!group_rpc_manager.claim_pending_results_slots(1, pending_results_seq)) {
+                // an RPC handler cannot wait for the delivery of earlier sends
+                rpc::PendingResults<Ret> unsent;
+                rpc::QueryResults<Ret> results = unsent.get_future();
+                unsent.set_exception_for_unsent_call(std::make_exception_ptr(derecho::derecho_exception(
+                        "Too many ordered_sends are awaiting delivery to send another one from an RPC handler")));
+                return results;
+            }
+            bool generated = false;
             auto serializer = [&](char* buffer) {
+                char* nodelist_header = buffer;
                 std::size_t max_payload_size;
                 int buffer_offset = group_rpc_manager.populate_nodelist_header({}, buffer, max_payload_size);
                 buffer += buffer_offset;
@@ -280,21 +312,110 @@ public:
                         },
                         std::forward<Args>(args)...);
                 results_ptr = new rpc::QueryResults<Ret>(std::move(send_return_struct.results));
-                pending_ptr = &send_return_struct.pending;
+                // register the reply map before the message can be delivered
+                group_rpc_manager.finish_rpc_send(nodelist_header, pending_results_seq, send_return_struct.pending);
+                generated = true;
             };
 
-            std::shared_lock<std::shared_timed_mutex> view_read_lock(group_rpc_manager.view_manager.view_mutex);
-            group_rpc_manager.view_manager.view_change_cv.wait(view_read_lock, [&]() {
-                return group_rpc_manager.view_manager.curr_view
-                        ->multicast_group->send(subgroup_id, msg_size, serializer, true);
-            });
-            group_rpc_manager.finish_rpc_send(*pending_ptr);
+            try {
+                std::shared_lock<std::shared_timed_mutex> view_read_lock(group_rpc_manager.view_manager.view_mutex);
+                group_rpc_manager.view_manager.view_change_cv.wait(view_read_lock, [&]() {
+                    return group_rpc_manager.view_manager.curr_view
+                            ->multicast_group->send(subgroup_id, msg_size, serializer, true);
+                });
+            } catch(...) {
+                if(!generated) {
+                    group_rpc_manager.release_pending_results_slots(pending_results_seq, 1);
+                }
+                throw;
+            }
             return std::move(*results_ptr);
         } else {
             throw derecho::empty_reference_exception{"Attempted to use an empty Replicated<T>"};
         }
     }
 
+    /**
+     * Collects ordered_send invocations, possibly of different RPC functions,
+     * so that they can be sent to the subgroup together. Every invocation
+     * gets its own QueryResults, and the members of the subgroup run the
+     * invocations one after another, in the order they were added.
+     *
+     * The whole batch is sent as a single multicast. If T has persistent
+     * fields, each invocation in it is still delivered with its own version,
+     * as if it had been sent by itself; otherwise they share one version.
+     */
+    class Batch {
+        Replicated& replicated;
+        rpc::ordered_batch batch;
+
+    public:
+        Batch(Replicated& replicated) : replicated(replicated) {}
+        Batch(const Batch&) = delete;
+        ~Batch() {
+            send();
+        }
+
+        /**
+         * Adds an invocation of the RPC function identified by the
+         * FunctionTag template parameter to the batch. If the batch is too
+         * full to hold it, the invocations already in the batch are sent
+         * first.
+         * @param args The arguments to the RPC function
+         * @return An instance of rpc::QueryResults<Ret>, where Ret is the
+         * return type of the RPC function being invoked; its replies arrive
+         * only after send() has been called.
+         */
+        template <rpc::FunctionTag tag, typename... Args>
+        auto add(Args&&... args) {
+            if(!replicated.is_valid()) {
+                throw derecho::empty_reference_exception{"Attempted to use an empty Replicated<T>"};
+            }
+            const std::size_t invocation_size = rpc::remote_invocation_utilities::header_space()
+                                                + replicated.wrapped_this->template get_size<tag>(std::forward<Args>(args)...);
+            const std::size_t max_batch_size = replicated.group_rpc_manager.get_max_batch_size();
+            if(invocation_size > max_batch_size) {
+                throw derecho::derecho_exception("RPC invocation is too large to fit in a batch");
+            }
+            if(batch.invocations.size() + invocation_size > max_batch_size) {
+                send();
+            }
+            auto send_return_struct = replicated.wrapped_this->template send<tag>(
+                    [this](size_t size) -> char* {
+                        const std::size_t offset = batch.invocations.size();
+                        batch.invocations.resize(offset + size);
+                        return batch.invocations.data() + offset;
+                    },
+                    std::forward<Args>(args)...);
+            batch.pending.push_back(send_return_struct.pending);
+            return std::move(send_return_struct.results);
+        }
+
+        /** Sends all the invocations added since the last send(), if any. */
+        void send() {
+            if(batch.empty()) {
+                return;
+            }
+            if(replicated.group_rpc_manager.auto_batching_enabled()) {
+                replicated.group_rpc_manager.flush_auto_batch(replicated.subgroup_id);
+            }
+            replicated.group_rpc_manager.send_batch(replicated.subgroup_id, batch, replicated.is_persistent());
+        }
+
+        /** @return The number of invocations waiting to be sent. */
+        std::size_t size() const {
+            return batch.pending.size();
+        }
+    };
+
+    /**
+     * @return An empty Batch of ordered_send invocations to this subgroup.
+     * Any invocations left in the Batch when it is destroyed are sent then.
+     */
+    Batch make_batch() {
+        return Batch(*this);
+    }
+
     /**
      * Sends a peer-to-peer message to a single member of the subgroup that
      * replicates this Replicated<T>, invoking the RPC function identified
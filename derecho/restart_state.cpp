@@ -31,7 +31,8 @@ void RestartState::load_ragged_trim(const View& curr_view) {
                     //Get the latest persisted version number from this subgroup's object's log
                     //(this requires converting the type ID to a std::type_index
                     persistent::version_t last_persisted_version = persistent::getMinimumLatestPersistedVersion(curr_view.subgroup_type_order.at(type_id_and_indices.first),
-                                                                                                                subgroup_index, shard_num);
+                                                                                                                subgroup_index, shard_num,
+                                                                                                                getPersFilePath(subgroup_id));
                     int32_t last_vid, last_seq_num;
                     std::tie(last_vid, last_seq_num) = persistent::unpack_version<int32_t>(last_persisted_version);
                     //Divide the sequence number into sender rank and message counter
@@ -4,7 +4,10 @@
  * @date Feb 7, 2017
  */
 
+#include <algorithm>
 #include <cassert>
+#include <chrono>
+#include <cstring>
 #include <iostream>
 
 #include "rpc_manager.h"
@@ -16,7 +19,12 @@ namespace rpc {
 thread_local bool _in_rpc_handler = false;
 
 RPCManager::~RPCManager() {
+    shutdown_auto_batching();
     thread_shutdown = true;
+    {
+        std::lock_guard<std::mutex> lock(p2p_doorbell_mutex);
+        p2p_doorbell_cv.notify_all();
+    }
     if(rpc_thread.joinable()) {
         rpc_thread.join();
     }
@@ -67,9 +75,18 @@ std::exception_ptr RPCManager::parse_and_receive(char* buf, std::size_t size,
                            payload_size, out_alloc);
 }
 
-void RPCManager::rpc_message_handler(subgroup_id_t subgroup_id, node_id_t sender_id, char* msg_buf, uint32_t payload_size) {
+void RPCManager::rpc_message_handler(subgroup_id_t subgroup_id, node_id_t sender_id, char* msg_buf, uint32_t payload_size,
+                                     int32_t only_invocation) {
+    using namespace remote_invocation_utilities;
     // WARNING: This assumes the current view doesn't change during execution! (It accesses curr_view without a lock).
-    // extract the destination vector
+    // extract the pending-results sequence number, the number of invocations
+    // packed in the message, and the destination vector
+    const uint64_t pending_results_seq = ((uint64_t*)msg_buf)[0];
+    msg_buf += sizeof(uint64_t);
+    payload_size -= sizeof(uint64_t);
+    const uint64_t num_invocations = ((uint64_t*)msg_buf)[0];
+    msg_buf += sizeof(uint64_t);
+    payload_size -= sizeof(uint64_t);
     size_t dest_size = ((size_t*)msg_buf)[0];
     msg_buf += sizeof(size_t);
     payload_size -= sizeof(size_t);
@@ -87,45 +104,74 @@ void RPCManager::rpc_message_handler(subgroup_id_t subgroup_id, node_id_t sender
     _in_rpc_handler = true;
 
     if(in_dest || dest_size == 0) {
-        //Use the reply-buffer allocation lambda to detect whether parse_and_receive generated a reply
-        size_t reply_size = 0;
-        char* reply_buf;
-        parse_and_receive(msg_buf, payload_size, [this, &reply_buf, &reply_size, &sender_id](size_t size) -> char* {
-            reply_size = size;
-            if(reply_size <= connections->get_max_p2p_size()) {
-                reply_buf = (char*)connections->get_sendbuffer_ptr(
-                        connections->get_node_rank(sender_id), sst::REQUEST_TYPE::RPC_REPLY);
-                return reply_buf;
-            } else {
-                // the reply size is too large - not part of the design to handle it
-                return nullptr;
+        // The invocations of a batch are laid out back to back, each with its
+        // own RPC header, and were given consecutive sequence numbers
+        uint64_t first_invocation = 0;
+        uint64_t end_invocation = num_invocations;
+        if(only_invocation >= 0) {
+            assert(static_cast<uint64_t>(only_invocation) < num_invocations);
+            first_invocation = only_invocation;
+            end_invocation = first_invocation + 1;
+        }
+        for(uint64_t invocation = 0; invocation < end_invocation; ++invocation) {
+            std::size_t invocation_payload_size;
+            Opcode indx;
+            node_id_t received_from;
+            uint32_t flags;
+            retrieve_header(nullptr, msg_buf, invocation_payload_size, indx, received_from, flags);
+            const std::size_t invocation_size = header_space() + invocation_payload_size;
+            assert(invocation_size <= payload_size);
+            if(invocation < first_invocation) {
+                msg_buf += invocation_size;
+                payload_size -= invocation_size;
+                continue;
             }
-        });
-        if(sender_id == nid) {
-            //This is a self-receive of an RPC message I sent, so I have a reply-map that needs fulfilling
-            int my_shard = view_manager.curr_view->multicast_group->get_subgroup_settings().at(subgroup_id).shard_num;
-            std::unique_lock<std::mutex> lock(pending_results_mutex);
-            // because of a race condition, toFulfillQueue can genuinely be empty
-            // so we shouldn't assert that it is empty
-            // instead we should sleep on a condition variable and let the main thread that called the orderedSend signal us
-            // although the race condition is infinitely rare
-            pending_results_cv.wait(lock, [&]() { return !toFulfillQueue.empty(); });
-            // whenlog(logger->trace("Calling fulfill_map on toFulfillQueue.front(), its size is {}", toFulfillQueue.size());)
-            //We now know the membership of "all nodes in my shard of the subgroup" in the current view
-            toFulfillQueue.front().get().fulfill_map(
-                    view_manager.curr_view->subgroup_shard_views.at(subgroup_id).at(my_shard).members);
-            fulfilledList.push_back(std::move(toFulfillQueue.front()));
-            toFulfillQueue.pop();
-            // whenlog(logger->trace("Popped a PendingResults from toFulfillQueue, size is now {}", toFulfillQueue.size());)
-            if(reply_size > 0) {
-                //Since this was a self-receive, the reply also goes to myself
-                parse_and_receive(
-                        reply_buf, reply_size,
-                        [](size_t size) -> char* { assert_always(false); });
+            //Use the reply-buffer allocation lambda to detect whether parse_and_receive generated a reply
+            size_t reply_size = 0;
+            char* reply_buf;
+            parse_and_receive(msg_buf, invocation_size, [this, &reply_buf, &reply_size, &sender_id](size_t size) -> char* {
+                reply_size = size;
+                if(reply_size <= connections->get_max_p2p_size()) {
+                    reply_buf = (char*)connections->get_sendbuffer_ptr(
+                            connections->get_node_rank(sender_id), sst::REQUEST_TYPE::RPC_REPLY);
+                    return reply_buf;
+                } else {
+                    // the reply size is too large - not part of the design to handle it
+                    return nullptr;
+                }
+            });
+            if(sender_id == nid) {
+                //This is a self-receive of an RPC message I sent, so I have a reply-map that needs fulfilling
+                int my_shard = view_manager.curr_view->multicast_group->get_subgroup_settings().at(subgroup_id).shard_num;
+                // the slot was filled in by finish_rpc_send before the message was sent,
+                // and cannot be claimed again until it is no longer in flight
+                const uint64_t seq = pending_results_seq + invocation;
+                pending_results_slot& slot = pending_results_ring[seq % PENDING_RESULTS_RING_SIZE];
+                std::shared_ptr<PendingBase> pending;
+                if(slot.in_flight && slot.seq == seq) {
+                    pending = std::atomic_load(&slot.pending);
+                }
+                if(pending) {
+                    //We now know the membership of "all nodes in my shard of the subgroup" in the current view
+                    pending->fulfill_map(
+                            view_manager.curr_view->subgroup_shard_views.at(subgroup_id).at(my_shard).members);
+                    slot.in_flight = false;
+                    notify_pending_results_waiters();
+                } else {
+                    whenlog(logger->error("No pending results registered for ordered_send sequence number {}", seq););
+                }
+                if(reply_size > 0) {
+                    //Since this was a self-receive, the reply also goes to myself
+                    parse_and_receive(
+                            reply_buf, reply_size,
+                            [](size_t size) -> char* { assert_always(false); });
+                }
+            } else if(reply_size > 0) {
+                //Otherwise, the only thing to do is send the reply (if there was one)
+                connections->send(connections->get_node_rank(sender_id));
             }
-        } else if(reply_size > 0) {
-            //Otherwise, the only thing to do is send the reply (if there was one)
-            connections->send(connections->get_node_rank(sender_id));
+            msg_buf += invocation_size;
+            payload_size -= invocation_size;
         }
     }
 
@@ -162,10 +208,11 @@ void RPCManager::p2p_message_handler(node_id_t sender_id, char* msg_buf, uint32_
         // for cascading messages, we create a new thread.
         throw derecho::derecho_exception("Cascading P2P Send/Queries to be implemented!");
     } else {
-        // send to fifo queue.
-        std::unique_lock<std::mutex> lock(fifo_queue_mutex);
-        fifo_queue.emplace(sender_id,msg_buf,buffer_size);
-        fifo_queue_cv.notify_one();
+        // send to the fifo queue of the sender's worker.
+        fifo_worker_state& worker = *fifo_workers[sender_id % fifo_workers.size()];
+        std::unique_lock<std::mutex> lock(worker.fifo_queue_mutex);
+        worker.fifo_queue.emplace(sender_id, msg_buf, buffer_size);
+        worker.fifo_queue_cv.notify_one();
     }
 }
 
@@ -173,17 +220,42 @@ void RPCManager::new_view_callback(const View& new_view) {
     std::lock_guard<std::mutex> connections_lock(p2p_connections_mutex);
     connections = std::make_unique<sst::P2PConnections>(std::move(*connections), new_view.members);
     whenlog(logger->debug("Created new connections among the new view members"););
-    std::lock_guard<std::mutex> lock(pending_results_mutex);
-    for(auto& pending : fulfilledList) {
-        for(auto removed_id : new_view.departed) {
-            pending.get().set_exception_for_removed_node(removed_id);
+    if(!new_view.departed.empty()) {
+        // slots that are in flight have no reply map yet; they will be
+        // fulfilled with the new view's membership when they are delivered.
+        // Senders keep claiming slots meanwhile: each slot is read atomically.
+        auto fail_departed = [&new_view](const std::shared_ptr<PendingBase>& pending) {
+            if(pending) {
+                for(auto removed_id : new_view.departed) {
+                    pending->set_exception_for_removed_node(removed_id);
+                }
+            }
+        };
+        for(std::size_t i = 0; i < PENDING_RESULTS_RING_SIZE; ++i) {
+            const pending_results_slot& slot = pending_results_ring[i];
+            if(!slot.in_flight) {
+                fail_departed(std::atomic_load(&slot.pending));
+            }
+        }
+        std::lock_guard<std::mutex> lock(p2p_query_ring_mutex);
+        for(std::size_t i = 0; i < std::min<uint64_t>(next_p2p_query_seq, PENDING_RESULTS_RING_SIZE); ++i) {
+            fail_departed(p2p_query_ring[i].lock());
         }
     }
+    ring_p2p_doorbell();
 }
 
 int RPCManager::populate_nodelist_header(const std::vector<node_id_t>& dest_nodes, char* buffer,
                                          std::size_t& max_payload_size) {
     int header_size = 0;
+    // Leave room for the pending-results sequence number and the number of
+    // invocations in the message, filled in by finish_rpc_send
+    ((uint64_t*)buffer)[0] = 0;
+    buffer += sizeof(uint64_t);
+    header_size += sizeof(uint64_t);
+    ((uint64_t*)buffer)[0] = 1;
+    buffer += sizeof(uint64_t);
+    header_size += sizeof(uint64_t);
     // Put the list of destination nodes in another layer of "header"
     ((size_t*)buffer)[0] = dest_nodes.size();
     buffer += sizeof(size_t);
@@ -199,13 +271,282 @@ int RPCManager::populate_nodelist_header(const std::vector<node_id_t>& dest_node
     return header_size;
 }
 
-bool RPCManager::finish_rpc_send(PendingBase& pending_results_handle) {
-    std::lock_guard<std::mutex> lock(pending_results_mutex);
-    toFulfillQueue.push(pending_results_handle);
-    pending_results_cv.notify_all();
+bool RPCManager::try_claim_pending_results_slots(uint64_t first_seq, std::size_t count, bool& gave_back) {
+    for(std::size_t i = 0; i < count; ++i) {
+        bool in_flight = false;
+        if(!pending_results_ring[(first_seq + i) % PENDING_RESULTS_RING_SIZE].in_flight.compare_exchange_strong(in_flight, true)) {
+            // claim all or nothing, so that no sender holds slots while it waits
+            gave_back = (i > 0);
+            while(i-- > 0) {
+                pending_results_ring[(first_seq + i) % PENDING_RESULTS_RING_SIZE].in_flight = false;
+            }
+            return false;
+        }
+    }
+    for(std::size_t i = 0; i < count; ++i) {
+        pending_results_slot& slot = pending_results_ring[(first_seq + i) % PENDING_RESULTS_RING_SIZE];
+        slot.seq = first_seq + i;
+        std::atomic_store(&slot.pending, std::shared_ptr<PendingBase>());
+    }
+    return true;
+}
+
+bool RPCManager::claim_pending_results_slots(std::size_t count, uint64_t& first_seq) {
+    assert(count <= PENDING_RESULTS_RING_SIZE);
+    first_seq = next_pending_results_seq.fetch_add(count);
+    bool gave_back = false;
+    if(try_claim_pending_results_slots(first_seq, count, gave_back)) {
+        return true;
+    }
+    if(gave_back) {
+        notify_pending_results_waiters();
+    }
+    if(_in_rpc_handler) {
+        return false;
+    }
+    whenlog(logger->debug("Waiting for earlier ordered_sends to be delivered before sending another one"););
+    std::unique_lock<std::mutex> lock(pending_results_mutex);
+    pending_results_waiters++;
+    pending_results_cv.wait(lock, [&]() {
+        gave_back = false;
+        const bool claimed = try_claim_pending_results_slots(first_seq, count, gave_back);
+        if(gave_back) {
+            // the lock is already held
+            pending_results_cv.notify_all();
+        }
+        return claimed;
+    });
+    pending_results_waiters--;
     return true;
 }
 
+void RPCManager::notify_pending_results_waiters() {
+    // Together with the increment of pending_results_waiters before a waiter
+    // looks at the slots, these sequentially consistent accesses make sure
+    // that either the waiter sees the freed slot or this sees the waiter.
+    if(pending_results_waiters.load()) {
+        std::lock_guard<std::mutex> lock(pending_results_mutex);
+        pending_results_cv.notify_all();
+    }
+}
+
+void RPCManager::release_pending_results_slots(uint64_t first_seq, std::size_t count) {
+    for(std::size_t i = 0; i < count; ++i) {
+        pending_results_slot& slot = pending_results_ring[(first_seq + i) % PENDING_RESULTS_RING_SIZE];
+        if(slot.seq == first_seq + i) {
+            std::atomic_store(&slot.pending, std::shared_ptr<PendingBase>());
+            slot.in_flight = false;
+        }
+    }
+    notify_pending_results_waiters();
+}
+
+bool RPCManager::finish_rpc_send(char* nodelist_header, uint64_t seq, const std::shared_ptr<PendingBase>& pending_results_handle) {
+    pending_results_slot& slot = pending_results_ring[seq % PENDING_RESULTS_RING_SIZE];
+    assert(slot.seq == seq && slot.in_flight);
+    std::atomic_store(&slot.pending, pending_results_handle);
+    ((uint64_t*)nodelist_header)[0] = seq;
+    ((uint64_t*)nodelist_header)[1] = 1;
+    // the replies will come back over the P2P connections
+    ring_p2p_doorbell();
+    return true;
+}
+
+bool RPCManager::finish_rpc_send(char* nodelist_header, uint64_t first_seq,
+                                 const std::shared_ptr<PendingBase>* pending_results_handles, std::size_t count) {
+    for(std::size_t i = 0; i < count; ++i) {
+        pending_results_slot& slot = pending_results_ring[(first_seq + i) % PENDING_RESULTS_RING_SIZE];
+        assert(slot.seq == first_seq + i && slot.in_flight);
+        std::atomic_store(&slot.pending, pending_results_handles[i]);
+    }
+    ((uint64_t*)nodelist_header)[0] = first_seq;
+    ((uint64_t*)nodelist_header)[1] = count;
+    ring_p2p_doorbell();
+    return true;
+}
+
+bool RPCManager::send_invocations(subgroup_id_t subgroup_id, uint64_t first_seq, const char* invocations, std::size_t size,
+                                  const std::shared_ptr<PendingBase>* pending_results_handles, std::size_t count,
+                                  bool version_per_invocation) {
+    bool generated = false;
+    auto serializer = [&](char* buffer) {
+        char* nodelist_header = buffer;
+        std::size_t max_payload_size;
+        buffer += populate_nodelist_header({}, buffer, max_payload_size);
+        assert(size <= max_payload_size);
+        memcpy(buffer, invocations, size);
+        // register the reply maps before the message can be delivered
+        finish_rpc_send(nodelist_header, first_seq, pending_results_handles, count);
+        generated = true;
+    };
+    const std::size_t msg_size = BATCH_NODELIST_HEADER_SIZE + size;
+    try {
+        std::shared_lock<std::shared_timed_mutex> view_read_lock(view_manager.view_mutex);
+        view_manager.view_change_cv.wait(view_read_lock, [&]() {
+            return auto_batch_shutdown
+                   || view_manager.curr_view->multicast_group->send(subgroup_id, msg_size, serializer, true,
+                                                                    version_per_invocation ? count : 1);
+        });
+    } catch(...) {
+        if(!generated) {
+            release_pending_results_slots(first_seq, count);
+        }
+        throw;
+    }
+    if(!generated) {
+        release_pending_results_slots(first_seq, count);
+    }
+    return generated;
+}
+
+void RPCManager::send_batch(subgroup_id_t subgroup_id, ordered_batch& batch, bool version_per_invocation) {
+    if(batch.empty()) {
+        return;
+    }
+    const std::size_t count = batch.pending.size();
+    try {
+        // claimed before taking the view lock, since it may wait for earlier sends to be delivered
+        uint64_t first_seq;
+        if(!claim_pending_results_slots(count, first_seq)) {
+            fail_batch(batch, 0, std::make_exception_ptr(derecho::derecho_exception(
+                                         "Too many ordered_sends are awaiting delivery to send more from an RPC handler")));
+            return;
+        }
+        if(!send_invocations(subgroup_id, first_seq, batch.invocations.data(), batch.invocations.size(),
+                             batch.pending.data(), count, version_per_invocation)) {
+            fail_batch(batch, 0, std::make_exception_ptr(derecho::derecho_exception(
+                                         "The group was shut down before this ordered_send could be sent")));
+            return;
+        }
+    } catch(...) {
+        fail_batch(batch, 0, std::current_exception());
+        throw;
+    }
+    batch.clear();
+}
+
+void RPCManager::fail_batch(ordered_batch& batch, std::size_t first, const std::exception_ptr& exception) {
+    for(std::size_t i = first; i < batch.pending.size(); ++i) {
+        batch.pending[i]->set_exception_for_unsent_call(exception);
+    }
+    batch.clear();
+}
+
+void RPCManager::send_auto_batch(subgroup_id_t subgroup_id, std::unique_lock<std::mutex>& batches_lock) {
+    auto_batch& queued = auto_batches.at(subgroup_id);
+    ordered_batch batch;
+    std::swap(batch, queued.batch);
+    const uint64_t turn = queued.batches_taken++;
+    auto_batches_cv.wait(batches_lock, [&]() { return queued.batches_sent == turn; });
+    batches_lock.unlock();
+    try {
+        send_batch(subgroup_id, batch, queued.version_per_invocation);
+    } catch(...) {
+        // send_batch has already failed the batch's QueryResults with the exception
+        whenlog(logger->error("Failed to send a batch of ordered_sends to subgroup {}", subgroup_id););
+    }
+    batches_lock.lock();
+    ++queued.batches_sent;
+    auto_batches_cv.notify_all();
+}
+
+void RPCManager::add_to_auto_batch(subgroup_id_t subgroup_id, bool version_per_invocation, std::size_t invocation_size,
+                                   const std::function<std::shared_ptr<PendingBase>(char*)>& serializer) {
+    std::unique_lock<std::mutex> lock(auto_batches_mutex);
+    if(auto_batch_shutdown) {
+        throw derecho::derecho_exception("Attempted to ordered_send after the group was shut down");
+    }
+    auto_batch& queued = auto_batches[subgroup_id];
+    queued.version_per_invocation = version_per_invocation;
+    while(!queued.batch.empty() && queued.batch.invocations.size() + invocation_size > std::min(auto_batch_bytes, max_batch_size)) {
+        send_auto_batch(subgroup_id, lock);
+    }
+    const std::size_t offset = queued.batch.invocations.size();
+    queued.batch.invocations.resize(offset + invocation_size);
+    queued.batch.pending.push_back(serializer(queued.batch.invocations.data() + offset));
+    if(queued.batch.invocations.size() >= auto_batch_bytes) {
+        send_auto_batch(subgroup_id, lock);
+    } else if(queued.batch.pending.size() == 1) {
+        queued.batch.first_added = std::chrono::steady_clock::now();
+        auto_batches_cv.notify_all();
+    }
+}
+
+void RPCManager::flush_auto_batch(subgroup_id_t subgroup_id) {
+    std::unique_lock<std::mutex> lock(auto_batches_mutex);
+    auto queued = auto_batches.find(subgroup_id);
+    if(queued == auto_batches.end()) {
+        return;
+    }
+    if(!queued->second.batch.empty()) {
+        send_auto_batch(subgroup_id, lock);
+    } else {
+        // a batch taken out earlier may still be on its way
+        const uint64_t taken = queued->second.batches_taken;
+        auto_batches_cv.wait(lock, [&]() { return queued->second.batches_sent >= taken; });
+    }
+}
+
+void RPCManager::auto_batch_loop() {
+    std::unique_lock<std::mutex> lock(auto_batches_mutex);
+    while(!auto_batch_shutdown) {
+        // send every batch that is old enough, and find when the next one will be
+        auto now = std::chrono::steady_clock::now();
+        auto next_deadline = std::chrono::steady_clock::time_point::max();
+        bool sent_any = false;
+        for(auto& subgroup_batch : auto_batches) {
+            if(subgroup_batch.second.batch.empty()) {
+                continue;
+            }
+            auto deadline = subgroup_batch.second.batch.first_added + auto_batch_delay;
+            if(deadline <= now) {
+                send_auto_batch(subgroup_batch.first, lock);
+                sent_any = true;
+            } else {
+                next_deadline = std::min(next_deadline, deadline);
+            }
+        }
+        if(sent_any || auto_batch_shutdown) {
+            // the lock was released while sending, so the batches may have changed
+            continue;
+        }
+        if(next_deadline == std::chrono::steady_clock::time_point::max()) {
+            auto_batches_cv.wait(lock);
+        } else {
+            auto_batches_cv.wait_until(lock, next_deadline);
+        }
+    }
+}
+
+void RPCManager::shutdown_auto_batching() {
+    {
+        // set under the mutex, so that the auto-batching thread either sees it
+        // before it waits or is already waiting when it is notified
+        std::lock_guard<std::mutex> lock(auto_batches_mutex);
+        if(auto_batch_shutdown) {
+            return;
+        }
+        auto_batch_shutdown = true;
+        auto_batches_cv.notify_all();
+    }
+    {
+        // the same for a batch that is waiting for a view change to be sent
+        std::unique_lock<std::shared_timed_mutex> view_lock(view_manager.view_mutex);
+    }
+    view_manager.view_change_cv.notify_all();
+    if(auto_batch_thread.joinable()) {
+        auto_batch_thread.join();
+    }
+    std::lock_guard<std::mutex> lock(auto_batches_mutex);
+    for(auto& subgroup_batch : auto_batches) {
+        if(!subgroup_batch.second.batch.empty()) {
+            fail_batch(subgroup_batch.second.batch, 0,
+                       std::make_exception_ptr(derecho::derecho_exception(
+                               "The group was shut down before this ordered_send could be sent")));
+        }
+    }
+}
+
 volatile char* RPCManager::get_sendbuffer_ptr(uint32_t dest_id, sst::REQUEST_TYPE type) {
     auto dest_rank = connections->get_node_rank(dest_id);
     volatile char* buf;
@@ -215,17 +556,32 @@ volatile char* RPCManager::get_sendbuffer_ptr(uint32_t dest_id, sst::REQUEST_TYP
     return buf;
 }
 
-void RPCManager::finish_p2p_send(bool is_query, node_id_t dest_id, PendingBase& pending_results_handle) {
+void RPCManager::finish_p2p_send(bool is_query, node_id_t dest_id, const std::shared_ptr<PendingBase>& pending_results_handle) {
     connections->send(connections->get_node_rank(dest_id));
     if(is_query) {
         //only fulfill the reply map if this is a non-void query - sends ignore the PendingResults
-        pending_results_handle.fulfill_map({dest_id});
-        std::lock_guard<std::mutex> lock(pending_results_mutex);
-        fulfilledList.push_back(pending_results_handle);
+        pending_results_handle->fulfill_map({dest_id});
+        {
+            std::lock_guard<std::mutex> lock(p2p_query_ring_mutex);
+            p2p_query_ring[next_p2p_query_seq++ % PENDING_RESULTS_RING_SIZE] = pending_results_handle;
+        }
+        ring_p2p_doorbell();
+    }
+}
+
+void RPCManager::ring_p2p_doorbell() {
+    // Together with the store of p2p_receiver_parked before the receiver's
+    // last look at p2p_doorbell, these sequentially consistent accesses make
+    // sure that either the receiver sees the ring or this sees it parked.
+    p2p_doorbell.store(true);
+    if(p2p_receiver_parked.load()) {
+        std::lock_guard<std::mutex> lock(p2p_doorbell_mutex);
+        p2p_doorbell_cv.notify_one();
     }
 }
 
-void RPCManager::fifo_worker() {
+void RPCManager::fifo_worker(uint32_t worker_index) {
+    pthread_setname_np(pthread_self(), ("fifo_worker_" + std::to_string(worker_index)).c_str());
     using namespace remote_invocation_utilities;
     const std::size_t header_size = header_space();
     std::size_t payload_size;
@@ -234,16 +590,17 @@ void RPCManager::fifo_worker() {
     uint32_t flags;
     size_t reply_size = 0;
     fifo_req request;
+    fifo_worker_state& worker = *fifo_workers[worker_index];
 
     while(!thread_shutdown) {
         {
-            std::unique_lock<std::mutex> lock(fifo_queue_mutex);
-            fifo_queue_cv.wait(lock, [&]() { return !fifo_queue.empty() || thread_shutdown; });
+            std::unique_lock<std::mutex> lock(worker.fifo_queue_mutex);
+            worker.fifo_queue_cv.wait(lock, [&]() { return !worker.fifo_queue.empty() || thread_shutdown; });
 	    if (thread_shutdown) {
 	      break;
 	    }
-            request = fifo_queue.front();
-            fifo_queue.pop();
+            request = worker.fifo_queue.front();
+            worker.fifo_queue.pop();
         }
         retrieve_header(nullptr, request.msg_buf, payload_size, indx, received_from, flags);
         if (indx.is_reply || RPC_HEADER_FLAG_TST(flags,CASCADE)) {
@@ -251,17 +608,24 @@ void RPCManager::fifo_worker() {
                 indx.is_reply,RPC_HEADER_FLAG_TST(flags,CASCADE));
             throw derecho::derecho_exception("invalid rpc message in fifo queue...crash.");
         }
+        reply_size = 0;
+        // held from the allocation of the reply buffer until the reply is
+        // sent, since the receive thread and the other workers use (and a
+        // view change replaces) the connections concurrently
+        std::unique_lock<std::mutex> reply_lock(p2p_connections_mutex, std::defer_lock);
         receive_message(indx, received_from, request.msg_buf + header_size, payload_size,
-                        [this, &reply_size, &request](size_t _size) -> char* {
+                        [this, &reply_size, &request, &reply_lock](size_t _size) -> char* {
                             reply_size = _size;
                             if(reply_size <= request.buffer_size) {
+                                reply_lock.lock();
                                 return (char*)connections->get_sendbuffer_ptr(
                                         connections->get_node_rank(request.sender_id), sst::REQUEST_TYPE::P2P_REPLY);
                             }
                             return nullptr;
                         });
-        if(reply_size > 0) {
+        if(reply_lock.owns_lock()) {
             connections->send(connections->get_node_rank(request.sender_id));
+            reply_lock.unlock();
         }
     }
 }
@@ -277,20 +641,72 @@ void RPCManager::p2p_receive_loop() {
         thread_start_cv.wait(lock, [this]() { return thread_start; });
     }
     whenlog(logger->debug("P2P listening thread started"););
-    // start the fifo worker thread
-    fifo_worker_thread = std::thread(&RPCManager::fifo_worker, this);
+    // start the fifo worker threads
+    const uint32_t num_fifo_workers = std::max(getConfUInt32(CONF_DERECHO_P2P_WORKER_THREADS), 1u);
+    for(uint32_t i = 0; i < num_fifo_workers; ++i) {
+        fifo_workers.emplace_back(std::make_unique<fifo_worker_state>());
+    }
+    for(uint32_t i = 0; i < num_fifo_workers; ++i) {
+        fifo_workers[i]->thread = std::thread(&RPCManager::fifo_worker, this, i);
+    }
+    const auto spin_time = std::chrono::microseconds(getConfUInt64(CONF_DERECHO_P2P_IDLE_SPIN_US));
+    const auto park_time = std::chrono::microseconds(getConfUInt64(CONF_DERECHO_P2P_IDLE_PARK_US));
+    std::vector<std::pair<uint32_t, char*>> ready_msgs;
+    auto last_msg_time = std::chrono::steady_clock::now();
     // loop event
     while(!thread_shutdown) {
-        std::lock_guard<std::mutex> connections_lock(p2p_connections_mutex);
-        auto optional_reply_pair = connections->probe_all();
-        if(optional_reply_pair) {
-            auto reply_pair = optional_reply_pair.value();
-            p2p_message_handler(reply_pair.first, (char*)reply_pair.second, max_payload_size);
+        {
+            std::lock_guard<std::mutex> connections_lock(p2p_connections_mutex);
+            connections->probe_all(ready_msgs);
+            for(const auto& ready_msg : ready_msgs) {
+                p2p_message_handler(ready_msg.first, ready_msg.second, max_payload_size);
+            }
+        }
+        if(!ready_msgs.empty()) {
+            ready_msgs.clear();
+            last_msg_time = std::chrono::steady_clock::now();
+            continue;
+        }
+        if(park_time.count() == 0 || std::chrono::steady_clock::now() - last_msg_time < spin_time) {
+            continue;
+        }
+        // Idle for a while: sleep until the doorbell rings or the park time
+        // is up. Once parked is set, look at the doorbell and the incoming
+        // buffers one last time under the doorbell mutex, so that nothing
+        // that arrived since the last poll waits out the park time.
+        std::unique_lock<std::mutex> connections_lock(p2p_connections_mutex);
+        std::unique_lock<std::mutex> lock(p2p_doorbell_mutex);
+        p2p_receiver_parked.store(true);
+        bool woken = p2p_doorbell.exchange(false);
+        if(!woken) {
+            connections->probe_all(ready_msgs);
+            woken = !ready_msgs.empty();
+        }
+        if(!woken) {
+            connections_lock.unlock();
+            woken = p2p_doorbell_cv.wait_for(lock, park_time, [this]() { return p2p_doorbell.load() || thread_shutdown; });
+            p2p_doorbell.store(false);
+        }
+        p2p_receiver_parked.store(false);
+        // don't dispatch with the doorbell mutex held
+        lock.unlock();
+        for(const auto& ready_msg : ready_msgs) {
+            p2p_message_handler(ready_msg.first, ready_msg.second, max_payload_size);
+        }
+        ready_msgs.clear();
+        if(woken) {
+            // a message is here or on its way, so go back to polling continuously
+            last_msg_time = std::chrono::steady_clock::now();
+        }
+    }
+    // stop fifo workers.
+    for(auto& worker : fifo_workers) {
+        {
+            std::lock_guard<std::mutex> lock(worker->fifo_queue_mutex);
+            worker->fifo_queue_cv.notify_one();
         }
+        worker->thread.join();
     }
-    // stop fifo worker.
-    fifo_queue_cv.notify_one();
-    fifo_worker_thread.join();
 }
 
 bool in_rpc_handler() {
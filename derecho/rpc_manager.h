@@ -6,6 +6,9 @@
 
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <exception>
 #include <functional>
 #include <map>
@@ -37,6 +40,25 @@ struct IDeserializationContext : public mutils::RemoteDeserializationContext {};
 
 namespace rpc {
 
+/**
+ * A set of ordered_send invocations that have been serialized but not yet
+ * sent, which RPCManager::send_batch() packs into as few multicasts as it can.
+ */
+struct ordered_batch {
+    /** The serialized invocations, each an RPC header followed by its payload. */
+    std::vector<char> invocations;
+    /** The "promise object" of each invocation, in the same order. */
+    std::vector<std::shared_ptr<PendingBase>> pending;
+    /** When the first invocation was added, for the auto-batching timer. */
+    std::chrono::steady_clock::time_point first_added;
+
+    bool empty() const { return pending.empty(); }
+    void clear() {
+        invocations.clear();
+        pending.clear();
+    }
+};
+
 class RPCManager {
     static_assert(std::is_trivially_copyable<Opcode>::value, "Oh no! Opcode is not trivially copyable!");
     /** The ID of the node this RPCManager is running on. */
@@ -65,12 +87,62 @@ class RPCManager {
     std::unique_ptr<sst::P2PConnections> connections;
 
     std::mutex p2p_connections_mutex;
-    /** This mutex guards both toFulfillQueue and fulfilledList. */
+    /**
+     * The number of slots in pending_results_ring, and also in
+     * p2p_query_ring. This is the number of distinct invocation IDs a
+     * RemoteInvoker hands out, which already assumes that a call is finished
+     * with by the time 64K later calls have been made.
+     */
+    static constexpr std::size_t PENDING_RESULTS_RING_SIZE = 1 << 16;
+    /** A slot of pending_results_ring. */
+    struct pending_results_slot {
+        /** The sequence number of the ordered_send invocation that last claimed this slot. */
+        std::atomic<uint64_t> seq{0};
+        /** The "promise object" of that invocation, once its message has been
+         * generated. Only accessed through std::atomic_load/std::atomic_store. */
+        std::shared_ptr<PendingBase> pending;
+        /** True from when the slot is claimed until fulfill_map() has been called on pending. */
+        std::atomic<bool> in_flight{false};
+    };
+    /**
+     * Only used by senders that wait for a slot of pending_results_ring;
+     * claiming and freeing slots does not take it.
+     */
     std::mutex pending_results_mutex;
-    /** This condition variable is to resolve a race condition in using ToFulfillQueue and fulfilledList */
+    /** Notified whenever a slot of pending_results_ring stops being in flight
+     * while a sender is waiting for one. */
     std::condition_variable pending_results_cv;
-    std::queue<std::reference_wrapper<PendingBase>> toFulfillQueue;
-    std::list<std::reference_wrapper<PendingBase>> fulfilledList;
+    /** The number of senders waiting on pending_results_cv. */
+    std::atomic<uint32_t> pending_results_waiters{0};
+    /**
+     * The "promise objects" of recent ordered_send invocations, indexed by a
+     * sequence number modulo PENDING_RESULTS_RING_SIZE. An ordered_send
+     * claims its sequence number with claim_pending_results_slots() before
+     * generating its message, and carries it in its node-list header, so the
+     * delivery of the message can find its slot. A slot that is still in
+     * flight is never reclaimed; senders wait for it instead. Each slot
+     * shares ownership of its "promise object", so it stays valid even after
+     * its RemoteInvoker has reused the invocation ID.
+     */
+    std::unique_ptr<pending_results_slot[]> pending_results_ring;
+    /** The sequence number the next ordered_send invocation will claim. */
+    std::atomic<uint64_t> next_pending_results_seq{0};
+    /** Guards p2p_query_ring and next_p2p_query_seq. */
+    std::mutex p2p_query_ring_mutex;
+    /**
+     * The "promise objects" of recent P2P queries, which are fulfilled as
+     * soon as they are sent and only kept here so that new_view_callback()
+     * can fail their replies from departed nodes. Queries whose results were
+     * discarded have expired from the ring.
+     */
+    std::unique_ptr<std::weak_ptr<PendingBase>[]> p2p_query_ring;
+    /** The number of P2P queries ever registered in p2p_query_ring. */
+    uint64_t next_p2p_query_seq = 0;
+    /**
+     * The size of the node-list header of a message with no destination
+     * nodes: sequence number, invocation count and destination count.
+     */
+    static constexpr std::size_t BATCH_NODELIST_HEADER_SIZE = 2 * sizeof(uint64_t) + sizeof(std::size_t);
 
     /** This is not accessed outside invocations of rpc_message_handler,
      * it's just a member so it won't be newly allocated every time. */
@@ -83,8 +155,18 @@ class RPCManager {
     std::condition_variable thread_start_cv;
     std::atomic<bool> thread_shutdown{false};
     std::thread rpc_thread;
-    /** p2p send and queries are queued in fifo worker */
-    std::thread fifo_worker_thread;
+    /** Guards p2p_doorbell, and is used to park the P2P listening thread while it is idle. */
+    std::mutex p2p_doorbell_mutex;
+    /** Notified when a parked P2P listening thread should resume polling. */
+    std::condition_variable p2p_doorbell_cv;
+    /** Set by ring_p2p_doorbell() to wake up the P2P listening thread, or to
+     * keep it from parking. */
+    std::atomic<bool> p2p_doorbell{false};
+    /** True while the P2P listening thread is (about to be) parked. Only this
+     * node rings the doorbell, so a message from a remote node to a parked
+     * thread waits up to the park time (DERECHO/p2p_idle_park_us). */
+    std::atomic<bool> p2p_receiver_parked{false};
+    /** p2p send and queries are queued in fifo workers */
     struct fifo_req {
         node_id_t sender_id;
         char* msg_buf;
@@ -102,15 +184,124 @@ class RPCManager {
                   buffer_size(_buffer_size)
         {}
     };
-    std::queue<fifo_req> fifo_queue;
-    std::mutex fifo_queue_mutex;
-    std::condition_variable fifo_queue_cv;
+    /** A thread that runs P2P send and query handlers, and its request queue. */
+    struct fifo_worker_state {
+        std::thread thread;
+        std::queue<fifo_req> fifo_queue;
+        std::mutex fifo_queue_mutex;
+        std::condition_variable fifo_queue_cv;
+    };
+    /**
+     * The P2P worker pool. All requests from the same sender go to the same
+     * worker, so they are handled, and replied to, in the order they were
+     * sent: the sender matches replies to queries by their order, and only
+     * reuses a request slot once the reply to the query in it has arrived,
+     * so a request's slot stays valid while its handler runs. Requests from
+     * different senders can run in parallel.
+     */
+    std::vector<std::unique_ptr<fifo_worker_state>> fifo_workers;
+
+    /**
+     * The batch size, in bytes, at which automatically-batched ordered_sends
+     * are sent; 0 if ordered_send does not batch.
+     */
+    const std::size_t auto_batch_bytes;
+    /** The longest an automatically-batched ordered_send waits to be sent. */
+    const std::chrono::microseconds auto_batch_delay;
+    /** The largest number of bytes of serialized invocations that fit in one message. */
+    const std::size_t max_batch_size;
+    /** The ordered_sends of one subgroup that are waiting to be batched. */
+    struct auto_batch {
+        ordered_batch batch;
+        /** Whether each invocation is delivered with its own version, as
+         * send_batch() does for a subgroup with persistent fields. */
+        bool version_per_invocation = false;
+        /** The number of batches taken out of this auto_batch to be sent. */
+        uint64_t batches_taken = 0;
+        /** The number of those that have been sent (or failed). */
+        uint64_t batches_sent = 0;
+    };
+    /**
+     * Guards auto_batches and auto_batch_shutdown. It is never held while
+     * sending: a batch is taken out under it and sent after it is released.
+     */
+    std::mutex auto_batches_mutex;
+    /**
+     * Notified when an auto-batch becomes non-empty, when a taken batch has
+     * been sent, and at shutdown.
+     */
+    std::condition_variable auto_batches_cv;
+    /** The ordered_sends waiting to be sent, for each subgroup. */
+    std::map<subgroup_id_t, auto_batch> auto_batches;
+    /**
+     * Set by shutdown_auto_batching(). Once set, nothing more is batched, and
+     * a batch that is still waiting to be sent is failed instead.
+     */
+    std::atomic<bool> auto_batch_shutdown{false};
+    /** Sends auto-batches that have waited auto_batch_delay. */
+    std::thread auto_batch_thread;
+
+    /** Body of auto_batch_thread. */
+    void auto_batch_loop();
+
+    /**
+     * Takes the subgroup's auto-batch out and sends it, after any batch of
+     * the same subgroup taken out before it, so that batches are sent in the
+     * order their invocations were made. batches_lock must hold
+     * auto_batches_mutex; it is released while waiting for the earlier
+     * batches and while sending, and held again on return.
+     */
+    void send_auto_batch(subgroup_id_t subgroup_id, std::unique_lock<std::mutex>& batches_lock);
+
+    /**
+     * Sends serialized invocations, back to back, as one multicast to the
+     * subgroup, like ordered_send.
+     * @param subgroup_id The subgroup to send to
+     * @param first_seq The sequence number returned by claim_pending_results_slots()
+     * for the invocations; the slots are given back if the message is not sent
+     * @param invocations The serialized invocations
+     * @param size The total size of the invocations, in bytes
+     * @param pending_results_handles The "promise object" of each invocation
+     * @param count The number of invocations
+     * @param version_per_invocation True to give each invocation its own
+     * message index, so that it is delivered with its own version
+     * @return True if the message was sent, false if auto-batching was shut
+     * down before it could be
+     */
+    bool send_invocations(subgroup_id_t subgroup_id, uint64_t first_seq, const char* invocations, std::size_t size,
+                          const std::shared_ptr<PendingBase>* pending_results_handles, std::size_t count,
+                          bool version_per_invocation);
+
+    /**
+     * Claims the slots first_seq to first_seq + count - 1 of the
+     * pending-results ring if none of them is in flight, and claims none of
+     * them otherwise.
+     * @param gave_back Set to true if slots claimed along the way had to be
+     * given back, so other senders waiting for them must be woken up
+     * @return True if the slots were claimed
+     */
+    bool try_claim_pending_results_slots(uint64_t first_seq, std::size_t count, bool& gave_back);
+
+    /** Wakes up the senders waiting for slots of the pending-results ring, if any. */
+    void notify_pending_results_waiters();
+
+    /**
+     * Fails the QueryResults of the invocations in a batch, from the given
+     * one on, since they will not be sent, and empties the batch.
+     */
+    static void fail_batch(ordered_batch& batch, std::size_t first, const std::exception_ptr& exception);
 
     /** Listens for P2P RPC calls over the RDMA P2P connections and handles them. */
     void p2p_receive_loop();
 
+    /**
+     * Wakes up the P2P listening thread if it is parked, because a P2P
+     * message (such as the reply to a query) is expected soon.
+     */
+    void ring_p2p_doorbell();
+
     /** Handle Non-cascading P2P Send and P2P Queries in fifo*/
-    void fifo_worker();
+    void fifo_worker(uint32_t worker_index);
 
     /**
      * Handler to be called by rpc_process_loop each time it receives a
@@ -161,11 +352,19 @@ public:
               whenlog(logger(LoggerFactory::getDefaultLogger()), )
               view_manager(group_view_manager),
               connections(std::make_unique<sst::P2PConnections>(sst::P2PParams{nid, {nid}, group_view_manager.derecho_params.window_size, group_view_manager.derecho_params.max_payload_size})),
-              replySendBuffer(new char[group_view_manager.derecho_params.max_payload_size]) {
+              pending_results_ring(std::make_unique<pending_results_slot[]>(PENDING_RESULTS_RING_SIZE)),
+              p2p_query_ring(std::make_unique<std::weak_ptr<PendingBase>[]>(PENDING_RESULTS_RING_SIZE)),
+              replySendBuffer(new char[group_view_manager.derecho_params.max_payload_size]),
+              auto_batch_bytes(getConfUInt64(CONF_DERECHO_ORDERED_SEND_BATCH_BYTES)),
+              auto_batch_delay(getConfUInt64(CONF_DERECHO_ORDERED_SEND_BATCH_DELAY_US)),
+              max_batch_size(getConfUInt64(CONF_DERECHO_MAX_PAYLOAD_SIZE) - BATCH_NODELIST_HEADER_SIZE) {
         if (deserialization_context_ptr != nullptr) {
             rdv.push_back(deserialization_context_ptr);
         }
         rpc_thread = std::thread(&RPCManager::p2p_receive_loop, this);
+        if(auto_batch_bytes > 0) {
+            auto_batch_thread = std::thread(&RPCManager::auto_batch_loop, this);
+        }
     }
 
     ~RPCManager();
@@ -270,12 +469,18 @@ public:
      * @param sender_id The ID of the node that sent the message
      * @param msg_buf A buffer containing the message
      * @param payload_size The size of the message in the buffer, in bytes
+     * @param only_invocation For a message whose invocations each have their
+     * own version, the one invocation being delivered; -1 to deliver all of
+     * the message's invocations
      */
-    void rpc_message_handler(subgroup_id_t subgroup_id, node_id_t sender_id, char* msg_buf, uint32_t payload_size);
+    void rpc_message_handler(subgroup_id_t subgroup_id, node_id_t sender_id, char* msg_buf, uint32_t payload_size,
+                             int32_t only_invocation);
 
     /**
      * Writes the "list of destination nodes" header field into the given
-     * buffer, in preparation for sending an RPC message.
+     * buffer, in preparation for sending an RPC message. The header also
+     * reserves space for the sequence number and invocation count that
+     * finish_rpc_send() fills in.
      * @param dest_nodes The list of destination nodes
      * @param buffer The buffer in which to write the header
      * @param max_payload_size Out parameter: the maximum size of a payload
@@ -286,14 +491,111 @@ public:
                                  std::size_t& max_payload_size);
 
     /**
-     * Sends the next message in the MulticastGroup's send buffer (which is
-     * assumed to be an RPC message prepared by earlier functions) and registers
-     * the "promise object" in pending_results_handle to await replies.
-     * @param pending_results_handle A reference to the "promise object" in the
-     * send_return for this send.
-     * @return True if the send was successful, false if the current view is wedged
+     * Claims consecutive slots of the pending-results ring for the
+     * invocations of one ordered_send message, waiting while any of them
+     * still belongs to a message that has not been delivered yet. This must
+     * be called before the message is generated, and without holding the
+     * view lock, since the delivery of earlier messages frees the slots.
+     * Called from an RPC handler, whose own thread would have to deliver the
+     * messages it is waiting for, it does not wait and fails instead.
+     * @param count The number of invocations the message will carry
+     * @param first_seq Out parameter: the sequence number of the first
+     * claimed slot
+     * @return True if the slots were claimed, false if the caller is an RPC
+     * handler and they are still in flight
+     */
+    bool claim_pending_results_slots(std::size_t count, uint64_t& first_seq);
+
+    /**
+     * Gives back slots claimed by claim_pending_results_slots() for a
+     * message that was never generated.
+     */
+    void release_pending_results_slots(uint64_t first_seq, std::size_t count);
+
+    /**
+     * Registers the "promise object" of an RPC message that is being written
+     * into the MulticastGroup's send buffer (by the message generator of an
+     * ordered_send), so that it is fulfilled when the message is delivered.
+     * @param nodelist_header The start of the message's node-list header, as
+     * written by populate_nodelist_header()
+     * @param seq The sequence number returned by claim_pending_results_slots()
+     * @param pending_results_handle The "promise object" in the send_return
+     * for this send.
+     * @return True
+     */
+    bool finish_rpc_send(char* nodelist_header, uint64_t seq, const std::shared_ptr<PendingBase>& pending_results_handle);
+
+    /**
+     * Registers the "promise objects" of a batch of RPC invocations being
+     * written into one message, in the order they appear in the message.
+     * Like the single-invocation version, but fills one claimed slot per
+     * invocation.
+     * @param nodelist_header The start of the message's node-list header
+     * @param first_seq The sequence number returned by claim_pending_results_slots()
+     * @param pending_results_handles The "promise object" of each invocation
+     * @param count The number of invocations
+     * @return True
+     */
+    bool finish_rpc_send(char* nodelist_header, uint64_t first_seq,
+                         const std::shared_ptr<PendingBase>* pending_results_handles, std::size_t count);
+
+    /**
+     * @return The largest number of bytes of serialized invocations that fit
+     * in one batched ordered_send message.
+     */
+    std::size_t get_max_batch_size() const {
+        return max_batch_size;
+    }
+
+    /**
+     * Sends all the invocations in a batch, in order, to the given subgroup,
+     * and empties the batch. Blocks if the subgroup's send window is full,
+     * and across view changes, like ordered_send. If auto-batching has been
+     * shut down while it waits, the invocations are failed instead.
+     * @param subgroup_id The subgroup to send to
+     * @param batch The invocations to send
+     * @param version_per_invocation True to deliver each invocation with its
+     * own version, as a subgroup with persistent fields needs: the multicast
+     * then uses one message index per invocation. False to deliver them all
+     * with the single version of the multicast.
+     */
+    void send_batch(subgroup_id_t subgroup_id, ordered_batch& batch, bool version_per_invocation);
+
+    /** @return True if ordered_send should add its invocations to auto-batches. */
+    bool auto_batching_enabled() const {
+        return auto_batch_bytes > 0;
+    }
+
+    /**
+     * Adds one invocation to the subgroup's auto-batch, sending the batch
+     * first if the invocation would not fit, and sending it right away if
+     * it is then at least auto_batch_bytes long. Otherwise the batch is
+     * sent by the auto-batching thread once it is old enough.
+     * @param subgroup_id The subgroup to send to
+     * @param version_per_invocation Whether the subgroup's invocations each
+     * need their own version, as for send_batch()
+     * @param invocation_size The size of the serialized invocation, including
+     * its RPC header
+     * @param serializer A function that writes the invocation into the buffer
+     * it is given and returns the invocation's "promise object"
+     */
+    void add_to_auto_batch(subgroup_id_t subgroup_id, bool version_per_invocation, std::size_t invocation_size,
+                           const std::function<std::shared_ptr<PendingBase>(char*)>& serializer);
+
+    /**
+     * Sends the subgroup's auto-batch right away, if it is not empty, and
+     * returns once it and any auto-batch sent before it have been sent.
+     */
+    void flush_auto_batch(subgroup_id_t subgroup_id);
+
+    /**
+     * Stops automatic batching: wakes up and stops the auto-batching thread,
+     * and fails the QueryResults of every invocation still waiting in an
+     * auto-batch. This must be called before the Replicated objects whose
+     * invocations may be batched are destroyed. It is safe to call more
+     * than once.
      */
-    bool finish_rpc_send(PendingBase& pending_results_handle);
+    void shutdown_auto_batching();
 
     /**
      * Retrieves a buffer for sending P2P messages from the RPCManager's pool of
@@ -310,10 +612,10 @@ public:
      * @param is_query True if this message represents a query (which expects replies),
      * false if it repesents a send (which does not)
      * @param dest_node The node to send the message to
-     * @param pending_results_handle A reference to the "promise object" in the
-     * send_return for this send.
+     * @param pending_results_handle The "promise object" in the send_return
+     * for this send.
      */
-    void finish_p2p_send(bool is_query, node_id_t dest_node, PendingBase& pending_results_handle);
+    void finish_p2p_send(bool is_query, node_id_t dest_node, const std::shared_ptr<PendingBase>& pending_results_handle);
 };
 
 //Now that RPCManager is finished being declared, we can declare these convenience types
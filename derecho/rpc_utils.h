@@ -6,15 +6,18 @@
 
 #pragma once
 
+#include <atomic>
 #include <cstddef>
 #include <exception>
 #include <functional>
 #include <future>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <tuple>
 #include <type_traits>
 #include <typeindex>
@@ -329,6 +332,8 @@ class PendingBase {
 public:
     virtual void fulfill_map(const node_list_t&) = 0;
     virtual void set_exception_for_removed_node(const node_id_t&) = 0;
+    /** Fails the whole call, whose message was never sent. */
+    virtual void set_exception_for_unsent_call(const std::exception_ptr&) = 0;
     virtual ~PendingBase() {}
 };
 
@@ -348,22 +353,26 @@ private:
      * when the RPC function call is actually sent and the set of repliers is known. */
     std::promise<std::unique_ptr<reply_map<Ret>>> promise_for_pending_map;
 
-    std::promise<std::map<node_id_t, std::promise<Ret>>> promise_for_reply_promises;
-    /** A future for a map containing one promise for each reply to the RPC function
-     * call. It will be fulfilled when fulfill_map is called, which means the RPC
-     * function call was actually sent and the set of destination nodes is known. */
-    std::future<std::map<node_id_t, std::promise<Ret>>> reply_promises_are_ready;
-    std::mutex reply_promises_are_ready_mutex;
+    /** One promise for each reply to the RPC function call, created by fulfill_map. */
     std::map<node_id_t, std::promise<Ret>> reply_promises;
+    /** Set once reply_promises is filled in. Replies can arrive before that
+     * (e.g. before an ordered_send is delivered locally), and then wait for it. */
+    std::atomic<bool> map_fulfilled{false};
+    /** Guards reply_promises, dest_nodes and responded_nodes. */
+    std::mutex reply_promises_mutex;
 
-    bool map_fulfilled = false;
     std::set<node_id_t> dest_nodes, responded_nodes;
     whenlog(std::shared_ptr<spdlog::logger> logger;);
 
+    void wait_for_map_fulfilled() {
+        while(!map_fulfilled.load(std::memory_order_acquire)) {
+            std::this_thread::yield();
+        }
+    }
+
 public:
     PendingResults()
-            : reply_promises_are_ready(promise_for_reply_promises.get_future())
-              whenlog(, logger(LoggerFactory::getDefaultLogger())) {
+            whenlog(: logger(LoggerFactory::getDefaultLogger())) {
         whenlog(logger->trace("Created a PendingResults<{}>", typeid(Ret).name()););
     }
     /**
@@ -374,44 +383,45 @@ public:
     void fulfill_map(const node_list_t& who) {
         whenlog(logger->trace("Got a call to fulfill_map for PendingResults<{}>", typeid(Ret).name()););
         whenlog(logger->flush(););
-        map_fulfilled = true;
         std::unique_ptr<reply_map<Ret>> futures_map = std::make_unique<reply_map<Ret>>();
-        std::map<node_id_t, std::promise<Ret>> promises_map;
-        for(const auto& e : who) {
-            futures_map->emplace(e, promises_map[e].get_future());
+        {
+            std::lock_guard<std::mutex> lock(reply_promises_mutex);
+            for(const auto& e : who) {
+                futures_map->emplace(e, reply_promises[e].get_future());
+            }
+            dest_nodes.insert(who.begin(), who.end());
+            whenlog(logger->trace("Marking the reply map of PendingResults<{}> fulfilled", typeid(Ret).name()););
+            map_fulfilled.store(true, std::memory_order_release);
         }
-        dest_nodes.insert(who.begin(), who.end());
-        whenlog(logger->trace("Setting a value for reply_promises_are_ready"););
-        promise_for_reply_promises.set_value(std::move(promises_map));
         promise_for_pending_map.set_value(std::move(futures_map));
     }
 
     void set_exception_for_removed_node(const node_id_t& removed_nid) {
         assert(map_fulfilled);
+        std::lock_guard<std::mutex> lock(reply_promises_mutex);
         if(dest_nodes.find(removed_nid) != dest_nodes.end()
            && responded_nodes.find(removed_nid) == responded_nodes.end()) {
-            set_exception(removed_nid,
-                          std::make_exception_ptr(
-                                  node_removed_from_group_exception{removed_nid}));
+            responded_nodes.insert(removed_nid);
+            reply_promises.at(removed_nid).set_exception(
+                    std::make_exception_ptr(node_removed_from_group_exception{removed_nid}));
         }
     }
 
+    void set_exception_for_unsent_call(const std::exception_ptr& e) {
+        promise_for_pending_map.set_exception(e);
+    }
+
     void set_value(const node_id_t& nid, const Ret& v) {
-        std::lock_guard<std::mutex> lock(reply_promises_are_ready_mutex);
+        wait_for_map_fulfilled();
+        std::lock_guard<std::mutex> lock(reply_promises_mutex);
         responded_nodes.insert(nid);
-        if(reply_promises.size() == 0) {
-            whenlog(logger->trace("PendingResults<{}>::set_value about to wait on reply_promises_are_ready", typeid(Ret).name()););
-            whenlog(logger->flush(););
-            reply_promises = std::move(reply_promises_are_ready.get());
-        }
         reply_promises.at(nid).set_value(v);
     }
 
     void set_exception(const node_id_t& nid, const std::exception_ptr e) {
+        wait_for_map_fulfilled();
+        std::lock_guard<std::mutex> lock(reply_promises_mutex);
         responded_nodes.insert(nid);
-        if(reply_promises.size() == 0) {
-            reply_promises = std::move(reply_promises_are_ready.get());
-        }
         reply_promises.at(nid).set_exception(e);
     }
 
@@ -442,6 +452,10 @@ public:
 
     void set_exception_for_removed_node(const node_id_t&) {}
 
+    void set_exception_for_unsent_call(const std::exception_ptr& e) {
+        promise_for_pending_map.set_exception(e);
+    }
+
     QueryResults<void> get_future() {
         return QueryResults<void>(promise_for_pending_map.get_future());
     }
@@ -1224,6 +1224,15 @@ void ViewManager::finish_view_change(
 /* ------------- 3. Helper Functions for Predicates and Triggers -------------
  */
 
+/** Reads the SST detector threads' idle policy from the configuration. */
+static sst::IdlePolicy get_sst_idle_policy() {
+    sst::IdlePolicy policy;
+    policy.spin_us = getConfUInt32(CONF_DERECHO_SST_IDLE_SPIN_US);
+    policy.yield_us = getConfUInt32(CONF_DERECHO_SST_IDLE_YIELD_US);
+    policy.park_us = getConfUInt32(CONF_DERECHO_SST_IDLE_PARK_US);
+    return policy;
+}
+
 void ViewManager::construct_multicast_group(CallbackSet callbacks,
                                             const std::map<subgroup_id_t, SubgroupSettings>& subgroup_settings,
                                             const uint32_t num_received_size) {
@@ -1231,7 +1240,10 @@ void ViewManager::construct_multicast_group(CallbackSet callbacks,
     curr_view->gmsSST = std::make_shared<DerechoSST>(
             sst::SSTParams(curr_view->members, curr_view->members[curr_view->my_rank],
                            [this](const uint32_t node_id) { report_failure(node_id); },
-                           curr_view->failed, false),
+                           curr_view->failed, false,
+                           getConfUInt32(CONF_DERECHO_SST_DETECTOR_THREADS),
+                           get_sst_idle_policy(),
+                           getConfBoolean(CONF_DERECHO_SST_WRITE_COMBINING)),
             num_subgroups, num_received_size, derecho_params.window_size,
             derecho_params.max_smc_payload_size + sizeof(header) + 2 * sizeof(uint64_t));
 
@@ -1253,7 +1265,10 @@ void ViewManager::transition_multicast_group(
     next_view->gmsSST = std::make_shared<DerechoSST>(
             sst::SSTParams(next_view->members, next_view->members[next_view->my_rank],
                            [this](const uint32_t node_id) { report_failure(node_id); },
-                           next_view->failed, false),
+                           next_view->failed, false,
+                           getConfUInt32(CONF_DERECHO_SST_DETECTOR_THREADS),
+                           get_sst_idle_policy(),
+                           getConfBoolean(CONF_DERECHO_SST_WRITE_COMBINING)),
             num_subgroups, new_num_received_size, derecho_params.window_size,
             derecho_params.max_smc_payload_size + sizeof(header) + 2 * sizeof(uint64_t));
 
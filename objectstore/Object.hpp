@@ -26,10 +26,14 @@ class Blob : public mutils::ByteRepresentable {
 public:
     char* bytes;
     std::size_t size;
+    // true if bytes is borrowed from a buffer owned by someone else (e.g. a
+    // delivered message) and must not be freed by this Blob
+    bool is_temporary;
 
     // constructor - copy to own the data
     Blob(const char* const b, const decltype(size) s) : bytes(nullptr),
-                                                        size(0) {
+                                                        size(0),
+                                                        is_temporary(false) {
         if(s > 0) {
             bytes = new char[s];
             memcpy(bytes, b, s);
@@ -37,9 +41,25 @@ public:
         }
     }
 
-    // copy constructor - copy to own the data
+    // constructor - borrow the data without copying it if temporary is true;
+    // the caller guarantees the buffer outlives the Blob
+    Blob(const char* const b, const decltype(size) s, bool temporary) : bytes(nullptr),
+                                                                       size(0),
+                                                                       is_temporary(temporary) {
+        if(temporary) {
+            bytes = const_cast<char*>(b);
+            size = s;
+        } else if(s > 0) {
+            bytes = new char[s];
+            memcpy(bytes, b, s);
+            size = s;
+        }
+    }
+
+    // copy constructor - copy to own the data, even if other is borrowing
     Blob(const Blob& other) : bytes(nullptr),
-                              size(0) {
+                              size(0),
+                              is_temporary(false) {
         if(other.size > 0) {
             bytes = new char[other.size];
             memcpy(bytes, other.bytes, other.size);
@@ -48,35 +68,40 @@ public:
     }
 
     // move constructor - accept the memory from another object
-    Blob(Blob&& other) : bytes(other.bytes), size(other.size) {
+    Blob(Blob&& other) : bytes(other.bytes), size(other.size), is_temporary(other.is_temporary) {
         other.bytes = nullptr;
         other.size = 0;
+        other.is_temporary = false;
     }
 
     // default constructor - no data at all
-    Blob() : bytes(nullptr), size(0) {}
+    Blob() : bytes(nullptr), size(0), is_temporary(false) {}
 
     // destructor
     virtual ~Blob() {
-        if(bytes) delete bytes;
+        if(bytes && !is_temporary) delete[] bytes;
     }
 
     // move evaluator:
     Blob& operator=(Blob&& other) {
         char* swp_bytes = other.bytes;
         std::size_t swp_size = other.size;
+        bool swp_is_temporary = other.is_temporary;
         other.bytes = bytes;
         other.size = size;
+        other.is_temporary = is_temporary;
         bytes = swp_bytes;
         size = swp_size;
+        is_temporary = swp_is_temporary;
         return *this;
     }
 
     // copy evaluator:
     Blob& operator=(const Blob& other) {
-        if(bytes != nullptr) {
-            delete bytes;
+        if(bytes != nullptr && !is_temporary) {
+            delete[] bytes;
         }
+        is_temporary = false;
         size = other.size;
         if(size > 0) {
             bytes = new char[size];
@@ -110,11 +135,15 @@ public:
         return std::make_unique<Blob>(v + sizeof(std::size_t), ((std::size_t*)(v))[0]);
     }
 
-    // from_bytes_noalloc() implementation borrowed from mutils-serialization.
-    // TODO: check with Matthew: if this will cause memory leak?
-    mutils::context_ptr<Blob> from_bytes_noalloc(mutils::DeserializationManager* ctx, const char* const v, mutils::context_ptr<Blob> = mutils::context_ptr<Blob>{}) {
+    static mutils::context_ptr<Blob> from_bytes_noalloc(mutils::DeserializationManager* ctx, const char* const v) {
         return mutils::context_ptr<Blob>{from_bytes(ctx, v).release()};
     }
+
+    // The returned Blob borrows its bytes from v, so it is only valid as long
+    // as the buffer v points into.
+    static Blob from_bytes_borrowed(mutils::DeserializationManager*, const char* const v) {
+        return Blob(v + sizeof(std::size_t), ((std::size_t*)(v))[0], true);
+    }
 };
 
 using OID = uint64_t;
@@ -147,8 +176,44 @@ public:
                                   blob(other.blob) {}
     // constructor 4 : default invalid constructor
     Object() : oid(INV_OID) {}
+    // constructor 5 : move the blob in, keeping it borrowed if it is temporary
+    Object(const OID& _oid, Blob&& _blob) : oid(_oid),
+                                            blob(std::move(_blob)) {}
+
+    // Serialization is written out by hand, in the same layout
+    // DEFAULT_SERIALIZATION_SUPPORT(Object, oid, blob) would produce, so that
+    // from_bytes_borrowed() can hand out an Object whose blob borrows the
+    // serialized bytes instead of copying them.
+    std::size_t to_bytes(char* v) const {
+        ((OID*)(v))[0] = oid;
+        return sizeof(OID) + blob.to_bytes(v + sizeof(OID));
+    }
+
+    std::size_t bytes_size() const {
+        return sizeof(OID) + blob.bytes_size();
+    }
+
+    void post_object(const std::function<void(char const* const, std::size_t)>& f) const {
+        f((char*)&oid, sizeof(oid));
+        blob.post_object(f);
+    }
+
+    void ensure_registered(mutils::DeserializationManager&) {}
+
+    static std::unique_ptr<Object> from_bytes(mutils::DeserializationManager*, const char* const v) {
+        const char* const blob_buf = v + sizeof(OID);
+        return std::make_unique<Object>(((OID*)(v))[0], blob_buf + sizeof(std::size_t), ((std::size_t*)(blob_buf))[0]);
+    }
 
-    DEFAULT_SERIALIZATION_SUPPORT(Object, oid, blob);
+    static mutils::context_ptr<Object> from_bytes_noalloc(mutils::DeserializationManager* ctx, const char* const v) {
+        return mutils::context_ptr<Object>{from_bytes(ctx, v).release()};
+    }
+
+    // The returned Object's blob borrows its bytes from v; copy the Object
+    // (e.g. into a map) to keep it beyond the life of the buffer.
+    static Object from_bytes_borrowed(mutils::DeserializationManager* ctx, const char* const v) {
+        return Object(((OID*)(v))[0], Blob::from_bytes_borrowed(ctx, v + sizeof(OID)));
+    }
 };
 
 inline std::ostream& operator << (std::ostream &out, const Blob &b) {
@@ -0,0 +1,434 @@
+#include "DirectLogWriter.hpp"
+#include "PersistException.hpp"
+#include "utils/logger.hpp"
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <map>
+#include <mutex>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace std;
+
+namespace persistent {
+
+// the maximum number of io_uring operations in flight
+#define DIRECT_WRITER_QUEUE_DEPTH (64)
+
+// a flush submitted and not yet completed
+struct pending_flush {
+    int fd;
+    vector<DirectWrite> writes;
+    vector<struct iovec> iovecs;
+    bool sync;
+    DirectLogWriter::FlushCallback callback;
+    // number of writes not completed yet
+    size_t writes_remaining;
+    // number of bytes not written yet
+    size_t bytes_remaining;
+    bool sync_submitted;
+    // errno of the first failed operation, or 0
+    int error;
+
+    pending_flush(int fd, vector<DirectWrite>&& writes, bool sync,
+                  const DirectLogWriter::FlushCallback& callback)
+            : fd(fd),
+              writes(std::move(writes)),
+              sync(sync),
+              callback(callback),
+              writes_remaining(this->writes.size()),
+              bytes_remaining(0),
+              sync_submitted(false),
+              error(0) {
+        for(const auto& write : this->writes) {
+            iovecs.push_back({write.buffer.get(), write.length});
+            bytes_remaining += write.length;
+        }
+    }
+};
+
+/////////////////////////////////////////////////////
+// io_uring writer, driven by the raw system calls //
+/////////////////////////////////////////////////////
+
+// user_data of the operation waking up the reaper on shutdown
+#define IO_URING_SHUTDOWN_TAG (~0ull)
+// user_data of the operations of a flush: the flush id shifted left by one,
+// with the lowest bit set for the data sync.
+#define IO_URING_FLUSH_TAG(id, is_sync) (((id) << 1) | ((is_sync) ? 1 : 0))
+
+class IoUringLogWriter : public DirectLogWriter {
+private:
+    int m_iRingFd;
+    // the mapped rings
+    void* m_pSqRing;
+    size_t m_sqRingSize;
+    void* m_pCqRing;
+    size_t m_cqRingSize;
+    struct io_uring_sqe* m_pSqes;
+    size_t m_sqesSize;
+    // pointers into the submission ring
+    unsigned* m_pSqHead;
+    unsigned* m_pSqTail;
+    unsigned* m_pSqMask;
+    unsigned* m_pSqArray;
+    // pointers into the completion ring
+    unsigned* m_pCqHead;
+    unsigned* m_pCqTail;
+    unsigned* m_pCqMask;
+    struct io_uring_cqe* m_pCqes;
+    // the number of submission queue entries. At most this many operations
+    // are in flight, so the completion queue, twice as large, never overflows.
+    unsigned m_depth;
+
+    // protects everything below and the submission ring
+    mutex m_mutex;
+    // notified when operations complete
+    condition_variable m_spaceCv;
+    // number of operations submitted and not reaped yet
+    unsigned m_inFlightOps;
+    uint64_t m_nextFlushId;
+    // flushes in flight, in submission order
+    map<uint64_t, pending_flush> m_flushes;
+    // thread reaping the completions
+    thread m_reaper;
+
+    // release the rings. Used by the destructor and a failed constructor.
+    void release() noexcept(true) {
+        if(m_pSqes != MAP_FAILED) {
+            munmap(m_pSqes, m_sqesSize);
+        }
+        if(m_pCqRing != MAP_FAILED && m_pCqRing != m_pSqRing) {
+            munmap(m_pCqRing, m_cqRingSize);
+        }
+        if(m_pSqRing != MAP_FAILED) {
+            munmap(m_pSqRing, m_sqRingSize);
+        }
+        close(m_iRingFd);
+    }
+
+    // get the next submission queue entry. m_mutex must be held and there
+    // must be space in the ring.
+    struct io_uring_sqe* nextSqe() {
+        unsigned tail = *m_pSqTail;
+        unsigned idx = tail & *m_pSqMask;
+        struct io_uring_sqe* sqe = &m_pSqes[idx];
+        memset(sqe, 0, sizeof(*sqe));
+        m_pSqArray[idx] = idx;
+        __atomic_store_n(m_pSqTail, tail + 1, __ATOMIC_RELEASE);
+        return sqe;
+    }
+
+    // hand nr entries of the submission ring to the kernel
+    void enter(unsigned nr) noexcept(false) {
+        while(nr > 0) {
+            int ret = syscall(__NR_io_uring_enter, m_iRingFd, nr, 0, 0, nullptr, 0);
+            if(ret < 0) {
+                if(errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+                    continue;
+                }
+                throw PERSIST_EXP_IO_URING(errno);
+            }
+            nr -= ret;
+        }
+    }
+
+    // start the data syncs whose flushes, and all earlier flushes to the same
+    // file, have finished writing. m_mutex must be held.
+    void submitReadySyncs() noexcept(false) {
+        map<int, bool> fd_blocked;
+        unsigned nr = 0;
+        for(auto& [id, flush] : m_flushes) {
+            bool& blocked = fd_blocked[flush.fd];
+            if(flush.writes_remaining > 0) {
+                blocked = true;
+            } else if(!blocked && !flush.sync_submitted && m_inFlightOps < m_depth) {
+                struct io_uring_sqe* sqe = nextSqe();
+                sqe->opcode = IORING_OP_FSYNC;
+                sqe->fd = flush.fd;
+                sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+                sqe->user_data = IO_URING_FLUSH_TAG(id, true);
+                flush.sync_submitted = true;
+                m_inFlightOps++;
+                nr++;
+            }
+        }
+        enter(nr);
+    }
+
+    void reap() noexcept(true) {
+        bool shutdown = false;
+        while(!shutdown) {
+            int ret = syscall(__NR_io_uring_enter, m_iRingFd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+            if(ret < 0 && errno != EINTR) {
+                dbg_default_error("io_uring writer failed to wait for completions: errno={}", errno);
+            }
+            vector<pair<FlushCallback, int>> completed;
+            {
+                lock_guard<mutex> lck(m_mutex);
+                unsigned head = *m_pCqHead;
+                unsigned tail = __atomic_load_n(m_pCqTail, __ATOMIC_ACQUIRE);
+                while(head != tail) {
+                    const struct io_uring_cqe* cqe = &m_pCqes[head & *m_pCqMask];
+                    const uint64_t tag = cqe->user_data;
+                    const int res = cqe->res;
+                    head++;
+                    m_inFlightOps--;
+                    if(tag == IO_URING_SHUTDOWN_TAG) {
+                        shutdown = true;
+                        continue;
+                    }
+                    auto flush_itr = m_flushes.find(tag >> 1);
+                    pending_flush& flush = flush_itr->second;
+                    if(res < 0 && flush.error == 0) {
+                        flush.error = -res;
+                    }
+                    if(tag & 1) {
+                        // the data sync ends the flush
+                        completed.emplace_back(flush.callback, flush.error);
+                        m_flushes.erase(flush_itr);
+                        continue;
+                    }
+                    if(res > 0) {
+                        flush.bytes_remaining -= res;
+                    }
+                    if(--flush.writes_remaining == 0) {
+                        if(flush.error == 0 && flush.bytes_remaining != 0) {
+                            // short write
+                            flush.error = EIO;
+                        }
+                        if(flush.error != 0 || !flush.sync) {
+                            completed.emplace_back(flush.callback, flush.error);
+                            m_flushes.erase(flush_itr);
+                        }
+                    }
+                }
+                __atomic_store_n(m_pCqHead, head, __ATOMIC_RELEASE);
+                try {
+                    submitReadySyncs();
+                } catch(persist_exception_t e) {
+                    dbg_default_error("io_uring writer failed to submit data syncs: errno={}", PERSIST_EXP_USERCODE(e));
+                }
+            }
+            m_spaceCv.notify_all();
+            for(auto& [callback, error] : completed) {
+                callback(error);
+            }
+        }
+    }
+
+public:
+    IoUringLogWriter(unsigned depth) noexcept(false) : m_pSqRing(MAP_FAILED),
+                                                       m_pCqRing(MAP_FAILED),
+                                                       m_pSqes((struct io_uring_sqe*)MAP_FAILED),
+                                                       m_inFlightOps(0),
+                                                       m_nextFlushId(0) {
+        struct io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        m_iRingFd = syscall(__NR_io_uring_setup, depth, &params);
+        if(m_iRingFd < 0) {
+            throw PERSIST_EXP_IO_URING(errno);
+        }
+        m_depth = params.sq_entries;
+        m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+        m_sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+        // kernels with IORING_FEAT_SINGLE_MMAP map both rings at once
+        if(params.features & IORING_FEAT_SINGLE_MMAP) {
+            m_sqRingSize = m_cqRingSize = std::max(m_sqRingSize, m_cqRingSize);
+        }
+        m_pSqRing = mmap(nullptr, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         m_iRingFd, IORING_OFF_SQ_RING);
+        if(m_pSqRing == MAP_FAILED) {
+            int err = errno;
+            release();
+            throw PERSIST_EXP_MMAP_FILE(err);
+        }
+        if(params.features & IORING_FEAT_SINGLE_MMAP) {
+            m_pCqRing = m_pSqRing;
+        } else {
+            m_pCqRing = mmap(nullptr, m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                             m_iRingFd, IORING_OFF_CQ_RING);
+            if(m_pCqRing == MAP_FAILED) {
+                int err = errno;
+                release();
+                throw PERSIST_EXP_MMAP_FILE(err);
+            }
+        }
+        m_pSqes = (struct io_uring_sqe*)mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                             m_iRingFd, IORING_OFF_SQES);
+        if(m_pSqes == MAP_FAILED) {
+            int err = errno;
+            release();
+            throw PERSIST_EXP_MMAP_FILE(err);
+        }
+        m_pSqHead = (unsigned*)((char*)m_pSqRing + params.sq_off.head);
+        m_pSqTail = (unsigned*)((char*)m_pSqRing + params.sq_off.tail);
+        m_pSqMask = (unsigned*)((char*)m_pSqRing + params.sq_off.ring_mask);
+        m_pSqArray = (unsigned*)((char*)m_pSqRing + params.sq_off.array);
+        m_pCqHead = (unsigned*)((char*)m_pCqRing + params.cq_off.head);
+        m_pCqTail = (unsigned*)((char*)m_pCqRing + params.cq_off.tail);
+        m_pCqMask = (unsigned*)((char*)m_pCqRing + params.cq_off.ring_mask);
+        m_pCqes = (struct io_uring_cqe*)((char*)m_pCqRing + params.cq_off.cqes);
+        m_reaper = thread(&IoUringLogWriter::reap, this);
+        dbg_default_info("direct log writer uses io_uring with {} entries.", m_depth);
+    }
+
+    virtual ~IoUringLogWriter() noexcept(true) {
+        {
+            unique_lock<mutex> lck(m_mutex);
+            m_spaceCv.wait(lck, [this]() { return m_inFlightOps < m_depth; });
+            struct io_uring_sqe* sqe = nextSqe();
+            sqe->opcode = IORING_OP_NOP;
+            sqe->user_data = IO_URING_SHUTDOWN_TAG;
+            m_inFlightOps++;
+            try {
+                enter(1);
+            } catch(persist_exception_t e) {
+                dbg_default_error("io_uring writer failed to shut down: errno={}", PERSIST_EXP_USERCODE(e));
+                m_reaper.detach();
+                return;
+            }
+        }
+        m_reaper.join();
+        release();
+    }
+
+    virtual void submit(int fd, vector<DirectWrite>&& writes, bool sync,
+                        const FlushCallback& callback) noexcept(false) {
+        unique_lock<mutex> lck(m_mutex);
+        const uint64_t id = m_nextFlushId++;
+        pending_flush& flush = m_flushes.emplace(piecewise_construct, forward_as_tuple(id),
+                                                 forward_as_tuple(fd, std::move(writes), sync, callback))
+                                       .first->second;
+        if(flush.writes.empty() && !sync) {
+            m_flushes.erase(id);
+            lck.unlock();
+            callback(0);
+            return;
+        }
+        size_t next_write = 0;
+        while(next_write < flush.writes.size()) {
+            m_spaceCv.wait(lck, [this]() { return m_inFlightOps < m_depth; });
+            unsigned nr = 0;
+            while(next_write < flush.writes.size() && m_inFlightOps < m_depth) {
+                struct io_uring_sqe* sqe = nextSqe();
+                sqe->opcode = IORING_OP_WRITEV;
+                sqe->fd = fd;
+                sqe->off = flush.writes[next_write].offset;
+                sqe->addr = (uint64_t)&flush.iovecs[next_write];
+                sqe->len = 1;
+                sqe->user_data = IO_URING_FLUSH_TAG(id, false);
+                m_inFlightOps++;
+                next_write++;
+                nr++;
+            }
+            enter(nr);
+        }
+        // a flush without writes may be ready to sync right away
+        submitReadySyncs();
+    }
+};
+
+//////////////////////////////////////////////////////
+// fallback writer: one thread doing pwrite/fdatasync //
+//////////////////////////////////////////////////////
+
+class ThreadLogWriter : public DirectLogWriter {
+private:
+    mutex m_mutex;
+    condition_variable m_cv;
+    deque<pending_flush> m_queue;
+    bool m_bShutdown;
+    thread m_worker;
+
+    static int doWrites(pending_flush& flush) noexcept(true) {
+        for(const auto& write : flush.writes) {
+            size_t written = 0;
+            while(written < write.length) {
+                ssize_t ret = pwrite(flush.fd, write.buffer.get() + written, write.length - written,
+                                     write.offset + written);
+                if(ret < 0) {
+                    if(errno == EINTR) {
+                        continue;
+                    }
+                    return errno;
+                }
+                written += ret;
+            }
+        }
+        if(flush.sync && fdatasync(flush.fd) != 0) {
+            return errno;
+        }
+        return 0;
+    }
+
+    void work() noexcept(true) {
+        while(true) {
+            unique_lock<mutex> lck(m_mutex);
+            m_cv.wait(lck, [this]() { return m_bShutdown || !m_queue.empty(); });
+            if(m_queue.empty()) {
+                return;
+            }
+            pending_flush flush = std::move(m_queue.front());
+            m_queue.pop_front();
+            lck.unlock();
+            flush.callback(doWrites(flush));
+        }
+    }
+
+public:
+    ThreadLogWriter() : m_bShutdown(false) {
+        m_worker = thread(&ThreadLogWriter::work, this);
+        dbg_default_info("direct log writer uses a writer thread.");
+    }
+
+    virtual ~ThreadLogWriter() noexcept(true) {
+        {
+            lock_guard<mutex> lck(m_mutex);
+            m_bShutdown = true;
+        }
+        m_cv.notify_all();
+        m_worker.join();
+    }
+
+    virtual void submit(int fd, vector<DirectWrite>&& writes, bool sync,
+                        const FlushCallback& callback) noexcept(false) {
+        {
+            lock_guard<mutex> lck(m_mutex);
+            m_queue.emplace_back(fd, std::move(writes), sync, callback);
+        }
+        m_cv.notify_all();
+    }
+};
+
+shared_ptr<DirectLogWriter> DirectLogWriter::get() noexcept(false) {
+    static mutex writer_mutex;
+    static shared_ptr<DirectLogWriter> writer;
+    lock_guard<mutex> lck(writer_mutex);
+    if(!writer) {
+        try {
+            writer = create(true);
+        } catch(persist_exception_t e) {
+            dbg_default_info("io_uring is not available (errno={}), falling back to a writer thread.",
+                             PERSIST_EXP_USERCODE(e));
+            writer = create(false);
+        }
+    }
+    return writer;
+}
+
+shared_ptr<DirectLogWriter> DirectLogWriter::create(bool io_uring) noexcept(false) {
+    if(io_uring) {
+        return make_shared<IoUringLogWriter>(DIRECT_WRITER_QUEUE_DEPTH);
+    }
+    return make_shared<ThreadLogWriter>();
+}
+}
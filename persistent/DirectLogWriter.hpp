@@ -0,0 +1,63 @@
+#ifndef DIRECT_LOG_WRITER_HPP
+#define DIRECT_LOG_WRITER_HPP
+
+#include <functional>
+#include <memory>
+#include <sys/types.h>
+#include <vector>
+
+namespace persistent {
+
+// One write of a flush. The buffer, offset and length must all be aligned to
+// the block size of the file, because the file is opened with O_DIRECT.
+struct DirectWrite {
+    // the bytes to write, kept alive until the write completes
+    std::shared_ptr<char> buffer;
+    // number of bytes to write
+    size_t length;
+    // offset in the file
+    off_t offset;
+};
+
+// DirectLogWriter carries out the flushes of DirectPersistLog. A flush is a
+// set of writes to one file, optionally followed by a data sync of the file.
+// Flushes are asynchronous and several of them can be in flight at once; the
+// data sync of a flush is only started once every write of that flush, and
+// of all earlier flushes to the same file, has completed, so a completed
+// sync makes everything submitted before it durable.
+//
+// There is one writer per process, shared by all direct logs. It uses
+// io_uring when the kernel supports it, and otherwise falls back to a thread
+// doing pwrite() and fdatasync().
+class DirectLogWriter {
+public:
+    // called with 0 or the errno of the first failed operation of a flush,
+    // from the writer's thread.
+    using FlushCallback = std::function<void(int)>;
+
+    virtual ~DirectLogWriter() noexcept(true) {}
+
+    /**
+     * Submit a flush.
+     * @param fd - the file to write, opened with O_DIRECT
+     * @param writes - the writes of this flush
+     * @param sync - if the flush ends with a data sync of the file
+     * @param callback - called once the flush has completed
+     */
+    virtual void submit(int fd, std::vector<DirectWrite>&& writes, bool sync,
+                        const FlushCallback& callback) noexcept(false)
+            = 0;
+
+    // get the writer of this process
+    static std::shared_ptr<DirectLogWriter> get() noexcept(false);
+
+    /**
+     * Create a writer of its own, not shared with the direct logs.
+     * @param io_uring - use io_uring, or the pwrite() fallback if false
+     * @return the writer; throws if io_uring is asked for but not available.
+     */
+    static std::shared_ptr<DirectLogWriter> create(bool io_uring) noexcept(false);
+};
+}
+
+#endif  //DIRECT_LOG_WRITER_HPP
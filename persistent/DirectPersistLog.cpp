@@ -0,0 +1,980 @@
+#include "DirectPersistLog.hpp"
+#include "util.hpp"
+#include <algorithm>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if __GNUC__ > 7
+#include <filesystem>
+namespace fs = std::filesystem;
+#else
+#include <experimental/filesystem>
+namespace fs = std::experimental::filesystem;
+#endif
+
+using namespace std;
+
+namespace persistent {
+
+/////////////////////////
+// internal structures //
+/////////////////////////
+
+static inline uint64_t alignUp(uint64_t ofst) {
+    return (ofst + DIRECT_LOG_BLOCK_SIZE - 1) & ~(DIRECT_LOG_BLOCK_SIZE - 1);
+}
+
+static inline uint64_t alignDown(uint64_t ofst) {
+    return ofst & ~(DIRECT_LOG_BLOCK_SIZE - 1);
+}
+
+// size of a record with dlen bytes of data
+static inline uint64_t recordSize(uint64_t dlen) {
+    return (sizeof(DirectRecordHeader) + dlen + 7) & ~((uint64_t)7);
+}
+
+// FNV-1a over 64-bit words
+static uint64_t checksumBytes(const void* p, uint64_t len, uint64_t sum) {
+    const uint8_t* bytes = (const uint8_t*)p;
+    uint64_t i = 0;
+    for(; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, bytes + i, sizeof(word));
+        sum = (sum ^ word) * 0x100000001b3ull;
+    }
+    for(; i < len; i++) {
+        sum = (sum ^ bytes[i]) * 0x100000001b3ull;
+    }
+    return sum;
+}
+
+static uint64_t recordChecksum(const DirectRecordHeader& header, const void* pdata) {
+    DirectRecordHeader h = header;
+    h.checksum = 0;
+    uint64_t sum = checksumBytes(&h, sizeof(h), 0xcbf29ce484222325ull);
+    return checksumBytes(pdata, header.dlen, sum);
+}
+
+// allocate a zeroed buffer aligned for O_DIRECT
+static std::shared_ptr<char> allocAligned(uint64_t size) noexcept(false) {
+    void* p = nullptr;
+    int ret = posix_memalign(&p, DIRECT_LOG_BLOCK_SIZE, size);
+    if(ret != 0) {
+        throw PERSIST_EXP_ALLOC(ret);
+    }
+    memset(p, 0, size);
+    return std::shared_ptr<char>((char*)p, free);
+}
+
+static bool preadFully(int fd, void* buf, uint64_t len, uint64_t ofst) {
+    uint64_t done = 0;
+    while(done < len) {
+        ssize_t nRead = pread(fd, (char*)buf + done, len - done, ofst + done);
+        if(nRead <= 0) {
+            if(nRead < 0 && errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        done += nRead;
+    }
+    return true;
+}
+
+// read and validate the record at ofst
+static bool readRecord(int fd, uint64_t ofst, uint64_t file_size,
+                       DirectRecordHeader& header, std::vector<char>& data) {
+    if(ofst + sizeof(DirectRecordHeader) > file_size) {
+        return false;
+    }
+    if(!preadFully(fd, &header, sizeof(DirectRecordHeader), ofst)) {
+        return false;
+    }
+    if(header.magic != DIRECT_RECORD_MAGIC
+       || (header.type != DIRECT_RECORD_ENTRY && header.type != DIRECT_RECORD_VERSION)
+       || header.dlen > file_size - ofst - sizeof(DirectRecordHeader)) {
+        return false;
+    }
+    data.resize(header.dlen);
+    if(header.dlen > 0 && !preadFully(fd, data.data(), header.dlen, ofst + sizeof(DirectRecordHeader))) {
+        return false;
+    }
+    return recordChecksum(header, data.data()) == header.checksum;
+}
+
+// scan the records of a log file starting at ofst and call f on each of
+// them, until the first record which is torn, stale or missing.
+// return the offset after the last valid record.
+static uint64_t scanLog(int fd, uint64_t ofst, uint64_t file_size,
+                        const std::function<void(const DirectRecordHeader&, uint64_t)>& f) {
+    int64_t last_entry_ver = INVALID_VERSION;
+    DirectRecordHeader header;
+    std::vector<char> data;
+    while(true) {
+        uint64_t rofst = ofst;
+        bool valid = readRecord(fd, rofst, file_size, header, data);
+        if(!valid && (rofst % DIRECT_LOG_BLOCK_SIZE) != 0) {
+            // persist() pads the records written so far to a block boundary
+            rofst = alignUp(rofst);
+            valid = readRecord(fd, rofst, file_size, header, data);
+        }
+        if(!valid || (header.type == DIRECT_RECORD_ENTRY && header.ver <= last_entry_ver)) {
+            break;
+        }
+        if(header.type == DIRECT_RECORD_ENTRY) {
+            last_entry_ver = header.ver;
+        }
+        f(header, rofst);
+        ofst = rofst + recordSize(header.dlen);
+    }
+    return ofst;
+}
+
+// read the meta header, or return false if there is none.
+static bool readMetaHeader(const string& metaFile, DirectMetaHeader& header) noexcept(false) {
+    if(!fs::exists(metaFile)) {
+        return false;
+    }
+    int fd = open(metaFile.c_str(), O_RDONLY);
+    if(fd == -1) {
+        throw PERSIST_EXP_OPEN_FILE(errno);
+    }
+    ssize_t nRead = read(fd, &header, sizeof(DirectMetaHeader));
+    close(fd);
+    if(nRead != sizeof(DirectMetaHeader)) {
+        throw PERSIST_EXP_READ_FILE(errno);
+    }
+    return true;
+}
+
+////////////////////////
+// visible to outside //
+////////////////////////
+
+DirectPersistLog::DirectPersistLog(const string& name, const string& dataPath) noexcept(false) : PersistLog(name),
+                                                                                                 m_sDataPath(dataPath),
+                                                                                                 m_sMetaFile(dataPath + "/" + name + "." + DIRECT_META_FILE_SUFFIX),
+                                                                                                 m_sLogFile(dataPath + "/" + name + "." + DIRECT_LOG_FILE_SUFFIX),
+                                                                                                 m_iLogFileDesc(-1),
+                                                                                                 m_iReadFileDesc(-1),
+                                                                                                 m_head(0),
+                                                                                                 m_headOfst(0),
+                                                                                                 m_latestVersion(INVALID_VERSION),
+                                                                                                 m_currChunk{nullptr, 0, 0, 0, 0},
+                                                                                                 m_nextOfst(0),
+                                                                                                 m_allocatedSize(0),
+                                                                                                 m_cacheHead(0),
+                                                                                                 m_cachedBytes(0),
+                                                                                                 m_punchedOfst(0),
+                                                                                                 m_syncSubmittedVersion(INVALID_VERSION),
+                                                                                                 m_reservedSize(0),
+                                                                                                 m_persistedVersion(INVALID_VERSION),
+                                                                                                 m_persistedOfst(0),
+                                                                                                 m_flushesInFlight(0),
+                                                                                                 m_writeError(0) {
+    this->m_pWriter = DirectLogWriter::get();
+    dbg_default_trace("{0} constructor: before load()", name);
+    if(derecho::getConfBoolean(CONF_PERS_RESET)) {
+        reset();
+    }
+    load();
+    dbg_default_trace("{0} constructor: after load()", name);
+}
+
+void DirectPersistLog::reset() noexcept(false) {
+    dbg_default_trace("{0} reset state...begin", this->m_sName);
+    for(const string& file : {this->m_sMetaFile, this->m_sLogFile}) {
+        if(fs::exists(file) && !fs::remove(file)) {
+            dbg_default_error("{0} reset failed to remove the file:{1}", this->m_sName, file);
+            throw PERSIST_EXP_REMOVE_FILE(errno);
+        }
+    }
+    dbg_default_trace("{0} reset state...done", this->m_sName);
+}
+
+void DirectPersistLog::load() noexcept(false) {
+    dbg_default_trace("{0}:load state...begin", this->m_sName);
+    // STEP 0: check if data path exists
+    checkOrCreateDir(this->m_sDataPath);
+    // STEP 1: read the meta header, if the log has been trimmed
+    DirectMetaHeader meta{0, 0};
+    readMetaHeader(this->m_sMetaFile, meta);
+    // STEP 2: open the log file
+    this->m_iLogFileDesc = open(this->m_sLogFile.c_str(), O_RDWR | O_CREAT | O_DIRECT,
+                                S_IWUSR | S_IRUSR | S_IRGRP | S_IWGRP | S_IROTH);
+    if(this->m_iLogFileDesc == -1) {
+        dbg_default_error("{0}:failed to open {1} with O_DIRECT. Does the file system support direct I/O?",
+                          this->m_sName, this->m_sLogFile);
+        throw PERSIST_EXP_OPEN_FILE(errno);
+    }
+    this->m_iReadFileDesc = open(this->m_sLogFile.c_str(), O_RDONLY);
+    if(this->m_iReadFileDesc == -1) {
+        throw PERSIST_EXP_OPEN_FILE(errno);
+    }
+    struct stat sb;
+    if(fstat(this->m_iReadFileDesc, &sb) != 0) {
+        throw PERSIST_EXP_STAT_FILE(errno);
+    }
+    // STEP 3: rebuild the index from the records
+    this->m_head = meta.head;
+    this->m_headOfst = meta.head_ofst;
+    uint64_t end = scanLog(this->m_iReadFileDesc, meta.head_ofst, sb.st_size,
+                           [this](const DirectRecordHeader& header, uint64_t rofst) {
+                               if(header.type == DIRECT_RECORD_ENTRY) {
+                                   this->hidx.insert(header.hlc_r, header.hlc_l, this->m_head + this->numEntries());
+                                   this->m_entries.push_back(Entry{header.ver, header.dlen, header.hlc_r, header.hlc_l, rofst, nullptr});
+                               }
+                               this->m_latestVersion = std::max(this->m_latestVersion, header.ver);
+                           });
+    this->m_cacheHead = this->m_head + this->numEntries();
+    // STEP 4: drop whatever follows the last valid record
+    resetTail(end);
+    this->m_persistedVersion = this->m_latestVersion;
+    this->m_syncSubmittedVersion = this->m_latestVersion;
+    this->m_persistedOfst = this->m_nextOfst;
+    dbg_default_trace("{0}:load state...done, {1} entries, latest version {2}",
+                      this->m_sName, this->numEntries(), this->m_latestVersion);
+}
+
+DirectPersistLog::~DirectPersistLog() noexcept(true) {
+    // the callbacks of the flushes in flight refer to this log
+    waitForFlushes();
+    if(this->m_iLogFileDesc != -1) {
+        close(this->m_iLogFileDesc);
+    }
+    if(this->m_iReadFileDesc != -1) {
+        close(this->m_iReadFileDesc);
+    }
+}
+
+void DirectPersistLog::append(const void* pdat, const uint64_t& size, const int64_t& ver, const HLC& mhlc) noexcept(false) {
+    dbg_default_trace("{0} append event ({1},{2})", this->m_sName, mhlc.m_rtc_us, mhlc.m_logic);
+    std::vector<DirectWrite> writes;
+    std::lock_guard<std::mutex> submit_lock(this->m_submitLock);
+    {
+        std::unique_lock<std::shared_mutex> write_lock(this->m_rwlock);
+        if(numEntries() > 0 && this->m_latestVersion >= ver) {
+            dbg_default_error("{0}-append version already exists! cur_ver:{1} new_ver:{2}", this->m_sName,
+                              this->m_latestVersion, (int64_t)ver);
+            dbg_default_flush();
+            throw PERSIST_EXP_INV_VERSION;
+        }
+        appendEntry(pdat, size, ver, mhlc, writes);
+    }
+    // write the full chunk behind
+    if(!writes.empty()) {
+        submitFlush(std::move(writes), false, INVALID_VERSION, 0);
+    }
+    dbg_default_debug("{0} append a log ver:{1} hlc:({2},{3})", this->m_sName,
+                      ver, mhlc.m_rtc_us, mhlc.m_logic);
+}
+
+void* DirectPersistLog::reserveAppend(const uint64_t& size, const int64_t& ver) noexcept(false) {
+    // the submit lock is held until commitAppend() or abortAppend(), so that
+    // persist() does not pad the current chunk over the reserved record.
+    this->m_submitLock.lock();
+    try {
+        std::unique_lock<std::shared_mutex> write_lock(this->m_rwlock);
+        if(numEntries() > 0 && this->m_latestVersion >= ver) {
+            dbg_default_error("{0}-append version already exists! cur_ver:{1} new_ver:{2}", this->m_sName,
+                              this->m_latestVersion, (int64_t)ver);
+            dbg_default_flush();
+            throw PERSIST_EXP_INV_VERSION;
+        }
+        void* pdata = reserveRecord(size, this->m_reservedWrites);
+        this->m_reservedSize = size;
+        return pdata;
+    } catch(persist_exception_t e) {
+        this->m_submitLock.unlock();
+        throw e;
+    }
+}
+
+void DirectPersistLog::commitAppend(const int64_t& ver, const HLC& mhlc) noexcept(false) {
+    std::lock_guard<std::mutex> submit_lock(this->m_submitLock, std::adopt_lock);
+    // write the chunk filled before the reserved record behind
+    if(!this->m_reservedWrites.empty()) {
+        std::vector<DirectWrite> writes;
+        writes.swap(this->m_reservedWrites);
+        submitFlush(std::move(writes), false, INVALID_VERSION, 0);
+    }
+    std::unique_lock<std::shared_mutex> write_lock(this->m_rwlock);
+    indexEntry(commitRecord(DIRECT_RECORD_ENTRY, this->m_reservedSize, ver, mhlc),
+               this->m_reservedSize, ver, mhlc);
+    dbg_default_debug("{0} append a log ver:{1} hlc:({2},{3})", this->m_sName,
+                      ver, mhlc.m_rtc_us, mhlc.m_logic);
+}
+
+void DirectPersistLog::abortAppend() noexcept(true) {
+    std::lock_guard<std::mutex> submit_lock(this->m_submitLock, std::adopt_lock);
+    std::vector<DirectWrite> writes;
+    writes.swap(this->m_reservedWrites);
+    // the reserved record is overwritten by the next one, but the chunk
+    // filled before the reservation still has to be written.
+    if(!writes.empty()) {
+        try {
+            submitFlush(std::move(writes), false, INVALID_VERSION, 0);
+        } catch(persist_exception_t e) {
+            dbg_default_error("{0} failed to submit a flush, error={1}", this->m_sName, PERSIST_EXP_USERCODE(e));
+        }
+    }
+}
+
+void DirectPersistLog::advanceVersion(const int64_t& ver) noexcept(false) {
+    std::vector<DirectWrite> writes;
+    std::lock_guard<std::mutex> submit_lock(this->m_submitLock);
+    {
+        std::unique_lock<std::shared_mutex> write_lock(this->m_rwlock);
+        if(this->m_latestVersion >= ver) {
+            throw PERSIST_EXP_INV_VERSION;
+        }
+        // the version is recorded in the log file instead of a meta header
+        appendRecord(DIRECT_RECORD_VERSION, nullptr, 0, ver, HLC{0, 0}, writes);
+        this->m_latestVersion = ver;
+    }
+    if(!writes.empty()) {
+        submitFlush(std::move(writes), false, INVALID_VERSION, 0);
+    }
+}
+
+const int64_t DirectPersistLog::persist(const bool preLocked) noexcept(false) {
+    int64_t ver_ret = INVALID_VERSION;
+    waitForPersisted(startPersist(ver_ret));
+    return ver_ret;
+}
+
+int64_t DirectPersistLog::getLength() noexcept(false) {
+    std::shared_lock<std::shared_mutex> read_lock(this->m_rwlock);
+    return numEntries();
+}
+
+int64_t DirectPersistLog::getEarliestIndex() noexcept(false) {
+    std::shared_lock<std::shared_mutex> read_lock(this->m_rwlock);
+    return (numEntries() == 0) ? INVALID_INDEX : this->m_head;
+}
+
+int64_t DirectPersistLog::getLatestIndex() noexcept(false) {
+    std::shared_lock<std::shared_mutex> read_lock(this->m_rwlock);
+    return (numEntries() == 0) ? -1 : this->m_head + numEntries() - 1;
+}
+
+version_t DirectPersistLog::getEarliestVersion() noexcept(false) {
+    std::shared_lock<std::shared_mutex> read_lock(this->m_rwlock);
+    return (numEntries() == 0) ? INVALID_VERSION : this->m_entries.front().ver;
+}
+
+version_t DirectPersistLog::getLatestVersion() noexcept(false) {
+    std::shared_lock<std::shared_mutex> read_lock(this->m_rwlock);
+    return (numEntries() == 0) ? INVALID_VERSION : this->m_entries.back().ver;
+}
+
+const version_t DirectPersistLog::getLastPersisted() noexcept(false) {
+    std::lock_guard<std::mutex> lck(this->m_persLock);
+    return this->m_persistedVersion;
+}
+
+int64_t DirectPersistLog::getVersionIndex(const version_t& ver) {
+    std::shared_lock<std::shared_mutex> read_lock(this->m_rwlock);
+    int64_t l_idx = searchVersion(ver);
+    dbg_default_trace("{0} getVersionIndex({1}) at index {2}", this->m_sName, ver, l_idx);
+    return l_idx;
+}
+
+int64_t DirectPersistLog::getHLCIndex(const HLC& rhlc) noexcept(false) {
+    std::shared_lock<std::shared_mutex> read_lock(this->m_rwlock);
+    int64_t l_idx = this->hidx.search(rhlc);
+    dbg_default_trace("{0} getHLCIndex({1},{2}) at index {3}", this->m_sName, rhlc.m_rtc_us, rhlc.m_logic, l_idx);
+    return l_idx;
+}
+
+version_t DirectPersistLog::getVersionByIndex(const int64_t& eidx) noexcept(false) {
+    std::shared_lock<std::shared_mutex> read_lock(this->m_rwlock);
+    int64_t tail = this->m_head + numEntries();
+    int64_t ridx = (eidx < 0) ? (tail + eidx) : eidx;
+
+    if(tail <= ridx || ridx < this->m_head) {
+        throw PERSIST_EXP_INV_ENTRY_IDX(eidx);
+    }
+    return entryAt(ridx).ver;
+}
+
+const void* DirectPersistLog::getEntryByIndex(const int64_t& eidx) noexcept(false) {
+    std::shared_lock<std::shared_mutex> read_lock(this->m_rwlock);
+    int64_t tail = this->m_head + numEntries();
+    dbg_default_trace("{0}-getEntryByIndex-head:{1},tail:{2},eidx:{3}",
+                      this->m_sName, this->m_head, tail, eidx);
+
+    int64_t ridx = (eidx < 0) ? (tail + eidx) : eidx;
+
+    if(tail <= ridx || ridx < this->m_head) {
+        throw PERSIST_EXP_INV_ENTRY_IDX(eidx);
+    }
+    return entryData(entryAt(ridx), nextPinnedEntry());
+}
+
+const void* DirectPersistLog::getEntry(const int64_t& ver) noexcept(false) {
+    std::shared_lock<std::shared_mutex> read_lock(this->m_rwlock);
+    int64_t l_idx = searchVersion(ver);
+    // no object exists before the requested version.
+    if(l_idx == -1) {
+        return nullptr;
+    }
+    return entryData(entryAt(l_idx), nextPinnedEntry());
+}
+
+const void* DirectPersistLog::getEntry(const HLC& rhlc) noexcept(false) {
+    std::shared_lock<std::shared_mutex> read_lock(this->m_rwlock);
+    dbg_default_trace("getEntry for hlc({0},{1})", rhlc.m_rtc_us, rhlc.m_logic);
+    int64_t l_idx = this->hidx.search(rhlc);
+    if(l_idx == INVALID_INDEX) {
+        // no object exists before the requested timestamp.
+        return nullptr;
+    }
+    dbg_default_trace("getEntry returns: idx:{0}", l_idx);
+    return entryData(entryAt(l_idx), nextPinnedEntry());
+}
+
+// trim by index
+void DirectPersistLog::trimByIndex(const int64_t& idx) noexcept(false) {
+    dbg_default_trace("{0} trim at index: {1}", this->m_sName, idx);
+    std::unique_lock<std::shared_mutex> write_lock(this->m_rwlock);
+    // validate check
+    if(idx < this->m_head || idx >= this->m_head + numEntries()) {
+        return;
+    }
+    const Entry& last = entryAt(idx);
+    uint64_t trimmed_end = last.rofst + recordSize(last.dlen);
+    while(this->m_head <= idx) {
+        if(this->m_entries.front().data) {
+            this->m_cachedBytes -= this->m_entries.front().dlen;
+        }
+        this->m_entries.pop_front();
+        this->m_head++;
+    }
+    this->m_cacheHead = std::max(this->m_cacheHead, this->m_head);
+    this->hidx.trim(this->m_head);
+    this->m_headOfst = (numEntries() > 0) ? this->m_entries.front().rofst : trimmed_end;
+    persistMetaHeader(DirectMetaHeader{this->m_head, this->m_headOfst});
+    // give the space of the trimmed records back to the file system. Only
+    // durable blocks are punched, so no write in flight can hit the hole.
+    uint64_t punch_end = alignDown(std::min(this->m_headOfst, this->m_persistedOfst.load()));
+    if(punch_end > this->m_punchedOfst) {
+        if(fallocate(this->m_iLogFileDesc, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                     this->m_punchedOfst, punch_end - this->m_punchedOfst)
+           != 0) {
+            dbg_default_warn("{0} failed to punch the trimmed records out of {1}, errno={2}",
+                             this->m_sName, this->m_sLogFile, errno);
+        }
+        this->m_punchedOfst = punch_end;
+    }
+    dbg_default_trace("{0} trim at index: {1}...done", this->m_sName, idx);
+}
+
+void DirectPersistLog::trim(const int64_t& ver) noexcept(false) {
+    dbg_default_trace("{0} trim at version: {1}", this->m_sName, ver);
+    int64_t idx;
+    {
+        std::shared_lock<std::shared_mutex> read_lock(this->m_rwlock);
+        idx = searchVersion(ver);
+    }
+    if(idx != -1) {
+        // trimByIndex() checks the index again.
+        trimByIndex(idx);
+    }
+    dbg_default_trace("{0} trim at version: {1}...done", this->m_sName, ver);
+}
+
+void DirectPersistLog::trim(const HLC& hlc) noexcept(false) {
+    //TODO: This is hard because HLC order does not agree with index order.
+    throw PERSIST_EXP_UNIMPLEMENTED;
+}
+
+void DirectPersistLog::persistMetaHeader(const DirectMetaHeader& header) noexcept(false) {
+    // STEP 1: get file name
+    const string swpFile = this->m_sMetaFile + "." + SWAP_FILE_SUFFIX;
+
+    // STEP 2: write the meta header to swap file
+    int fd = open(swpFile.c_str(), O_RDWR | O_CREAT | O_TRUNC, S_IWUSR | S_IRUSR | S_IRGRP | S_IWGRP | S_IROTH);
+    if(fd == -1) {
+        throw PERSIST_EXP_OPEN_FILE(errno);
+    }
+    ssize_t nWrite = write(fd, &header, sizeof(DirectMetaHeader));
+    if(nWrite != sizeof(DirectMetaHeader)) {
+        close(fd);
+        throw PERSIST_EXP_WRITE_FILE(errno);
+    }
+    if(fsync(fd) != 0) {
+        close(fd);
+        throw PERSIST_EXP_WRITE_FILE(errno);
+    }
+    close(fd);
+
+    // STEP 3: atomically update the meta file
+    if(rename(swpFile.c_str(), this->m_sMetaFile.c_str()) != 0) {
+        throw PERSIST_EXP_RENAME_FILE(errno);
+    }
+}
+
+void DirectPersistLog::truncate(const int64_t& ver) noexcept(false) {
+    dbg_default_trace("{0} truncate at version: {1}.", this->m_sName, ver);
+    // STEP 1: make everything appended so far durable, so that the tail can
+    // be cut without any write in flight.
+    persist();
+    waitForFlushes();
+    std::vector<DirectWrite> writes;
+    std::lock_guard<std::mutex> submit_lock(this->m_submitLock);
+    {
+        std::unique_lock<std::shared_mutex> write_lock(this->m_rwlock);
+        // STEP 2: remove the entries after ver
+        int64_t l_idx = searchVersion(ver);
+        int64_t new_tail = (l_idx == -1) ? this->m_head : l_idx + 1;
+        uint64_t cut = this->m_headOfst;
+        if(new_tail > this->m_head) {
+            const Entry& last = entryAt(new_tail - 1);
+            cut = last.rofst + recordSize(last.dlen);
+        }
+        while(this->m_head + numEntries() > new_tail) {
+            if(this->m_entries.back().data) {
+                this->m_cachedBytes -= this->m_entries.back().dlen;
+            }
+            this->m_entries.pop_back();
+        }
+        this->m_cacheHead = std::min(this->m_cacheHead, new_tail);
+        this->hidx.truncate(new_tail);
+        // STEP 3: cut the log file after the last entry kept
+        resetTail(cut);
+        if(this->m_latestVersion > ver) {
+            this->m_latestVersion = ver;
+        }
+        {
+            std::lock_guard<std::mutex> lck(this->m_persLock);
+            this->m_persistedVersion = std::min(this->m_persistedVersion, this->m_latestVersion);
+            this->m_persistedOfst = this->m_nextOfst;
+        }
+        // STEP 4: record the latest version if it is beyond the last entry
+        int64_t last_entry_ver = (numEntries() > 0) ? this->m_entries.back().ver : INVALID_VERSION;
+        if(this->m_latestVersion > last_entry_ver) {
+            appendRecord(DIRECT_RECORD_VERSION, nullptr, 0, this->m_latestVersion, HLC{0, 0}, writes);
+            takeWrites(writes);
+        }
+        this->m_syncSubmittedVersion = this->m_latestVersion;
+    }
+    if(!writes.empty()) {
+        submitFlush(std::move(writes), true, INVALID_VERSION, this->m_nextOfst);
+        waitForFlushes();
+        std::lock_guard<std::mutex> lck(this->m_persLock);
+        if(this->m_writeError != 0) {
+            throw PERSIST_EXP_DIRECT_IO(this->m_writeError);
+        }
+    }
+    dbg_default_trace("{0} truncate at version: {1}....done", this->m_sName, ver);
+}
+
+// The log tail uses the format of FilePersistLog:
+// [latest_version(int64_t)][nr_log_entry(int64_t)][log_enty1][log_entry2]...
+// the log entry is from the earliest to the latest.
+size_t DirectPersistLog::bytes_size(const int64_t& ver) noexcept(false) {
+    std::shared_lock<std::shared_mutex> read_lock(this->m_rwlock);
+    size_t bsize = (sizeof(int64_t) + sizeof(int64_t));
+    int64_t idx = this->getMinimumIndexBeyondVersion(ver);
+    if(idx != INVALID_INDEX) {
+        for(; idx < this->m_head + numEntries(); idx++) {
+            bsize += sizeof(LogEntry) + entryAt(idx).dlen;
+        }
+    }
+    return bsize;
+}
+
+size_t DirectPersistLog::to_bytes(char* buf, const int64_t& ver) noexcept(false) {
+    size_t ofst = 0;
+    this->post_object([buf, &ofst](char const* const data, std::size_t size) {
+        memcpy(buf + ofst, data, size);
+        ofst += size;
+    },
+                      ver);
+    return ofst;
+}
+
+void DirectPersistLog::post_object(const std::function<void(char const* const, std::size_t)>& f,
+                                   const int64_t& ver) noexcept(false) {
+    std::shared_lock<std::shared_mutex> read_lock(this->m_rwlock);
+    int64_t idx = this->getMinimumIndexBeyondVersion(ver);
+    int64_t tail = this->m_head + numEntries();
+    // latest_version
+    int64_t latest_version = (numEntries() == 0) ? INVALID_VERSION : this->m_entries.back().ver;
+    f((char*)&latest_version, sizeof(int64_t));
+    // nr_log_entry
+    int64_t nr_log_entry = (idx == INVALID_INDEX) ? 0 : (tail - idx);
+    f((char*)&nr_log_entry, sizeof(int64_t));
+    // log_entries
+    if(idx != INVALID_INDEX) {
+        for(; idx < tail; idx++) {
+            postLogEntry(f, entryAt(idx));
+        }
+    }
+}
+
+void DirectPersistLog::applyLogTail(char const* v) noexcept(false) {
+    std::vector<DirectWrite> writes;
+    std::lock_guard<std::mutex> submit_lock(this->m_submitLock);
+    {
+        std::unique_lock<std::shared_mutex> write_lock(this->m_rwlock);
+        size_t ofst = 0;
+        // latest_version
+        int64_t latest_version = *(const int64_t*)(v + ofst);
+        ofst += sizeof(int64_t);
+        // nr_log_entry
+        int64_t nr_log_entry = *(const int64_t*)(v + ofst);
+        ofst += sizeof(int64_t);
+        // log_entries
+        while(nr_log_entry--) {
+            ofst += mergeLogEntryFromByteArray(v + ofst, writes);
+        }
+        // update the latest version.
+        if(latest_version > this->m_latestVersion) {
+            appendRecord(DIRECT_RECORD_VERSION, nullptr, 0, latest_version, HLC{0, 0}, writes);
+            this->m_latestVersion = latest_version;
+        }
+    }
+    if(!writes.empty()) {
+        submitFlush(std::move(writes), false, INVALID_VERSION, 0);
+    }
+}
+
+const uint64_t DirectPersistLog::getMinimumLatestPersistedVersion(const std::string& prefix, const std::string& path) {
+    // STEP 1: list all log files in the path
+    DIR* dir = opendir(path.c_str());
+    if(dir == NULL) {
+        // We cannot open the persistent directory, so just return error.
+        dbg_default_error("{}:{} failed to open the directory. errno={}, err={}.",
+                          __FILE__, __func__, errno, strerror(errno));
+        return INVALID_VERSION;
+    }
+    // STEP 2: scan the logs for the minimum of their latest versions
+    struct dirent* dent;
+    bool found = false;
+    int64_t ver = INVALID_VERSION;
+    const size_t suffix_len = strlen(DIRECT_LOG_FILE_SUFFIX) + 1;
+    while((dent = readdir(dir)) != NULL) {
+        size_t name_len = strlen(dent->d_name);
+        if(name_len > prefix.length() + suffix_len && strncmp(prefix.c_str(), dent->d_name, prefix.length()) == 0 && strcmp("." DIRECT_LOG_FILE_SUFFIX, dent->d_name + name_len - suffix_len) == 0) {
+            const string base = path + "/" + string(dent->d_name, name_len - suffix_len);
+            DirectMetaHeader meta{0, 0};
+            try {
+                readMetaHeader(base + "." + DIRECT_META_FILE_SUFFIX, meta);
+            } catch(persist_exception_t e) {
+                dbg_default_warn("{}:{} cannot load meta header of log:{}", __FILE__, __func__, dent->d_name);
+                continue;
+            }
+            int fd = open((base + "." + DIRECT_LOG_FILE_SUFFIX).c_str(), O_RDONLY);
+            struct stat sb;
+            if(fd < 0 || fstat(fd, &sb) != 0) {
+                dbg_default_warn("{}:{} cannot read file:{}, errno={}, err={}.",
+                                 __FILE__, __func__, dent->d_name, errno, strerror(errno));
+                if(fd >= 0) {
+                    close(fd);
+                }
+                continue;
+            }
+            int64_t latest_version = INVALID_VERSION;
+            scanLog(fd, meta.head_ofst, sb.st_size,
+                    [&latest_version](const DirectRecordHeader& header, uint64_t) {
+                        latest_version = std::max(latest_version, header.ver);
+                    });
+            close(fd);
+            if(!found || ver > latest_version) {
+                ver = latest_version;
+                found = true;
+            }
+        }
+    }
+    closedir(dir);
+    return ver;
+}
+
+//////////////////////////
+// invisible to outside //
+//////////////////////////
+
+int64_t DirectPersistLog::searchVersion(const int64_t& ver) noexcept(true) {
+    auto it = std::upper_bound(this->m_entries.begin(), this->m_entries.end(), ver,
+                               [](const int64_t& v, const Entry& entry) { return v < entry.ver; });
+    if(it == this->m_entries.begin()) {
+        return -1;
+    }
+    return this->m_head + (it - this->m_entries.begin()) - 1;
+}
+
+int64_t DirectPersistLog::getMinimumIndexBeyondVersion(const int64_t& ver) noexcept(true) {
+    if(numEntries() == 0) {
+        dbg_default_trace("{0}[{1}] - request on an empty log, return INVALID_INDEX.", this->m_sName, __func__);
+        return INVALID_INDEX;
+    }
+    if(ver == INVALID_VERSION) {
+        // return the earliest log we have.
+        return this->m_head;
+    }
+    int64_t l_idx = searchVersion(ver);
+    if(l_idx == -1) {
+        // the requested version is earlier than the earliest available log
+        return this->m_head;
+    } else if((l_idx + 1) == this->m_head + numEntries()) {
+        // ver is in the future
+        return INVALID_INDEX;
+    }
+    return l_idx + 1;
+}
+
+const char* DirectPersistLog::entryData(const Entry& entry, std::shared_ptr<char>& holder) noexcept(false) {
+    if(entry.data) {
+        holder = entry.data;
+        return holder.get();
+    }
+    // evicted entries are durable, so they can be read from the file
+    holder = std::shared_ptr<char>(new char[std::max<uint64_t>(entry.dlen, 1)], std::default_delete<char[]>());
+    if(!preadFully(this->m_iReadFileDesc, holder.get(), entry.dlen, entry.rofst + sizeof(DirectRecordHeader))) {
+        throw PERSIST_EXP_READ_FILE(errno);
+    }
+    return holder.get();
+}
+
+char* DirectPersistLog::reserveRecord(uint64_t size, std::vector<DirectWrite>& writes) noexcept(false) {
+    const uint64_t rsize = recordSize(size);
+    Chunk& chunk = this->m_currChunk;
+    if(!chunk.buffer || chunk.capacity - chunk.used < rsize) {
+        // allocate first: the writes of the current chunk must not be lost
+        // if this fails.
+        const uint64_t ofst = chunk.buffer ? chunk.ofst + alignUp(chunk.used) : this->m_nextOfst;
+        const uint64_t capacity = std::max(DIRECT_LOG_CHUNK_SIZE, alignUp(rsize));
+        ensureAllocated(ofst + capacity);
+        std::shared_ptr<char> buffer = allocAligned(capacity);
+        takeWrites(writes);
+        chunk = Chunk{std::move(buffer), capacity, ofst, 0, 0};
+    }
+    return chunk.buffer.get() + chunk.used + sizeof(DirectRecordHeader);
+}
+
+uint64_t DirectPersistLog::commitRecord(uint32_t type, uint64_t size, int64_t ver, const HLC& mhlc) noexcept(true) {
+    char* record = this->m_currChunk.buffer.get() + this->m_currChunk.used;
+    DirectRecordHeader* header = (DirectRecordHeader*)record;
+    header->magic = DIRECT_RECORD_MAGIC;
+    header->type = type;
+    header->ver = ver;
+    header->dlen = size;
+    header->hlc_r = mhlc.m_rtc_us;
+    header->hlc_l = mhlc.m_logic;
+    header->checksum = recordChecksum(*header, record + sizeof(DirectRecordHeader));
+    uint64_t rofst = this->m_currChunk.ofst + this->m_currChunk.used;
+    this->m_currChunk.used += recordSize(size);
+    return rofst;
+}
+
+uint64_t DirectPersistLog::appendRecord(uint32_t type, const void* pdata, uint64_t size,
+                                        int64_t ver, const HLC& mhlc,
+                                        std::vector<DirectWrite>& writes) noexcept(false) {
+    char* pdest = reserveRecord(size, writes);
+    if(size > 0) {
+        memcpy(pdest, pdata, size);
+    }
+    return commitRecord(type, size, ver, mhlc);
+}
+
+void DirectPersistLog::appendEntry(const void* pdata, uint64_t size, int64_t ver, const HLC& mhlc,
+                                   std::vector<DirectWrite>& writes) noexcept(false) {
+    indexEntry(appendRecord(DIRECT_RECORD_ENTRY, pdata, size, ver, mhlc, writes), size, ver, mhlc);
+}
+
+void DirectPersistLog::indexEntry(uint64_t rofst, uint64_t size, int64_t ver, const HLC& mhlc) noexcept(false) {
+    // the data stays in the chunk until it is evicted from the cache
+    std::shared_ptr<char> data(this->m_currChunk.buffer,
+                               this->m_currChunk.buffer.get() + (rofst - this->m_currChunk.ofst) + sizeof(DirectRecordHeader));
+    this->hidx.insert(mhlc.m_rtc_us, mhlc.m_logic, this->m_head + numEntries());
+    this->m_entries.push_back(Entry{ver, size, mhlc.m_rtc_us, mhlc.m_logic, rofst, std::move(data)});
+    this->m_latestVersion = ver;
+    this->m_cachedBytes += size;
+    evictEntries();
+}
+
+void DirectPersistLog::takeWrites(std::vector<DirectWrite>& writes) noexcept(true) {
+    Chunk& chunk = this->m_currChunk;
+    if(!chunk.buffer || chunk.used == chunk.submitted) {
+        return;
+    }
+    // the chunk is zeroed, so the records are padded with zeros up to the
+    // block boundary. The next records go to the following block, so that no
+    // block is written twice.
+    const uint64_t end = alignUp(chunk.used);
+    writes.push_back(DirectWrite{std::shared_ptr<char>(chunk.buffer, chunk.buffer.get() + chunk.submitted),
+                                 end - chunk.submitted,
+                                 (off_t)(chunk.ofst + chunk.submitted)});
+    chunk.used = chunk.submitted = end;
+    this->m_nextOfst = chunk.ofst + end;
+    if(chunk.used == chunk.capacity) {
+        chunk = Chunk{nullptr, 0, 0, 0, 0};
+    }
+}
+
+void DirectPersistLog::submitFlush(std::vector<DirectWrite>&& writes, bool sync, int64_t ver, uint64_t end) noexcept(false) {
+    {
+        std::lock_guard<std::mutex> lck(this->m_persLock);
+        this->m_flushesInFlight++;
+    }
+    try {
+        this->m_pWriter->submit(this->m_iLogFileDesc, std::move(writes), sync,
+                                [this, sync, ver, end](int err) {
+                                    std::lock_guard<std::mutex> lck(this->m_persLock);
+                                    if(err != 0) {
+                                        if(this->m_writeError == 0) {
+                                            dbg_default_error("{0} failed to write {1}, errno={2}",
+                                                              this->m_sName, this->m_sLogFile, err);
+                                            this->m_writeError = err;
+                                        }
+                                    } else if(sync && this->m_writeError == 0) {
+                                        // a failed write-behind flush is never reported as persisted
+                                        this->m_persistedVersion = std::max(this->m_persistedVersion, ver);
+                                        if(end > this->m_persistedOfst) {
+                                            this->m_persistedOfst = end;
+                                        }
+                                    }
+                                    this->m_flushesInFlight--;
+                                    this->m_persCv.notify_all();
+                                });
+    } catch(persist_exception_t e) {
+        std::lock_guard<std::mutex> lck(this->m_persLock);
+        this->m_flushesInFlight--;
+        this->m_persCv.notify_all();
+        throw e;
+    }
+}
+
+int64_t DirectPersistLog::startPersist(int64_t& ver_ret) noexcept(false) {
+    std::vector<DirectWrite> writes;
+    int64_t ver;
+    uint64_t end;
+    std::lock_guard<std::mutex> submit_lock(this->m_submitLock);
+    {
+        std::unique_lock<std::shared_mutex> write_lock(this->m_rwlock);
+        ver = this->m_latestVersion;
+        ver_ret = (numEntries() > 0) ? ver : INVALID_VERSION;
+        takeWrites(writes);
+        end = this->m_nextOfst;
+    }
+    if(!writes.empty() || ver != this->m_syncSubmittedVersion) {
+        dbg_default_trace("{0} flush log up to version {1}.", this->m_sName, ver);
+        submitFlush(std::move(writes), true, ver, end);
+        this->m_syncSubmittedVersion = ver;
+    }
+    return ver;
+}
+
+void DirectPersistLog::waitForPersisted(int64_t ver) noexcept(false) {
+    std::unique_lock<std::mutex> lck(this->m_persLock);
+    this->m_persCv.wait(lck, [this, ver]() {
+        return this->m_writeError != 0 || this->m_persistedVersion >= ver;
+    });
+    if(this->m_writeError != 0) {
+        throw PERSIST_EXP_DIRECT_IO(this->m_writeError);
+    }
+}
+
+void DirectPersistLog::waitForFlushes() noexcept(true) {
+    std::unique_lock<std::mutex> lck(this->m_persLock);
+    this->m_persCv.wait(lck, [this]() { return this->m_flushesInFlight == 0; });
+}
+
+void DirectPersistLog::evictEntries() noexcept(true) {
+    // only entries which are durable can be read back from the file
+    const uint64_t durable = this->m_persistedOfst.load();
+    const int64_t tail = this->m_head + numEntries();
+    while(this->m_cachedBytes > DIRECT_LOG_CACHE_SIZE && this->m_cacheHead < tail) {
+        Entry& entry = entryAt(this->m_cacheHead);
+        if(entry.rofst + recordSize(entry.dlen) > durable) {
+            break;
+        }
+        if(entry.data) {
+            this->m_cachedBytes -= entry.dlen;
+            entry.data.reset();
+        }
+        this->m_cacheHead++;
+    }
+}
+
+void DirectPersistLog::ensureAllocated(uint64_t end) noexcept(false) {
+    if(end <= this->m_allocatedSize) {
+        return;
+    }
+    // allocate whole segments, so that the writes do not grow the file and the
+    // syncs do not have to update its size.
+    const uint64_t new_size = ((end + DIRECT_LOG_SEGMENT_SIZE - 1) / DIRECT_LOG_SEGMENT_SIZE) * DIRECT_LOG_SEGMENT_SIZE;
+    if(fallocate(this->m_iLogFileDesc, 0, this->m_allocatedSize, new_size - this->m_allocatedSize) != 0) {
+        if(errno != EOPNOTSUPP) {
+            throw PERSIST_EXP_FALLOCATE(errno);
+        }
+        if(ftruncate(this->m_iLogFileDesc, new_size) != 0) {
+            throw PERSIST_EXP_TRUNCATE_FILE(errno);
+        }
+    }
+    this->m_allocatedSize = new_size;
+}
+
+void DirectPersistLog::resetTail(uint64_t ofst) noexcept(false) {
+    const uint64_t aligned = alignUp(ofst);
+    if(ftruncate(this->m_iLogFileDesc, aligned) != 0) {
+        throw PERSIST_EXP_TRUNCATE_FILE(errno);
+    }
+    if(aligned != ofst) {
+        // clear the rest of the last block, so no stale record follows the cut
+        const uint64_t block = alignDown(ofst);
+        std::shared_ptr<char> buf = allocAligned(DIRECT_LOG_BLOCK_SIZE);
+        if(pread(this->m_iLogFileDesc, buf.get(), DIRECT_LOG_BLOCK_SIZE, block) != (ssize_t)DIRECT_LOG_BLOCK_SIZE) {
+            throw PERSIST_EXP_READ_FILE(errno);
+        }
+        memset(buf.get() + (ofst - block), 0, aligned - ofst);
+        if(pwrite(this->m_iLogFileDesc, buf.get(), DIRECT_LOG_BLOCK_SIZE, block) != (ssize_t)DIRECT_LOG_BLOCK_SIZE) {
+            throw PERSIST_EXP_WRITE_FILE(errno);
+        }
+    }
+    if(fdatasync(this->m_iLogFileDesc) != 0) {
+        throw PERSIST_EXP_DIRECT_IO(errno);
+    }
+    this->m_currChunk = Chunk{nullptr, 0, 0, 0, 0};
+    this->m_nextOfst = aligned;
+    this->m_allocatedSize = aligned;
+}
+
+size_t DirectPersistLog::postLogEntry(const std::function<void(char const* const, std::size_t)>& f, const Entry& entry) noexcept(false) {
+    LogEntry log_entry;
+    memset(&log_entry, 0, sizeof(LogEntry));
+    log_entry.fields.ver = entry.ver;
+    log_entry.fields.dlen = entry.dlen;
+    log_entry.fields.hlc_r = entry.hlc_r;
+    log_entry.fields.hlc_l = entry.hlc_l;
+    f((const char*)&log_entry, sizeof(LogEntry));
+    if(entry.dlen > 0) {
+        std::shared_ptr<char> holder;
+        f(entryData(entry, holder), entry.dlen);
+    }
+    return sizeof(LogEntry) + entry.dlen;
+}
+
+size_t DirectPersistLog::mergeLogEntryFromByteArray(const char* ba, std::vector<DirectWrite>& writes) noexcept(false) {
+    // the entries in a log tail are not aligned
+    LogEntry le;
+    memcpy(&le, ba, sizeof(LogEntry));
+    // valid check: version grows monotonically.
+    if(le.fields.ver <= this->m_latestVersion) {
+        dbg_default_trace("{0} skip log entry version {1}, we are at {2}.", __func__, le.fields.ver, this->m_latestVersion);
+        return le.fields.dlen + sizeof(LogEntry);
+    }
+    appendEntry(ba + sizeof(LogEntry), le.fields.dlen, le.fields.ver,
+                HLC{le.fields.hlc_r, le.fields.hlc_l}, writes);
+    dbg_default_trace("{0} merge log:log entry and meta data are updated.", __func__);
+    return le.fields.dlen + sizeof(LogEntry);
+}
+}  // namespace persistent
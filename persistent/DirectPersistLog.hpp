@@ -0,0 +1,302 @@
+#ifndef DIRECT_PERSIST_LOG_HPP
+#define DIRECT_PERSIST_LOG_HPP
+
+#include "DirectLogWriter.hpp"
+#include "FilePersistLog.hpp"
+#include "PersistLog.hpp"
+#include "util.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+namespace persistent {
+
+#define DIRECT_LOG_FILE_SUFFIX "dlog"
+#define DIRECT_META_FILE_SUFFIX "dmeta"
+
+// Writes are aligned to this size for O_DIRECT.
+#define DIRECT_LOG_BLOCK_SIZE ((uint64_t)4096)
+// Size of the in-memory buffers records are appended to before being written.
+#define DIRECT_LOG_CHUNK_SIZE ((uint64_t)(1ul << 20))
+// The log file is pre-allocated in segments of this size.
+#define DIRECT_LOG_SEGMENT_SIZE ((uint64_t)(64ul << 20))
+// Data of the most recent entries kept in memory to serve reads from.
+#define DIRECT_LOG_CACHE_SIZE ((uint64_t)(64ul << 20))
+
+#define DIRECT_RECORD_MAGIC (0x474f4c44u)
+// a log entry
+#define DIRECT_RECORD_ENTRY (1u)
+// a version advanced without a log entry
+#define DIRECT_RECORD_VERSION (2u)
+
+// record header in the log file. A record is the header followed by dlen
+// bytes of data, padded to 8 bytes.
+typedef struct direct_record_header {
+    uint32_t magic;
+    uint32_t type;
+    int64_t ver;
+    uint64_t dlen;
+    uint64_t hlc_r;
+    uint64_t hlc_l;
+    // checksum of the header, with this field set to 0, and of the data
+    uint64_t checksum;
+} DirectRecordHeader;
+
+// meta file format. It only changes when the log is trimmed.
+typedef struct direct_meta_header {
+    // index of the first entry
+    int64_t head;
+    // offset of the first entry's record in the log file
+    uint64_t head_ofst;
+} DirectMetaHeader;
+
+// DirectPersistLog is a PersistLog that appends its entries to a single log
+// file of self-describing records, written with O_DIRECT by the
+// DirectLogWriter instead of through a shared memory mapping. It is selected
+// with PERS/backend = direct.
+//
+// Records are appended to a block-aligned in-memory chunk. A full chunk is
+// written behind right away, without a sync; persist() writes out the rest of
+// the current chunk, padded to a block boundary, and syncs the file. The log
+// file grows in pre-allocated segments, and the records are scanned and
+// checksummed on load, so the meta file is only written when the log is
+// trimmed.
+//
+// The data of recent entries stays in memory; older entries are read from
+// the file. The entries returned by getEntry() or getEntryByIndex() are kept
+// alive as described in PersistLog::PinnedEntries.
+class DirectPersistLog : public PersistLog {
+protected:
+    // in-memory index entry
+    struct Entry {
+        int64_t ver;
+        uint64_t dlen;
+        uint64_t hlc_r;
+        uint64_t hlc_l;
+        // offset of the entry's record in the log file
+        uint64_t rofst;
+        // the data, while the entry is cached
+        std::shared_ptr<char> data;
+    };
+
+    // the chunk records are appended to
+    struct Chunk {
+        std::shared_ptr<char> buffer;
+        uint64_t capacity;
+        // offset of the chunk in the log file
+        uint64_t ofst;
+        // bytes filled
+        uint64_t used;
+        // bytes handed to the writer
+        uint64_t submitted;
+    };
+
+    // path of the data files
+    const std::string m_sDataPath;
+    // full meta file name
+    const std::string m_sMetaFile;
+    // full log file name
+    const std::string m_sLogFile;
+    // log file descriptor, opened with O_DIRECT
+    int m_iLogFileDesc;
+    // log file descriptor for reading entries which are not cached
+    int m_iReadFileDesc;
+    std::shared_ptr<DirectLogWriter> m_pWriter;
+
+    // protects the state below, until m_submitLock
+    std::shared_mutex m_rwlock;
+    // index of the first entry
+    int64_t m_head;
+    // offset of the first entry's record
+    uint64_t m_headOfst;
+    std::deque<Entry> m_entries;
+    // the latest version, including versions advanced without an entry
+    int64_t m_latestVersion;
+    Chunk m_currChunk;
+    // offset of the next chunk
+    uint64_t m_nextOfst;
+    // size of the log file, pre-allocated
+    uint64_t m_allocatedSize;
+    // index of the oldest cached entry
+    int64_t m_cacheHead;
+    // bytes of data cached
+    uint64_t m_cachedBytes;
+    // offset up to which the log has been hole punched after trimming
+    uint64_t m_punchedOfst;
+
+    // orders the submission of flushes, taken before m_rwlock
+    std::mutex m_submitLock;
+    // the latest version submitted with a sync, protected by m_submitLock
+    int64_t m_syncSubmittedVersion;
+    // size of the data reserved by reserveAppend(), protected by m_submitLock
+    uint64_t m_reservedSize;
+    // writes of the chunk filled before the reserved record
+    std::vector<DirectWrite> m_reservedWrites;
+
+    // protects the flush state below
+    std::mutex m_persLock;
+    std::condition_variable m_persCv;
+    int64_t m_persistedVersion;
+    // offset up to which the log file is durable, read without the lock when
+    // evicting entries from the cache
+    std::atomic<uint64_t> m_persistedOfst;
+    uint32_t m_flushesInFlight;
+    // errno of the first failed flush, or 0
+    int m_writeError;
+
+    // load the log from the log and meta files
+    virtual void load() noexcept(false);
+
+    // reset the logs. This will remove the existing persisted data.
+    virtual void reset() noexcept(false);
+
+    // persist the meta header
+    virtual void persistMetaHeader(const DirectMetaHeader& header) noexcept(false);
+
+public:
+    //Constructor
+    DirectPersistLog(const std::string& name, const std::string& dataPath) noexcept(false);
+    DirectPersistLog(const std::string& name) noexcept(false) : DirectPersistLog(name, getPersFilePath()){};
+    //Destructor
+    virtual ~DirectPersistLog() noexcept(true);
+
+    //Derived from PersistLog
+    virtual void append(const void* pdata,
+                        const uint64_t& size, const int64_t& ver,
+                        const HLC& mhlc) noexcept(false);
+    virtual void* reserveAppend(const uint64_t& size, const int64_t& ver) noexcept(false);
+    virtual void commitAppend(const int64_t& ver, const HLC& mhlc) noexcept(false);
+    virtual void abortAppend() noexcept(true);
+    virtual void advanceVersion(const int64_t& ver) noexcept(false);
+    virtual int64_t getLength() noexcept(false);
+    virtual int64_t getEarliestIndex() noexcept(false);
+    virtual int64_t getLatestIndex() noexcept(false);
+    virtual int64_t getVersionIndex(const version_t& ver) noexcept(false);
+    virtual int64_t getHLCIndex(const HLC& hlc) noexcept(false);
+    virtual version_t getVersionByIndex(const int64_t& eno) noexcept(false);
+    virtual version_t getEarliestVersion() noexcept(false);
+    virtual version_t getLatestVersion() noexcept(false);
+    virtual const version_t getLastPersisted() noexcept(false);
+    virtual const void* getEntryByIndex(const int64_t& eno) noexcept(false);
+    virtual const void* getEntry(const version_t& ver) noexcept(false);
+    virtual const void* getEntry(const HLC& hlc) noexcept(false);
+    virtual const version_t persist(const bool preLocked = false) noexcept(false);
+    virtual void trimByIndex(const int64_t& eno) noexcept(false);
+    virtual void trim(const version_t& ver) noexcept(false);
+    virtual void trim(const HLC& hlc) noexcept(false);
+    virtual void truncate(const version_t& ver) noexcept(false);
+    virtual size_t bytes_size(const version_t& ver) noexcept(false);
+    virtual size_t to_bytes(char* buf, const version_t& ver) noexcept(false);
+    virtual void post_object(const std::function<void(char const* const, std::size_t)>& f,
+                             const version_t& ver) noexcept(false);
+    virtual void applyLogTail(char const* v) noexcept(false);
+
+    /**
+     * Get the minimum latest persisted version for a subgroup/shard with prefix
+     * @PARAM prefix the subgroup/shard prefix
+     * @PARAM path the folder of the logs
+     * @RETURN the minimum latest persisted version
+     */
+    static const uint64_t getMinimumLatestPersistedVersion(const std::string& prefix, const std::string& path = getPersFilePath());
+
+private:
+    // the number of entries
+    int64_t numEntries() const {
+        return (int64_t)m_entries.size();
+    }
+    // the entry at an index, between m_head and m_head + numEntries()
+    Entry& entryAt(int64_t idx) {
+        return m_entries[idx - m_head];
+    }
+    /**
+     * binary search for the latest entry with a version <= ver.
+     * Note: no lock protected, use a read lock
+     * @return the index of the entry or -1 if none.
+     */
+    int64_t searchVersion(const int64_t& ver) noexcept(true);
+    /**
+     * Get the minimum index greater than a given version
+     * Note: no lock protected, use a read lock
+     * @PARAM ver the given version. INVALID_VERSION means to return the earliest index.
+     * @RETURN the minimum index since the given version. INVALID_INDEX means
+     *         that no log entry is available for the requested version.
+     */
+    int64_t getMinimumIndexBeyondVersion(const int64_t& ver) noexcept(true);
+    /**
+     * Get the data of an entry, from the cache or from the log file.
+     * Note: no lock protected, use a read lock
+     * @PARAM holder - keeps the returned data alive
+     */
+    const char* entryData(const Entry& entry, std::shared_ptr<char>& holder) noexcept(false);
+    /**
+     * make room for a record in the current chunk, starting a new chunk if it
+     * does not fit. Note: no lock protected, use m_submitLock and a write lock
+     * @PARAM writes - receives the writes of the previous chunk
+     * @RETURN where the record's data goes
+     */
+    char* reserveRecord(uint64_t size, std::vector<DirectWrite>& writes) noexcept(false);
+    /**
+     * finish the record reserved by reserveRecord(), once its data is there.
+     * Note: no lock protected, use m_submitLock and a write lock
+     * @RETURN the record's offset in the log file
+     */
+    uint64_t commitRecord(uint32_t type, uint64_t size, int64_t ver, const HLC& mhlc) noexcept(true);
+    /**
+     * append a record to the current chunk, starting a new chunk if it does
+     * not fit. Note: no lock protected, use m_submitLock and a write lock
+     * @PARAM writes - receives the writes of the previous chunk
+     * @RETURN the record's offset in the log file
+     */
+    uint64_t appendRecord(uint32_t type, const void* pdata, uint64_t size,
+                          int64_t ver, const HLC& mhlc,
+                          std::vector<DirectWrite>& writes) noexcept(false);
+    /**
+     * append an entry to the log and cache its data.
+     * Note: no lock protected, use m_submitLock and a write lock
+     * @PARAM writes - receives the writes of the previous chunk
+     */
+    void appendEntry(const void* pdata, uint64_t size, int64_t ver, const HLC& mhlc,
+                     std::vector<DirectWrite>& writes) noexcept(false);
+    // add the entry of a record in the current chunk to the index and cache.
+    // Note: no lock protected, use a write lock
+    void indexEntry(uint64_t rofst, uint64_t size, int64_t ver, const HLC& mhlc) noexcept(false);
+    /**
+     * take the writes of the current chunk which have not been submitted yet,
+     * padding the chunk to a block boundary.
+     * Note: no lock protected, use m_submitLock and a write lock
+     */
+    void takeWrites(std::vector<DirectWrite>& writes) noexcept(true);
+    /**
+     * hand writes to the writer. Note: use m_submitLock
+     * @PARAM sync - if the file is synced after the writes.
+     * @PARAM ver - the latest version in the writes
+     * @PARAM end - the offset of the end of the writes
+     */
+    void submitFlush(std::vector<DirectWrite>&& writes, bool sync, int64_t ver, uint64_t end) noexcept(false);
+    // start persisting all the records appended so far, return the version
+    // to wait for. ver_ret receives the version persist() returns.
+    int64_t startPersist(int64_t& ver_ret) noexcept(false);
+    // wait until a version is persisted.
+    void waitForPersisted(int64_t ver) noexcept(false);
+    // wait until all flushes have completed
+    void waitForFlushes() noexcept(true);
+    // evict entries from the cache until it fits. Note: use a write lock
+    void evictEntries() noexcept(true);
+    // make sure the log file is allocated up to end. Note: use a write lock
+    void ensureAllocated(uint64_t end) noexcept(false);
+    // cut the log file at ofst, clearing the stale bytes after it. Note: use
+    // a write lock and make sure no flush is in flight.
+    void resetTail(uint64_t ofst) noexcept(false);
+    // serialize an entry in the FilePersistLog log tail format
+    size_t postLogEntry(const std::function<void(char const* const, std::size_t)>& f, const Entry& entry) noexcept(false);
+    // merge an entry in the FilePersistLog log tail format
+    size_t mergeLogEntryFromByteArray(const char* ba, std::vector<DirectWrite>& writes) noexcept(false);
+};
+}
+
+#endif  //DIRECT_PERSIST_LOG_HPP
@@ -1,5 +1,6 @@
 #include "FilePersistLog.hpp"
 #include "util.hpp"
+#include <algorithm>
 #include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
@@ -29,11 +30,14 @@ namespace persistent {
 // verify the existence of the meta file
 static bool checkOrCreateMetaFile(const string& metaFile) noexcept(false);
 
-// verify the existence of the log file
-static bool checkOrCreateLogFile(const string& logFile) noexcept(false);
+// call fun(path, suffix, segno) for every segment file of the log name in
+// dataPath
+template <typename SegmentFileFunc>
+static void forEachSegmentFile(const string& dataPath, const string& name, const SegmentFileFunc& fun) noexcept(false);
 
-// verify the existence of the data file
-static bool checkOrCreateDataFile(const string& dataFile) noexcept(false);
+// read size bytes at ofst of a file of the ring layout, a ring of ring_size
+// bytes, wrapping around its end
+static void readRingFile(int fd, void* buf, uint64_t size, uint64_t ofst, const uint64_t& ring_size) noexcept(false);
 
 ////////////////////////
 // visible to outside //
@@ -42,12 +46,16 @@ static bool checkOrCreateDataFile(const string& dataFile) noexcept(false);
 FilePersistLog::FilePersistLog(const string& name, const string& dataPath) noexcept(false) : PersistLog(name),
                                                                                              m_sDataPath(dataPath),
                                                                                              m_sMetaFile(dataPath + "/" + name + "." + META_FILE_SUFFIX),
-                                                                                             m_sLogFile(dataPath + "/" + name + "." + LOG_FILE_SUFFIX),
-                                                                                             m_sDataFile(dataPath + "/" + name + "." + DATA_FILE_SUFFIX),
-                                                                                             m_iLogFileDesc(-1),
-                                                                                             m_iDataFileDesc(-1),
-                                                                                             m_pLog(MAP_FAILED),
-                                                                                             m_pData(MAP_FAILED) {
+                                                                                             m_iDirDesc(-1),
+                                                                                             m_logSegmentEntries(0),
+                                                                                             m_dataSegmentSize(0),
+                                                                                             m_bSegmentsCreated(false),
+                                                                                             m_boundsSeq(0),
+                                                                                             m_bReserved(false),
+                                                                                             m_reservedSize(0),
+                                                                                             m_reservedOfst(0),
+                                                                                             m_reservedIdx(INVALID_INDEX),
+                                                                                             m_reservedVer(INVALID_VERSION) {
     if(pthread_rwlock_init(&this->m_rwlock, NULL) != 0) {
         throw PERSIST_EXP_RWLOCK_INIT(errno);
     }
@@ -69,13 +77,19 @@ void FilePersistLog::reset() noexcept(false) {
             dbg_default_error("{0} reset failed to remove the file:{1}", this->m_sName, this->m_sMetaFile);
             throw PERSIST_EXP_REMOVE_FILE(errno);
         }
-        if(!fs::remove(this->m_sLogFile)) {
-            dbg_default_error("{0} reset failed to remove the file:{1}", this->m_sName, this->m_sLogFile);
-            throw PERSIST_EXP_REMOVE_FILE(errno);
-        }
-        if(!fs::remove(this->m_sDataFile)) {
-            dbg_default_error("{0} reset failed to remove the file:{1}", this->m_sName, this->m_sDataFile);
-            throw PERSIST_EXP_REMOVE_FILE(errno);
+    }
+    if(fs::exists(this->m_sDataPath)) {
+        forEachSegmentFile(this->m_sDataPath, this->m_sName, [this](const string& file, const char*, const int64_t&) {
+            if(!fs::remove(file)) {
+                dbg_default_error("{0} reset failed to remove the file:{1}", this->m_sName, file);
+                throw PERSIST_EXP_REMOVE_FILE(errno);
+            }
+        });
+        for(const char* suffix : {LOG_FILE_SUFFIX, DATA_FILE_SUFFIX}) {
+            if(fs::exists(ringFile(suffix)) && !fs::remove(ringFile(suffix))) {
+                dbg_default_error("{0} reset failed to remove the file:{1}", this->m_sName, ringFile(suffix));
+                throw PERSIST_EXP_REMOVE_FILE(errno);
+            }
         }
     }
     dbg_default_trace("{0} reset state...done", this->m_sName);
@@ -88,75 +102,33 @@ void FilePersistLog::load() noexcept(false) {
     dbg_default_trace("{0}:checkOrCreateDir passed.", this->m_sName);
     // STEP 1: check and create files.
     bool bCreate = checkOrCreateMetaFile(this->m_sMetaFile);
-    checkOrCreateLogFile(this->m_sLogFile);
-    checkOrCreateDataFile(this->m_sDataFile);
-    dbg_default_trace("{0}:checkOrCreateDataFile passed.", this->m_sName);
-    // STEP 2: open files
-    this->m_iLogFileDesc = open(this->m_sLogFile.c_str(), O_RDWR);
-    if(this->m_iLogFileDesc == -1) {
-        throw PERSIST_EXP_OPEN_FILE(errno);
-    }
-    this->m_iDataFileDesc = open(this->m_sDataFile.c_str(), O_RDWR);
-    if(this->m_iDataFileDesc == -1) {
+    dbg_default_trace("{0}:checkOrCreateMetaFile passed.", this->m_sName);
+    // STEP 2: open the data path
+    this->m_iDirDesc = open(this->m_sDataPath.c_str(), O_RDONLY | O_DIRECTORY);
+    if(this->m_iDirDesc == -1) {
         throw PERSIST_EXP_OPEN_FILE(errno);
     }
-    // STEP 3: mmap to memory
-    //// we map the log entry and data twice to faciliate the search and data
-    //// retrieving then the data is rewinding across the buffer end as follow:
-    //// [1][2][3][4][5][6][1][2][3][4][5][6]
-    this->m_pLog = mmap(NULL, MAX_LOG_SIZE << 1, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-    if(this->m_pLog == MAP_FAILED) {
-        dbg_default_error("{0}:reserve map space for log failed.", this->m_sName);
-        throw PERSIST_EXP_MMAP_FILE(errno);
-    }
-    if(mmap(this->m_pLog, MAX_LOG_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, this->m_iLogFileDesc, 0) == MAP_FAILED) {
-        dbg_default_error("{0}:map ringbuffer space for the first half of log failed. Is the size of log ringbuffer aligned to page?", this->m_sName);
-        throw PERSIST_EXP_MMAP_FILE(errno);
-    }
-    if(mmap((void*)((uint64_t)this->m_pLog + MAX_LOG_SIZE), MAX_LOG_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, this->m_iLogFileDesc, 0) == MAP_FAILED) {
-        dbg_default_error("{0}:map ringbuffer space for the second half of log failed. Is the size of log ringbuffer aligned to page?", this->m_sName);
-        throw PERSIST_EXP_MMAP_FILE(errno);
-    }
-    //// data ringbuffer
-    this->m_pData = mmap(NULL, (size_t)(MAX_DATA_SIZE << 1), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-    if(this->m_pData == MAP_FAILED) {
-        dbg_default_error("{0}:reserve map space for data failed.", this->m_sName);
-        throw PERSIST_EXP_MMAP_FILE(errno);
-    }
-    if(mmap(this->m_pData, (size_t)(MAX_DATA_SIZE), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, this->m_iDataFileDesc, 0) == MAP_FAILED) {
-        dbg_default_error("{0}:map ringbuffer space for the first half of data failed. Is the size of data ringbuffer aligned to page?", this->m_sName);
-        throw PERSIST_EXP_MMAP_FILE(errno);
-    }
-    if(mmap((void*)((uint64_t)this->m_pData + MAX_DATA_SIZE), (size_t)MAX_DATA_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, this->m_iDataFileDesc, 0) == MAP_FAILED) {
-        dbg_default_error("{0}:map ringbuffer space for the second half of data failed. Is the size of data ringbuffer aligned to page?", this->m_sName);
-        throw PERSIST_EXP_MMAP_FILE(errno);
-    }
-    dbg_default_trace("{0}:data/meta file mapped to memory", this->m_sName);
-    // STEP 4: initialize the header for new created Metafile
+    // STEP 3: initialize the header for new created Metafile
     if(bCreate) {
-        META_HEADER->fields.head = 0ll;
-        META_HEADER->fields.tail = 0ll;
-        META_HEADER->fields.ver = INVALID_VERSION;
-        META_HEADER_PERS->fields.head = -1ll;  // -1 means uninitialized
-        META_HEADER_PERS->fields.tail = -1ll;  // -1 means uninitialized
-        META_HEADER_PERS->fields.ver = INVALID_VERSION;
+        initializeMetaHeader(0ll);
         // persist the header
-        FPL_RDLOCK;
         FPL_PERS_LOCK;
+        FPL_RDLOCK;
 
         try {
             persistMetaHeaderAtomically(META_HEADER);
-        } catch(uint64_t e) {
-            FPL_PERS_UNLOCK;
+        } catch(persist_exception_t e) {
             FPL_UNLOCK;
+            FPL_PERS_UNLOCK;
             throw e;
         }
-        FPL_PERS_UNLOCK;
         FPL_UNLOCK;
+        FPL_PERS_UNLOCK;
         dbg_default_info("{0}:new header initialized.", this->m_sName);
     } else {  // load META_HEADER from disk
-        FPL_WRLOCK;
+        bool bRing = false;
         FPL_PERS_LOCK;
+        FPL_WRLOCK;
         try {
             int fd = open(this->m_sMetaFile.c_str(), O_RDONLY);
             if(fd == -1) {
@@ -169,24 +141,65 @@ void FilePersistLog::load() noexcept(false) {
             }
             close(fd);
             *META_HEADER = *META_HEADER_PERS;
-            // update mhlc index
-            for(int64_t idx = META_HEADER->fields.head; idx < META_HEADER->fields.tail; idx++) {
-                struct hlc_index_entry _ent;
-                _ent.hlc.m_rtc_us = LOG_ENTRY_AT(idx)->fields.hlc_r;
-                _ent.hlc.m_logic = LOG_ENTRY_AT(idx)->fields.hlc_l;
-                _ent.log_idx = idx;
-                this->hidx.insert(_ent);
+            if(META_HEADER->fields.format != META_FORMAT) {
+                // a log of the ring layout is migrated once the locks are
+                // released.
+                bRing = fs::exists(ringFile(LOG_FILE_SUFFIX)) && fs::exists(ringFile(DATA_FILE_SUFFIX));
+                if(!bRing) {
+                    dbg_default_error("{0}:{1} has the unknown log format {2}, and there is no log of the ring layout to migrate.",
+                                      this->m_sName, this->m_sMetaFile, META_HEADER->fields.format);
+                    throw PERSIST_EXP_INV_FILE;
+                }
+            } else {
+                if(META_HEADER->fields.log_seg_entries == 0 || META_HEADER->fields.data_seg_size == 0) {
+                    dbg_default_error("{0}:{1} has invalid segment sizes.", this->m_sName, this->m_sMetaFile);
+                    throw PERSIST_EXP_INV_FILE;
+                }
+                this->m_logSegmentEntries = META_HEADER->fields.log_seg_entries;
+                this->m_dataSegmentSize = META_HEADER->fields.data_seg_size;
+                // register the segments of the entries, and update mhlc index
+                if(NUM_USED_SLOTS > 0) {
+                    for(int64_t segno = META_HEADER->fields.head / this->m_logSegmentEntries;
+                        segno <= CURR_LOG_IDX / (int64_t)this->m_logSegmentEntries; segno++) {
+                        this->m_logSegments[segno];
+                    }
+                }
+                this->hidx.reserve(META_HEADER->fields.tail - META_HEADER->fields.head);
+                for(int64_t idx = META_HEADER->fields.head; idx < META_HEADER->fields.tail; idx++) {
+                    const LogEntry* ple = LOG_ENTRY_AT(idx);
+                    this->m_dataSegments[ple->fields.ofst / this->m_dataSegmentSize];
+                    this->hidx.insert(ple->fields.hlc_r, ple->fields.hlc_l, idx);
+                }
+                // remove the segments left behind by a crash during a trim,
+                // truncation, or append.
+                forEachSegmentFile(this->m_sDataPath, this->m_sName, [this](const string& file, const char* suffix, const int64_t& segno) {
+                    SegmentTable& table = (strcmp(suffix, LOG_FILE_SUFFIX) == 0) ? this->m_logSegments : this->m_dataSegments;
+                    if(table.find(segno) == table.end() && unlink(file.c_str()) != 0) {
+                        dbg_default_warn("{0}:failed to remove the stale segment file:{1}, errno={2}", this->m_sName, file, errno);
+                    }
+                });
+                // and the files of a ring layout log left behind by a crash
+                // after its migration.
+                for(const char* suffix : {LOG_FILE_SUFFIX, DATA_FILE_SUFFIX}) {
+                    if(fs::exists(ringFile(suffix)) && unlink(ringFile(suffix).c_str()) != 0) {
+                        dbg_default_warn("{0}:failed to remove the migrated file:{1}, errno={2}", this->m_sName, ringFile(suffix), errno);
+                    }
+                }
             }
-        } catch(uint64_t e) {
-            FPL_PERS_UNLOCK;
+        } catch(persist_exception_t e) {
             FPL_UNLOCK;
+            FPL_PERS_UNLOCK;
             throw e;
         }
 
-        FPL_PERS_UNLOCK;
         FPL_UNLOCK;
+        FPL_PERS_UNLOCK;
+        if(bRing) {
+            const MetaHeader ring = *META_HEADER_PERS;
+            migrateRingLog(ring);
+        }
     }
-    // STEP 5: update m_hlcLE with the latest event: we don't need this anymore
+    // STEP 4: update m_hlcLE with the latest event: we don't need this anymore
     //if (META_HEADER->fields.eno >0) {
     //  if (this->m_hlcLE.m_rtc_us < CURR_LOG_ENTRY->fields.hlc_r &&
     //    this->m_hlcLE.m_logic < CURR_LOG_ENTRY->fields.hlc_l){
@@ -197,45 +210,100 @@ void FilePersistLog::load() noexcept(false) {
     dbg_default_trace("{0}:load state...done", this->m_sName);
 }
 
-FilePersistLog::~FilePersistLog() noexcept(true) {
-    pthread_rwlock_destroy(&this->m_rwlock);
-    pthread_mutex_destroy(&this->m_perslock);
-    if(this->m_pData != MAP_FAILED) {
-        munmap(m_pData, (size_t)(MAX_DATA_SIZE << 1));
+void FilePersistLog::initializeMetaHeader(const int64_t& head) noexcept(false) {
+    memset(META_HEADER, 0, sizeof(MetaHeader));
+    META_HEADER->fields.head = head;
+    META_HEADER->fields.tail = head;
+    META_HEADER->fields.ver = INVALID_VERSION;
+    META_HEADER->fields.dtail = 0ull;
+    META_HEADER->fields.log_seg_entries = getPersLogSegmentEntries();
+    META_HEADER->fields.data_seg_size = getPersDataSegmentSize();
+    META_HEADER->fields.format = META_FORMAT;
+    if(META_HEADER->fields.log_seg_entries == 0 || META_HEADER->fields.data_seg_size == 0) {
+        dbg_default_error("{0}:the log and data segment sizes must not be 0.", this->m_sName);
+        throw PERSIST_EXP_INV_FILE;
     }
-    this->m_pData = nullptr;  // prevent ~MemLog() destructor to release it again.
-    if(this->m_pLog != MAP_FAILED) {
-        munmap(m_pLog, MAX_LOG_SIZE);
+    *META_HEADER_PERS = *META_HEADER;
+    META_HEADER_PERS->fields.head = -1ll;  // -1 means uninitialized
+    META_HEADER_PERS->fields.tail = -1ll;  // -1 means uninitialized
+    this->m_logSegmentEntries = META_HEADER->fields.log_seg_entries;
+    this->m_dataSegmentSize = META_HEADER->fields.data_seg_size;
+}
+
+std::string FilePersistLog::ringFile(const char* suffix) const {
+    return this->m_sDataPath + "/" + this->m_sName + "." + suffix;
+}
+
+// The entries keep their indexes. The meta file is only replaced by the
+// persist() at the end, so a migration that is interrupted starts over on the
+// next load.
+void FilePersistLog::migrateRingLog(const MetaHeader& ring) noexcept(false) {
+    dbg_default_info("{0}:migrating {1} entries of the ring layout to segments.", this->m_sName,
+                     ring.fields.tail - ring.fields.head);
+    if(ring.fields.head < 0 || ring.fields.tail < ring.fields.head
+       || (uint64_t)(ring.fields.tail - ring.fields.head) >= RING_LOG_ENTRIES) {
+        dbg_default_error("{0}:{1} is not a valid meta file of the ring layout.", this->m_sName, this->m_sMetaFile);
+        throw PERSIST_EXP_INV_FILE;
+    }
+    // the segments of an interrupted migration
+    forEachSegmentFile(this->m_sDataPath, this->m_sName, [this](const string& file, const char*, const int64_t&) {
+        if(unlink(file.c_str()) != 0) {
+            throw PERSIST_EXP_REMOVE_FILE(errno);
+        }
+    });
+    initializeMetaHeader(ring.fields.head);
+
+    int logFd = open(ringFile(LOG_FILE_SUFFIX).c_str(), O_RDONLY);
+    if(logFd == -1) {
+        throw PERSIST_EXP_OPEN_FILE(errno);
+    }
+    int dataFd = open(ringFile(DATA_FILE_SUFFIX).c_str(), O_RDONLY);
+    if(dataFd == -1) {
+        const int err = errno;
+        close(logFd);
+        throw PERSIST_EXP_OPEN_FILE(err);
+    }
+    try {
+        std::vector<uint8_t> data;
+        for(int64_t idx = ring.fields.head; idx < ring.fields.tail; idx++) {
+            LogEntry entry;
+            readRingFile(logFd, &entry, sizeof(LogEntry), (idx % RING_LOG_ENTRIES) * sizeof(LogEntry),
+                         RING_LOG_ENTRIES * sizeof(LogEntry));
+            data.resize(entry.fields.dlen);
+            readRingFile(dataFd, data.data(), entry.fields.dlen, entry.fields.ofst % RING_DATA_SIZE, RING_DATA_SIZE);
+            this->append(data.data(), entry.fields.dlen, entry.fields.ver, HLC{entry.fields.hlc_r, entry.fields.hlc_l});
+        }
+    } catch(persist_exception_t e) {
+        close(logFd);
+        close(dataFd);
+        throw e;
     }
-    this->m_pLog = nullptr;  // prevent ~MemLog() destructor to release it again.
-    if(this->m_iLogFileDesc != -1) {
-        close(this->m_iLogFileDesc);
+    close(logFd);
+    close(dataFd);
+    // a version advanced without an entry
+    if(ring.fields.ver > META_HEADER->fields.ver) {
+        this->advanceVersion(ring.fields.ver);
     }
-    if(this->m_iDataFileDesc != -1) {
-        close(this->m_iDataFileDesc);
+    this->persist();
+    for(const char* suffix : {LOG_FILE_SUFFIX, DATA_FILE_SUFFIX}) {
+        if(unlink(ringFile(suffix).c_str()) != 0) {
+            dbg_default_warn("{0}:failed to remove the migrated file:{1}, errno={2}", this->m_sName, ringFile(suffix), errno);
+        }
     }
+    dbg_default_info("{0}:migrated the ring layout to segments.", this->m_sName);
 }
 
-void FilePersistLog::append(const void* pdat, const uint64_t& size, const int64_t& ver, const HLC& mhlc) noexcept(false) {
-    dbg_default_trace("{0} append event ({1},{2})", this->m_sName, mhlc.m_rtc_us, mhlc.m_logic);
-    FPL_RDLOCK;
+FilePersistLog::~FilePersistLog() noexcept(true) {
+    pthread_rwlock_destroy(&this->m_rwlock);
+    pthread_mutex_destroy(&this->m_perslock);
+    // the segments are unmapped with the tables, once no reader pins them
+    if(this->m_iDirDesc != -1) {
+        close(this->m_iDirDesc);
+    }
+}
 
 #define __DO_VALIDATION                                                                                    \
     do {                                                                                                   \
-        if(NUM_FREE_SLOTS < 1) {                                                                           \
-            dbg_default_error("{0}-append exception no free slots in log! NUM_FREE_SLOTS={1}",             \
-                              this->m_sName, NUM_FREE_SLOTS);                                              \
-            dbg_default_flush();                                                                           \
-            FPL_UNLOCK;                                                                                    \
-            throw PERSIST_EXP_NOSPACE_LOG;                                                                 \
-        }                                                                                                  \
-        if(NUM_FREE_BYTES < size) {                                                                        \
-            dbg_default_error("{0}-append exception no space for data: NUM_FREE_BYTES={1}, size={2}",      \
-                              this->m_sName, NUM_FREE_BYTES, size);                                        \
-            dbg_default_flush();                                                                           \
-            FPL_UNLOCK;                                                                                    \
-            throw PERSIST_EXP_NOSPACE_DATA;                                                                \
-        }                                                                                                  \
         if((CURR_LOG_IDX != -1) && (META_HEADER->fields.ver >= ver)) {                                     \
             int64_t cver = META_HEADER->fields.ver;                                                        \
             dbg_default_error("{0}-append version already exists! cur_ver:{1} new_ver:{2}", this->m_sName, \
@@ -246,29 +314,28 @@ void FilePersistLog::append(const void* pdat, const uint64_t& size, const int64_
         }                                                                                                  \
     } while(0)
 
+void FilePersistLog::append(const void* pdat, const uint64_t& size, const int64_t& ver, const HLC& mhlc) noexcept(false) {
+    dbg_default_trace("{0} append event ({1},{2})", this->m_sName, mhlc.m_rtc_us, mhlc.m_logic);
+    // only this thread appends, so the validation holds until the entry is
+    // published.
+    lockForAppend(size);
 #pragma GCC diagnostic ignored "-Wunused-variable"
     __DO_VALIDATION;
 #pragma GCC diagnostic pop
-    FPL_UNLOCK;
-    dbg_default_trace("{0} append:validate check1 Finished.", this->m_sName);
-
-    FPL_WRLOCK;
-//check
-#pragma GCC diagnostic ignored "-Wunused-variable"
-    __DO_VALIDATION;
-#pragma GCC diagnostic pop
-    dbg_default_trace("{0} append:validate check2 Finished.", this->m_sName);
+    dbg_default_trace("{0} append:validate check Finished.", this->m_sName);
 
     // copy data
-    memcpy(NEXT_DATA, pdat, size);
-    dbg_default_trace("{0} append:data is copied to log.", this->m_sName);
-
-    // fill the log entry
-    NEXT_LOG_ENTRY->fields.ver = ver;
-    NEXT_LOG_ENTRY->fields.dlen = size;
-    NEXT_LOG_ENTRY->fields.ofst = NEXT_DATA_OFST;
-    NEXT_LOG_ENTRY->fields.hlc_r = mhlc.m_rtc_us;
-    NEXT_LOG_ENTRY->fields.hlc_l = mhlc.m_logic;
+    uint64_t ofst = placeData(size);
+    try {
+        memcpy(newEntryData(ofst, size), pdat, size);
+        dbg_default_trace("{0} append:data is copied to log.", this->m_sName);
+
+        // fill the log entry
+        appendLogEntry(ofst, size, ver, mhlc);
+    } catch(persist_exception_t e) {
+        FPL_UNLOCK;
+        throw e;
+    }
     /* No Sync required here.
     if (msync(ALIGN_TO_PAGE(NEXT_LOG_ENTRY), 
         sizeof(LogEntry) + (((uint64_t)NEXT_LOG_ENTRY) % PAGE_SIZE),MS_SYNC) != 0) {
@@ -277,10 +344,6 @@ void FilePersistLog::append(const void* pdat, const uint64_t& size, const int64_
     }
 */
 
-    // update meta header
-    this->hidx.insert(hlc_index_entry{mhlc, META_HEADER->fields.tail});
-    META_HEADER->fields.tail++;
-    META_HEADER->fields.ver = ver;
     dbg_default_trace("{0} append:log entry and meta data are updated.", this->m_sName);
     /* No sync
     if (msync(this->m_pMeta,sizeof(MetaHeader),MS_SYNC) != 0) {
@@ -293,10 +356,276 @@ void FilePersistLog::append(const void* pdat, const uint64_t& size, const int64_
     FPL_UNLOCK;
 }
 
-void FilePersistLog::advanceVersion(const int64_t& ver) noexcept(false) {
+void* FilePersistLog::reserveAppend(const uint64_t& size, const int64_t& ver) noexcept(false) {
+    dbg_default_trace("{0} reserve {1} bytes for version {2}", this->m_sName, size, ver);
+    lockForAppend(size);
+#pragma GCC diagnostic ignored "-Wunused-variable"
+    __DO_VALIDATION;
+#pragma GCC diagnostic pop
+    // only the appending thread moves the tail, so the space after it stays
+    // free until commitAppend().
+    void* pdata;
+    try {
+        this->m_reservedOfst = placeData(size);
+        pdata = newEntryData(this->m_reservedOfst, size);
+        // create the log segment of the entry as well, so that commitAppend()
+        // only needs the read lock.
+        NEXT_LOG_ENTRY;
+    } catch(persist_exception_t e) {
+        FPL_UNLOCK;
+        throw e;
+    }
+    this->m_reservedSize = size;
+    this->m_reservedIdx = META_HEADER->fields.tail;
+    this->m_reservedVer = ver;
+    this->m_bReserved = true;
+    FPL_UNLOCK;
+    return pdata;
+}
+
+void FilePersistLog::commitAppend(const int64_t& ver, const HLC& mhlc) noexcept(false) {
+    FPL_RDLOCK;
+    // A truncate() meanwhile may have moved the tail and dropped the segment
+    // of the reserved data, and advanceVersion() may have passed the version.
+    const LogBounds bounds = readBounds();
+    if(!this->m_bReserved || ver != this->m_reservedVer
+       || bounds.tail != this->m_reservedIdx || placeData(this->m_reservedSize) != this->m_reservedOfst
+       || (bounds.tail > bounds.head && bounds.ver >= ver)) {
+        dbg_default_error("{0}-commit of a stale reservation! reserved idx:{1} ver:{2}, tail:{3}, commit ver:{4}",
+                          this->m_sName, this->m_reservedIdx, this->m_reservedVer, bounds.tail, (int64_t)ver);
+        this->m_bReserved = false;
+        FPL_UNLOCK;
+        throw PERSIST_EXP_INV_RESERVATION;
+    }
+    this->m_bReserved = false;
+    try {
+        appendLogEntry(this->m_reservedOfst, this->m_reservedSize, ver, mhlc);
+    } catch(persist_exception_t e) {
+        FPL_UNLOCK;
+        throw e;
+    }
+    this->m_reservedSize = 0;
+    dbg_default_debug("{0} append a log ver:{1} hlc:({2},{3})", this->m_sName,
+                      ver, mhlc.m_rtc_us, mhlc.m_logic);
+    FPL_UNLOCK;
+}
+
+void FilePersistLog::abortAppend() noexcept(true) {
+    this->m_bReserved = false;
+    this->m_reservedSize = 0;
+}
+
+void FilePersistLog::lockForAppend(const uint64_t& size) noexcept(false) {
+    FPL_RDLOCK;
+    if(this->m_logSegments.find(META_HEADER->fields.tail / this->m_logSegmentEntries) != this->m_logSegments.end()
+       && this->m_dataSegments.find(placeData(size) / this->m_dataSegmentSize) != this->m_dataSegments.end()) {
+        return;
+    }
+    // Creating a segment changes the segment tables. Nothing else but the
+    // appending thread moves the tail, so the entry is placed the same way
+    // under the write lock.
+    FPL_UNLOCK;
     FPL_WRLOCK;
+}
+
+FilePersistLog::LogBounds FilePersistLog::readBounds() noexcept(true) {
+    LogBounds bounds;
+    uint64_t seq;
+    do {
+        seq = this->m_boundsSeq.load(std::memory_order_acquire);
+        bounds.head = __atomic_load_n(&META_HEADER->fields.head, __ATOMIC_RELAXED);
+        bounds.tail = __atomic_load_n(&META_HEADER->fields.tail, __ATOMIC_RELAXED);
+        bounds.ver = __atomic_load_n(&META_HEADER->fields.ver, __ATOMIC_RELAXED);
+        bounds.dtail = __atomic_load_n(&META_HEADER->fields.dtail, __ATOMIC_RELAXED);
+        std::atomic_thread_fence(std::memory_order_acquire);
+    } while((seq & 1) || seq != this->m_boundsSeq.load(std::memory_order_relaxed));
+    return bounds;
+}
+
+void FilePersistLog::publishBounds(const LogBounds& bounds) noexcept(true) {
+    // the entries below the new tail are written before the sequence number
+    // is released.
+    const uint64_t seq = this->m_boundsSeq.load(std::memory_order_relaxed);
+    this->m_boundsSeq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    __atomic_store_n(&META_HEADER->fields.head, bounds.head, __ATOMIC_RELAXED);
+    __atomic_store_n(&META_HEADER->fields.tail, bounds.tail, __ATOMIC_RELAXED);
+    __atomic_store_n(&META_HEADER->fields.ver, bounds.ver, __ATOMIC_RELAXED);
+    __atomic_store_n(&META_HEADER->fields.dtail, bounds.dtail, __ATOMIC_RELAXED);
+    this->m_boundsSeq.store(seq + 2, std::memory_order_release);
+}
+
+void FilePersistLog::appendLogEntry(const uint64_t& ofst, const uint64_t& size, const int64_t& ver, const HLC& mhlc) noexcept(false) {
+    // the data is already at ofst
+    LogEntry* ple = NEXT_LOG_ENTRY;
+    ple->fields.ver = ver;
+    ple->fields.dlen = size;
+    ple->fields.ofst = ofst;
+    ple->fields.hlc_r = mhlc.m_rtc_us;
+    ple->fields.hlc_l = mhlc.m_logic;
+    // update meta header
+    const int64_t idx = META_HEADER->fields.tail;
+    publishBounds({META_HEADER->fields.head, idx + 1, ver, ofst + size});
+    // index the entry once it is published: the index never refers to an
+    // entry a reader cannot see.
+    std::unique_lock<std::shared_mutex> hidx_lck(this->m_hidxLock);
+    this->hidx.insert(mhlc.m_rtc_us, mhlc.m_logic, idx);
+}
+
+LogEntry* FilePersistLog::logEntryAt(const int64_t& idx, const bool create) noexcept(false) {
+    const uint64_t seg_size = this->m_logSegmentEntries * sizeof(LogEntry);
+    uint8_t* addr = getSegment(this->m_logSegments, LOG_FILE_SUFFIX, idx / this->m_logSegmentEntries, create ? seg_size : 0);
+    return (LogEntry*)addr + idx % this->m_logSegmentEntries;
+}
+
+void* FilePersistLog::entryData(const LogEntry* ple) noexcept(false) {
+    uint8_t* addr = getSegment(this->m_dataSegments, DATA_FILE_SUFFIX, ple->fields.ofst / this->m_dataSegmentSize, 0);
+    return addr + ple->fields.ofst % this->m_dataSegmentSize;
+}
+
+const void* FilePersistLog::pinnedEntryData(const LogEntry* ple) noexcept(false) {
+    char* pdata = (char*)entryData(ple);
+    // entryData() found and mapped the segment
+    const Segment& seg = this->m_dataSegments.at(ple->fields.ofst / this->m_dataSegmentSize);
+    nextPinnedEntry() = std::shared_ptr<char>(seg.mapping, pdata);
+    return pdata;
+}
+
+uint64_t FilePersistLog::placeData(const uint64_t& size) noexcept(true) {
+    uint64_t ofst = NEXT_DATA_OFST;
+    uint64_t seg_ofst = ofst % this->m_dataSegmentSize;
+    if(seg_ofst != 0 && seg_ofst + size > this->m_dataSegmentSize) {
+        ofst += this->m_dataSegmentSize - seg_ofst;
+    }
+    return ofst;
+}
+
+void* FilePersistLog::newEntryData(const uint64_t& ofst, const uint64_t& size) noexcept(false) {
+    uint64_t seg_ofst = ofst % this->m_dataSegmentSize;
+    uint8_t* addr = getSegment(this->m_dataSegments, DATA_FILE_SUFFIX, ofst / this->m_dataSegmentSize,
+                               MAX(this->m_dataSegmentSize, seg_ofst + size));
+    return addr + seg_ofst;
+}
+
+std::string FilePersistLog::segmentFile(const char* suffix, const int64_t& segno) const {
+    return this->m_sDataPath + "/" + this->m_sName + "." + suffix + "." + std::to_string(segno);
+}
+
+uint8_t* FilePersistLog::getSegment(SegmentTable& table, const char* suffix, const int64_t& segno,
+                                    const uint64_t& create_size) noexcept(false) {
+    auto search = table.find(segno);
+    if(search == table.end()) {
+        if(create_size == 0) {
+            dbg_default_error("{0} {1} segment {2} does not exist.", this->m_sName, suffix, segno);
+            throw PERSIST_EXP_INV_FILE;
+        }
+        search = table.emplace(std::piecewise_construct, std::forward_as_tuple(segno), std::forward_as_tuple()).first;
+    }
+    Segment& seg = search->second;
+    uint8_t* addr = seg.addr.load(std::memory_order_acquire);
+    if(addr != nullptr) {
+        return addr;
+    }
+    // map the segment on first access
+    std::lock_guard<std::mutex> lck(this->m_mapLock);
+    addr = seg.addr.load(std::memory_order_relaxed);
+    if(addr != nullptr) {
+        return addr;
+    }
+    const string file = segmentFile(suffix, segno);
+    int fd = open(file.c_str(), (create_size > 0) ? (O_RDWR | O_CREAT) : O_RDWR, S_IWUSR | S_IRUSR | S_IRGRP | S_IWGRP | S_IROTH);
+    if(fd == -1) {
+        dbg_default_error("{0} failed to open the segment file:{1}, errno={2}", this->m_sName, file, errno);
+        throw PERSIST_EXP_OPEN_FILE(errno);
+    }
+    struct stat sb;
+    if(fstat(fd, &sb) != 0) {
+        close(fd);
+        throw PERSIST_EXP_STAT_FILE(errno);
+    }
+    uint64_t size = sb.st_size;
+    if(size < create_size) {
+        // a new segment file, sparse
+        if(ftruncate(fd, create_size) != 0) {
+            close(fd);
+            throw PERSIST_EXP_TRUNCATE_FILE(errno);
+        }
+        size = create_size;
+        this->m_bSegmentsCreated = true;
+    }
+    void* p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(p == MAP_FAILED) {
+        dbg_default_error("{0} failed to map the segment file:{1}, errno={2}", this->m_sName, file, errno);
+        throw PERSIST_EXP_MMAP_FILE(errno);
+    }
+    seg.size = size;
+    seg.mapping.reset((uint8_t*)p, [size](uint8_t* addr) { munmap(addr, size); });
+    seg.addr.store((uint8_t*)p, std::memory_order_release);
+    return (uint8_t*)p;
+}
+
+void FilePersistLog::getSyncRanges(SegmentTable& table, const uint64_t& unit,
+                                   const uint64_t& start, const uint64_t& end,
+                                   std::vector<std::pair<void*, size_t>>& ranges) noexcept(false) {
+    if(end <= start) {
+        return;
+    }
+    // a segment may be larger than unit if it holds a single large entry
+    for(auto it = table.lower_bound(start / unit); it != table.end() && it->first <= (int64_t)((end - 1) / unit); it++) {
+        uint8_t* addr = it->second.addr.load(std::memory_order_acquire);
+        if(addr == nullptr) {
+            // not written since it was loaded
+            continue;
+        }
+        const uint64_t seg_start = it->first * unit;
+        const uint64_t range_start = MAX(start, seg_start);
+        const uint64_t range_end = MIN(end, seg_start + it->second.size);
+        if(range_start >= range_end) {
+            continue;
+        }
+        uint8_t* p = addr + (range_start - seg_start);
+        ranges.emplace_back(ALIGN_TO_PAGE(p), (range_end - range_start) + ((uint64_t)p) % PAGE_SIZE);
+    }
+}
+
+void FilePersistLog::dropSegments(const bool truncated) noexcept(true) {
+    int64_t data_first;
+    try {
+        data_first = ((NUM_USED_SLOTS > 0) ? LOG_ENTRY_AT(META_HEADER->fields.head)->fields.ofst : NEXT_DATA_OFST) / this->m_dataSegmentSize;
+    } catch(persist_exception_t e) {
+        // keep the segments, they are removed when the log is loaded again.
+        dbg_default_warn("{0} failed to read the head entry, exception={1}", this->m_sName, e);
+        return;
+    }
+    dropSegments(this->m_logSegments, LOG_FILE_SUFFIX,
+                 META_HEADER->fields.head / this->m_logSegmentEntries,
+                 truncated ? (int64_t)(META_HEADER->fields.tail / this->m_logSegmentEntries) : INT64_MAX);
+    dropSegments(this->m_dataSegments, DATA_FILE_SUFFIX, data_first,
+                 truncated ? (int64_t)(NEXT_DATA_OFST / this->m_dataSegmentSize) : INT64_MAX);
+}
+
+void FilePersistLog::dropSegments(SegmentTable& table, const char* suffix,
+                                  const int64_t& first, const int64_t& last) noexcept(true) {
+    for(auto it = table.begin(); it != table.end();) {
+        if(it->first >= first && it->first <= last) {
+            it++;
+            continue;
+        }
+        // the mapping goes with the last reader pinning an entry in it
+        const string file = segmentFile(suffix, it->first);
+        if(unlink(file.c_str()) != 0 && errno != ENOENT) {
+            dbg_default_warn("{0} failed to remove the segment file:{1}, errno={2}", this->m_sName, file, errno);
+        }
+        dbg_default_trace("{0} dropped {1} segment {2}", this->m_sName, suffix, it->first);
+        it = table.erase(it);
+    }
+}
+
+void FilePersistLog::advanceVersion(const int64_t& ver) noexcept(false) {
+    FPL_RDLOCK;
     if(META_HEADER->fields.ver < ver) {
-        META_HEADER->fields.ver = ver;
+        publishBounds({META_HEADER->fields.head, META_HEADER->fields.tail, ver, NEXT_DATA_OFST});
     } else {
         FPL_UNLOCK;
         throw PERSIST_EXP_INV_VERSION;
@@ -311,10 +640,18 @@ const int64_t FilePersistLog::persist(const bool preLocked) noexcept(false) {
         FPL_RDLOCK;
     }
 
-    if(*META_HEADER == *META_HEADER_PERS) {
-        if(CURR_LOG_IDX != -1) {
-            //ver_ret = LOG_ENTRY_AT(CURR_LOG_IDX)->fields.ver;
-            ver_ret = META_HEADER->fields.ver;
+    // a snapshot of the current state: the appending thread goes on while
+    // it is flushed.
+    const LogBounds bounds = readBounds();
+    MetaHeader shadow_header = *META_HEADER_PERS;
+    shadow_header.fields.head = bounds.head;
+    shadow_header.fields.tail = bounds.tail;
+    shadow_header.fields.ver = bounds.ver;
+    shadow_header.fields.dtail = bounds.dtail;
+
+    if(shadow_header == *META_HEADER_PERS) {
+        if(bounds.tail > bounds.head) {
+            ver_ret = bounds.ver;
         }
         if(!preLocked) {
             FPL_UNLOCK;
@@ -326,40 +663,45 @@ const int64_t FilePersistLog::persist(const bool preLocked) noexcept(false) {
     //flush data
     dbg_default_trace("{0} flush data,log,and meta.", this->m_sName);
     try {
-        // shadow the current state
-        void *flush_dstart = nullptr, *flush_lstart = nullptr;
-        size_t flush_dlen = 0, flush_llen = 0;
-        MetaHeader shadow_header = *META_HEADER;
-        if((NUM_USED_SLOTS > 0) && (NEXT_LOG_ENTRY > NEXT_LOG_ENTRY_PERS)) {
-            flush_dlen = (LOG_ENTRY_AT(CURR_LOG_IDX)->fields.ofst + LOG_ENTRY_AT(CURR_LOG_IDX)->fields.dlen - NEXT_LOG_ENTRY_PERS->fields.ofst);
-            // flush data
-            flush_dstart = ALIGN_TO_PAGE(NEXT_DATA_PERS);
-            flush_dlen += ((int64_t)NEXT_DATA_PERS) % PAGE_SIZE;
-            // flush log
-            flush_lstart = ALIGN_TO_PAGE(NEXT_LOG_ENTRY_PERS);
-            flush_llen = ((size_t)NEXT_LOG_ENTRY - (size_t)NEXT_LOG_ENTRY_PERS) + ((int64_t)NEXT_LOG_ENTRY_PERS) % PAGE_SIZE;
-        }
-        if(NUM_USED_SLOTS > 0) {
+        // the data ranges come first, then the log ranges.
+        std::vector<std::pair<void*, size_t>> flush_ranges;
+        int64_t flush_idx = MAX(META_HEADER_PERS->fields.tail, bounds.head);
+        if(bounds.tail > flush_idx) {
+            try {
+                // flush data
+                getSyncRanges(this->m_dataSegments, this->m_dataSegmentSize,
+                              LOG_ENTRY_AT(flush_idx)->fields.ofst, bounds.dtail, flush_ranges);
+                // flush log
+                getSyncRanges(this->m_logSegments, this->m_logSegmentEntries * sizeof(LogEntry),
+                              flush_idx * sizeof(LogEntry), bounds.tail * sizeof(LogEntry), flush_ranges);
+            } catch(persist_exception_t e) {
+                if(!preLocked) {
+                    FPL_UNLOCK;
+                }
+                throw e;
+            }
+        }
+        bool sync_dir = this->m_bSegmentsCreated;
+        this->m_bSegmentsCreated = false;
+        if(bounds.tail > bounds.head) {
             //get the latest flushed version
-            //ver_ret = LOG_ENTRY_AT(CURR_LOG_IDX)->fields.ver;
-            ver_ret = META_HEADER->fields.ver;
+            ver_ret = bounds.ver;
         }
         if(!preLocked) {
             FPL_UNLOCK;
         }
-        if(flush_dlen > 0) {
-            if(msync(flush_dstart, flush_dlen, MS_SYNC) != 0) {
+        for(auto& range : flush_ranges) {
+            if(msync(range.first, range.second, MS_SYNC) != 0) {
                 throw PERSIST_EXP_MSYNC(errno);
             }
         }
-        if(flush_llen > 0) {
-            if(msync(flush_lstart, flush_llen, MS_SYNC) != 0) {
-                throw PERSIST_EXP_MSYNC(errno);
-            }
+        // flush the directory entries of new segment files
+        if(sync_dir && fsync(this->m_iDirDesc) != 0) {
+            throw PERSIST_EXP_MSYNC(errno);
         }
         // flush meta data
         this->persistMetaHeaderAtomically(&shadow_header);
-    } catch(uint64_t e) {
+    } catch(persist_exception_t e) {
         if(!preLocked) {
             FPL_PERS_UNLOCK;
         }
@@ -373,40 +715,52 @@ const int64_t FilePersistLog::persist(const bool preLocked) noexcept(false) {
     return ver_ret;
 }
 
+// The bounds of the log are read without the lock.
 int64_t FilePersistLog::getLength() noexcept(false) {
-    FPL_RDLOCK;
-    int64_t len = NUM_USED_SLOTS;
-    FPL_UNLOCK;
-
-    return len;
+    const LogBounds bounds = readBounds();
+    return bounds.tail - bounds.head;
 }
 
 int64_t FilePersistLog::getEarliestIndex() noexcept(false) {
-    FPL_RDLOCK;
-    int64_t idx = (NUM_USED_SLOTS == 0) ? INVALID_INDEX : META_HEADER->fields.head;
-    FPL_UNLOCK;
-    return idx;
+    const LogBounds bounds = readBounds();
+    return (bounds.tail == bounds.head) ? INVALID_INDEX : bounds.head;
 }
 
 int64_t FilePersistLog::getLatestIndex() noexcept(false) {
-    FPL_RDLOCK;
-    int64_t idx = CURR_LOG_IDX;
-    FPL_UNLOCK;
-    return idx;
+    const LogBounds bounds = readBounds();
+    return (bounds.tail == bounds.head) ? -1 : bounds.tail - 1;
 }
 
 version_t FilePersistLog::getEarliestVersion() noexcept(false) {
     FPL_RDLOCK;
-    int64_t idx = (NUM_USED_SLOTS == 0) ? INVALID_INDEX : META_HEADER->fields.head;
-    version_t ver = (idx == INVALID_INDEX) ? INVALID_VERSION : (LOG_ENTRY_AT(idx)->fields.ver);
+    const LogBounds bounds = readBounds();
+    int64_t idx = (bounds.tail == bounds.head) ? INVALID_INDEX : bounds.head;
+    version_t ver = INVALID_VERSION;
+    if(idx != INVALID_INDEX) {
+        try {
+            ver = LOG_ENTRY_AT(idx)->fields.ver;
+        } catch(persist_exception_t e) {
+            FPL_UNLOCK;
+            throw e;
+        }
+    }
     FPL_UNLOCK;
     return ver;
 }
 
 version_t FilePersistLog::getLatestVersion() noexcept(false) {
     FPL_RDLOCK;
-    int64_t idx = CURR_LOG_IDX;
-    version_t ver = (idx == INVALID_INDEX) ? INVALID_VERSION : (LOG_ENTRY_AT(idx)->fields.ver);
+    const LogBounds bounds = readBounds();
+    int64_t idx = (bounds.tail == bounds.head) ? -1 : bounds.tail - 1;
+    version_t ver = INVALID_VERSION;
+    if(idx != -1) {
+        try {
+            ver = LOG_ENTRY_AT(idx)->fields.ver;
+        } catch(persist_exception_t e) {
+            FPL_UNLOCK;
+            throw e;
+        }
+    }
     FPL_UNLOCK;
     return ver;
 }
@@ -424,16 +778,23 @@ const version_t FilePersistLog::getLastPersisted() noexcept(false) {
 
 int64_t FilePersistLog::getVersionIndex(const version_t& ver) {
     FPL_RDLOCK;
+    const LogBounds bounds = readBounds();
 
     //binary search
     dbg_default_trace("{0} - begin binary search.", this->m_sName);
-    int64_t l_idx = binarySearch<int64_t>(
-            [&](const LogEntry* ple) {
-                return ple->fields.ver;
-            },
-            ver,
-            META_HEADER->fields.head,
-            META_HEADER->fields.tail);
+    int64_t l_idx;
+    try {
+        l_idx = binarySearch<int64_t>(
+                [&](const LogEntry* ple) {
+                    return ple->fields.ver;
+                },
+                ver,
+                bounds.head,
+                bounds.tail);
+    } catch(persist_exception_t e) {
+        FPL_UNLOCK;
+        throw e;
+    }
     dbg_default_trace("{0} - end binary search.", this->m_sName);
 
     FPL_UNLOCK;
@@ -443,27 +804,69 @@ int64_t FilePersistLog::getVersionIndex(const version_t& ver) {
     return l_idx;
 }
 
+int64_t FilePersistLog::getHLCIndex(const HLC& rhlc) noexcept(false) {
+    int64_t l_idx = INVALID_INDEX;
+
+    {
+        std::shared_lock<std::shared_mutex> hidx_lck(this->m_hidxLock);
+        l_idx = this->hidx.search(rhlc);
+    }
+
+    dbg_default_trace("{0} getHLCIndex({1},{2}) at index {3}", this->m_sName, rhlc.m_rtc_us, rhlc.m_logic, l_idx);
+
+    return l_idx;
+}
+
+version_t FilePersistLog::getVersionByIndex(const int64_t& eidx) noexcept(false) {
+    FPL_RDLOCK;
+    const LogBounds bounds = readBounds();
+    int64_t ridx = (eidx < 0) ? (bounds.tail + eidx) : eidx;
+
+    if(bounds.tail <= ridx || ridx < bounds.head) {
+        FPL_UNLOCK;
+        throw PERSIST_EXP_INV_ENTRY_IDX(eidx);
+    }
+    version_t ver;
+    try {
+        ver = LOG_ENTRY_AT(ridx)->fields.ver;
+    } catch(persist_exception_t e) {
+        FPL_UNLOCK;
+        throw e;
+    }
+    FPL_UNLOCK;
+
+    return ver;
+}
+
 const void* FilePersistLog::getEntryByIndex(const int64_t& eidx) noexcept(false) {
     FPL_RDLOCK;
+    const LogBounds bounds = readBounds();
     dbg_default_trace("{0}-getEntryByIndex-head:{1},tail:{2},eidx:{3}",
-                      this->m_sName, META_HEADER->fields.head, META_HEADER->fields.tail, eidx);
+                      this->m_sName, bounds.head, bounds.tail, eidx);
 
-    int64_t ridx = (eidx < 0) ? (META_HEADER->fields.tail + eidx) : eidx;
+    int64_t ridx = (eidx < 0) ? (bounds.tail + eidx) : eidx;
 
-    if(META_HEADER->fields.tail <= ridx || ridx < META_HEADER->fields.head) {
+    if(bounds.tail <= ridx || ridx < bounds.head) {
         FPL_UNLOCK;
         throw PERSIST_EXP_INV_ENTRY_IDX(eidx);
     }
+    const void* pdata;
+    try {
+        const LogEntry* ple = LOG_ENTRY_AT(ridx);
+        dbg_default_trace("{0} getEntryByIndex at idx:{1} ver:{2} time:({3},{4})",
+                          this->m_sName,
+                          ridx,
+                          (int64_t)(ple->fields.ver),
+                          ple->fields.hlc_r,
+                          ple->fields.hlc_l);
+        pdata = pinnedEntryData(ple);
+    } catch(persist_exception_t e) {
+        FPL_UNLOCK;
+        throw e;
+    }
     FPL_UNLOCK;
 
-    dbg_default_trace("{0} getEntryByIndex at idx:{1} ver:{2} time:({3},{4})",
-                      this->m_sName,
-                      ridx,
-                      (int64_t)(LOG_ENTRY_AT(ridx)->fields.ver),
-                      (LOG_ENTRY_AT(ridx))->fields.hlc_r,
-                      (LOG_ENTRY_AT(ridx))->fields.hlc_l);
-
-    return LOG_ENTRY_DATA(LOG_ENTRY_AT(ridx));
+    return pdata;
 }
 
 /** MOVED TO .hpp
@@ -516,20 +919,30 @@ const void* FilePersistLog::getEntryByIndex(const int64_t& eidx) noexcept(false)
 
 const void* FilePersistLog::getEntry(const int64_t& ver) noexcept(false) {
     LogEntry* ple = nullptr;
+    const void* pdata = nullptr;
 
     FPL_RDLOCK;
+    const LogBounds bounds = readBounds();
 
     //binary search
     dbg_default_trace("{0} - begin binary search.", this->m_sName);
-    int64_t l_idx = binarySearch<int64_t>(
-            [&](const LogEntry* ple) {
-                return ple->fields.ver;
-            },
-            ver,
-            META_HEADER->fields.head,
-            META_HEADER->fields.tail);
-    ple = (l_idx == -1) ? nullptr : LOG_ENTRY_AT(l_idx);
-    dbg_default_trace("{0} - end binary search.", this->m_sName);
+    try {
+        int64_t l_idx = binarySearch<int64_t>(
+                [&](const LogEntry* ple) {
+                    return ple->fields.ver;
+                },
+                ver,
+                bounds.head,
+                bounds.tail);
+        ple = (l_idx == -1) ? nullptr : LOG_ENTRY_AT(l_idx);
+        dbg_default_trace("{0} - end binary search.", this->m_sName);
+        if(ple != nullptr) {
+            pdata = pinnedEntryData(ple);
+        }
+    } catch(persist_exception_t e) {
+        FPL_UNLOCK;
+        throw e;
+    }
 
     FPL_UNLOCK;
 
@@ -540,11 +953,12 @@ const void* FilePersistLog::getEntry(const int64_t& ver) noexcept(false) {
 
     dbg_default_trace("{0} getEntry at ({1},{2})", this->m_sName, ple->fields.hlc_r, ple->fields.hlc_l);
 
-    return LOG_ENTRY_DATA(ple);
+    return pdata;
 }
 
 const void* FilePersistLog::getEntry(const HLC& rhlc) noexcept(false) {
     LogEntry* ple = nullptr;
+    const void* pdata = nullptr;
     //    unsigned __int128 key = ((((unsigned __int128)rhlc.m_rtc_us)<<64) | rhlc.m_logic);
 
     FPL_RDLOCK;
@@ -563,23 +977,22 @@ const void* FilePersistLog::getEntry(const HLC& rhlc) noexcept(false) {
     //    dbg_default_trace("{0} - end binary search.",this->m_sName);
     //    ple = (l_idx == -1) ? nullptr : LOG_ENTRY_AT(l_idx);
     dbg_default_trace("getEntry for hlc({0},{1})", rhlc.m_rtc_us, rhlc.m_logic);
-    struct hlc_index_entry skey(rhlc, 0);
-    auto key = this->hidx.upper_bound(skey);
-    FPL_UNLOCK;
-
-#ifndef NDEBUG
-    dbg_default_trace("hidx.size = {}", this->hidx.size());
-    if(key == this->hidx.end())
-        dbg_default_trace("found upper bound = hidx.end()");
-    else
-        dbg_default_trace("found upper bound = hlc({},{}),idx{}", key->hlc.m_rtc_us, key->hlc.m_logic, key->log_idx);
-#endif  //NDEBUG
-
-    if(key != this->hidx.begin() && this->hidx.size() > 0) {
-        key--;
-        ple = LOG_ENTRY_AT(key->log_idx);
-        dbg_default_trace("getEntry returns: hlc:({0},{1}),idx:{2}", key->hlc.m_rtc_us, key->hlc.m_logic, key->log_idx);
+    int64_t l_idx;
+    {
+        std::shared_lock<std::shared_mutex> hidx_lck(this->m_hidxLock);
+        l_idx = this->hidx.search(rhlc);
+    }
+    if(l_idx != INVALID_INDEX) {
+        try {
+            ple = LOG_ENTRY_AT(l_idx);
+            pdata = pinnedEntryData(ple);
+        } catch(persist_exception_t e) {
+            FPL_UNLOCK;
+            throw e;
+        }
+        dbg_default_trace("getEntry returns: hlc:({0},{1}),idx:{2}", ple->fields.hlc_r, ple->fields.hlc_l, l_idx);
     }
+    FPL_UNLOCK;
 
     // no object exists before the requested timestamp.
     if(ple == nullptr) {
@@ -588,19 +1001,17 @@ const void* FilePersistLog::getEntry(const HLC& rhlc) noexcept(false) {
 
     dbg_default_trace("{0} getEntry at ({1},{2})", this->m_sName, ple->fields.hlc_r, ple->fields.hlc_l);
 
-    return LOG_ENTRY_DATA(ple);
+    return pdata;
 }
 
 // trim by index
 void FilePersistLog::trimByIndex(const int64_t& idx) noexcept(false) {
     dbg_default_trace("{0} trim at index: {1}", this->m_sName, idx);
-    FPL_RDLOCK;
     // validate check
-    if(idx < META_HEADER->fields.head || idx >= META_HEADER->fields.tail) {
-        FPL_UNLOCK;
+    const LogBounds bounds = readBounds();
+    if(idx < bounds.head || idx >= bounds.tail) {
         return;
     }
-    FPL_UNLOCK;
 
     FPL_PERS_LOCK;
     FPL_WRLOCK;
@@ -610,16 +1021,19 @@ void FilePersistLog::trimByIndex(const int64_t& idx) noexcept(false) {
         FPL_PERS_UNLOCK;
         return;
     }
-    META_HEADER->fields.head = idx + 1;
+    publishBounds({idx + 1, META_HEADER->fields.tail, META_HEADER->fields.ver, NEXT_DATA_OFST});
     try {
         persist(true);
-    } catch(uint64_t e) {
+    } catch(persist_exception_t e) {
         FPL_UNLOCK;
         FPL_PERS_UNLOCK;
         throw e;
     }
-    //TODO: remove entry from index...this is tricky because HLC
-    // order does not agree with index order.
+    {
+        std::unique_lock<std::shared_mutex> hidx_lck(this->m_hidxLock);
+        this->hidx.trim(META_HEADER->fields.head);
+    }
+    dropSegments(false);
     FPL_UNLOCK;
     FPL_PERS_UNLOCK;
     // throw PERSIST_EXP_UNIMPLEMENTED;
@@ -670,12 +1084,12 @@ void FilePersistLog::persistMetaHeaderAtomically(MetaHeader* pShadowHeader) noex
     *META_HEADER_PERS = *pShadowHeader;
 }
 
-int64_t FilePersistLog::getMinimumIndexBeyondVersion(const int64_t& ver) noexcept(false) {
+int64_t FilePersistLog::getMinimumIndexBeyondVersion(const LogBounds& bounds, const int64_t& ver) noexcept(false) {
     int64_t rIndex = INVALID_INDEX;
 
     dbg_default_trace("{0}[{1}] - request version {2}", this->m_sName, __func__, ver);
 
-    if(NUM_USED_SLOTS == 0) {
+    if(bounds.tail == bounds.head) {
         dbg_default_trace("{0}[{1}] - request on an empty log, return INVALID_INDEX.", this->m_sName, __func__);
         return rIndex;
     }
@@ -683,7 +1097,7 @@ int64_t FilePersistLog::getMinimumIndexBeyondVersion(const int64_t& ver) noexcep
     if(ver == INVALID_VERSION) {
         dbg_default_trace("{0}[{1}] - request all logs", this->m_sName, __func__);
         // return the earliest log we have.
-        return META_HEADER->fields.head;
+        return bounds.head;
     }
 
     // binary search
@@ -693,16 +1107,16 @@ int64_t FilePersistLog::getMinimumIndexBeyondVersion(const int64_t& ver) noexcep
                 return ple->fields.ver;
             },
             ver,
-            META_HEADER->fields.head,
-            META_HEADER->fields.tail);
+            bounds.head,
+            bounds.tail);
 
     if(l_idx == -1) {
         // if binary search failed, it means the requested version is earlier
         // than the earliest available log so we return the earliest log entry
         // we have.
-        rIndex = META_HEADER->fields.head;
+        rIndex = bounds.head;
         dbg_default_trace("{0}[{1}] - binary search failed, return the earliest version {2}", this->m_sName, __func__, ver);
-    } else if((l_idx + 1) == META_HEADER->fields.tail) {
+    } else if((l_idx + 1) == bounds.tail) {
         // if binary search found the last one, it means ver is in the future return INVALID_INDEX.
         // use the default rIndex value (INVALID_INDEX)
         dbg_default_trace("{0}[{1}] - binary search returns the last entry in the log. return INVALID_INDEX.", this->m_sName, __func__);
@@ -723,54 +1137,81 @@ int64_t FilePersistLog::getMinimumIndexBeyondVersion(const int64_t& ver) noexcep
 // 2) size_t writeLogEntryToByteArray(const LogEntry * ple, char * ba);
 // 3) size_t postLogEntry(const std::function<void (char const *const, std::size_t)> f, const LogEntry *ple);
 // 4) size_t mergeLogEntryFromByteArray(const char * ba);
+// The segments are looked up under FPL_RDLOCK, because an append may add one.
 size_t FilePersistLog::bytes_size(const int64_t& ver) noexcept(false) {
     size_t bsize = (sizeof(int64_t) + sizeof(int64_t));
-    int64_t idx = this->getMinimumIndexBeyondVersion(ver);
-    if(idx != INVALID_INDEX) {
-        while(idx < META_HEADER->fields.tail) {
-            bsize += byteSizeOfLogEntry(LOG_ENTRY_AT(idx));
-            idx++;
+    FPL_RDLOCK;
+    const LogBounds bounds = readBounds();
+    try {
+        int64_t idx = this->getMinimumIndexBeyondVersion(bounds, ver);
+        if(idx != INVALID_INDEX) {
+            while(idx < bounds.tail) {
+                bsize += byteSizeOfLogEntry(LOG_ENTRY_AT(idx));
+                idx++;
+            }
         }
+    } catch(persist_exception_t e) {
+        FPL_UNLOCK;
+        throw e;
     }
+    FPL_UNLOCK;
     return bsize;
 }
 
 size_t FilePersistLog::to_bytes(char* buf, const int64_t& ver) noexcept(false) {
-    int64_t idx = this->getMinimumIndexBeyondVersion(ver);
     size_t ofst = 0;
-    // latest_version
-    int64_t latest_version = this->getLatestVersion();
-    *(int64_t*)(buf + ofst) = latest_version;
-    ofst += sizeof(int64_t);
-    // nr_log_entry
-    *(int64_t*)(buf + ofst) = (idx == INVALID_INDEX) ? 0 : (META_HEADER->fields.tail - idx);
-    ofst += sizeof(int64_t);
-    // log_entries
-    if(idx != INVALID_INDEX) {
-        while(idx < META_HEADER->fields.tail) {
-            ofst += writeLogEntryToByteArray(LOG_ENTRY_AT(idx), buf + ofst);
-            idx++;
+    FPL_RDLOCK;
+    // the entries appended meanwhile are left out
+    const LogBounds bounds = readBounds();
+    try {
+        int64_t idx = this->getMinimumIndexBeyondVersion(bounds, ver);
+        // latest_version
+        int64_t latest_version = (bounds.tail == bounds.head) ? INVALID_VERSION : LOG_ENTRY_AT(bounds.tail - 1)->fields.ver;
+        *(int64_t*)(buf + ofst) = latest_version;
+        ofst += sizeof(int64_t);
+        // nr_log_entry
+        *(int64_t*)(buf + ofst) = (idx == INVALID_INDEX) ? 0 : (bounds.tail - idx);
+        ofst += sizeof(int64_t);
+        // log_entries
+        if(idx != INVALID_INDEX) {
+            while(idx < bounds.tail) {
+                ofst += writeLogEntryToByteArray(LOG_ENTRY_AT(idx), buf + ofst);
+                idx++;
+            }
         }
+    } catch(persist_exception_t e) {
+        FPL_UNLOCK;
+        throw e;
     }
+    FPL_UNLOCK;
     return ofst;
 }
 
 void FilePersistLog::post_object(const std::function<void(char const* const, std::size_t)>& f,
                                  const int64_t& ver) noexcept(false) {
-    int64_t idx = this->getMinimumIndexBeyondVersion(ver);
-    // latest_version
-    int64_t latest_version = this->getLatestVersion();
-    f((char*)&latest_version, sizeof(int64_t));
-    // nr_log_entry
-    int64_t nr_log_entry = (idx == INVALID_INDEX) ? 0 : (META_HEADER->fields.tail - idx);
-    f((char*)&nr_log_entry, sizeof(int64_t));
-    // log_entries
-    if(idx != INVALID_INDEX) {
-        while(idx < META_HEADER->fields.tail) {
-            postLogEntry(f, LOG_ENTRY_AT(idx));
-            idx++;
+    FPL_RDLOCK;
+    // the entries appended meanwhile are left out
+    const LogBounds bounds = readBounds();
+    try {
+        int64_t idx = this->getMinimumIndexBeyondVersion(bounds, ver);
+        // latest_version
+        int64_t latest_version = (bounds.tail == bounds.head) ? INVALID_VERSION : LOG_ENTRY_AT(bounds.tail - 1)->fields.ver;
+        f((char*)&latest_version, sizeof(int64_t));
+        // nr_log_entry
+        int64_t nr_log_entry = (idx == INVALID_INDEX) ? 0 : (bounds.tail - idx);
+        f((char*)&nr_log_entry, sizeof(int64_t));
+        // log_entries
+        if(idx != INVALID_INDEX) {
+            while(idx < bounds.tail) {
+                postLogEntry(f, LOG_ENTRY_AT(idx));
+                idx++;
+            }
         }
+    } catch(persist_exception_t e) {
+        FPL_UNLOCK;
+        throw e;
     }
+    FPL_UNLOCK;
 }
 
 void FilePersistLog::applyLogTail(char const* v) noexcept(false) {
@@ -781,12 +1222,19 @@ void FilePersistLog::applyLogTail(char const* v) noexcept(false) {
     // nr_log_entry
     int64_t nr_log_entry = *(const int64_t*)(v + ofst);
     ofst += sizeof(int64_t);
-    // log_entries
-    while(nr_log_entry--) {
-        ofst += mergeLogEntryFromByteArray(v + ofst);
+    // log_entries, which may need new segments
+    FPL_WRLOCK;
+    try {
+        while(nr_log_entry--) {
+            ofst += mergeLogEntryFromByteArray(v + ofst);
+        }
+    } catch(persist_exception_t e) {
+        FPL_UNLOCK;
+        throw e;
     }
     // update the latest version.
-    META_HEADER->fields.ver = latest_version;
+    publishBounds({META_HEADER->fields.head, META_HEADER->fields.tail, latest_version, NEXT_DATA_OFST});
+    FPL_UNLOCK;
 }
 
 size_t FilePersistLog::byteSizeOfLogEntry(const LogEntry* ple) noexcept(false) {
@@ -823,22 +1271,16 @@ size_t FilePersistLog::mergeLogEntryFromByteArray(const char* ba) noexcept(false
         dbg_default_trace("{0} skip log entry version {1}, we are at {2}.", __func__, cple->fields.ver, META_HEADER->fields.ver);
         return cple->fields.dlen + sizeof(LogEntry);
     }
-    // 1) do we have space to merge it?
-    if(NUM_FREE_SLOTS == 0) {
-        dbg_default_trace("{0} failed to merge log entry, we don't empty log entry.", __func__);
-        throw PERSIST_EXP_NOSPACE_LOG;
-    }
-    if(NUM_FREE_BYTES < cple->fields.dlen) {
-        dbg_default_trace("{0} failed to merge log entry, we need {1} bytes data space, but we have only {2} bytes.", __func__, cple->fields.dlen, NUM_FREE_BYTES);
-        throw PERSIST_EXP_NOSPACE_DATA;
-    }
-    // 2) merge it!
-    memcpy(NEXT_DATA, (const void*)(ba + sizeof(LogEntry)), cple->fields.dlen);
-    memcpy(NEXT_LOG_ENTRY, cple, sizeof(LogEntry));
-    NEXT_LOG_ENTRY->fields.ofst = NEXT_DATA_OFST;
-    this->hidx.insert(hlc_index_entry{HLC{cple->fields.hlc_r, cple->fields.hlc_l}, META_HEADER->fields.tail});
-    META_HEADER->fields.tail++;
-    META_HEADER->fields.ver = cple->fields.ver;
+    // 1) merge it!
+    uint64_t ofst = placeData(cple->fields.dlen);
+    memcpy(newEntryData(ofst, cple->fields.dlen), (const void*)(ba + sizeof(LogEntry)), cple->fields.dlen);
+    LogEntry* ple = NEXT_LOG_ENTRY;
+    memcpy(ple, cple, sizeof(LogEntry));
+    ple->fields.ofst = ofst;
+    const int64_t idx = META_HEADER->fields.tail;
+    publishBounds({META_HEADER->fields.head, idx + 1, cple->fields.ver, ofst + cple->fields.dlen});
+    std::unique_lock<std::shared_mutex> hidx_lck(this->m_hidxLock);
+    this->hidx.insert(cple->fields.hlc_r, cple->fields.hlc_l, idx);
     dbg_default_trace("{0} merge log:log entry and meta data are updated.", __func__);
     return cple->fields.dlen + sizeof(LogEntry);
 }
@@ -892,57 +1334,96 @@ bool checkOrCreateMetaFile(const string& metaFile) noexcept(false) {
     return checkOrCreateFileWithSize(metaFile, META_SIZE);
 }
 
-bool checkOrCreateLogFile(const string& logFile) noexcept(false) {
-    return checkOrCreateFileWithSize(logFile, MAX_LOG_SIZE);
+template <typename SegmentFileFunc>
+void forEachSegmentFile(const string& dataPath, const string& name, const SegmentFileFunc& fun) noexcept(false) {
+    for(const char* suffix : {LOG_FILE_SUFFIX, DATA_FILE_SUFFIX}) {
+        const string prefix = name + "." + suffix + ".";
+        for(const auto& dent : fs::directory_iterator(dataPath)) {
+            const string file_name = dent.path().filename().string();
+            if(file_name.size() <= prefix.size() || file_name.compare(0, prefix.size(), prefix) != 0
+               || file_name.find_first_not_of("0123456789", prefix.size()) != string::npos) {
+                continue;
+            }
+            fun(dent.path().string(), suffix, std::stoll(file_name.substr(prefix.size())));
+        }
+    }
 }
 
-bool checkOrCreateDataFile(const string& dataFile) noexcept(false) {
-    return checkOrCreateFileWithSize(dataFile, MAX_DATA_SIZE);
+void readRingFile(int fd, void* buf, uint64_t size, uint64_t ofst, const uint64_t& ring_size) noexcept(false) {
+    while(size > 0) {
+        ssize_t nRead = pread(fd, buf, std::min(size, ring_size - ofst), ofst);
+        if(nRead <= 0) {
+            throw PERSIST_EXP_READ_FILE(errno);
+        }
+        buf = (uint8_t*)buf + nRead;
+        size -= nRead;
+        ofst = (ofst + nRead) % ring_size;
+    }
 }
 
 void FilePersistLog::truncate(const int64_t& ver) noexcept(false) {
     dbg_default_trace("{0} truncate at version: {1}.", this->m_sName, ver);
+    FPL_PERS_LOCK;
     FPL_WRLOCK;
     // STEP 1: search for the log entry
-    // TODO
     //binary search
-    int64_t head = META_HEADER->fields.head % MAX_LOG_ENTRY;
-    int64_t tail = META_HEADER->fields.tail % MAX_LOG_ENTRY;
-    if(tail < head) tail += MAX_LOG_ENTRY;
     dbg_default_trace("{0} - begin binary search.", this->m_sName);
-    int64_t l_idx = binarySearch<int64_t>(
-            [&](const LogEntry* ple) {
-                return ple->fields.ver;
-            },
-            ver, head, tail);
+    int64_t l_idx;
+    try {
+        l_idx = binarySearch<int64_t>(
+                [&](const LogEntry* ple) {
+                    return ple->fields.ver;
+                },
+                ver, META_HEADER->fields.head, META_HEADER->fields.tail);
+    } catch(persist_exception_t e) {
+        FPL_UNLOCK;
+        FPL_PERS_UNLOCK;
+        throw e;
+    }
     dbg_default_trace("{0} - end binary search.", this->m_sName);
     // STEP 2: update META_HEADER
-    if(l_idx == -1) {  // not adequate log found. We need to remove all logs.
-        // TODO: this may not be safe in case the log has been trimmed beyond 'ver' !!!
-        META_HEADER->fields.tail = META_HEADER->fields.head;
-    } else {
-        int64_t _idx = (META_HEADER->fields.head + l_idx - head) + ((head > l_idx) ? MAX_LOG_ENTRY : 0);
-        META_HEADER->fields.tail = _idx + 1;
+    int64_t new_tail = META_HEADER->fields.head;
+    if(l_idx != -1) {
+        new_tail = l_idx + 1;
+    }
+    // else: not adequate log found. We need to remove all logs.
+    // TODO: this may not be safe in case the log has been trimmed beyond 'ver' !!!
+    LogBounds bounds{META_HEADER->fields.head, META_HEADER->fields.tail, META_HEADER->fields.ver, NEXT_DATA_OFST};
+    if(new_tail < bounds.tail) {
+        // the data of the removed entries starts with the first of them
+        try {
+            bounds.dtail = LOG_ENTRY_AT(new_tail)->fields.ofst;
+        } catch(persist_exception_t e) {
+            FPL_UNLOCK;
+            FPL_PERS_UNLOCK;
+            throw e;
+        }
+        bounds.tail = new_tail;
+    }
+    if(bounds.ver > ver)
+        bounds.ver = ver;
+    publishBounds(bounds);
+    {
+        std::unique_lock<std::shared_mutex> hidx_lck(this->m_hidxLock);
+        this->hidx.truncate(META_HEADER->fields.tail);
     }
-    if(META_HEADER->fields.ver > ver)
-        META_HEADER->fields.ver = ver;
     // STEP 3: update PERSISTENT STATE
-    FPL_PERS_LOCK;
     try {
         persistMetaHeaderAtomically(META_HEADER);
-    } catch(uint64_t e) {
-        FPL_PERS_UNLOCK;
+    } catch(persist_exception_t e) {
         FPL_UNLOCK;
+        FPL_PERS_UNLOCK;
         throw e;
     }
-    FPL_PERS_UNLOCK;
+    dropSegments(true);
     FPL_UNLOCK;
+    FPL_PERS_UNLOCK;
     dbg_default_trace("{0} truncate at version: {1}....done", this->m_sName, ver);
 }
 
-const uint64_t FilePersistLog::getMinimumLatestPersistedVersion(const std::string& prefix) {
+const uint64_t FilePersistLog::getMinimumLatestPersistedVersion(const std::string& prefix, const std::string& path) {
     // STEP 1: list all meta files in the path
-    DIR* dir = opendir(getPersFilePath().c_str());
+    DIR* dir = opendir(path.c_str());
     if(dir == NULL) {
         // We cannot open the persistent directory, so just return error.
         dbg_default_error("{}:{} failed to open the directory. errno={}, err={}.",
@@ -958,7 +1439,7 @@ const uint64_t FilePersistLog::getMinimumLatestPersistedVersion(const std::strin
         if(name_len > prefix.length() && strncmp(prefix.c_str(), dent->d_name, prefix.length()) == 0 && strncmp("." META_FILE_SUFFIX, dent->d_name + name_len - strlen(META_FILE_SUFFIX) - 1, strlen(META_FILE_SUFFIX) + 1) == 0) {
             MetaHeader mh;
             char fn[1024];
-            sprintf(fn, "%s/%s", getPersFilePath().c_str(), dent->d_name);
+            sprintf(fn, "%s/%s", path.c_str(), dent->d_name);
             int fd = open(fn, O_RDONLY);
             if(fd < 0) {
                 dbg_default_warn("{}:{} cannot read file:{}, errno={}, err={}.",
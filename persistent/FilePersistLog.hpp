@@ -4,8 +4,14 @@
 #include "PersistLog.hpp"
 #include "util.hpp"
 #include "utils/logger.hpp"
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <pthread.h>
+#include <shared_mutex>
 #include <string>
+#include <vector>
 
 namespace persistent {
 
@@ -20,8 +26,10 @@ typedef union meta_header {
         int64_t head;  // the head index
         int64_t tail;  // the tail index
         int64_t ver;   // the latest version number.
-                       // uint64_t d_head;  // the data head offset
-                       // uint64_t d_tail;  // the data tail offset
+        uint64_t dtail;            // the data tail offset
+        uint64_t log_seg_entries;  // number of log entries in a log segment
+        uint64_t data_seg_size;    // size of a data segment
+        uint64_t format;           // the layout of the log, META_FORMAT
     } fields;
     uint8_t bytes[256];
     bool operator==(const union meta_header& other) {
@@ -41,40 +49,52 @@ typedef union log_entry {
     uint8_t bytes[64];
 } LogEntry;
 
-// TODO: make this hard-wired number configurable.
-// Currently, we allow 1M(2^20-1) log entries and
-// 512GB data size.
-#define MAX_LOG_ENTRY ((uint64_t)(1UL << 20))
-// #define MAX_LOG_ENTRY         (1UL<<6)
-#define MAX_LOG_SIZE (sizeof(LogEntry) * MAX_LOG_ENTRY)
-#define MAX_DATA_SIZE ((uint64_t)(1UL << 39))
-// #define MAX_DATA_SIZE         (1UL<<12)
+// The log entries and their data are stored in segment files, which are
+// created as the log grows and removed whole once they are trimmed or
+// truncated away:
+// - log segment n, "<name>.log.<n>", holds the log entries with the indexes
+//   in [n*E, (n+1)*E), where E is log_seg_entries of the meta header.
+// - data segment n, "<name>.data.<n>", holds the data at the offsets in
+//   [n*S, (n+1)*S), where S is data_seg_size. Data offsets only grow. The
+//   data of an entry is never split: it starts in the next data segment if
+//   it does not fit in the rest of the current one, and an entry larger than
+//   S gets a data segment of its own, as large as the entry.
+// The segment sizes are taken from the configuration when the log is created
+// and kept in the meta header. Segment files are sparse, and are mapped to
+// memory the first time they are accessed.
 #define META_SIZE (sizeof(MetaHeader))
+// the layout described above. Meta headers without it are from the ring
+// layout, which kept the entries of a log in one file, "<name>.log", a ring of
+// RING_LOG_ENTRIES entries, and their data in "<name>.data", a ring of
+// RING_DATA_SIZE bytes. Such a log is migrated to segments when it is loaded.
+#define META_FORMAT ((uint64_t)1)
+#define RING_LOG_ENTRIES ((uint64_t)(1UL << 20))
+#define RING_DATA_SIZE ((uint64_t)(1UL << 39))
+
+// Appends are made by a single thread, the delivery thread of the object,
+// which holds FPL_RDLOCK only: readers and appends do not block each other.
+// FPL_WRLOCK is taken to change the segment tables or to move the head, by an
+// append that needs a new segment, a trim, or a truncation. The appending
+// thread publishes the tail, the version, and the data tail of the meta
+// header through a seqlock, see publishBounds(), and a reader takes a
+// consistent snapshot of them with readBounds() instead of reading
+// META_HEADER.
 
 // helpers:
-///// READ or WRITE LOCK on LOG REQUIRED to use the following MACROs!!!!
+///// the appending thread, or WRITE LOCK on LOG REQUIRED to use the following MACROs!!!!
 #define META_HEADER ((MetaHeader*)(&(this->m_currMetaHeader)))
 #define META_HEADER_PERS ((MetaHeader*)(&(this->m_persMetaHeader)))
-#define LOG_ENTRY_ARRAY ((LogEntry*)(this->m_pLog))
 
 #define NUM_USED_SLOTS (META_HEADER->fields.tail - META_HEADER->fields.head)
 // #define NUM_USED_SLOTS_PERS   (META_HEADER_PERS->tail - META_HEADER_PERS->head)
-#define NUM_FREE_SLOTS (MAX_LOG_ENTRY - 1 - NUM_USED_SLOTS)
-// #define NUM_FREE_SLOTS_PERS   (MAX_LOG_ENTRY - 1 - NUM_USERD_SLOTS_PERS)
 
-#define LOG_ENTRY_AT(idx) (LOG_ENTRY_ARRAY + (int)((idx) % MAX_LOG_ENTRY))
-#define NEXT_LOG_ENTRY LOG_ENTRY_AT(META_HEADER->fields.tail)
-#define NEXT_LOG_ENTRY_PERS LOG_ENTRY_AT( \
-        MAX(META_HEADER_PERS->fields.tail, META_HEADER->fields.head))
+#define LOG_ENTRY_AT(idx) (this->logEntryAt(idx))
+// creates the log segment of the next log entry if necessary: WRITE LOCK
+#define NEXT_LOG_ENTRY (this->logEntryAt(META_HEADER->fields.tail, true))
 #define CURR_LOG_IDX ((NUM_USED_SLOTS == 0) ? -1 : META_HEADER->fields.tail - 1)
-#define LOG_ENTRY_DATA(e) ((void*)((uint8_t*)this->m_pData + (e)->fields.ofst % MAX_DATA_SIZE))
-
-#define NEXT_DATA_OFST ((CURR_LOG_IDX == -1) ? 0 : (LOG_ENTRY_AT(CURR_LOG_IDX)->fields.ofst + LOG_ENTRY_AT(CURR_LOG_IDX)->fields.dlen))
-#define NEXT_DATA ((void*)((uint64_t) this->m_pData + NEXT_DATA_OFST % MAX_DATA_SIZE))
-#define NEXT_DATA_PERS ((NEXT_LOG_ENTRY > NEXT_LOG_ENTRY_PERS) ? LOG_ENTRY_DATA(NEXT_LOG_ENTRY_PERS) : NULL)
+#define LOG_ENTRY_DATA(e) (this->entryData(e))
 
-#define NUM_USED_BYTES ((NUM_USED_SLOTS == 0) ? 0 : (LOG_ENTRY_AT(CURR_LOG_IDX)->fields.ofst + LOG_ENTRY_AT(CURR_LOG_IDX)->fields.dlen - LOG_ENTRY_AT(META_HEADER->fields.head)->fields.ofst))
-#define NUM_FREE_BYTES (MAX_DATA_SIZE - NUM_USED_BYTES)
+#define NEXT_DATA_OFST (META_HEADER->fields.dtail)
 
 #define PAGE_SIZE (getpagesize())
 #define ALIGN_TO_PAGE(x) ((void*)(((uint64_t)(x)) - ((uint64_t)(x)) % PAGE_SIZE))
@@ -90,28 +110,60 @@ protected:
     MetaHeader m_currMetaHeader;
     // the persisted meta header
     MetaHeader m_persMetaHeader;
+    // a segment file mapped to memory
+    struct Segment {
+        // the mapping, nullptr until the segment is accessed
+        std::atomic<uint8_t*> addr;
+        // size of the mapping
+        uint64_t size;
+        // owns the mapping, which is unmapped once the segment is dropped and
+        // no reader pins an entry in it any more
+        std::shared_ptr<uint8_t> mapping;
+        Segment() : addr(nullptr), size(0) {}
+    };
+    // segment number -> segment. Segments are added and removed with the
+    // write lock, and mapped on first access with m_mapLock.
+    typedef std::map<int64_t, Segment> SegmentTable;
+
     // path of the data files
     const std::string m_sDataPath;
     // full meta file name
     const std::string m_sMetaFile;
-    // full log file name
-    const std::string m_sLogFile;
-    // full data file name
-    const std::string m_sDataFile;
-
-    // the log file descriptor
-    int m_iLogFileDesc;
-    // the data file descriptor
-    int m_iDataFileDesc;
-
-    // memory mapped Log RingBuffer
-    void* m_pLog;
-    // memory mapped Data RingBuffer
-    void* m_pData;
+    // the data path descriptor, for syncing the directory and file system
+    int m_iDirDesc;
+
+    // number of log entries in a log segment
+    uint64_t m_logSegmentEntries;
+    // size of a data segment
+    uint64_t m_dataSegmentSize;
+    // the log segments
+    SegmentTable m_logSegments;
+    // the data segments. Segments skipped by an entry larger than a data
+    // segment are not in the table.
+    SegmentTable m_dataSegments;
+    // serializes mapping the segments
+    std::mutex m_mapLock;
+    // if segment files were created since the last persist(), whose
+    // directory entries have to be synced.
+    bool m_bSegmentsCreated;
     // read/write lock
     pthread_rwlock_t m_rwlock;
+    // seqlock of head, tail, ver and dtail of m_currMetaHeader: odd while
+    // they are being updated.
+    std::atomic<uint64_t> m_boundsSeq;
+    // protects hidx from concurrent appends and temporal queries
+    std::shared_mutex m_hidxLock;
     // persistent lock
     pthread_mutex_t m_perslock;
+    // if reserveAppend() reserved an entry not committed or aborted yet
+    bool m_bReserved;
+    // size of the data reserved by reserveAppend()
+    uint64_t m_reservedSize;
+    // offset of the data reserved by reserveAppend()
+    uint64_t m_reservedOfst;
+    // index and version of the entry reserved by reserveAppend()
+    int64_t m_reservedIdx;
+    int64_t m_reservedVer;
 // lock macro
 #define FPL_WRLOCK                                        \
     do {                                                  \
@@ -153,6 +205,25 @@ protected:
         dbg_default_trace("PERS_UNLOCK");                          \
     } while(0)
 
+    // the fields of the meta header changed by appends, trims and truncations
+    struct LogBounds {
+        int64_t head;
+        int64_t tail;
+        int64_t ver;
+        uint64_t dtail;
+    };
+
+    // a consistent snapshot of the log bounds, taken without any lock
+    LogBounds readBounds() noexcept(true);
+
+    // update the log bounds in META_HEADER. Note: call it from the appending
+    // thread, or with FPL_WRLOCK.
+    void publishBounds(const LogBounds& bounds) noexcept(true);
+
+    // Lock the log for the next append, of an entry with size bytes of data:
+    // FPL_RDLOCK, or FPL_WRLOCK if a segment has to be created for it.
+    void lockForAppend(const uint64_t& size) noexcept(false);
+
     // load the log from files. This method may through exceptions if read from
     // file failed.
     virtual void load() noexcept(false);
@@ -160,6 +231,18 @@ protected:
     // reset the logs. This will remove the existing persisted data.
     virtual void reset() noexcept(false);
 
+    // initialize the meta header of an empty log, whose next entry has the
+    // index head.
+    void initializeMetaHeader(const int64_t& head) noexcept(false);
+
+    // copy a log of the ring layout, see META_FORMAT, to segments and remove
+    // its files.
+    // @PARAM ring - the meta header of the ring layout
+    void migrateRingLog(const MetaHeader& ring) noexcept(false);
+
+    // full name of a file of the ring layout
+    std::string ringFile(const char* suffix) const;
+
     // Persistent the Metadata header, we assume
     // FPL_PERS_LOCK is acquired.
     virtual void persistMetaHeaderAtomically(MetaHeader*) noexcept(false);
@@ -175,11 +258,16 @@ public:
     virtual void append(const void* pdata,
                         const uint64_t& size, const int64_t& ver,
                         const HLC& mhlc) noexcept(false);
+    virtual void* reserveAppend(const uint64_t& size, const int64_t& ver) noexcept(false);
+    virtual void commitAppend(const int64_t& ver, const HLC& mhlc) noexcept(false);
+    virtual void abortAppend() noexcept(true);
     virtual void advanceVersion(const int64_t& ver) noexcept(false);
     virtual int64_t getLength() noexcept(false);
     virtual int64_t getEarliestIndex() noexcept(false);
     virtual int64_t getLatestIndex() noexcept(false);
     virtual int64_t getVersionIndex(const version_t& ver) noexcept(false);
+    virtual int64_t getHLCIndex(const HLC& hlc) noexcept(false);
+    virtual version_t getVersionByIndex(const int64_t& eno) noexcept(false);
     virtual version_t getEarliestVersion() noexcept(false);
     virtual version_t getLatestVersion() noexcept(false);
     virtual const version_t getLastPersisted() noexcept(false);
@@ -202,7 +290,13 @@ public:
         int64_t idx;
         // RDLOCK for validation
         FPL_RDLOCK;
-        idx = binarySearch<TKey>(keyGetter, key, META_HEADER->fields.head, META_HEADER->fields.tail);
+        const LogBounds bounds = readBounds();
+        try {
+            idx = binarySearch<TKey>(keyGetter, key, bounds.head, bounds.tail);
+        } catch(persist_exception_t e) {
+            FPL_UNLOCK;
+            throw e;
+        }
         if(idx == -1) {
             FPL_UNLOCK;
             return;
@@ -211,46 +305,125 @@ public:
         // do binary search again in case some concurrent trim() and
         // append() happens. TODO: any optimization to avoid the second
         // search?
-        // WRLOCK for trim
+        // WRLOCK for trim, after the PERS_LOCK as in persist()
+        FPL_PERS_LOCK;
         FPL_WRLOCK;
-        idx = binarySearch<TKey>(keyGetter, key, META_HEADER->fields.head, META_HEADER->fields.tail);
+        try {
+            idx = binarySearch<TKey>(keyGetter, key, META_HEADER->fields.head, META_HEADER->fields.tail);
+        } catch(persist_exception_t e) {
+            FPL_UNLOCK;
+            FPL_PERS_UNLOCK;
+            throw e;
+        }
         if(idx != -1) {
-            META_HEADER->fields.head = (idx + 1);
-            FPL_PERS_LOCK;
+            publishBounds({idx + 1, META_HEADER->fields.tail, META_HEADER->fields.ver, NEXT_DATA_OFST});
             try {
                 persist(true);
-            } catch(uint64_t e) {
+            } catch(persist_exception_t e) {
                 FPL_UNLOCK;
                 FPL_PERS_UNLOCK;
                 throw e;
             }
-            FPL_PERS_UNLOCK;
-            //TODO:remove delete entries from the index. This is tricky because
-            // HLC order and idex order does not agree with each other.
-            // throw PERSIST_EXP_UNIMPLEMENTED;
-        } else {
-            FPL_UNLOCK;
-            return;
+            {
+                std::unique_lock<std::shared_mutex> hidx_lck(this->m_hidxLock);
+                this->hidx.trim(META_HEADER->fields.head);
+            }
+            dropSegments(false);
         }
         FPL_UNLOCK;
+        FPL_PERS_UNLOCK;
     }
 
     /**
      * Get the minimum latest persisted version for a subgroup/shard with prefix
      * @PARAM prefix the subgroup/shard prefix
+     * @PARAM path the folder of the logs
      * @RETURN the minimum latest persisted version
      */
-    static const uint64_t getMinimumLatestPersistedVersion(const std::string& prefix);
+    static const uint64_t getMinimumLatestPersistedVersion(const std::string& prefix, const std::string& path = getPersFilePath());
 
 private:
+    /**
+     * fill the next log entry for data already copied to offset ofst and
+     * update the meta header.
+     * Note: no lock protected, use lockForAppend()
+     */
+    void appendLogEntry(const uint64_t& ofst, const uint64_t& size, const int64_t& ver, const HLC& mhlc) noexcept(false);
+    /**
+     * Get a log entry, mapping its log segment if necessary.
+     * Note: no lock protected, use FPL_RDLOCK, or FPL_WRLOCK to create.
+     * @PARAM idx - the index of the entry
+     * @PARAM create - create the log segment if it does not exist
+     */
+    LogEntry* logEntryAt(const int64_t& idx, const bool create = false) noexcept(false);
+    /**
+     * Get the data of a log entry, mapping its data segment if necessary.
+     * Note: no lock protected, use FPL_RDLOCK
+     */
+    void* entryData(const LogEntry* ple) noexcept(false);
+    /**
+     * Get the data of a log entry for a reader, and pin its data segment in
+     * the reader's PersistLog::PinnedEntries scope, so that it stays mapped
+     * even if the segment is dropped meanwhile.
+     * Note: no lock protected, use FPL_RDLOCK
+     */
+    const void* pinnedEntryData(const LogEntry* ple) noexcept(false);
+    /**
+     * Get the offset of the data of a new log entry
+     * Note: no lock protected, use FPL_RDLOCK
+     * @PARAM size - size of the data
+     */
+    uint64_t placeData(const uint64_t& size) noexcept(true);
+    /**
+     * Get the memory to write the data of a new log entry to, creating its
+     * data segment if necessary.
+     * Note: no lock protected, use lockForAppend()
+     * @PARAM ofst - the offset returned by placeData()
+     * @PARAM size - size of the data
+     */
+    void* newEntryData(const uint64_t& ofst, const uint64_t& size) noexcept(false);
+    /**
+     * Get the address of a segment, mapping it if necessary.
+     * @PARAM table - m_logSegments or m_dataSegments
+     * @PARAM suffix - LOG_FILE_SUFFIX or DATA_FILE_SUFFIX
+     * @PARAM segno - the segment number
+     * @PARAM create_size - if not 0, the segment is created if it does not
+     *                      exist, with at least create_size bytes.
+     */
+    uint8_t* getSegment(SegmentTable& table, const char* suffix, const int64_t& segno,
+                        const uint64_t& create_size) noexcept(false);
+    // full name of a segment file
+    std::string segmentFile(const char* suffix, const int64_t& segno) const;
+    /**
+     * Collect the memory ranges of [start, end) to msync().
+     * @PARAM table - m_logSegments or m_dataSegments
+     * @PARAM unit - the number of bytes a segment of table covers
+     * @PARAM start, end - the range, in bytes from the start of segment 0
+     */
+    void getSyncRanges(SegmentTable& table, const uint64_t& unit,
+                       const uint64_t& start, const uint64_t& end,
+                       std::vector<std::pair<void*, size_t>>& ranges) noexcept(false);
+    /**
+     * Remove the segments without live entries, after the meta header is
+     * persisted.
+     * Note: no lock protected, use FPL_WRLOCK
+     * @PARAM truncated - if the log was truncated. The segments after the
+     *        tail are only removed then: a trim may run while an append is
+     *        writing to a new data segment.
+     */
+    void dropSegments(const bool truncated) noexcept(true);
+    // remove the segments of table outside [first, last]
+    void dropSegments(SegmentTable& table, const char* suffix,
+                      const int64_t& first, const int64_t& last) noexcept(true);
     /**
      * Get the minimum index greater than a given version
      * Note: no lock protected, use FPL_RDLOCK
+     * @PARAM bounds the log bounds read under the lock
      * @PARAM ver the given version. INVALID_VERSION means to return the earliest index.
      * @RETURN the minimum index since the given version. INVALID_INDEX means 
      *         that no log entry is available for the requested version.
      */
-    int64_t getMinimumIndexBeyondVersion(const int64_t& ver) noexcept(false);
+    int64_t getMinimumIndexBeyondVersion(const LogBounds& bounds, const int64_t& ver) noexcept(false);
     /**
      * get the byte size of log entry
      * Note: no lock protected, use FPL_RDLOCK
@@ -330,10 +503,9 @@ private:
 #ifndef NDEBUG
     //dbg functions
     void dbgDumpMeta() {
-        dbg_default_trace("m_pData={0},m_pLog={1}", (void*)this->m_pData, (void*)this->m_pLog);
-        dbg_default_trace("MEAT_HEADER:head={0},tail={1}", (int64_t)META_HEADER->fields.head, (int64_t)META_HEADER->fields.tail);
-        dbg_default_trace("MEAT_HEADER_PERS:head={0},tail={1}", (int64_t)META_HEADER_PERS->fields.head, (int64_t)META_HEADER_PERS->fields.tail);
-        dbg_default_trace("NEXT_LOG_ENTRY={0},NEXT_LOG_ENTRY_PERS={1}", (void*)NEXT_LOG_ENTRY, (void*)NEXT_LOG_ENTRY_PERS);
+        dbg_default_trace("log segments={0},data segments={1}", this->m_logSegments.size(), this->m_dataSegments.size());
+        dbg_default_trace("MEAT_HEADER:head={0},tail={1},dtail={2}", (int64_t)META_HEADER->fields.head, (int64_t)META_HEADER->fields.tail, META_HEADER->fields.dtail);
+        dbg_default_trace("MEAT_HEADER_PERS:head={0},tail={1},dtail={2}", (int64_t)META_HEADER_PERS->fields.head, (int64_t)META_HEADER_PERS->fields.tail, META_HEADER_PERS->fields.dtail);
     }
 #endif  //NDEBUG
 };
@@ -0,0 +1,113 @@
+#include "HLCIndex.hpp"
+#include "PersistLog.hpp"
+#include <algorithm>
+
+namespace persistent {
+
+size_t HLCIndex::countNotAfter(const Clock& c) const noexcept(true) {
+    size_t len = size();
+    if(len == 0) {
+        return 0;
+    }
+    // everything before base is not after c, and the first entry after c is
+    // in [base, base + len]. The loop has no branch but its condition, and
+    // it prefetches both possible probes of the next round.
+    const Clock* const first = m_clocks.data() + m_begin;
+    const Clock* base = first;
+    while(len > 1) {
+        size_t half = len / 2;
+        __builtin_prefetch(base + (len - half) / 2);
+        __builtin_prefetch(base + half + (len - half) / 2);
+        base = before(c, base[half]) ? base : base + half;
+        len -= half;
+    }
+    return (base - first) + (before(c, *base) ? 0 : 1);
+}
+
+size_t HLCIndex::countBefore(const Clock& c) const noexcept(true) {
+    size_t len = size();
+    if(len == 0) {
+        return 0;
+    }
+    // the same search as countNotAfter(), for the first entry not before c
+    const Clock* const first = m_clocks.data() + m_begin;
+    const Clock* base = first;
+    while(len > 1) {
+        size_t half = len / 2;
+        __builtin_prefetch(base + (len - half) / 2);
+        __builtin_prefetch(base + half + (len - half) / 2);
+        base = before(base[half], c) ? base + half : base;
+        len -= half;
+    }
+    return (base - first) + (before(*base, c) ? 1 : 0);
+}
+
+int64_t HLCIndex::search(const HLC& hlc) const noexcept(true) {
+    size_t n = countNotAfter(Clock{hlc.m_rtc_us, hlc.m_logic});
+    if(n == 0) {
+        return INVALID_INDEX;
+    }
+    // the clocks of the entries are rarely equal, only look for the first
+    // entry with the clock found if the one before has it too.
+    const Clock& found = clockAt(n - 1);
+    if(n == 1 || before(clockAt(n - 2), found)) {
+        return logIndexAt(n - 1);
+    }
+    return logIndexAt(countBefore(found));
+}
+
+void HLCIndex::insertOutOfOrder(const Clock& c, const int64_t& log_idx) noexcept(false) {
+    size_t pos = m_begin + countNotAfter(c);
+    m_clocks.insert(m_clocks.begin() + pos, c);
+    m_logIdx.insert(m_logIdx.begin() + pos, log_idx);
+    // log_idx is the largest index, and it is not at the end.
+    m_indexOrdered = false;
+}
+
+template <typename Pred>
+void HLCIndex::removeIf(const Pred& pred) noexcept(false) {
+    compact();
+    size_t kept = 0;
+    for(size_t i = 0; i < m_clocks.size(); i++) {
+        if(!pred(m_logIdx[i])) {
+            m_clocks[kept] = m_clocks[i];
+            m_logIdx[kept] = m_logIdx[i];
+            kept++;
+        }
+    }
+    m_clocks.resize(kept);
+    m_logIdx.resize(kept);
+    m_indexOrdered = std::is_sorted(m_logIdx.begin(), m_logIdx.end());
+}
+
+void HLCIndex::compact() noexcept(false) {
+    if(m_begin > 0) {
+        m_clocks.erase(m_clocks.begin(), m_clocks.begin() + m_begin);
+        m_logIdx.erase(m_logIdx.begin(), m_logIdx.begin() + m_begin);
+        m_begin = 0;
+    }
+}
+
+void HLCIndex::trim(const int64_t& head) noexcept(false) {
+    if(!m_indexOrdered) {
+        removeIf([&head](const int64_t& idx) { return idx < head; });
+        return;
+    }
+    // the trimmed entries are a prefix, skip them and compact the arrays once
+    // they are mostly trimmed entries.
+    m_begin = std::lower_bound(m_logIdx.begin() + m_begin, m_logIdx.end(), head) - m_logIdx.begin();
+    if(m_begin > m_clocks.size() / 2) {
+        compact();
+    }
+}
+
+void HLCIndex::truncate(const int64_t& tail) noexcept(false) {
+    if(!m_indexOrdered) {
+        removeIf([&tail](const int64_t& idx) { return idx >= tail; });
+        return;
+    }
+    size_t end = std::lower_bound(m_logIdx.begin() + m_begin, m_logIdx.end(), tail) - m_logIdx.begin();
+    m_clocks.resize(end);
+    m_logIdx.resize(end);
+}
+}
@@ -0,0 +1,118 @@
+#ifndef HLC_INDEX_HPP
+#define HLC_INDEX_HPP
+
+#include "HLC.hpp"
+#include <inttypes.h>
+#include <stdint.h>
+#include <vector>
+
+namespace persistent {
+
+// HLCIndex maps the HLC clocks of the log entries to their indexes. The
+// clocks of the appended entries are almost always non-decreasing, so the
+// index is a sorted array instead of a tree: an append is a push_back, and
+// only an entry with an out-of-order clock is inserted in the middle. The
+// clocks are kept apart from the log indexes so that a lookup, a branchless
+// binary search, touches as few cache lines as possible. Entries with equal
+// clocks are kept in the order they were added.
+//
+// HLCIndex is not thread-safe, it is protected by the lock of its log.
+class HLCIndex {
+public:
+    // the clock of an entry, without the lock of an HLC object
+    struct Clock {
+        uint64_t hlc_r;
+        uint64_t hlc_l;
+    };
+
+    HLCIndex() noexcept(true) : m_begin(0), m_indexOrdered(true) {}
+
+    /**
+     * Add an entry.
+     * @param hlc_r - real-time part of the clock
+     * @param hlc_l - logic part of the clock
+     * @param log_idx - index of the entry in the log. It must be greater than
+     *                  the indexes of all the entries in the index.
+     */
+    void insert(const uint64_t& hlc_r, const uint64_t& hlc_l, const int64_t& log_idx) noexcept(false) {
+        if(size() == 0 || !before(Clock{hlc_r, hlc_l}, m_clocks.back())) {
+            m_clocks.push_back(Clock{hlc_r, hlc_l});
+            m_logIdx.push_back(log_idx);
+        } else {
+            insertOutOfOrder(Clock{hlc_r, hlc_l}, log_idx);
+        }
+    }
+
+    /**
+     * Find the latest entry with a clock equal or earlier than hlc. Of the
+     * entries with that same clock, the first one added is returned.
+     * @return the log index of the entry, or INVALID_INDEX if there is none.
+     */
+    int64_t search(const HLC& hlc) const noexcept(true);
+
+    // remove the entries with a log index smaller than head, after a trim.
+    void trim(const int64_t& head) noexcept(false);
+
+    // remove the entries with a log index equal or greater than tail, after
+    // a truncation.
+    void truncate(const int64_t& tail) noexcept(false);
+
+    // reserve space for entries
+    void reserve(size_t n) noexcept(false) {
+        m_clocks.reserve(m_begin + n);
+        m_logIdx.reserve(m_begin + n);
+    }
+
+    // remove all the entries
+    void clear() noexcept(true) {
+        m_clocks.clear();
+        m_logIdx.clear();
+        m_begin = 0;
+        m_indexOrdered = true;
+    }
+
+    // number of entries
+    size_t size() const noexcept(true) {
+        return m_clocks.size() - m_begin;
+    }
+
+    // the clock of the i-th entry, in clock order
+    const Clock& clockAt(size_t i) const noexcept(true) {
+        return m_clocks[m_begin + i];
+    }
+
+    // the log index of the i-th entry, in clock order
+    int64_t logIndexAt(size_t i) const noexcept(true) {
+        return m_logIdx[m_begin + i];
+    }
+
+private:
+    // if clock a is strictly earlier than clock b
+    static bool before(const Clock& a, const Clock& b) noexcept(true) {
+        return (a.hlc_r < b.hlc_r) | ((a.hlc_r == b.hlc_r) & (a.hlc_l < b.hlc_l));
+    }
+    // the number of entries with a clock equal or earlier than c
+    size_t countNotAfter(const Clock& c) const noexcept(true);
+    // the number of entries with a clock strictly earlier than c
+    size_t countBefore(const Clock& c) const noexcept(true);
+    // the slow path of insert()
+    void insertOutOfOrder(const Clock& c, const int64_t& log_idx) noexcept(false);
+    // remove the entries whose log index matches pred
+    template <typename Pred>
+    void removeIf(const Pred& pred) noexcept(false);
+    // drop the trimmed slots before m_begin
+    void compact() noexcept(false);
+
+    // the clocks, sorted
+    std::vector<Clock> m_clocks;
+    // the log indexes, in the order of m_clocks
+    std::vector<int64_t> m_logIdx;
+    // the slots before m_begin are trimmed entries not yet compacted
+    size_t m_begin;
+    // if the log indexes are sorted as well, which holds until an entry with
+    // an out-of-order clock is added.
+    bool m_indexOrdered;
+};
+}
+
+#endif  //HLC_INDEX_HPP
@@ -8,6 +8,9 @@ namespace persistent {
 #define PERSIST_EXP(errcode, usercode) \
     ((((errcode)&0xffffffffull) << 32) | ((usercode)&0xffffffffull))
 #define PERSIST_EXP_USERCODE(x) ((uint32_t)((x)&0xffffffffull))
+// The exceptions are thrown as unsigned long long, which is not the same type
+// as uint64_t on LP64 platforms.
+typedef decltype(PERSIST_EXP(0, 0)) persist_exception_t;
 #define PERSIST_EXP_UNIMPLEMENTED PERSIST_EXP(0, 0)
 #define PERSIST_EXP_NEW_FAILED_UNKNOWN PERSIST_EXP(1, 0)
 #define PERSIST_EXP_STORAGE_TYPE_UNKNOWN(x) PERSIST_EXP(2, (x))
@@ -45,6 +48,11 @@ namespace persistent {
 #define PERSIST_EXP_OOM(x) PERSIST_EXP(32, (x))
 #define PERSIST_EXP_INV_OBJNAME PERSIST_EXP(33, 0)
 #define PERSIST_EXP_REMOVE_FILE(x) PERSIST_EXP(34, (x))
+#define PERSIST_EXP_STAT_FILE(x) PERSIST_EXP(35, (x))
+#define PERSIST_EXP_IO_URING(x) PERSIST_EXP(37, (x))
+#define PERSIST_EXP_FALLOCATE(x) PERSIST_EXP(38, (x))
+#define PERSIST_EXP_DIRECT_IO(x) PERSIST_EXP(39, (x))
+#define PERSIST_EXP_INV_RESERVATION PERSIST_EXP(40, 0)
 }
 
 #endif  //PERSISTENT_EXCEPTION_HPP
@@ -1,20 +1,63 @@
 #include "PersistLog.hpp"
 #include "util.hpp"
 #include "utils/logger.hpp"
+#include <cassert>
+#include <deque>
 
 namespace persistent {
 
+// the entries kept alive for the last reads of this thread outside of a
+// PinnedEntries scope
+static thread_local std::shared_ptr<char> t_pinnedEntries[PERSIST_LOG_PINNED_ENTRIES];
+static thread_local uint32_t t_nextPinnedEntry = 0;
+// the entries kept alive by the PinnedEntries scopes of this thread
+static thread_local std::deque<std::shared_ptr<char>> t_scopedEntries;
+static thread_local uint32_t t_pinScopes = 0;
+
+PersistLog::PinnedEntries::PinnedEntries() noexcept(true) : m_outerPinned(t_scopedEntries.size()) {
+    t_pinScopes++;
+}
+
+PersistLog::PinnedEntries::~PinnedEntries() noexcept(true) {
+    t_pinScopes--;
+    t_scopedEntries.resize(m_outerPinned);
+}
+
+std::shared_ptr<char> &PersistLog::nextPinnedEntry() noexcept(false) {
+    assert(t_pinScopes > 0 && "entries must be read in a PersistLog::PinnedEntries scope");
+    if(t_pinScopes > 0) {
+        t_scopedEntries.emplace_back();
+        return t_scopedEntries.back();
+    }
+    t_nextPinnedEntry = (t_nextPinnedEntry + 1) % PERSIST_LOG_PINNED_ENTRIES;
+    return t_pinnedEntries[t_nextPinnedEntry];
+}
+
 PersistLog::PersistLog(const std::string &name) noexcept(true) : m_sName(name) {
 }
 
 PersistLog::~PersistLog() noexcept(true) {
 }
 
+void *PersistLog::reserveAppend(const uint64_t &size, const version_t &ver) noexcept(false) {
+    m_reservedData.resize(size);
+    return m_reservedData.data();
+}
+
+void PersistLog::commitAppend(const version_t &ver, const HLC &mhlc) noexcept(false) {
+    append(m_reservedData.data(), m_reservedData.size(), ver, mhlc);
+    m_reservedData.clear();
+}
+
+void PersistLog::abortAppend() noexcept(true) {
+    m_reservedData.clear();
+}
+
 #ifndef NDEBUG
 void PersistLog::dump_hidx() {
     dbg_default_trace("number of entry in hidx:{}.log_len={}.", hidx.size(), getLength());
-    for(auto itr = hidx.cbegin(); itr != hidx.cend(); itr++) {
-        dbg_default_trace("hlc({0},{1})->idx({2})", itr->hlc.m_rtc_us, itr->hlc.m_logic, itr->log_idx);
+    for(size_t i = 0; i < hidx.size(); i++) {
+        dbg_default_trace("hlc({0},{1})->idx({2})", hidx.clockAt(i).hlc_r, hidx.clockAt(i).hlc_l, hidx.logIndexAt(i));
     }
 }
 #endif  //NDEBUG
@@ -6,14 +6,17 @@
 #endif
 
 #include "HLC.hpp"
+#include "HLCIndex.hpp"
 #include "PersistException.hpp"
 #include "PersistentTypenames.hpp"
 #include <functional>
 #include <inttypes.h>
 #include <map>
+#include <memory>
 #include <set>
 #include <stdio.h>
 #include <string>
+#include <vector>
 
 namespace persistent {
 
@@ -27,31 +30,10 @@ enum StorageType {
 //#define INVALID_VERSION ((__int128)-1L)
 #define INVALID_VERSION ((int64_t)-1L)
 #define INVALID_INDEX INT64_MAX
-
-// index entry for the hlc index
-struct hlc_index_entry {
-    HLC hlc;
-    int64_t log_idx;
-    //default constructor
-    hlc_index_entry() : log_idx(-1) {
-    }
-    // constructor with hlc and index.
-    hlc_index_entry(const HLC &_hlc, const int64_t &_log_idx) : hlc(_hlc), log_idx(_log_idx) {
-    }
-    // constructor with time stamp and index.
-    hlc_index_entry(const uint64_t &r, const uint64_t &l, const int64_t &_log_idx) : hlc(r, l), log_idx(_log_idx) {
-    }
-    //copy constructor
-    hlc_index_entry(const struct hlc_index_entry &_entry) : hlc(_entry.hlc), log_idx(_entry.log_idx) {
-    }
-};
-// comparator for the hlc index
-struct hlc_index_entry_comp {
-    bool operator()(const struct hlc_index_entry &e1,
-                    const struct hlc_index_entry &e2) const {
-        return e1.hlc < e2.hlc;
-    }
-};
+// Number of entries read by a thread outside of a PersistLog::PinnedEntries
+// scope which are kept alive for it in release builds, by the logs that may
+// release the memory of an entry.
+#define PERSIST_LOG_PINNED_ENTRIES (8)
 
 // Persistent log interfaces
 class PersistLog {
@@ -59,7 +41,7 @@ public:
     // LogName
     const std::string m_sName;
     // HLCIndex
-    std::set<hlc_index_entry, hlc_index_entry_comp> hidx;
+    HLCIndex hidx;
 #ifndef NDEBUG
     void dump_hidx();
 #endif  //NDEBUG
@@ -85,6 +67,31 @@ public:
                         const HLC &mhlc) noexcept(false)
             = 0;
 
+    /**
+     * Reserve space at the tail of the log for the data of the next entry, so
+     * that the data can be serialized in place instead of being copied by
+     * append(). The entry is added by commitAppend() or dropped by
+     * abortAppend(); one of them must be called before anything else is
+     * appended to the log. The default implementation stages the data in a
+     * buffer and appends it on commitAppend().
+     * @param size - length of the data
+     * @param ver - version of the entry, checked as in append()
+     * @return - a pointer to the size bytes to write the data to.
+     */
+    virtual void *reserveAppend(const uint64_t &size, const version_t &ver) noexcept(false);
+
+    /**
+     * Add the entry reserved by reserveAppend(), once its data is written.
+     * Throws PERSIST_EXP_INV_RESERVATION, and drops the reservation, if the
+     * log was truncated or its version advanced since the reservation.
+     * @param ver - version of the entry, the one given to reserveAppend()
+     * @param mhlc - the hlc clock of the entry
+     */
+    virtual void commitAppend(const version_t &ver, const HLC &mhlc) noexcept(false);
+
+    // Drop the entry reserved by reserveAppend().
+    virtual void abortAppend() noexcept(true);
+
     /**
      * Advance the version number without appendding a log. This is useful
      * to create gap between versions.
@@ -104,6 +111,13 @@ public:
     // Get the Index corresponding to a version
     virtual int64_t getVersionIndex(const version_t &ver) = 0;
 
+    // Get the index of the latest entry equal or earlier than hlc, or
+    // INVALID_INDEX if there is none
+    virtual int64_t getHLCIndex(const HLC &hlc) noexcept(false) = 0;
+
+    // Get the version of the entry at an index
+    virtual version_t getVersionByIndex(const int64_t &eno) noexcept(false) = 0;
+
     // Get the Earlist version
     virtual version_t getEarliestVersion() noexcept(false) = 0;
 
@@ -113,10 +127,38 @@ public:
     // return the last persisted value
     virtual const version_t getLastPersisted() noexcept(false) = 0;
 
-    // Get a version by entry number return both length and buffer
+    /**
+     * Keeps every entry the calling thread reads from a PersistLog alive
+     * until it goes out of scope, even if the log is trimmed meanwhile. Scopes nest: an inner scope only releases
+     * the entries read in it, so a replay may read other logs while it holds
+     * the entries of its own.
+     */
+    class PinnedEntries {
+    public:
+        PinnedEntries() noexcept(true);
+        ~PinnedEntries() noexcept(true);
+        PinnedEntries(const PinnedEntries &) = delete;
+        PinnedEntries &operator=(const PinnedEntries &) = delete;
+
+    private:
+        // the number of entries pinned by the enclosing scopes
+        const std::size_t m_outerPinned;
+    };
+
+    /**
+     * Get a version by entry number return both length and buffer.
+     * The caller must hold a PinnedEntries scope: the returned pointer is
+     * valid until the scope it was read in ends, even if the log is trimmed
+     * meanwhile. If the entry is truncated away, its data may be overwritten
+     * by later appends. The logs that may release the memory of an entry
+     * assert the scope in debug builds; in release builds, an entry read
+     * without one is only kept alive until the thread has read
+     * PERSIST_LOG_PINNED_ENTRIES more entries, from any log.
+     */
     virtual const void *getEntryByIndex(const int64_t &eno) noexcept(false) = 0;
 
     // Get the latest version equal or earlier than ver.
+    // The returned pointer is valid as long as one from getEntryByIndex().
     virtual const void *getEntry(const version_t &ver) noexcept(false) = 0;
 
     // Get the latest version - deprecated.
@@ -188,6 +230,17 @@ public:
      * @param ver - all log entry strict after ver will be truncated.
      */
     virtual void truncate(const version_t &ver) noexcept(false) = 0;
+
+protected:
+    // the data staged by the default reserveAppend()
+    std::vector<char> m_reservedData;
+
+    /**
+     * Get a holder to keep an entry returned to the calling thread alive, as
+     * long as promised by getEntryByIndex(). Asserts that the thread holds a
+     * PinnedEntries scope in debug builds.
+     */
+    static std::shared_ptr<char> &nextPinnedEntry() noexcept(false);
 };
 }
 
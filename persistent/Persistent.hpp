@@ -2,6 +2,7 @@
 #ifndef PERSISTENT_HPP
 #define PERSISTENT_HPP
 
+#include "DirectPersistLog.hpp"
 #include "FilePersistLog.hpp"
 #include "HLC.hpp"
 #include "PersistException.hpp"
@@ -9,6 +10,8 @@
 #include "PersistNoLog.hpp"
 #include "PersistentTypenames.hpp"
 #include "SerializationSupport.hpp"
+#include "VersionCache.hpp"
+#include <atomic>
 #include <functional>
 #include <inttypes.h>
 #include <iostream>
@@ -17,6 +20,7 @@
 #include <pthread.h>
 #include <string>
 #include <sys/types.h>
+#include <vector>
 #include <time.h>
 #include <typeindex>
 
@@ -98,8 +102,11 @@ std::pair<int_type, int_type> unpack_version(const version_t packed_int) {
 class PersistentRegistry : public mutils::RemoteDeserializationContext {
 public:
     // TODO: take the subgroup_type,shubgroup_index,shard_num
-    PersistentRegistry(ITemporalQueryFrontierProvider* tqfp, const std::type_index& subgroup_type, uint32_t subgroup_index, uint32_t shard_num) : _subgroup_prefix(generate_prefix(subgroup_type, subgroup_index, shard_num)),
-                                                                                                                                                  _temporal_query_frontier_provider(tqfp){};
+    // @param file_path - the folder of the logs of the registered ST_FILE fields
+    PersistentRegistry(ITemporalQueryFrontierProvider* tqfp, const std::type_index& subgroup_type, uint32_t subgroup_index, uint32_t shard_num,
+                       const std::string& file_path = getPersFilePath()) : _subgroup_prefix(generate_prefix(subgroup_type, subgroup_index, shard_num)),
+                                                                           _file_path(file_path),
+                                                                           _temporal_query_frontier_provider(tqfp){};
     virtual ~PersistentRegistry() {
         this->_registry.clear();
     };
@@ -170,11 +177,11 @@ public:
         //this->_registry.push_back(std::make_tuple(vf,pf,tf));
         auto tuple_val = std::make_tuple(vf, pf, tf, lpgf, tcf);
         std::size_t key = std::hash<std::string>{}(obj_name);
-        auto res = this->_registry.insert(std::pair<std::size_t, std::tuple<VersionFunc, PersistFunc, TrimFunc, LatestPersistedGetterFunc, TruncateFunc>>(key, tuple_val));
+        auto res = this->_registry.insert(std::pair<std::size_t, RegistryEntry>(key, tuple_val));
         if(res.second == false) {
             //override the previous value:
             this->_registry.erase(res.first);
-            this->_registry.insert(std::pair<std::size_t, std::tuple<VersionFunc, PersistFunc, TrimFunc, LatestPersistedGetterFunc, TruncateFunc>>(key, tuple_val));
+            this->_registry.insert(std::pair<std::size_t, RegistryEntry>(key, tuple_val));
         }
     };
     // deregister
@@ -212,6 +219,10 @@ public:
     const char* get_subgroup_prefix() {
         return this->_subgroup_prefix.c_str();
     }
+    /** the folder of the logs of the registered ST_FILE fields */
+    const std::string& get_file_path() {
+        return this->_file_path;
+    }
     /** prefix generator
      * prefix format: [hex of subgroup_type]-[subgroup_index]-[shard_num]
      * @param subgroup_type, the type information of a subgroup
@@ -249,8 +260,11 @@ public:
 
 protected:
     const std::string _subgroup_prefix;  // this appears in the first part of storage file for persistent<T>
+    // the folder of the logs of the registered ST_FILE fields
+    const std::string _file_path;
     ITemporalQueryFrontierProvider* _temporal_query_frontier_provider;
-    std::map<std::size_t, std::tuple<VersionFunc, PersistFunc, TrimFunc, LatestPersistedGetterFunc, TruncateFunc>> _registry;
+    using RegistryEntry = std::tuple<VersionFunc, PersistFunc, TrimFunc, LatestPersistedGetterFunc, TruncateFunc>;
+    std::map<std::size_t, RegistryEntry> _registry;
     template <int funcIdx, typename... Args>
     void callFunc(Args... args) {
         for(auto itr = this->_registry.begin();
@@ -287,7 +301,17 @@ protected:
 // of a byte array - the DELTA, as long as the update should be persisted. Each
 // time Persistent<T> trying to make a version, it collects the DELTA and write
 // it to the log. On reloading data from persistent storage, the DELTAs in the
-// log entries are applied in order. TODO: use checkpointing to accelerate it!
+// log entries are applied in order.
+//
+// To bound the number of DELTAs to apply, Persistent<T> also writes a full
+// snapshot of T, a checkpoint, to a side log every CONF_PERS_CHECKPOINT_ENTRIES
+// log entries or CONF_PERS_CHECKPOINT_BYTES bytes of DELTAs. Reading a version
+// starts from the latest checkpoint not newer than the version, and only
+// applies the DELTAs logged after it. Trimming the log keeps the latest
+// durable checkpoint not newer than the trim point and the DELTAs after it.
+// If both triggers are disabled, trimming requests a checkpoint of the trim
+// point instead, which the next persist() writes. The checkpoint log has the same name as the log, in the
+// PERS_CHECKPOINT_DIR subfolder.
 //
 // There are three method included in this interface:
 // - 'finalizeCurrentDelta'     This method is called when Persistent<T> trying to
@@ -345,32 +369,178 @@ protected:
     inline void initialize_log(const char* object_name) noexcept(false) {
         // STEP 1: initialize log
         this->m_pLog = nullptr;
+        this->m_pCheckpointLog = nullptr;
         switch(storageType) {
             // file system
             case ST_FILE:
-                this->m_pLog = std::make_unique<FilePersistLog>(object_name);
-                if(this->m_pLog == nullptr) {
-                    throw PERSIST_EXP_NEW_FAILED_UNKNOWN;
-                }
+                this->m_pLog = create_log(object_name, this->getFilePath());
                 break;
             // volatile
             case ST_MEM: {
                 // const std::string tmpfsPath = "/dev/shm/volatile_t";
-                this->m_pLog = std::make_unique<FilePersistLog>(object_name, getPersRamdiskPath());
-                if(this->m_pLog == nullptr) {
-                    throw PERSIST_EXP_NEW_FAILED_UNKNOWN;
-                }
+                this->m_pLog = create_log(object_name, getPersRamdiskPath());
                 break;
             }
             //default
             default:
                 throw PERSIST_EXP_STORAGE_TYPE_UNKNOWN(storageType);
         }
+        // STEP 2: initialize the cache of deserialized versions
+        this->m_pVersionCache = nullptr;
+        if(getPersVersionCacheSize() > 0) {
+            this->m_pVersionCache = std::make_unique<VersionCache<ObjectType>>(getPersVersionCacheSize());
+        }
+        // STEP 3: initialize the checkpoint log of a delta object. It is opened
+        // even if checkpointing is disabled, to keep it consistent with the log.
+        if
+            constexpr(std::is_base_of<IDeltaSupport<ObjectType>, ObjectType>::value) {
+                const std::string path = (storageType == ST_MEM) ? getPersRamdiskPath() : this->getFilePath();
+                this->m_pCheckpointLog = create_log(object_name, path + "/" + PERS_CHECKPOINT_DIR);
+                this->m_checkpointEntries = getPersCheckpointEntries();
+                this->m_checkpointBytes = getPersCheckpointBytes();
+            }
+    }
+    // the folder of the ST_FILE logs: that of the registry, if any
+    inline std::string getFilePath() noexcept(false) {
+        return (this->m_pRegistry != nullptr) ? this->m_pRegistry->get_file_path() : getPersFilePath();
+    }
+    /** create a log in a folder
+       * @param log_name name of the log
+       * @param path the folder of the log files
+       */
+    inline std::unique_ptr<PersistLog> create_log(const std::string& log_name, const std::string& path) noexcept(false) {
+        std::unique_ptr<PersistLog> log;
+        if(storageType == ST_FILE && usePersDirectBackend()) {
+            log = std::make_unique<DirectPersistLog>(log_name, path);
+        } else {
+            log = std::make_unique<FilePersistLog>(log_name, path);
+        }
+        if(log == nullptr) {
+            throw PERSIST_EXP_NEW_FAILED_UNKNOWN;
+        }
+        return log;
+    }
+    /** drop the checkpoints newer than the log, which are left if the process
+       * failed after persisting a checkpoint but before persisting the log, and
+       * count the log entries written since the latest checkpoint.
+       */
+    inline void reconcile_checkpoint_log() noexcept(false) {
+        if(this->m_pCheckpointLog == nullptr) {
+            return;
+        }
+        if(this->m_pLog->getLength() == 0) {
+            if(this->m_pCheckpointLog->getLength() > 0) {
+                this->m_pCheckpointLog->truncate(INVALID_VERSION);
+            }
+        } else if(this->m_pCheckpointLog->getLength() > 0 && this->m_pCheckpointLog->getLatestVersion() > this->m_pLog->getLatestVersion()) {
+            this->m_pCheckpointLog->truncate(this->m_pLog->getLatestVersion());
+        }
+        this->m_entriesSinceCheckpoint = this->m_pLog->getLength();
+        this->m_bytesSinceCheckpoint = 0;
+        if(this->m_pCheckpointLog->getLength() > 0) {
+            int64_t idx = this->m_pLog->getVersionIndex(this->m_pCheckpointLog->getLatestVersion());
+            if(idx >= 0 && idx != INVALID_INDEX) {
+                this->m_entriesSinceCheckpoint = this->m_pLog->getLatestIndex() - idx;
+            }
+        }
+    }
+    /** write a checkpoint of a delta object if enough deltas have been logged
+       * since the latest one. Only called after a delta was appended.
+       * @param v the object, in the state of version ver
+       * @param ver version of the log entry just appended
+       * @param mhlc hlc clock of the log entry just appended
+       * @param delta_size size of the delta just appended
+       */
+    inline void checkpoint(ObjectType& v, const version_t& ver, const HLC& mhlc, size_t delta_size) noexcept(false) {
+        this->m_entriesSinceCheckpoint++;
+        this->m_bytesSinceCheckpoint += delta_size;
+        if(!(this->m_checkpointEntries > 0 && this->m_entriesSinceCheckpoint >= this->m_checkpointEntries)
+           && !(this->m_checkpointBytes > 0 && this->m_bytesSinceCheckpoint >= this->m_checkpointBytes)) {
+            return;
+        }
+        dbg_default_trace("{0} checkpoint at ver({1}) after {2} entries, {3} bytes.",
+                          this->m_pLog->m_sName, ver, this->m_entriesSinceCheckpoint, this->m_bytesSinceCheckpoint);
+        auto size = mutils::bytes_size(v);
+        char* buf = (char*)this->m_pCheckpointLog->reserveAppend(size, ver);
+        try {
+            mutils::to_bytes(v, buf);
+        } catch(...) {
+            this->m_pCheckpointLog->abortAppend();
+            throw;
+        }
+        this->m_pCheckpointLog->commitAppend(ver, mhlc);
+        this->m_entriesSinceCheckpoint = 0;
+        this->m_bytesSinceCheckpoint = 0;
+    }
+    /** With checkpointing disabled, no checkpoint is written as the deltas are
+       * logged, and the log could never be trimmed: trim() requests a
+       * checkpoint of the version it keeps instead, and the next persist()
+       * writes it, off the thread that trims or appends. persist() is then the
+       * only writer of the checkpoint log.
+       * @param ver the version to checkpoint
+       */
+    inline void request_checkpoint(const version_t& ver) noexcept(true) {
+        version_t requested = this->m_checkpointRequest.load();
+        while(requested < ver && !this->m_checkpointRequest.compare_exchange_weak(requested, ver)) {
+        }
+    }
+    /** write the checkpoint requested by trim(), if it is still needed.
+       */
+    inline void write_requested_checkpoint() noexcept(false) {
+        const version_t ver = this->m_checkpointRequest.exchange(INVALID_VERSION);
+        if(ver == INVALID_VERSION) {
+            return;
+        }
+        const version_t latest = this->m_pCheckpointLog->getLatestVersion();
+        if(latest != INVALID_VERSION && latest >= ver) {
+            return;
+        }
+        // the version may have been truncated since it was requested
+        const int64_t idx = this->m_pLog->getVersionIndex(ver);
+        if(idx < 0 || idx == INVALID_INDEX || this->m_pLog->getVersionByIndex(idx) != ver) {
+            return;
+        }
+        dbg_default_trace("{0} checkpoint at ver({1}) to trim the log.", this->m_pLog->m_sName, ver);
+        std::unique_ptr<ObjectType> v = this->getByIndex(idx);
+        auto size = mutils::bytes_size(*v);
+        char* buf = (char*)this->m_pCheckpointLog->reserveAppend(size, ver);
+        try {
+            mutils::to_bytes(*v, buf);
+        } catch(...) {
+            this->m_pCheckpointLog->abortAppend();
+            throw;
+        }
+        // checkpoints are only looked up by version
+        this->m_pCheckpointLog->commitAppend(ver, HLC{0, 0});
+    }
+    // the index of the latest entry not newer than a trim key
+    inline int64_t trim_key_index(const version_t& ver) noexcept(false) {
+        return this->m_pLog->getVersionIndex(ver);
+    }
+    inline int64_t trim_key_index(const HLC& hlc) noexcept(false) {
+        return this->m_pLog->getHLCIndex(hlc);
+    }
+    // get the object of a log entry from the version cache, or deserialize it
+    // and cache it. The generation is read first, so an entry truncated and
+    // written again while it is read is not cached, see VersionCache.
+    inline std::shared_ptr<const ObjectType> getCachedByIndex(int64_t idx, mutils::DeserializationManager* dm) noexcept(false) {
+        if(this->m_pVersionCache == nullptr) {
+            return this->getByIndex(idx, dm);
+        }
+        const uint64_t generation = this->m_pVersionCache->getGeneration();
+        const version_t ver = this->m_pLog->getVersionByIndex(idx);
+        std::shared_ptr<const ObjectType> obj = this->m_pVersionCache->find(ver);
+        if(obj == nullptr) {
+            obj = this->getByIndex(idx, dm);
+            this->m_pVersionCache->insert(ver, obj, generation);
+        }
+        return obj;
     }
     /** initialize the object from log
        */
     inline void initialize_object_from_log(const std::function<std::unique_ptr<ObjectType>(void)> &object_factory,
     mutils::DeserializationManager* dm) {
+        reconcile_checkpoint_log();
         if(this->getNumOfVersions() > 0) {
             // load the object from log.
             this->m_pWrappedObject = this->getByIndex(this->getLatestIndex(),dm);
@@ -428,6 +598,13 @@ public:
     Persistent(Persistent&& other) noexcept(false) {
         this->m_pWrappedObject = std::move(other.m_pWrappedObject);
         this->m_pLog = std::move(other.m_pLog);
+        this->m_pCheckpointLog = std::move(other.m_pCheckpointLog);
+        this->m_pVersionCache = std::move(other.m_pVersionCache);
+        this->m_checkpointEntries = other.m_checkpointEntries;
+        this->m_checkpointBytes = other.m_checkpointBytes;
+        this->m_entriesSinceCheckpoint = other.m_entriesSinceCheckpoint;
+        this->m_bytesSinceCheckpoint = other.m_bytesSinceCheckpoint;
+        this->m_checkpointRequest.store(other.m_checkpointRequest.load());
         this->m_pRegistry = other.m_pRegistry;
         register_callbacks();  // this callback will override the previous registry entry.
     }
@@ -453,6 +630,7 @@ public:
         if(log_tail != nullptr) {
             this->m_pLog->applyLogTail(log_tail);
         }
+        reconcile_checkpoint_log();
         // Initialize Wrapped Object
         assert(wrapped_obj_ptr != nullptr);
         this->m_pWrappedObject = std::move(wrapped_obj_ptr);
@@ -532,9 +710,11 @@ public:
             mutils::DeserializationManager* dm = nullptr) noexcept(false) {
         if
             constexpr(std::is_base_of<IDeltaSupport<ObjectType>, ObjectType>::value) {
-                return f(*this->getByIndex(idx, dm));
+                return fun(*this->getByIndex(idx, dm));
             }
         else {
+            // the entry must outlive fun, which may read other entries
+            PersistLog::PinnedEntries pinned;
             return mutils::deserialize_and_run<ObjectType>(dm, (char*)this->m_pLog->getEntryByIndex(idx), fun);
         }
     };
@@ -545,10 +725,29 @@ public:
             mutils::DeserializationManager* dm = nullptr) noexcept(false) {
         if
             constexpr(std::is_base_of<IDeltaSupport<ObjectType>, ObjectType>::value) {
-                // ObjectType* ot = new ObjectType{};
-                std::unique_ptr<ObjectType> p = ObjectType::create(dm);
-                // TODO: accelerate this by checkpointing
-                for(int64_t i = this->m_pLog->getEarliestIndex(); i <= idx; i++) {
+                int64_t ridx = (idx < 0) ? (this->m_pLog->getLatestIndex() + 1 + idx) : idx;
+                int64_t i = this->m_pLog->getEarliestIndex();
+                std::unique_ptr<ObjectType> p;
+                // start from the latest checkpoint not newer than the entry, if
+                // the log still has the entries after it.
+                if(this->m_pCheckpointLog != nullptr && this->m_pCheckpointLog->getLength() > 0) {
+                    int64_t cidx = this->m_pCheckpointLog->getVersionIndex(this->m_pLog->getVersionByIndex(ridx));
+                    if(cidx >= 0 && cidx != INVALID_INDEX) {
+                        const version_t cver = this->m_pCheckpointLog->getVersionByIndex(cidx);
+                        int64_t base = this->m_pLog->getVersionIndex(cver);
+                        if(base >= 0 && base != INVALID_INDEX && this->m_pLog->getVersionByIndex(base) == cver) {
+                            PersistLog::PinnedEntries pinned;
+                            p = mutils::from_bytes<ObjectType>(dm, (char const*)this->m_pCheckpointLog->getEntryByIndex(cidx));
+                            i = base + 1;
+                        }
+                    }
+                }
+                if(p == nullptr) {
+                    p = ObjectType::create(dm);
+                }
+                for(; i <= ridx; i++) {
+                    // a delta may read other entries while it is applied
+                    PersistLog::PinnedEntries pinned;
                     const char* entry_data = (const char*)this->m_pLog->getEntryByIndex(i);
                     p->applyDelta(entry_data);
                 }
@@ -556,27 +755,32 @@ public:
                 return p;
             }
         else {
+            PersistLog::PinnedEntries pinned;
             return mutils::from_bytes<ObjectType>(dm, (char const*)this->m_pLog->getEntryByIndex(idx));
         }
     };
 
     // get a version of Value T, specified by version. the user lambda will be fed with
     // an object of T.
-    // zerocopy: this object will not live once it returns.
+    // zerocopy: this object will not live once it returns. An IDeltaSupport
+    // object is const, shared through the version cache.
     // return value is decided by the user lambda.
     template <typename Func>
     auto get(
             const int64_t& ver,
             const Func& fun,
             mutils::DeserializationManager* dm = nullptr) noexcept(false) {
+        // the entry must outlive fun, which may read other entries
+        PersistLog::PinnedEntries pinned;
         char* pdat = (char*)this->m_pLog->getEntry(ver);
         if(pdat == nullptr) {
             throw PERSIST_EXP_INV_VERSION;
         }
         if
             constexpr(std::is_base_of<IDeltaSupport<ObjectType>, ObjectType>::value) {
-                // "So far, the IDeltaSupport does not work with zero-copy 'Persistent::get()'. Emulate with the copy version."
-                return f(*this->get(ver, dm));
+                // The deltas cannot be read in place: fun gets the shared
+                // object of the version cache, which is replayed only once.
+                return fun(*this->getCached(ver, dm));
             }
         else {
             return mutils::deserialize_and_run<ObjectType>(dm, pdat, fun);
@@ -598,6 +802,7 @@ public:
                 return getByIndex(idx, dm);
             }
         else {
+            PersistLog::PinnedEntries pinned;
             return mutils::from_bytes<ObjectType>(dm, (const char*)this->m_pLog->getEntryByIndex(idx));
         }
     }
@@ -605,7 +810,41 @@ public:
     template <typename TKey>
     void trim(const TKey& k) noexcept(false) {
         dbg_default_trace("trim.");
-        this->m_pLog->trim(k);
+        if
+            constexpr(std::is_base_of<IDeltaSupport<ObjectType>, ObjectType>::value) {
+                // The deltas can only be applied on top of a checkpoint: keep
+                // the latest checkpoint not newer than k and the deltas after
+                // it, and trim the rest.
+                int64_t idx = trim_key_index(k);
+                if(idx < 0 || idx == INVALID_INDEX) {
+                    return;
+                }
+                const version_t ver = this->m_pLog->getVersionByIndex(idx);
+                if(this->m_checkpointEntries == 0 && this->m_checkpointBytes == 0) {
+                    request_checkpoint(ver);
+                }
+                // the deltas before a checkpoint are only trimmed once it is
+                // durable
+                int64_t cidx = this->m_pCheckpointLog->getVersionIndex(
+                        std::min(ver, this->m_pCheckpointLog->getLastPersisted()));
+                if(cidx < 0 || cidx == INVALID_INDEX) {
+                    dbg_default_trace("{0} has no checkpoint to trim to.", this->m_pLog->m_sName);
+                    return;
+                }
+                const version_t cver = this->m_pCheckpointLog->getVersionByIndex(cidx);
+                this->m_pLog->trim(cver - 1);
+                this->m_pCheckpointLog->trim(cver - 1);
+            }
+        else {
+            this->m_pLog->trim(k);
+        }
+        if(this->m_pVersionCache != nullptr) {
+            if(this->m_pLog->getLength() > 0) {
+                this->m_pVersionCache->dropBefore(this->m_pLog->getEarliestVersion());
+            } else {
+                this->m_pVersionCache->clear();
+            }
+        }
         dbg_default_trace("trim...done");
     }
 
@@ -615,12 +854,20 @@ public:
     void truncate(const int64_t& ver) {
         dbg_default_trace("truncate.");
         this->m_pLog->truncate(ver);
+        if(this->m_pVersionCache != nullptr) {
+            this->m_pVersionCache->dropAfter(ver);
+        }
+        if(this->m_pCheckpointLog != nullptr) {
+            this->m_pCheckpointLog->truncate(ver);
+            reconcile_checkpoint_log();
+        }
         dbg_default_trace("truncate...done");
     }
 
     // get a version of Value T, specified by HLC clock. the user lambda will be fed with
     // an object of T.
-    // zerocopy: this object will not live once it returns.
+    // zerocopy: this object will not live once it returns. An IDeltaSupport
+    // object is const, shared through the version cache.
     // return value is decided by the user lambda.
     template <typename Func>
     auto get(
@@ -631,11 +878,20 @@ public:
         if(m_pRegistry != nullptr && m_pRegistry->getFrontier() <= hlc) {
             throw PERSIST_EXP_BEYOND_GSF;
         }
-        char* pdat = (char*)this->m_pLog->getEntry(hlc);
-        if(pdat == nullptr) {
-            throw PERSIST_EXP_INV_HLC;
+        if
+            constexpr(std::is_base_of<IDeltaSupport<ObjectType>, ObjectType>::value) {
+                // see get(const int64_t&, const Func&)
+                return fun(*this->getCached(hlc, dm));
+            }
+        else {
+            // the entry must outlive fun, which may read other entries
+            PersistLog::PinnedEntries pinned;
+            char* pdat = (char*)this->m_pLog->getEntry(hlc);
+            if(pdat == nullptr) {
+                throw PERSIST_EXP_INV_HLC;
+            }
+            return mutils::deserialize_and_run<ObjectType>(dm, pdat, fun);
         }
-        return mutils::deserialize_and_run<ObjectType>(dm, pdat, fun);
     };
 
     // get a version of value T. specified by HLC clock.
@@ -646,6 +902,15 @@ public:
         if(m_pRegistry != nullptr && m_pRegistry->getFrontier() <= hlc) {
             throw PERSIST_EXP_BEYOND_GSF;
         }
+        if
+            constexpr(std::is_base_of<IDeltaSupport<ObjectType>, ObjectType>::value) {
+                int64_t idx = this->m_pLog->getHLCIndex(hlc);
+                if(idx == INVALID_INDEX) {
+                    throw PERSIST_EXP_INV_HLC;
+                }
+                return getByIndex(idx, dm);
+            }
+        PersistLog::PinnedEntries pinned;
         char const* pdat = (char const*)this->m_pLog->getEntry(hlc);
         if(pdat == nullptr) {
             throw PERSIST_EXP_INV_HLC;
@@ -654,6 +919,45 @@ public:
         return mutils::from_bytes<ObjectType>(dm, pdat);
     }
 
+    // get a version of value T, specified by version, through the cache of
+    // deserialized versions. The object is shared with the other readers of
+    // the same version and stays valid as long as the returned pointer.
+    std::shared_ptr<const ObjectType> getCached(
+            const int64_t& ver,
+            mutils::DeserializationManager* dm = nullptr) noexcept(false) {
+        int64_t idx = this->m_pLog->getVersionIndex(ver);
+        if(idx < 0 || idx == INVALID_INDEX) {
+            throw PERSIST_EXP_INV_VERSION;
+        }
+        return getCachedByIndex(idx, dm);
+    }
+
+    // get a version of value T, specified by HLC clock, through the cache of
+    // deserialized versions, see getCached(const int64_t&).
+    std::shared_ptr<const ObjectType> getCached(
+            const HLC& hlc,
+            mutils::DeserializationManager* dm = nullptr) noexcept(false) {
+        // global stability frontier test
+        if(m_pRegistry != nullptr && m_pRegistry->getFrontier() <= hlc) {
+            throw PERSIST_EXP_BEYOND_GSF;
+        }
+        int64_t idx = this->m_pLog->getHLCIndex(hlc);
+        if(idx == INVALID_INDEX) {
+            throw PERSIST_EXP_INV_HLC;
+        }
+        return getCachedByIndex(idx, dm);
+    }
+
+    // number of getCached() calls that found the version in the cache
+    uint64_t getVersionCacheHits() const {
+        return (this->m_pVersionCache == nullptr) ? 0 : this->m_pVersionCache->getHits();
+    }
+
+    // number of getCached() calls that deserialized the version
+    uint64_t getVersionCacheMisses() const {
+        return (this->m_pVersionCache == nullptr) ? 0 : this->m_pVersionCache->getMisses();
+    }
+
     // syntax sugar: get a specified version of T without DSM
     /*
       std::unique_ptr<ObjectType> operator [](const int64_t idx)
@@ -702,18 +1006,30 @@ public:
         dbg_default_trace("append to log with ver({}),hlc({},{})", ver, mhlc.m_rtc_us, mhlc.m_logic);
         if
             constexpr(std::is_base_of<IDeltaSupport<ObjectType>, ObjectType>::value) {
+                bool appended = false;
+                size_t delta_size = 0;
                 v.finalizeCurrentDelta([&](char const* const buf, size_t len) {
                     this->m_pLog->append((const void* const)buf, len, ver, mhlc);
+                    appended = true;
+                    delta_size = len;
                 });
+                // a version without a delta has no log entry to count
+                if(appended) {
+                    checkpoint(v, ver, mhlc, delta_size);
+                }
             }
         else {
             // ObjectType does not support Delta, logging the whole current state.
+            // The state is serialized straight into the log.
             auto size = mutils::bytes_size(v);
-            char* buf = new char[size];
-            bzero(buf, size);
-            mutils::to_bytes(v, buf);
-            this->m_pLog->append((void*)buf, size, ver, mhlc);
-            delete buf;
+            char* buf = (char*)this->m_pLog->reserveAppend(size, ver);
+            try {
+                mutils::to_bytes(v, buf);
+            } catch(...) {
+                this->m_pLog->abortAppend();
+                throw;
+            }
+            this->m_pLog->commitAppend(ver, mhlc);
         }
     };
 
@@ -745,6 +1061,12 @@ public:
        * @return the given version to be persisted.
        */
     virtual const int64_t persist() noexcept(false) {
+        // the checkpoints go first, a checkpoint newer than the persisted log
+        // is dropped on reload.
+        if(this->m_pCheckpointLog != nullptr) {
+            write_requested_checkpoint();
+            this->m_pCheckpointLog->persist();
+        }
 #if defined(_PERFORMANCE_DEBUG) || !defined(NDEBUG)
         struct timespec t1, t2;
         clock_gettime(CLOCK_REALTIME, &t1);
@@ -806,6 +1128,19 @@ public:
 protected:
     // PersistLog
     std::unique_ptr<PersistLog> m_pLog;
+    // the deserialized versions read by getCached(), nullptr if disabled
+    std::unique_ptr<VersionCache<ObjectType>> m_pVersionCache;
+    // the checkpoints of an IDeltaSupport object, nullptr for other objects
+    std::unique_ptr<PersistLog> m_pCheckpointLog;
+    // checkpoint every so many log entries or bytes of deltas, 0 for never
+    uint64_t m_checkpointEntries = 0;
+    uint64_t m_checkpointBytes = 0;
+    // log entries and bytes of deltas since the latest checkpoint
+    uint64_t m_entriesSinceCheckpoint = 0;
+    uint64_t m_bytesSinceCheckpoint = 0;
+    // the version trim() requested a checkpoint of, written by the next
+    // persist(); INVALID_VERSION if none
+    std::atomic<version_t> m_checkpointRequest{INVALID_VERSION};
     // Persistence Registry
     PersistentRegistry* m_pRegistry;
     // get the static name maker.
@@ -885,6 +1220,10 @@ public:
         */
         // Step 2: apply log tail
         this->m_pLog->applyLogTail(v);
+        if(this->m_pVersionCache != nullptr) {
+            this->m_pVersionCache->clear();
+        }
+        reconcile_checkpoint_log();
     }
 
 #if defined(_PERFORMANCE_DEBUG) || !defined(NDEBUG)
@@ -902,6 +1241,8 @@ public:
         std::cout << "\tset:\t" << ns_in_set << " ns/"
                   << cnt_in_set << " ops" << std::endl;
         ;
+        std::cout << "\tversion cache:\t" << getVersionCacheHits() << " hits/"
+                  << getVersionCacheMisses() << " misses" << std::endl;
     }
 #endif  //_PERFORMANCE_DEBUG
 };
@@ -1024,9 +1365,11 @@ std::unique_ptr<ObjectType> loadObject(const char* object_name = nullptr) noexce
 /// @param subgroup_type
 /// @param subgroup_index
 /// @param shard_num
+/// @param file_path the folder of the logs of the Replicated<T>
 /// @return The minimum latest persisted version across the Replicated's Persistent<T> fields, as a version number
 template <StorageType storageType = ST_FILE>
-const typename std::enable_if<(storageType == ST_FILE || storageType == ST_MEM), version_t>::type getMinimumLatestPersistedVersion(const std::type_index& subgroup_type, uint32_t subgroup_index, uint32_t shard_num) {
+const typename std::enable_if<(storageType == ST_FILE || storageType == ST_MEM), version_t>::type getMinimumLatestPersistedVersion(const std::type_index& subgroup_type, uint32_t subgroup_index, uint32_t shard_num,
+                                                                                                                                    const std::string& file_path = getPersFilePath()) {
     // All persistent log implementation MUST implement getMinimumLatestPersistedVersion()
     // All of them need to be checked here
     // NOTE: we assume that an application will only use ONE type of PERSISTED LOG (ST_FILE or ST_NVM, ...). Otherwise,
@@ -1036,7 +1379,12 @@ const typename std::enable_if<(storageType == ST_FILE || storageType == ST_MEM),
     // In case we get a valid version from log stored in other storage type, we should return INVALID_VERSION for 1)
     // but return the valid version for 2).
     version_t mlpv = INVALID_VERSION;
-    mlpv = FilePersistLog::getMinimumLatestPersistedVersion(PersistentRegistry::generate_prefix(subgroup_type, subgroup_index, shard_num));
+    const std::string prefix = PersistentRegistry::generate_prefix(subgroup_type, subgroup_index, shard_num);
+    if(storageType == ST_FILE && usePersDirectBackend()) {
+        mlpv = DirectPersistLog::getMinimumLatestPersistedVersion(prefix, file_path);
+    } else {
+        mlpv = FilePersistLog::getMinimumLatestPersistedVersion(prefix, file_path);
+    }
     return mlpv;
 }
 
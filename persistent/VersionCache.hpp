@@ -0,0 +1,147 @@
+#ifndef VERSION_CACHE_HPP
+#define VERSION_CACHE_HPP
+
+#include "PersistLog.hpp"
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace persistent {
+
+// VersionCache keeps the most recently read versions of a Persistent<T>,
+// deserialized, so that repeated queries for the same past version do not
+// deserialize it again. The cached objects are shared and immutable: a reader
+// keeps its object alive through the returned shared_ptr, even after the
+// version is evicted. The cache is thread-safe.
+//
+// A truncated version can be written again with other contents. Dropping
+// versions after a truncate or a reload advances the generation of the
+// cache, and an object read from the log before that is not inserted.
+template <typename ObjectType>
+class VersionCache {
+public:
+    /**
+     * Constructor
+     * @param capacity - the maximum number of versions cached
+     */
+    VersionCache(size_t capacity) noexcept(true) : m_capacity(capacity),
+                                                   m_generation(0),
+                                                   m_hits(0),
+                                                   m_misses(0) {}
+
+    /**
+     * Look up a version, and mark it as the most recently used.
+     * @param ver - the version of a log entry
+     * @return - the cached object, or nullptr on a miss
+     */
+    std::shared_ptr<const ObjectType> find(const version_t& ver) noexcept(true) {
+        std::lock_guard<std::mutex> lck(this->m_mutex);
+        auto search = this->m_index.find(ver);
+        if(search == this->m_index.end()) {
+            this->m_misses++;
+            return nullptr;
+        }
+        this->m_hits++;
+        this->m_lru.splice(this->m_lru.begin(), this->m_lru, search->second);
+        return search->second->second;
+    }
+
+    /**
+     * Get the current generation, to be read before the object of a version
+     * is read from the log.
+     */
+    uint64_t getGeneration() noexcept(true) {
+        std::lock_guard<std::mutex> lck(this->m_mutex);
+        return this->m_generation;
+    }
+
+    /**
+     * Cache a version, evicting the least recently used one if it is full.
+     * @param ver - the version of a log entry
+     * @param obj - the object of that version
+     * @param generation - the generation read before obj was read from the
+     *                     log. obj is not cached if it has changed since.
+     */
+    void insert(const version_t& ver, const std::shared_ptr<const ObjectType>& obj, uint64_t generation) noexcept(false) {
+        std::lock_guard<std::mutex> lck(this->m_mutex);
+        if(generation != this->m_generation) {
+            return;
+        }
+        auto search = this->m_index.find(ver);
+        if(search != this->m_index.end()) {
+            // another reader got here first
+            this->m_lru.splice(this->m_lru.begin(), this->m_lru, search->second);
+            return;
+        }
+        if(this->m_lru.size() >= this->m_capacity) {
+            this->m_index.erase(this->m_lru.back().first);
+            this->m_lru.pop_back();
+        }
+        this->m_lru.emplace_front(ver, obj);
+        this->m_index.emplace(ver, this->m_lru.begin());
+    }
+
+    // drop the versions older than ver, after the log is trimmed.
+    void dropBefore(const version_t& ver) noexcept(true) {
+        dropIf([&ver](const version_t& v) { return v < ver; });
+    }
+
+    // drop the versions newer than ver, after the log is truncated.
+    void dropAfter(const version_t& ver) noexcept(true) {
+        dropIf([&ver](const version_t& v) { return v > ver; }, true);
+    }
+
+    // drop all the versions
+    void clear() noexcept(true) {
+        std::lock_guard<std::mutex> lck(this->m_mutex);
+        this->m_generation++;
+        this->m_index.clear();
+        this->m_lru.clear();
+    }
+
+    // number of lookups that found the version
+    uint64_t getHits() const noexcept(true) {
+        return this->m_hits;
+    }
+
+    // number of lookups that missed
+    uint64_t getMisses() const noexcept(true) {
+        return this->m_misses;
+    }
+
+private:
+    // drop the versions matching pred, and advance the generation if they
+    // may be written again.
+    template <typename Pred>
+    void dropIf(const Pred& pred, bool advance_generation = false) noexcept(true) {
+        std::lock_guard<std::mutex> lck(this->m_mutex);
+        if(advance_generation) {
+            this->m_generation++;
+        }
+        for(auto it = this->m_lru.begin(); it != this->m_lru.end();) {
+            if(pred(it->first)) {
+                this->m_index.erase(it->first);
+                it = this->m_lru.erase(it);
+            } else {
+                it++;
+            }
+        }
+    }
+
+    // the maximum number of versions cached
+    const size_t m_capacity;
+    // the cached versions, the most recently used first
+    std::list<std::pair<version_t, std::shared_ptr<const ObjectType>>> m_lru;
+    // version -> position in m_lru
+    std::unordered_map<version_t, typename decltype(m_lru)::iterator> m_index;
+    std::mutex m_mutex;
+    // advanced whenever dropped versions may be written again
+    uint64_t m_generation;
+    std::atomic<uint64_t> m_hits;
+    std::atomic<uint64_t> m_misses;
+};
+}
+
+#endif  //VERSION_CACHE_HPP
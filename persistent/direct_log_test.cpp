@@ -0,0 +1,332 @@
+// Tests of DirectPersistLog and DirectLogWriter. Each test works on its own
+// log in the directory given on the command line, ".direct_log_test" by
+// default, which must be on a file system supporting O_DIRECT.
+#include "DirectLogWriter.hpp"
+#include "DirectPersistLog.hpp"
+#include "util.hpp"
+#include <condition_variable>
+#include <experimental/filesystem>
+#include <fcntl.h>
+#include <iostream>
+#include <mutex>
+#include <string.h>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utils/test_check.hpp>
+#include <vector>
+
+using namespace persistent;
+using std::cout;
+using std::endl;
+namespace fs = std::experimental::filesystem;
+
+static std::string test_dir = ".direct_log_test";
+
+// the data of the entry with version ver
+static std::string entry_data(int64_t ver, std::size_t size) {
+    std::string data;
+    while(data.size() < size) {
+        data += "entry-" + std::to_string(ver) + ";";
+    }
+    data.resize(size);
+    return data;
+}
+
+static void append_entry(DirectPersistLog& log, int64_t ver, std::size_t size) {
+    std::string data = entry_data(ver, size);
+    log.append(data.data(), data.size(), ver, HLC{(uint64_t)ver * 10, 0});
+}
+
+static bool check_entry(DirectPersistLog& log, int64_t idx, int64_t ver, std::size_t size) {
+    PersistLog::PinnedEntries pinned;
+    const char* pdat = (const char*)log.getEntryByIndex(idx);
+    return log.getVersionByIndex(idx) == ver && pdat != nullptr
+           && memcmp(pdat, entry_data(ver, size).data(), size) == 0;
+}
+
+static std::string log_file(const std::string& name) {
+    return test_dir + "/" + name + "." + DIRECT_LOG_FILE_SUFFIX;
+}
+
+static void remove_log(const std::string& name) {
+    fs::remove(log_file(name));
+    fs::remove(test_dir + "/" + name + "." + DIRECT_META_FILE_SUFFIX);
+}
+
+// the offsets of the records in a log file, scanned as the log does on load.
+// @return the end of the last valid record
+static uint64_t scan_records(const std::string& file, std::vector<uint64_t>& offsets) {
+    int fd = open(file.c_str(), O_RDONLY);
+    struct stat sb;
+    fstat(fd, &sb);
+    uint64_t ofst = 0;
+    DirectRecordHeader header;
+    while(true) {
+        if(ofst + sizeof(header) > (uint64_t)sb.st_size
+           || pread(fd, &header, sizeof(header), ofst) != sizeof(header)
+           || header.magic != DIRECT_RECORD_MAGIC) {
+            // persist() pads the records to a block boundary
+            uint64_t aligned = (ofst + DIRECT_LOG_BLOCK_SIZE - 1) & ~(DIRECT_LOG_BLOCK_SIZE - 1);
+            if(aligned == ofst || aligned + sizeof(header) > (uint64_t)sb.st_size
+               || pread(fd, &header, sizeof(header), aligned) != sizeof(header)
+               || header.magic != DIRECT_RECORD_MAGIC) {
+                break;
+            }
+            ofst = aligned;
+        }
+        offsets.push_back(ofst);
+        ofst += (sizeof(header) + header.dlen + 7) & ~((uint64_t)7);
+    }
+    close(fd);
+    return ofst;
+}
+
+// if the log file holds nothing but zeros after the end of its records
+static bool tail_is_zero(const std::string& file) {
+    std::vector<uint64_t> offsets;
+    uint64_t end = scan_records(file, offsets);
+    int fd = open(file.c_str(), O_RDONLY);
+    struct stat sb;
+    fstat(fd, &sb);
+    std::vector<char> rest(sb.st_size > (off_t)end ? sb.st_size - end : 0);
+    bool zero = (pread(fd, rest.data(), rest.size(), end) == (ssize_t)rest.size());
+    close(fd);
+    for(char c : rest) {
+        zero = zero && (c == 0);
+    }
+    return zero;
+}
+
+// entries are appended, persisted and read back after the log is reloaded
+static void test_round_trip() {
+    cout << "round trip" << endl;
+    remove_log("round_trip");
+    // the large entries fill chunks, which are written behind
+    const std::size_t sizes[] = {1, 100, 4096, DIRECT_LOG_CHUNK_SIZE + 1, 7, 3 * DIRECT_LOG_CHUNK_SIZE, 4095};
+    const int n = sizeof(sizes) / sizeof(sizes[0]);
+    {
+        DirectPersistLog log("round_trip", test_dir);
+        for(int i = 0; i < n; i++) {
+            append_entry(log, i * 2, sizes[i]);
+        }
+        log.advanceVersion(n * 2);
+        CHECK(log.persist() == n * 2);
+        CHECK(log.getLastPersisted() == n * 2);
+        for(int i = 0; i < n; i++) {
+            CHECK(check_entry(log, i, i * 2, sizes[i]));
+        }
+    }
+    DirectPersistLog log("round_trip", test_dir);
+    CHECK(log.getLength() == n);
+    CHECK(log.getLatestVersion() == (n - 1) * 2);
+    // the version advanced past the last entry
+    CHECK(log.getLastPersisted() == n * 2);
+    for(int i = 0; i < n; i++) {
+        CHECK(check_entry(log, i, i * 2, sizes[i]));
+    }
+    // the latest entry not newer than the version or the clock
+    CHECK(log.getVersionIndex(5) == 2);
+    PersistLog::PinnedEntries pinned;
+    CHECK(memcmp(log.getEntry(HLC{45, 0}), entry_data(4, sizes[2]).data(), sizes[2]) == 0);
+    CHECK(log.getEntry((int64_t)-1) == nullptr);
+}
+
+// the entries after a torn or corrupted record are dropped on load, and the
+// log can be appended to again
+static void test_torn_tail() {
+    cout << "torn tail" << endl;
+    remove_log("torn_tail");
+    {
+        DirectPersistLog log("torn_tail", test_dir);
+        for(int64_t v = 0; v < 4; v++) {
+            append_entry(log, v, 1000);
+            log.persist();
+        }
+    }
+    std::vector<uint64_t> offsets;
+    scan_records(log_file("torn_tail"), offsets);
+    CHECK(offsets.size() == 4);
+    // corrupt the data of the last record
+    int fd = open(log_file("torn_tail").c_str(), O_WRONLY);
+    CHECK(pwrite(fd, "X", 1, offsets[3] + sizeof(DirectRecordHeader) + 10) == 1);
+    close(fd);
+    {
+        DirectPersistLog log("torn_tail", test_dir);
+        CHECK(log.getLength() == 3);
+        CHECK(log.getLatestVersion() == 2);
+        CHECK(tail_is_zero(log_file("torn_tail")));
+        append_entry(log, 3, 500);
+        append_entry(log, 4, 500);
+        log.persist();
+    }
+    // cut the last record in the middle of its header
+    offsets.clear();
+    scan_records(log_file("torn_tail"), offsets);
+    CHECK(offsets.size() == 5);
+    CHECK(truncate(log_file("torn_tail").c_str(), offsets[4] + 20) == 0);
+    DirectPersistLog log("torn_tail", test_dir);
+    CHECK(log.getLength() == 4);
+    CHECK(check_entry(log, 2, 2, 1000));
+    CHECK(check_entry(log, 3, 3, 500));
+    CHECK(log.getLatestVersion() == 3);
+}
+
+// a truncated log does not keep stale records after its new tail
+static void test_truncate() {
+    cout << "truncate" << endl;
+    remove_log("truncate");
+    {
+        DirectPersistLog log("truncate", test_dir);
+        for(int64_t v = 0; v < 6; v++) {
+            // sizes which do not end the records on a block boundary
+            append_entry(log, v, 1000 + v);
+        }
+        log.persist();
+        log.truncate(2);
+        CHECK(log.getLength() == 3);
+        CHECK(log.getLatestVersion() == 2);
+        CHECK(tail_is_zero(log_file("truncate")));
+        struct stat sb;
+        CHECK(stat(log_file("truncate").c_str(), &sb) == 0 && sb.st_size % DIRECT_LOG_BLOCK_SIZE == 0);
+        append_entry(log, 7, 10);
+        log.persist();
+    }
+    DirectPersistLog log("truncate", test_dir);
+    CHECK(log.getLength() == 4);
+    CHECK(check_entry(log, 2, 2, 1002));
+    CHECK(check_entry(log, 3, 7, 10));
+    // the version is cut back to the truncation point
+    log.advanceVersion(9);
+    log.persist();
+    log.truncate(8);
+    CHECK(log.getLastPersisted() == 8);
+}
+
+// trimmed entries stay trimmed after the log is reloaded
+static void test_trim() {
+    cout << "trim" << endl;
+    remove_log("trim");
+    {
+        DirectPersistLog log("trim", test_dir);
+        for(int64_t v = 0; v < 10; v++) {
+            append_entry(log, v * 10, 300);
+        }
+        log.persist();
+        log.trim((int64_t)35);
+        CHECK(log.getEarliestIndex() == 4);
+        CHECK(log.getEarliestVersion() == 40);
+        CHECK(log.getLength() == 6);
+        log.trimByIndex(6);
+        CHECK(log.getEarliestVersion() == 70);
+    }
+    DirectPersistLog log("trim", test_dir);
+    CHECK(log.getEarliestIndex() == 7);
+    CHECK(log.getLength() == 3);
+    CHECK(check_entry(log, 7, 70, 300));
+    CHECK(check_entry(log, 9, 90, 300));
+    log.trimByIndex(9);
+    CHECK(log.getLength() == 0);
+    CHECK(log.getLastPersisted() == 90);
+}
+
+// an entry read in a PinnedEntries scope stays valid however many entries are
+// read after it
+static void test_pinned_entries() {
+    cout << "pinned entries" << endl;
+    remove_log("pinned");
+    {
+        DirectPersistLog log("pinned", test_dir);
+        for(int64_t v = 0; v < 4 * PERSIST_LOG_PINNED_ENTRIES; v++) {
+            append_entry(log, v, 2000);
+        }
+        log.persist();
+    }
+    // reloaded, so the entries are read from the file
+    DirectPersistLog log("pinned", test_dir);
+    PersistLog::PinnedEntries pinned;
+    const char* first = (const char*)log.getEntryByIndex(0);
+    for(int64_t i = 1; i < 4 * PERSIST_LOG_PINNED_ENTRIES; i++) {
+        CHECK(check_entry(log, i, i, 2000));
+    }
+    CHECK(memcmp(first, entry_data(0, 2000).data(), 2000) == 0);
+}
+
+// one writer, io_uring or the pwrite() fallback, writes and syncs in order
+static void test_writer(bool io_uring) {
+    cout << "writer " << (io_uring ? "io_uring" : "pwrite") << endl;
+    std::shared_ptr<DirectLogWriter> writer;
+    try {
+        writer = DirectLogWriter::create(io_uring);
+    } catch(persist_exception_t e) {
+        cout << "\tskipped, io_uring is not available" << endl;
+        return;
+    }
+    const std::string file = test_dir + "/writer.dat";
+    int fd = open(file.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_DIRECT, S_IWUSR | S_IRUSR);
+    CHECK(fd != -1);
+    const int nflushes = 16;
+    std::mutex mutex;
+    std::condition_variable cv;
+    // the flushes of different files may complete in any order
+    std::vector<int> results(nflushes + 1, -1);
+    int completed = 0;
+    auto callback = [&](int flush) {
+        return [&, flush](int error) {
+            std::lock_guard<std::mutex> lck(mutex);
+            results[flush] = error;
+            completed++;
+            cv.notify_all();
+        };
+    };
+    for(int i = 0; i < nflushes; i++) {
+        std::vector<DirectWrite> writes;
+        for(int j = 0; j < 2; j++) {
+            char* buf;
+            CHECK(posix_memalign((void**)&buf, DIRECT_LOG_BLOCK_SIZE, DIRECT_LOG_BLOCK_SIZE) == 0);
+            memset(buf, 'a' + (i * 2 + j) % 26, DIRECT_LOG_BLOCK_SIZE);
+            writes.push_back(DirectWrite{std::shared_ptr<char>(buf, free), DIRECT_LOG_BLOCK_SIZE,
+                                         (off_t)((i * 2 + j) * DIRECT_LOG_BLOCK_SIZE)});
+        }
+        writer->submit(fd, std::move(writes), i % 4 == 3, callback(i));
+    }
+    // a failed write is reported to its own flush
+    writer->submit(-1, {}, true, callback(nflushes));
+    {
+        std::unique_lock<std::mutex> lck(mutex);
+        cv.wait(lck, [&]() { return completed == nflushes + 1; });
+    }
+    for(int i = 0; i < nflushes; i++) {
+        CHECK(results[i] == 0);
+    }
+    CHECK(results[nflushes] == EBADF);
+    std::vector<char> data(DIRECT_LOG_BLOCK_SIZE);
+    int rfd = open(file.c_str(), O_RDONLY);
+    for(int b = 0; b < nflushes * 2; b++) {
+        CHECK(pread(rfd, data.data(), data.size(), b * DIRECT_LOG_BLOCK_SIZE) == (ssize_t)data.size());
+        CHECK(data[0] == 'a' + b % 26 && data[DIRECT_LOG_BLOCK_SIZE - 1] == 'a' + b % 26);
+    }
+    close(rfd);
+    close(fd);
+    fs::remove(file);
+}
+
+int main(int argc, char** argv) {
+    if(argc > 1) {
+        test_dir = argv[1];
+    }
+    fs::create_directories(test_dir);
+    try {
+        test_round_trip();
+        test_torn_tail();
+        test_truncate();
+        test_trim();
+        test_pinned_entries();
+        test_writer(true);
+        test_writer(false);
+    } catch(persist_exception_t exp) {
+        cout << "Exception captured:0x" << std::hex << exp << endl;
+        return -1;
+    }
+    return check_results();
+}
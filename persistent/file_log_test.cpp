@@ -0,0 +1,403 @@
+// Tests of FilePersistLog. Each test works on its own log in the directory
+// given on the command line, ".file_log_test" by default.
+#include "FilePersistLog.hpp"
+#include "HLCIndex.hpp"
+#include "util.hpp"
+#include <atomic>
+#include <experimental/filesystem>
+#include <fcntl.h>
+#include <iostream>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <utils/test_check.hpp>
+
+using namespace persistent;
+using std::cout;
+using std::endl;
+namespace fs = std::experimental::filesystem;
+
+static std::string test_dir = ".file_log_test";
+
+// the data of the entry with version ver
+static std::string entry_data(int64_t ver, std::size_t size) {
+    std::string data;
+    while(data.size() < size) {
+        data += "entry-" + std::to_string(ver) + ";";
+    }
+    data.resize(size);
+    return data;
+}
+
+static void append_entry(FilePersistLog& log, int64_t ver, std::size_t size) {
+    std::string data = entry_data(ver, size);
+    log.append(data.data(), data.size(), ver, HLC{(uint64_t)ver * 10, 0});
+}
+
+// reserve an entry and write its data, without committing it
+static void reserve_entry(FilePersistLog& log, int64_t ver, std::size_t size) {
+    std::string data = entry_data(ver, size);
+    memcpy(log.reserveAppend(size, ver), data.data(), size);
+}
+
+static bool check_entry(FilePersistLog& log, int64_t idx, int64_t ver, std::size_t size) {
+    PersistLog::PinnedEntries pinned;
+    const char* pdat = (const char*)log.getEntryByIndex(idx);
+    return log.getVersionByIndex(idx) == ver && pdat != nullptr
+           && memcmp(pdat, entry_data(ver, size).data(), size) == 0;
+}
+
+// remove the files of a log
+static void remove_log(const std::string& name) {
+    for(auto& file : fs::directory_iterator(test_dir)) {
+        if(file.path().filename().string().compare(0, name.size() + 1, name + ".") == 0) {
+            fs::remove(file.path());
+        }
+    }
+}
+
+// a committed reservation is an entry like an appended one
+static void test_reserve_commit() {
+    cout << "reserve and commit" << endl;
+    remove_log("reserve_commit");
+    {
+        FilePersistLog log("reserve_commit", test_dir);
+        append_entry(log, 1, 100);
+        reserve_entry(log, 2, 5000);
+        log.commitAppend(2, HLC{20, 0});
+        reserve_entry(log, 3, 1);
+        log.commitAppend(3, HLC{30, 0});
+        CHECK(log.getLength() == 3);
+        CHECK(check_entry(log, 1, 2, 5000));
+        CHECK(log.persist() == 3);
+    }
+    FilePersistLog log("reserve_commit", test_dir);
+    CHECK(log.getLength() == 3);
+    CHECK(check_entry(log, 0, 1, 100));
+    CHECK(check_entry(log, 1, 2, 5000));
+    CHECK(check_entry(log, 2, 3, 1));
+    CHECK(log.getHLCIndex(HLC{25, 0}) == 1);
+}
+
+// an aborted reservation leaves no trace, and a commit without a
+// reservation is rejected
+static void test_reserve_abort() {
+    cout << "reserve and abort" << endl;
+    remove_log("reserve_abort");
+    {
+        FilePersistLog log("reserve_abort", test_dir);
+        append_entry(log, 1, 100);
+        reserve_entry(log, 2, 300);
+        log.abortAppend();
+        CHECK(log.getLength() == 1);
+        CHECK(log.getLatestVersion() == 1);
+        bool rejected = false;
+        try {
+            log.commitAppend(2, HLC{20, 0});
+        } catch(persist_exception_t e) {
+            rejected = (e == PERSIST_EXP_INV_RESERVATION);
+        }
+        CHECK(rejected);
+        // the space of the aborted reservation is reused
+        append_entry(log, 2, 200);
+        reserve_entry(log, 3, 300);
+        log.abortAppend();
+        log.persist();
+    }
+    FilePersistLog log("reserve_abort", test_dir);
+    CHECK(log.getLength() == 2);
+    CHECK(check_entry(log, 1, 2, 200));
+    CHECK(log.getLatestVersion() == 2);
+}
+
+// a reservation does not survive a truncate or a version advanced past it,
+// but it survives a trim
+static void test_reserve_stale() {
+    cout << "stale reservation" << endl;
+    remove_log("reserve_stale");
+    FilePersistLog log("reserve_stale", test_dir);
+    for(int64_t v = 1; v <= 4; v++) {
+        append_entry(log, v, 100);
+    }
+    reserve_entry(log, 5, 100);
+    log.truncate(2);
+    bool rejected = false;
+    try {
+        log.commitAppend(5, HLC{50, 0});
+    } catch(persist_exception_t e) {
+        rejected = (e == PERSIST_EXP_INV_RESERVATION);
+    }
+    CHECK(rejected);
+    CHECK(log.getLength() == 2);
+    CHECK(log.getLatestVersion() == 2);
+
+    reserve_entry(log, 6, 100);
+    log.advanceVersion(7);
+    rejected = false;
+    try {
+        log.commitAppend(6, HLC{60, 0});
+    } catch(persist_exception_t e) {
+        rejected = (e == PERSIST_EXP_INV_RESERVATION);
+    }
+    CHECK(rejected);
+    CHECK(log.getLength() == 2);
+
+    // a reservation is committed with its own version only
+    reserve_entry(log, 8, 100);
+    rejected = false;
+    try {
+        log.commitAppend(9, HLC{90, 0});
+    } catch(persist_exception_t e) {
+        rejected = (e == PERSIST_EXP_INV_RESERVATION);
+    }
+    CHECK(rejected);
+
+    reserve_entry(log, 8, 100);
+    log.trim((int64_t)1);
+    log.commitAppend(8, HLC{80, 0});
+    CHECK(log.getLength() == 2);
+    CHECK(check_entry(log, 2, 8, 100));
+}
+
+// a lookup finds the latest clock not after the key, and the first entry
+// added with that clock
+static void test_hlc_index() {
+    cout << "hlc index" << endl;
+    HLCIndex hidx;
+    CHECK(hidx.search(HLC{10, 0}) == INVALID_INDEX);
+    hidx.insert(10, 0, 0);
+    hidx.insert(20, 0, 1);
+    hidx.insert(20, 0, 2);
+    hidx.insert(20, 0, 3);
+    hidx.insert(30, 0, 4);
+    CHECK(hidx.search(HLC{5, 0}) == INVALID_INDEX);
+    CHECK(hidx.search(HLC{10, 0}) == 0);
+    CHECK(hidx.search(HLC{20, 0}) == 1);
+    CHECK(hidx.search(HLC{25, 0}) == 1);
+    CHECK(hidx.search(HLC{30, 0}) == 4);
+    CHECK(hidx.search(HLC{100, 0}) == 4);
+    // out-of-order clocks
+    hidx.insert(15, 0, 5);
+    hidx.insert(20, 0, 6);
+    CHECK(hidx.search(HLC{15, 0}) == 5);
+    CHECK(hidx.search(HLC{17, 0}) == 5);
+    CHECK(hidx.search(HLC{20, 0}) == 1);
+    CHECK(hidx.search(HLC{20, 1}) == 1);
+    hidx.trim(2);
+    CHECK(hidx.search(HLC{12, 0}) == INVALID_INDEX);
+    CHECK(hidx.search(HLC{15, 0}) == 5);
+    CHECK(hidx.search(HLC{20, 0}) == 2);
+    hidx.truncate(4);
+    CHECK(hidx.size() == 2);
+    CHECK(hidx.search(HLC{100, 0}) == 2);
+
+    // the same in a log, before and after it is reloaded
+    remove_log("hlc_index");
+    {
+        FilePersistLog log("hlc_index", test_dir);
+        for(int64_t v = 1; v <= 3; v++) {
+            std::string data = entry_data(v, 100);
+            log.append(data.data(), data.size(), v, HLC{20, 0});
+        }
+        CHECK(log.getHLCIndex(HLC{20, 0}) == 0);
+        log.persist();
+    }
+    FilePersistLog log("hlc_index", test_dir);
+    CHECK(log.getHLCIndex(HLC{20, 0}) == 0);
+    CHECK(log.getHLCIndex(HLC{19, 0}) == INVALID_INDEX);
+}
+
+// a log of the ring layout is migrated to segments. The ring wraps around in
+// the middle of the log, and in the middle of the data of an entry.
+static void test_ring_migration() {
+    cout << "ring layout migration" << endl;
+    remove_log("ring");
+    const int64_t head = RING_LOG_ENTRIES - 2;
+    const int64_t tail = RING_LOG_ENTRIES + 2;
+    {
+        int logFd = open((test_dir + "/ring." LOG_FILE_SUFFIX).c_str(), O_RDWR | O_CREAT, 0644);
+        int dataFd = open((test_dir + "/ring." DATA_FILE_SUFFIX).c_str(), O_RDWR | O_CREAT, 0644);
+        for(int64_t idx = head; idx < tail; idx++) {
+            const int64_t ver = idx - head + 1;
+            LogEntry entry;
+            memset(&entry, 0, sizeof(entry));
+            entry.fields.ver = ver;
+            entry.fields.dlen = 100;
+            entry.fields.ofst = RING_DATA_SIZE * 3 - 150 + (idx - head) * 100;
+            entry.fields.hlc_r = ver * 10;
+            CHECK(pwrite(logFd, &entry, sizeof(entry), (idx % RING_LOG_ENTRIES) * sizeof(LogEntry)) == sizeof(entry));
+            std::string data = entry_data(ver, 100);
+            for(uint64_t i = 0; i < data.size(); i++) {
+                CHECK(pwrite(dataFd, &data[i], 1, (entry.fields.ofst + i) % RING_DATA_SIZE) == 1);
+            }
+        }
+        close(logFd);
+        close(dataFd);
+        MetaHeader header;
+        memset(&header, 0, sizeof(header));
+        header.fields.head = head;
+        header.fields.tail = tail;
+        header.fields.ver = 6;
+        int metaFd = open((test_dir + "/ring." META_FILE_SUFFIX).c_str(), O_RDWR | O_CREAT, 0644);
+        CHECK(write(metaFd, &header, sizeof(header)) == sizeof(header));
+        close(metaFd);
+    }
+    for(int load = 0; load < 2; load++) {
+        FilePersistLog log("ring", test_dir);
+        CHECK(log.getLength() == 4);
+        CHECK(log.getEarliestIndex() == head);
+        for(int64_t idx = head; idx < tail; idx++) {
+            CHECK(check_entry(log, idx, idx - head + 1, 100));
+        }
+        CHECK(log.getLatestVersion() == 4);
+        CHECK(log.getLastPersisted() == 6);
+        CHECK(log.getHLCIndex(HLC{25, 0}) == head + 1);
+        CHECK(!fs::exists(test_dir + "/ring." LOG_FILE_SUFFIX));
+        CHECK(!fs::exists(test_dir + "/ring." DATA_FILE_SUFFIX));
+    }
+
+    // a meta file of an unknown format is rejected
+    remove_log("unknown");
+    {
+        MetaHeader header;
+        memset(&header, 0, sizeof(header));
+        int metaFd = open((test_dir + "/unknown." META_FILE_SUFFIX).c_str(), O_RDWR | O_CREAT, 0644);
+        CHECK(write(metaFd, &header, sizeof(header)) == sizeof(header));
+        close(metaFd);
+    }
+    bool rejected = false;
+    try {
+        FilePersistLog log("unknown", test_dir);
+    } catch(persist_exception_t e) {
+        rejected = (e == PERSIST_EXP_INV_FILE);
+    }
+    CHECK(rejected);
+    remove_log("unknown");
+}
+
+// exposes the bounds of the log
+class BoundsLog : public FilePersistLog {
+public:
+    BoundsLog(const std::string& name) : FilePersistLog(name, test_dir) {}
+    using FilePersistLog::LogBounds;
+    using FilePersistLog::readBounds;
+};
+
+// the readers of the log bounds see consistent snapshots while one thread
+// appends and another trims. The entry at index i has version i + 1 and 64
+// bytes of data, so a snapshot is torn unless ver == tail and
+// dtail == tail * 64.
+static void test_concurrent_bounds() {
+    cout << "concurrent bounds" << endl;
+    const int64_t num_entries = 200000;
+    remove_log("bounds");
+    BoundsLog log("bounds");
+    std::atomic<bool> done(false);
+    std::atomic<int> torn(0);
+    std::atomic<int> bad_entries(0);
+    auto reader = [&]() {
+        BoundsLog::LogBounds last{0, 0, INVALID_VERSION, 0};
+        while(!done.load()) {
+            const BoundsLog::LogBounds bounds = log.readBounds();
+            if(bounds.head > bounds.tail || bounds.head < last.head || bounds.tail < last.tail
+               || (bounds.tail > 0 && bounds.ver != bounds.tail)
+               || bounds.dtail != (uint64_t)bounds.tail * 64) {
+                torn++;
+            }
+            // the latest entry is written before it is published, unless it
+            // has been trimmed since.
+            if(bounds.tail > bounds.head) {
+                try {
+                    if(log.getVersionByIndex(bounds.tail - 1) != bounds.tail) {
+                        bad_entries++;
+                    }
+                } catch(persist_exception_t e) {
+                    if(e != PERSIST_EXP_INV_ENTRY_IDX(bounds.tail - 1)) {
+                        throw;
+                    }
+                }
+            }
+            last = bounds;
+        }
+    };
+    std::thread readers[] = {std::thread(reader), std::thread(reader)};
+    std::thread trimmer([&]() {
+        while(!done.load()) {
+            const int64_t tail = log.readBounds().tail;
+            if(tail > 100) {
+                log.trimByIndex(tail - 100);
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+    for(int64_t v = 1; v <= num_entries; v++) {
+        append_entry(log, v, 64);
+    }
+    done.store(true);
+    for(auto& t : readers) {
+        t.join();
+    }
+    trimmer.join();
+    CHECK(torn.load() == 0);
+    CHECK(bad_entries.load() == 0);
+    CHECK(log.getLatestVersion() == num_entries);
+    CHECK(check_entry(log, num_entries - 1, num_entries, 64));
+}
+
+// an entry pinned by a reader stays readable while two trims drop its data
+// segment and the one after it. Each entry is larger than half a data
+// segment, so the entry at index i starts data segment i.
+static void test_pinned_across_trims() {
+    cout << "pinned entry across trims" << endl;
+    const std::size_t size = getPersDataSegmentSize() / 2 + 4096;
+    remove_log("pinned");
+    FilePersistLog log("pinned", test_dir);
+    for(int64_t v = 1; v <= 3; v++) {
+        append_entry(log, v, size);
+    }
+    log.persist();
+    std::atomic<bool> pinned(false);
+    std::atomic<bool> trimmed(false);
+    std::atomic<bool> intact(false);
+    std::thread reader([&]() {
+        PersistLog::PinnedEntries scope;
+        const char* pdat = (const char*)log.getEntryByIndex(0);
+        pinned.store(true);
+        while(!trimmed.load()) {
+            std::this_thread::yield();
+        }
+        intact.store(memcmp(pdat, entry_data(1, size).data(), size) == 0);
+    });
+    while(!pinned.load()) {
+        std::this_thread::yield();
+    }
+    log.trimByIndex(0);
+    log.trimByIndex(1);
+    trimmed.store(true);
+    reader.join();
+    CHECK(intact.load());
+    CHECK(log.getEarliestIndex() == 2);
+    CHECK(check_entry(log, 2, 3, size));
+    remove_log("pinned");
+}
+
+int main(int argc, char** argv) {
+    if(argc > 1) {
+        test_dir = argv[1];
+    }
+    fs::create_directories(test_dir);
+    try {
+        test_reserve_commit();
+        test_reserve_abort();
+        test_reserve_stale();
+        test_hlc_index();
+        test_ring_migration();
+        test_concurrent_bounds();
+        test_pinned_across_trims();
+    } catch(persist_exception_t exp) {
+        cout << "Exception captured:0x" << std::hex << exp << endl;
+        return -1;
+    }
+    return check_results();
+}
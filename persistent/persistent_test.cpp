@@ -0,0 +1,240 @@
+// Tests of Persistent<T>. The logs are kept in the directory given on the
+// command line, ".persistent_test" by default. Checkpointing of delta objects
+// is disabled.
+#include "Persistent.hpp"
+#include <SerializationSupport.hpp>
+#include <conf/conf.hpp>
+#include <iostream>
+#include <string>
+#include <utils/test_check.hpp>
+#include <vector>
+
+using namespace persistent;
+using namespace mutils;
+using std::cout;
+using std::endl;
+
+static std::string test_dir = ".persistent_test";
+
+class IntegerWithDelta : public ByteRepresentable, IDeltaSupport<IntegerWithDelta> {
+public:
+    int value;
+    int delta;
+    IntegerWithDelta() : value(0), delta(0) {}
+    int add(int op) {
+        this->value += op;
+        this->delta += op;
+        return this->value;
+    }
+    virtual void finalizeCurrentDelta(const DeltaFinalizer& dp) {
+        dp((char const* const) & (this->delta), sizeof(this->delta));
+        this->delta = 0;
+    }
+    virtual void applyDelta(char const* const pdat) {
+        this->value += *((const int* const)pdat);
+    }
+    static std::unique_ptr<IntegerWithDelta> create(mutils::DeserializationManager* dm) {
+        return std::make_unique<IntegerWithDelta>();
+    }
+
+    DEFAULT_SERIALIZATION_SUPPORT(IntegerWithDelta, value);
+};
+
+class Integer : public ByteRepresentable {
+public:
+    int value;
+    Integer() : value(0) {}
+    Integer(int v) : value(v) {}
+
+    DEFAULT_SERIALIZATION_SUPPORT(Integer, value);
+};
+
+// remove the files of a log, and of its checkpoint log
+static void remove_log(const std::string& name) {
+    for(const std::string& dir : {test_dir, test_dir + "/" + PERS_CHECKPOINT_DIR}) {
+        if(!fs::exists(dir)) {
+            continue;
+        }
+        for(auto& file : fs::directory_iterator(dir)) {
+            if(file.path().filename().string().compare(0, name.size() + 1, name + ".") == 0) {
+                fs::remove(file.path());
+            }
+        }
+    }
+}
+
+static std::unique_ptr<IntegerWithDelta> make_delta() {
+    return std::make_unique<IntegerWithDelta>();
+}
+
+static std::unique_ptr<Integer> make_integer() {
+    return std::make_unique<Integer>();
+}
+
+// set versions first..last of an Integer to ver * 10, at time ver * 10
+static void set_versions(Persistent<Integer>& p, int64_t first, int64_t last) {
+    for(int64_t v = first; v <= last; v++) {
+        Integer i(v * 10);
+        p.set(i, v, HLC{(uint64_t)v * 10, 0});
+    }
+}
+
+// the cache evicts the least recently used version, and a reader keeps its
+// object after eviction
+static void test_version_cache() {
+    cout << "version cache" << endl;
+    VersionCache<Integer> cache(2);
+    CHECK(cache.find(1) == nullptr);
+    cache.insert(1, std::make_shared<Integer>(10), cache.getGeneration());
+    cache.insert(2, std::make_shared<Integer>(20), cache.getGeneration());
+    std::shared_ptr<const Integer> one = cache.find(1);
+    CHECK(one != nullptr && one->value == 10);
+    // 2 is the least recently used
+    cache.insert(3, std::make_shared<Integer>(30), cache.getGeneration());
+    CHECK(cache.find(2) == nullptr);
+    CHECK(cache.find(3) != nullptr);
+    // 1 is the least recently used
+    cache.insert(4, std::make_shared<Integer>(40), cache.getGeneration());
+    CHECK(cache.find(1) == nullptr);
+    CHECK(one->value == 10);
+    // a second insert of a version keeps the first object
+    cache.insert(4, std::make_shared<Integer>(41), cache.getGeneration());
+    CHECK(cache.find(4)->value == 40);
+    CHECK(cache.getHits() == 3);
+    CHECK(cache.getMisses() == 3);
+
+    cache.dropBefore(4);
+    CHECK(cache.find(3) == nullptr);
+    CHECK(cache.find(4) != nullptr);
+    cache.insert(5, std::make_shared<Integer>(50), cache.getGeneration());
+    cache.dropAfter(4);
+    CHECK(cache.find(5) == nullptr);
+    CHECK(cache.find(4) != nullptr);
+    cache.clear();
+    CHECK(cache.find(4) == nullptr);
+
+    // an object read before a truncate is not cached after it
+    const uint64_t generation = cache.getGeneration();
+    cache.dropAfter(3);
+    cache.insert(4, std::make_shared<Integer>(40), generation);
+    CHECK(cache.find(4) == nullptr);
+}
+
+// getCached() deserializes a version once, and does not return versions a
+// trim or a truncate removed
+static void test_get_cached() {
+    cout << "getCached" << endl;
+    remove_log("get_cached");
+    Persistent<Integer> p(make_integer, "get_cached");
+    set_versions(p, 0, 9);
+    std::shared_ptr<const Integer> v3 = p.getCached((int64_t)3);
+    CHECK(v3->value == 30);
+    CHECK(p.getCached((int64_t)3) == v3);
+    CHECK(p.getCached(HLC{35, 0}) == v3);
+    CHECK(p.getVersionCacheMisses() == 1);
+    CHECK(p.getVersionCacheHits() == 2);
+    CHECK(p.getCached(HLC{95, 0})->value == 90);
+
+    // a truncated version written again is read again
+    CHECK(p.getCached((int64_t)8)->value == 80);
+    p.truncate(7);
+    for(int64_t v = 8; v <= 9; v++) {
+        Integer i(v * 100);
+        p.set(i, v, HLC{(uint64_t)v * 10, 0});
+    }
+    CHECK(p.getCached((int64_t)8)->value == 800);
+    CHECK(p.getCached(HLC{95, 0})->value == 900);
+
+    // a trimmed version is gone, even if it is cached
+    p.trim((int64_t)4);
+    bool rejected = false;
+    try {
+        p.getCached((int64_t)3);
+    } catch(persist_exception_t e) {
+        rejected = (e == PERSIST_EXP_INV_VERSION);
+    }
+    CHECK(rejected);
+    CHECK(v3->value == 30);
+    CHECK(p.getCached((int64_t)5)->value == 50);
+}
+
+// reading a delta object in place replays a version once, through the cache
+static void test_delta_get() {
+    cout << "read a delta object in place" << endl;
+    remove_log("delta_get");
+    Persistent<IntegerWithDelta> p(make_delta, "delta_get");
+    for(int64_t v = 0; v < 10; v++) {
+        p->add(1);
+        p.version(v);
+    }
+    auto value = [](const IntegerWithDelta& i) { return i.value; };
+    CHECK(p.get((int64_t)5, value) == 6);
+    CHECK(p.get((int64_t)5, value) == 6);
+    CHECK(p.getVersionCacheMisses() == 1);
+    CHECK(p.getVersionCacheHits() == 1);
+    // a truncated version written again is replayed again
+    p.truncate(4);
+    p->add(10);
+    p.version(5);
+    CHECK(p.get((int64_t)5, value) == 15);
+}
+
+// with checkpointing disabled, trimming a delta log requests the checkpoint
+// of the trim point, which the next persist() writes; the log is trimmed to
+// it by the following trim, and still reads and reloads correctly
+static void test_delta_trim() {
+    cout << "trim a delta log without checkpoints" << endl;
+    remove_log("delta_trim");
+    {
+        Persistent<IntegerWithDelta> p(make_delta, "delta_trim");
+        for(int64_t v = 0; v < 10; v++) {
+            p->add(1);
+            p.version(v);
+        }
+        p.persist();
+        p.trim((int64_t)5);
+        CHECK(p.getEarliestVersion() == 0);
+        p.persist();
+        p.trim((int64_t)5);
+        CHECK(p.getEarliestVersion() == 5);
+        CHECK(p.get((int64_t)5)->value == 6);
+        CHECK(p.get((int64_t)9)->value == 10);
+        // the checkpoint of 5 is kept until the one of 8 is written
+        p.trim((int64_t)8);
+        CHECK(p.getEarliestVersion() == 5);
+        p.persist();
+        p.trim((int64_t)8);
+        CHECK(p.getEarliestVersion() == 8);
+        CHECK(p.get((int64_t)8)->value == 9);
+    }
+    Persistent<IntegerWithDelta> p(make_delta, "delta_trim");
+    CHECK(p->value == 10);
+    CHECK(p.getEarliestVersion() == 8);
+    CHECK(p.get((int64_t)9)->value == 10);
+}
+
+int main(int argc, char** argv) {
+    if(argc > 1) {
+        test_dir = argv[1];
+    }
+    fs::create_directories(test_dir);
+    std::vector<std::string> args = {argv[0],
+                                     "--" CONF_PERS_FILE_PATH "=" + test_dir,
+                                     "--" CONF_PERS_CHECKPOINT_ENTRIES "=0",
+                                     "--" CONF_PERS_CHECKPOINT_BYTES "=0"};
+    std::vector<char*> conf_argv;
+    for(auto& arg : args) {
+        conf_argv.push_back(&arg[0]);
+    }
+    derecho::Conf::initialize(conf_argv.size(), conf_argv.data());
+    try {
+        test_delta_trim();
+        test_version_cache();
+        test_get_cached();
+        test_delta_get();
+    } catch(persist_exception_t exp) {
+        cout << "Exception captured:0x" << std::hex << exp << endl;
+        return -1;
+    }
+    return check_results();
+}
@@ -1,4 +1,5 @@
 #include "HLC.hpp"
+#include "HLCIndex.hpp"
 #include "Persistent.hpp"
 #include "signal.h"
 #include "util.hpp"
@@ -34,14 +35,17 @@ class ReplicatedT {
 
 PersistentRegistry pr(nullptr, typeid(ReplicatedT), 123, 321);
 
+// the maximum length of a VariableBytes value
+#define MAX_VARIABLE_BYTES_SIZE (1UL << 20)
+
 // A variable that can change the length of its value
 class VariableBytes : public ByteRepresentable {
 public:
     std::size_t data_len;
-    char buf[MAX_DATA_SIZE];
+    char buf[MAX_VARIABLE_BYTES_SIZE];
 
     VariableBytes() {
-        data_len = MAX_DATA_SIZE;
+        data_len = MAX_VARIABLE_BYTES_SIZE;
     }
 
     virtual std::size_t to_bytes(char* v) const {
@@ -142,6 +146,8 @@ printhelp() {
     cout << "\tdelta-sub <op> <version>" << endl;
     cout << "\tdelta-getbyidx <index>" << endl;
     cout << "\tdelta-getbyver <version>" << endl;
+    cout << "\tdelta-eval <num> <reads>" << endl;
+    cout << "\thlcidx-eval <num> <searches>" << endl;
     cout << "NOTICE: test can crash if <datasize> is too large(>8MB).\n"
          << "This is probably due to the stack size is limited. Try \n"
          << "  \"ulimit -s unlimited\"\n"
@@ -221,6 +227,71 @@ static void eval_write(std::size_t osize, int nops, bool batch) {
     cout << "latency:\t" << lat_us << " microseconds" << endl;
 }
 
+// evaluate the cost of rebuilding the versions of a delta object
+static void eval_delta_read(int nops, int nreads) {
+    Persistent<IntegerWithDelta> pvar([](){return std::make_unique<IntegerWithDelta>();});
+    struct timespec ts, te;
+    int64_t ver = (pvar.getNumOfVersions() == 0) ? 0 : pvar.getLatestVersion() + 1;
+    for(int i = 0; i < nops; i++) {
+        pvar->add(1);
+        pvar.version(ver++);
+    }
+    pvar.persist();
+
+    // read versions spread evenly over the log
+    const int64_t earliest = pvar.getEarliestIndex();
+    const int64_t nv = pvar.getNumOfVersions();
+    clock_gettime(CLOCK_REALTIME, &ts);
+    for(int i = 0; i < nreads; i++) {
+        pvar.getByIndex(earliest + (nv - 1) * i / std::max(nreads - 1, 1));
+    }
+    clock_gettime(CLOCK_REALTIME, &te);
+    long read_nsec = (te.tv_sec - ts.tv_sec) * 1000000000 + te.tv_nsec - ts.tv_nsec;
+
+    // reloading the object rebuilds the latest version
+    clock_gettime(CLOCK_REALTIME, &ts);
+    pvar.getByIndex(-1L);
+    clock_gettime(CLOCK_REALTIME, &te);
+    long reload_nsec = (te.tv_sec - ts.tv_sec) * 1000000000 + te.tv_nsec - ts.tv_nsec;
+
+    cout << "DELTA READ TEST(versions=" << nv << ", reads=" << nreads
+         << ", checkpoint_entries=" << getPersCheckpointEntries()
+         << ", checkpoint_bytes=" << getPersCheckpointBytes() << ")" << endl;
+    cout << "read latency:\t" << (double)read_nsec / nreads / 1000 << " microseconds" << endl;
+    cout << "reload latency:\t" << (double)reload_nsec / 1000 << " microseconds" << endl;
+}
+
+// evaluate the cost of building and searching the HLC index of a log
+static void eval_hlc_index(int nentries, int nsearches) {
+    HLCIndex hidx;
+    struct timespec ts, te;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    for(int i = 0; i < nentries; i++) {
+        hidx.insert((uint64_t)i * 10, 0, i);
+    }
+    clock_gettime(CLOCK_REALTIME, &te);
+    long insert_nsec = (te.tv_sec - ts.tv_sec) * 1000000000 + te.tv_nsec - ts.tv_nsec;
+
+    // search random clocks, the keys are drawn before the clock starts
+    std::vector<HLC> keys;
+    keys.reserve(nsearches);
+    for(int i = 0; i < nsearches; i++) {
+        keys.emplace_back((uint64_t)rand() % ((uint64_t)nentries * 10), 0);
+    }
+    int64_t sum = 0;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    for(const HLC& key : keys) {
+        sum += hidx.search(key);
+    }
+    clock_gettime(CLOCK_REALTIME, &te);
+    long search_nsec = (te.tv_sec - ts.tv_sec) * 1000000000 + te.tv_nsec - ts.tv_nsec;
+
+    cout << "HLC INDEX TEST(entries=" << nentries << ", searches=" << nsearches << ")" << endl;
+    cout << "insert latency:\t" << (double)insert_nsec / nentries << " nanoseconds" << endl;
+    cout << "search latency:\t" << (double)search_nsec / nsearches << " nanoseconds" << endl;
+    dbg_default_trace("sum of the indexes found={}", sum);
+}
+
 int main(int argc, char** argv) {
     spdlog::set_level(spdlog::level::trace);
 
@@ -432,6 +503,10 @@ int main(int argc, char** argv) {
         } else if (strcmp(argv[1], "delta-getbyver") == 0) {
             int64_t version = std::stoi(argv[1]);
             cout << "dx[idx:" << version << "] = " << dx[version]->value << endl;
+        } else if (strcmp(argv[1], "delta-eval") == 0) {
+            eval_delta_read(atoi(argv[2]), atoi(argv[3]));
+        } else if (strcmp(argv[1], "hlcidx-eval") == 0) {
+            eval_hlc_index(atoi(argv[2]), atoi(argv[3]));
         } else {
             cout << "unknown command: " << argv[1] << endl;
             printhelp();
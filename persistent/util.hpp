@@ -5,10 +5,12 @@
 #include "conf/conf.hpp"
 #include <errno.h>
 #include <fcntl.h>
+#include <sstream>
 #include <string>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <vector>
 
 #define MAX(a, b) \
     ({ __typeof__ (a) _a = (a); \
@@ -37,6 +39,58 @@ inline std::string getPersFilePath() {
     return std::string(derecho::getConfString(CONF_PERS_FILE_PATH));
 }
 
+// the folder of the logs of a subgroup: the (subgroup_id mod n)-th of the n
+// folders in PERS/file_paths, or PERS/file_path if it is empty.
+inline std::string getPersFilePath(const uint32_t subgroup_id) {
+    const std::string& paths = derecho::getConfString(CONF_PERS_FILE_PATHS);
+    std::vector<std::string> path_list;
+    std::stringstream paths_ss(paths);
+    std::string path;
+    while(std::getline(paths_ss, path, ',')) {
+        path.erase(0, path.find_first_not_of(" \t"));
+        path.erase(path.find_last_not_of(" \t") + 1);
+        if(!path.empty()) {
+            path_list.push_back(path);
+        }
+    }
+    if(path_list.empty()) {
+        return getPersFilePath();
+    }
+    return path_list[subgroup_id % path_list.size()];
+}
+
+// the log backend of ST_FILE: "mmap" or "direct"
+#define PERS_BACKEND_MMAP "mmap"
+#define PERS_BACKEND_DIRECT "direct"
+inline bool usePersDirectBackend() {
+    return derecho::getConfString(CONF_PERS_BACKEND) == PERS_BACKEND_DIRECT;
+}
+
+// the checkpoints of IDeltaSupport objects are kept in a subfolder of the
+// persistent folder, away from the logs scanned by
+// getMinimumLatestPersistedVersion()
+#define PERS_CHECKPOINT_DIR "checkpoint"
+inline uint64_t getPersCheckpointEntries() {
+    return derecho::getConfUInt64(CONF_PERS_CHECKPOINT_ENTRIES);
+}
+
+inline uint64_t getPersCheckpointBytes() {
+    return derecho::getConfUInt64(CONF_PERS_CHECKPOINT_BYTES);
+}
+
+// the segment sizes of new FilePersistLogs
+inline uint64_t getPersLogSegmentEntries() {
+    return derecho::getConfUInt64(CONF_PERS_LOG_SEGMENT_ENTRIES);
+}
+
+inline uint64_t getPersDataSegmentSize() {
+    return derecho::getConfUInt64(CONF_PERS_DATA_SEGMENT_SIZE);
+}
+
+inline uint64_t getPersVersionCacheSize() {
+    return derecho::getConfUInt64(CONF_PERS_VERSION_CACHE_SIZE);
+}
+
 // verify the existence of a folder
 // Check if directory exists or not. Create it on absence.
 // return error if creating failed
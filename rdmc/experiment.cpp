@@ -163,6 +163,101 @@ send_stats measure_multicast(size_t size, size_t block_size,
                                                   1, iterations, type, use_cv);
 }
 
+// Node 0 sends a stream of num_messages messages, keeping up to send_depth of
+// them in the group at once. One iteration times the whole stream.
+send_stats measure_streaming_multicast(size_t size, size_t block_size,
+                                       uint32_t group_size, size_t num_messages,
+                                       size_t send_depth, size_t iterations,
+                                       rdmc::send_algorithm type = rdmc::BINOMIAL_SEND) {
+    if(node_rank >= group_size) {
+        // Each iteration involves two barriers: one at the start and one at the
+        // end.
+        for(size_t i = 0; i < iterations * 2; i++) {
+            universal_barrier_group->barrier_wait();
+        }
+
+        return send_stats();
+    }
+
+    atomic<uint64_t> end_time;
+    atomic<uint64_t> end_ptime;
+    atomic<size_t> messages_completed;
+
+    size_t num_blocks = (size - 1) / block_size + 1;
+    auto mr = make_shared<memory_region>(num_blocks * block_size);
+
+    uint16_t group_number = next_group_number;
+    vector<uint32_t> members;
+    for(uint32_t j = 0; j < group_size; j++) {
+        members.push_back(j);
+    }
+    CHECK(rdmc::create_group(
+            group_number, members, block_size, type,
+            [&mr](size_t length) -> rdmc::receive_destination {
+                return {mr, 0};
+            },
+            [&](char *data, size_t) {
+                if(++messages_completed == num_messages) {
+                    universal_barrier_group->barrier_wait();
+                    end_ptime = get_process_time();
+                    end_time = get_time();
+                }
+            },
+            [group_number](std::optional<uint32_t>) {
+                LOG_EVENT(group_number, -1, -1, "send_failed");
+                CHECK(false);
+            },
+            send_depth));
+
+    vector<double> rates;
+    vector<double> times;
+    vector<double> cpu_usages;
+
+    for(size_t i = 0; i < iterations; i++) {
+        messages_completed = 0;
+        end_time = 0;
+        end_ptime = 0;
+
+        universal_barrier_group->barrier_wait();
+
+        uint64_t start_ptime = get_process_time();
+        uint64_t start_time = get_time();
+
+        if(node_rank == 0) {
+            for(size_t m = 0; m < num_messages; m++) {
+                while(m - messages_completed >= send_depth)
+                    /* do nothing */;
+                CHECK(rdmc::send(group_number, mr, 0, size));
+            }
+        }
+
+        while(end_time == 0)
+            /* do nothing*/;
+
+        uint64_t time_diff = end_time - start_time;
+        uint64_t ptime_diff = end_ptime - start_ptime;
+        rates.push_back(8.0 * size * num_messages / time_diff);
+        times.push_back(1.0e-6 * time_diff);
+        cpu_usages.push_back((double)ptime_diff / time_diff);
+    }
+
+    rdmc::destroy_group(group_number);
+
+    send_stats s;
+    s.size = size;
+    s.block_size = block_size;
+    s.group_size = group_size;
+    s.iterations = iterations;
+
+    s.time.mean = compute_mean(times);
+    s.time.stddev = compute_stddev(times);
+    s.bandwidth.mean = compute_mean(rates);
+    s.bandwidth.stddev = compute_stddev(rates);
+    s.cpu_usage.mean = compute_mean(cpu_usages);
+    s.cpu_usage.stddev = compute_stddev(cpu_usages);
+    return s;
+}
+
 void blocksize_v_bandwidth(uint16_t gsize) {
     const size_t min_block_size = 16ull << 10;
     const size_t max_block_size = 16ull << 20;
@@ -388,6 +483,37 @@ void active_senders(bool interrupts = false, bool labels = true) {
         }
     }
 }
+void send_depth_bandwidth() {
+    puts("=========================================================");
+    puts("=          Streaming Bandwidth vs. Send Depth           =");
+    puts("=========================================================");
+    puts("Message Size, Group Size, Binomial (depth 1), Binomial (depth 4), "
+         "Chain (depth 1), Chain (depth 4)");
+    fflush(stdout);
+
+    const size_t num_messages = 256;
+    const size_t iterations = 16;
+    for(size_t size : {64ull << 10, 256ull << 10, 1ull << 20}) {
+        // a handful of blocks per message, so that the schedule pipelines
+        const size_t block_size = size / 4;
+        for(uint32_t gsize = 2; gsize <= num_nodes; gsize *= 2) {
+            printf("%d KB, %d, ", (int)(size >> 10), (int)gsize);
+            for(auto type : {rdmc::BINOMIAL_SEND, rdmc::CHAIN_SEND}) {
+                for(size_t depth : {1, 4}) {
+                    auto s = measure_streaming_multicast(size, block_size, gsize,
+                                                         num_messages, depth,
+                                                         iterations, type);
+                    printf("%f, ", s.bandwidth.mean);
+                    fflush(stdout);
+                }
+            }
+            puts("");
+            fflush(stdout);
+        }
+    }
+    puts("");
+    fflush(stdout);
+}
 void latency_group_size() {
     puts("=========================================================");
     puts("=               Latency vs. Group Size                  =");
@@ -731,6 +857,8 @@ int main(int argc, char *argv[]) {
         latency_group_size();
     } else if(strcmp(argv[1], "smallsend") == 0) {
         // small_send_latency_group_size();
+    } else if(strcmp(argv[1], "send_depth") == 0) {
+        send_depth_bandwidth();
     } else if(strcmp(argv[1], "concurrent") == 0) {
         concurrent_bandwidth_group_size();
     } else if(strcmp(argv[1], "active_senders") == 0) {
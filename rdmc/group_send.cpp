@@ -26,12 +26,14 @@ group::group(uint16_t _group_number, size_t _block_size,
              vector<uint32_t> _members, uint32_t _member_index,
              incoming_message_callback_t upcall,
              completion_callback_t callback,
-             unique_ptr<schedule> _schedule)
+             unique_ptr<schedule> _schedule,
+             size_t _send_depth)
         : members(_members),
           group_number(_group_number),
           block_size(_block_size),
           num_members(members.size()),
           member_index(_member_index),
+          send_depth(_send_depth),
           transfer_schedule(std::move(_schedule)),
           completion_callback(callback),
           incoming_message_upcall(upcall) {}
@@ -71,9 +73,10 @@ polling_group::polling_group(uint16_t _group_number, size_t _block_size,
                              vector<uint32_t> _members, uint32_t _member_index,
                              incoming_message_callback_t upcall,
                              completion_callback_t callback,
-                             unique_ptr<schedule> _schedule)
+                             unique_ptr<schedule> _schedule,
+                             size_t _send_depth)
         : group(_group_number, _block_size, _members, _member_index, upcall,
-                callback, std::move(_schedule)),
+                callback, std::move(_schedule), _send_depth),
           first_block_buffer(nullptr) {
     if(member_index != 0) {
         first_block_buffer = unique_ptr<char[]>(new char[block_size]);
@@ -278,17 +281,28 @@ void polling_group::send_message(shared_ptr<memory_region> message_mr, size_t of
     if(length == 0) throw rdmc::invalid_args();
     if(offset + length > message_mr->size) throw rdmc::invalid_args();
     if(member_index > 0) throw rdmc::nonroot_sender();
+    if((length - 1) / block_size + 1 > std::numeric_limits<uint16_t>::max())
+        throw rdmc::invalid_args();
 
-    // Queueing sends is not supported
-    if(receive_step > 0) throw rdmc::group_busy();
-    if(send_step > 0) throw rdmc::group_busy();
+    // A message is in progress until its last block has been sent, even if
+    // no receiver has been ready for its first block yet. Later messages
+    // wait in queued_sends, and complete_message starts the next one.
+    if(mr) {
+        if(queued_sends.size() + 1 >= send_depth) throw rdmc::group_busy();
+        queued_sends.push_back({message_mr, offset, length});
+        LOG_EVENT(group_number, message_number + queued_sends.size(), -1,
+                  "queued_message");
+        return;
+    }
 
+    start_message(message_mr, offset, length);
+}
+void polling_group::start_message(shared_ptr<memory_region> message_mr,
+                                  size_t offset, size_t length) {
     mr = message_mr;
     mr_offset = offset;
     message_size = length;
     num_blocks = (message_size - 1) / block_size + 1;
-    if(num_blocks > std::numeric_limits<uint16_t>::max())
-        throw rdmc::invalid_args();
     // printf("message_size = %lu, block_size = %lu, num_blocks = %lu\n",
     //        message_size, block_size, num_blocks);
     LOG_EVENT(group_number, message_number, -1, "send_message");
@@ -376,13 +390,17 @@ void polling_group::complete_message() {
         LOG_EVENT(group_number, message_number, *first_block_number,
                   "finished_remap_first_block");
     }
-    completion_callback(mr->buffer + mr_offset, message_size);
+    // Move on to the next message before the completion callback runs, so
+    // that its first block can be on its way while the callback handles
+    // this one.
+    shared_ptr<memory_region> completed_mr = std::move(mr);
+    char* completed_buffer = completed_mr->buffer + mr_offset;
+    size_t completed_size = message_size;
 
     ++message_number;
     sending = false;
     send_step = 0;
     receive_step = 0;
-    mr.reset();
     // if(first_block_buffer == nullptr && member_index > 0){
     //     first_block_buffer = (char*)mmap(NULL, block_size,
     // PROT_READ|PROT_WRITE,
@@ -404,7 +422,13 @@ void polling_group::complete_message() {
         // cout << "Issued Ready For Block DDDDDDD (target = " <<
         // transfer->target
         //      << ")" << endl;
+    } else if(!queued_sends.empty()) {
+        queued_message next = std::move(queued_sends.front());
+        queued_sends.pop_front();
+        start_message(std::move(next.mr), next.offset, next.length);
     }
+
+    completion_callback(completed_buffer, completed_size);
 }
 void polling_group::post_recv(schedule::block_transfer transfer) {
 #ifdef USE_VERBS_API
@@ -11,6 +11,7 @@
     #include "lf_helper.h"
 #endif
 
+#include <deque>
 #include <optional>
 #include <map>
 #include <memory>
@@ -32,6 +33,9 @@ protected:
     const size_t block_size;
     const uint32_t num_members;
     const uint32_t member_index;  // our index in the members list
+    // maximum number of messages the sender may have in the group at once:
+    // the one being sent and the ones queued behind it
+    const size_t send_depth;
 
     const unique_ptr<schedule> transfer_schedule;
 
@@ -49,7 +53,8 @@ protected:
           vector<uint32_t> members, uint32_t member_index,
           incoming_message_callback_t upcall,
           completion_callback_t callback,
-          unique_ptr<schedule> transfer_schedule);
+          unique_ptr<schedule> transfer_schedule,
+          size_t send_depth);
 
 public:
     virtual ~group();
@@ -74,6 +79,15 @@ private:
     size_t incoming_block;
     size_t message_number = 0;
 
+    // A message handed to send_message while another one is being sent
+    struct queued_message {
+        std::shared_ptr<rdma::memory_region> mr;
+        size_t offset;
+        size_t length;
+    };
+    // Messages waiting to be sent after the current one, in order
+    std::deque<queued_message> queued_sends;
+
     size_t outgoing_block;
     bool sending = false;  // Whether a block send is in progress
     size_t send_step = 0;  // Number of blocks sent/stalls so far
@@ -104,7 +118,8 @@ public:
                   vector<uint32_t> members, uint32_t member_index,
                   incoming_message_callback_t upcall,
                   completion_callback_t callback,
-                  unique_ptr<schedule> transfer_schedule);
+                  unique_ptr<schedule> transfer_schedule,
+                  size_t send_depth);
 
     virtual void receive_block(uint32_t send_imm, size_t size);
     virtual void receive_ready_for_block(uint32_t step, uint32_t sender);
@@ -115,6 +130,8 @@ public:
 
 private:
     void post_recv(schedule::block_transfer transfer);
+    void start_message(std::shared_ptr<rdma::memory_region> message_mr,
+                       size_t offset, size_t length);
     void send_next_block();
     void complete_message();
     void prepare_for_next_message();
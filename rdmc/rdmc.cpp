@@ -61,8 +61,9 @@ bool create_group(uint16_t group_number, std::vector<uint32_t> members,
                   size_t block_size, send_algorithm algorithm,
                   incoming_message_callback_t incoming_upcall,
                   completion_callback_t callback,
-                  failure_callback_t failure_callback) {
-    if(shutdown_flag) return false;
+                  failure_callback_t failure_callback,
+                  size_t send_depth) {
+    if(shutdown_flag || send_depth == 0) return false;
 
     schedule* send_schedule;
     uint32_t member_index = index_of(members, node_rank);
@@ -83,7 +84,8 @@ bool create_group(uint16_t group_number, std::vector<uint32_t> members,
     unique_lock<mutex> lock(groups_lock);
     auto g = make_shared<polling_group>(group_number, block_size, members,
                                         member_index, incoming_upcall, callback,
-                                        unique_ptr<schedule>(send_schedule));
+                                        unique_ptr<schedule>(send_schedule),
+                                        send_depth);
     auto p = groups.emplace(group_number, std::move(g));
     return p.second;
 }
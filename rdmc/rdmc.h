@@ -63,16 +63,25 @@ void shutdown();
  * message in this group
  * @param failure_callback The function to call when RDMC detects a failure in
  * this group. It will be called with the suspected failed node's ID.
+ * @param send_depth The number of messages the sender may hand to send() before
+ * the first of them completes. Messages after the first are queued and sent in
+ * order, each starting as soon as the previous one has left the sender.
  * @return True if group creation succeeds, false if it fails.
  */
 bool create_group(uint16_t group_number, std::vector<uint32_t> members,
                   size_t block_size, send_algorithm algorithm,
                   incoming_message_callback_t incoming_receive,
                   completion_callback_t send_callback,
-                  failure_callback_t failure_callback)
+                  failure_callback_t failure_callback,
+                  size_t send_depth = 1)
         __attribute__((warn_unused_result));
 void destroy_group(uint16_t group_number);
 
+/**
+ * Sends a message in a group this node is the sender of. If the group is
+ * already sending a message, the new one is queued behind it, and group_busy
+ * is thrown if that would exceed the group's send_depth.
+ */
 bool send(uint16_t group_number, std::shared_ptr<rdma::memory_region> mr,
           size_t offset, size_t length) __attribute__((warn_unused_result));
 
@@ -385,7 +385,8 @@ namespace sst{
     const long long int offset,
     const long long int size,
     const int op,
-    const bool completion) {
+    const bool completion,
+    const bool more) {
     // dbg_default_trace("resources::post_remote_send(),this={}",(void*)this);
     // #ifdef !NDEBUG
     // printf(YEL "resources::post_remote_send(),this=%p\n" RESET, this);
@@ -439,7 +440,7 @@ namespace sst{
       // dbg_default_flush();
   
       if(op == 1) { //write
-        FAIL_IF_NONZERO_RETRY_EAGAIN(ret = fi_writemsg(this->ep,&msg,(completion)?FI_COMPLETION:0),
+        FAIL_IF_NONZERO_RETRY_EAGAIN(ret = fi_writemsg(this->ep,&msg,((completion)?FI_COMPLETION:0)|((more)?FI_MORE:0)),
           "fi_writemsg failed.",
           REPORT_ON_FAILURE);
       } else { // read op==0
@@ -481,6 +482,12 @@ namespace sst{
     FAIL_IF_NONZERO_RETRY_EAGAIN(post_remote_send(ctxt,offset,size,1,true),"post_remote_write(4) failed.",REPORT_ON_FAILURE);
   }
 
+  void resources::post_remote_writes(const std::vector<std::pair<long long int, long long int>>& ranges){
+    for(size_t i = 0; i < ranges.size(); ++i) {
+      FAIL_IF_NONZERO_RETRY_EAGAIN(post_remote_send(NULL,ranges[i].first,ranges[i].second,1,false,i + 1 < ranges.size()),"post_remote_writes failed.",REPORT_ON_FAILURE);
+    }
+  }
+
 
   /**
    * @param size The number of bytes to write from the local buffer to remote
@@ -10,6 +10,8 @@
 #include <map>
 #include <rdma/fabric.h>
 #include <thread>
+#include <utility>
+#include <vector>
 
 #include "derecho/derecho_type_definitions.h"
 
@@ -53,10 +55,12 @@ protected:
      * @param offset - The offset within the remote buffer to read/write
      * @param size - The number of bytes to read/write
      * @param op - 0 for read and 1 for write
+     * @param more - true if the caller will post another operation right
+     *     after this one, which lets the provider batch them (FI_MORE)
      * @param return the return code for operation.
      */
     int post_remote_send(struct lf_sender_ctxt* ctxt, const long long int offset, const long long int size,
-                         const int op, const bool completion);
+                         const int op, const bool completion, const bool more = false);
 
 public:
     /** ID of the remote node. */
@@ -135,6 +139,12 @@ public:
     void post_remote_write_with_completion(struct lf_sender_ctxt* ctxt, const long long int size);
     /** Post an RDMA write at an offset into remote memory. */
     void post_remote_write_with_completion(struct lf_sender_ctxt* ctxt, const long long int offset, const long long int size);
+    /**
+     * Post a chain of RDMA writes, one per (offset, size) pair. All but the
+     * last are posted with FI_MORE, so the provider can hand them to the NIC
+     * together.
+     */
+    void post_remote_writes(const std::vector<std::pair<long long int, long long int>>& ranges);
 };
 
 /**
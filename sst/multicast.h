@@ -47,7 +47,11 @@ class multicast_group {
     uint32_t num_senders;
     // window size
     const uint32_t window_size;
-    // maximum size that the SST can send
+    // size of a slot: the maximum message size plus the size and next_seq words.
+    // A slot is laid out as [size | message | next_seq], with the size first so
+    // that it and the message can be written with one RDMA write of only the
+    // bytes in use. next_seq is written separately after it, and tells the
+    // receivers that the slot is complete.
     const uint64_t max_msg_size;
 
     std::thread timeout_thread;
@@ -58,7 +62,7 @@ class multicast_group {
                 sst->num_received_sst[i][j] = -1;
             }
             for(uint j = slots_offset; j < slots_offset + window_size; ++j) {
-                sst->slots[i][max_msg_size * j] = 0;
+                (uint64_t&)sst->slots[i][max_msg_size * j] = 0;
                 (uint64_t&)sst->slots[i][max_msg_size * (j + 1) - sizeof(uint64_t)] = 0;
             }
         }
@@ -114,14 +118,14 @@ public:
     volatile char* get_buffer(uint64_t msg_size) {
         assert(my_sender_index >= 0);
         std::lock_guard<std::mutex> lock(msg_send_mutex);
-        assert(msg_size <= max_msg_size);
+        assert(msg_size <= max_msg_size - 2 * sizeof(uint64_t));
         while(true) {
             if(queued_num - finished_multicasts_num < window_size) {
                 queued_num++;
                 uint32_t slot = queued_num % window_size;
                 // set size appropriately
-                (uint64_t&)sst->slots[my_row][max_msg_size * (slots_offset + slot + 1) - 2 * sizeof(uint64_t)] = msg_size;
-                return &sst->slots[my_row][max_msg_size * (slots_offset + slot)];
+                (uint64_t&)sst->slots[my_row][max_msg_size * (slots_offset + slot)] = msg_size;
+                return &sst->slots[my_row][max_msg_size * (slots_offset + slot) + sizeof(uint64_t)];
             } else {
                 long long int min_multicast_num = sst->num_received_sst[my_row][num_received_offset + my_sender_index];
                 for(auto i : row_indices) {
@@ -142,12 +146,13 @@ public:
         uint32_t slot = num_sent % window_size;
         num_sent++;
         ((uint64_t&)sst->slots[my_row][max_msg_size * (slots_offset + slot + 1) - sizeof(uint64_t)])++;
-        sst->put(
-                (char*)std::addressof(sst->slots[0][max_msg_size * (slots_offset + slot)]) - sst->getBaseAddress(),
-                max_msg_size - sizeof(uint64_t));
-        sst->put(
-                (char*)std::addressof(sst->slots[0][max_msg_size * (slots_offset + slot)]) - sst->getBaseAddress() + max_msg_size - sizeof(uint64_t),
-                sizeof(uint64_t));
+        const uint64_t msg_size = (uint64_t&)sst->slots[my_row][max_msg_size * (slots_offset + slot)];
+        const long long int slot_start = (char*)std::addressof(sst->slots[0][max_msg_size * (slots_offset + slot)]) - sst->getBaseAddress();
+        // write only the size and the message, and only to the rows of this group,
+        // then next_seq. Both writes go on the same connection, so next_seq
+        // cannot arrive before the message it announces.
+        sst->put(row_indices, slot_start, sizeof(uint64_t) + msg_size);
+        sst->put(row_indices, slot_start + max_msg_size - sizeof(uint64_t), sizeof(uint64_t));
     }
 
     void debug_print() {
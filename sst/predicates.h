@@ -1,10 +1,15 @@
 #pragma once
 
 #include <algorithm>
+#include <cassert>
+#include <cstdint>
 #include <functional>
 #include <list>
+#include <memory>
 #include <mutex>
+#include <thread>
 #include <utility>
+#include <vector>
 
 #include "sst.h"
 
@@ -25,44 +30,136 @@ enum class PredicateType {
     TRANSITION
 };
 
+/** Counters kept by the detector thread for each registered predicate. */
+struct PredicateCounters {
+    /** The number of times the predicate was evaluated. */
+    uint64_t num_evaluations = 0;
+    /** The number of times the predicate's trigger ran. */
+    uint64_t num_fired = 0;
+    /** Total time, in nanoseconds, spent running the trigger. */
+    uint64_t trigger_time_ns = 0;
+    /** The number of times the trigger ran on the first pass after the
+     * detector thread had parked. */
+    uint64_t num_wakeups = 0;
+    /** Sum of the wake-up latencies of those firings: the time the detector
+     * had been parked, which bounds how late the predicate was noticed. */
+    uint64_t total_wakeup_latency_ns = 0;
+    /** The largest single wake-up latency observed. */
+    uint64_t max_wakeup_latency_ns = 0;
+};
+
+/** Counters describing how a detector thread spent its idle time. */
+struct DetectorCounters {
+    /** The number of evaluation passes over the predicate lists. */
+    uint64_t num_passes = 0;
+    /** The number of passes in which no predicate fired. */
+    uint64_t num_idle_passes = 0;
+    /** The number of times the thread yielded the CPU while idle. */
+    uint64_t num_yields = 0;
+    /** The number of times the thread parked (slept) while idle. */
+    uint64_t num_parks = 0;
+    /** Total time, in nanoseconds, spent parked. */
+    uint64_t parked_time_ns = 0;
+    /** CPU time, in nanoseconds, consumed by the thread so far. */
+    uint64_t cpu_time_ns = 0;
+};
+
+/**
+ * True while the calling thread is running an SST trigger. Shared by all SST
+ * types, so that a trigger of one SST that removes predicates of another can
+ * be recognized.
+ */
+inline bool& running_trigger() {
+    static thread_local bool in_trigger = false;
+    return in_trigger;
+}
+
 template <class DerivedSST>
 class Predicates {
     using pred = std::function<bool(const DerivedSST&)>;
     using trig = std::function<void(DerivedSST&)>;
-    using pred_list = std::list<std::unique_ptr<std::pair<pred, std::shared_ptr<trig>>>>;
-    /** Predicate list for one-time predicates. */
-    pred_list one_time_predicates;
-    /** Predicate list for recurrent predicates */
-    pred_list recurrent_predicates;
-    /** Predicate list for transition predicates */
-    pred_list transition_predicates;
-    /** Contains one entry for every predicate in `transition_predicates`, in parallel. */
-    std::list<bool> transition_predicate_states;
+    /** A registered predicate, its trigger, and its counters. */
+    struct pred_entry {
+        pred predicate;
+        std::shared_ptr<trig> trigger;
+        PredicateCounters counters;
+    };
+    using pred_list = std::list<std::unique_ptr<pred_entry>>;
+    /**
+     * The set of predicates evaluated by a single detector thread. Each
+     * evaluation group has its own lists and its own lock, so predicates in
+     * different groups never wait for each other.
+     */
+    struct evaluation_group {
+        /** Predicate list for one-time predicates. */
+        pred_list one_time_predicates;
+        /** Predicate list for recurrent predicates */
+        pred_list recurrent_predicates;
+        /** Predicate list for transition predicates */
+        pred_list transition_predicates;
+        /** Contains one entry for every predicate in `transition_predicates`, in parallel. */
+        std::list<bool> transition_predicate_states;
+        /** Protects the predicate lists of this group. */
+        std::mutex predicate_mutex;
+        /** Held by the detector thread while it runs one of this group's triggers. */
+        std::mutex trigger_mutex;
+        /** Idle-time counters of the detector thread, protected by predicate_mutex. */
+        DetectorCounters detector_counters;
+    };
+    /** One evaluation group per detector thread; never resized after construction. */
+    std::vector<std::unique_ptr<evaluation_group>> evaluation_groups;
     // SST needs to read these predicate lists directly
     friend class SST<DerivedSST>;
 
-    std::mutex predicate_mutex;
+    /**
+     * Blocks until the given group is not running a trigger, unless the caller
+     * is itself running a trigger, of this or of any other SST. Such a caller
+     * (e.g. wedge() called from a GMS trigger) could be waited on by the
+     * trigger it would wait for, so it does not block: the removed entry can
+     * no longer fire, and a trigger of it that is already running is left to
+     * finish on its owning detector thread.
+     */
+    void wait_for_trigger_completion(evaluation_group& group) {
+        if(!running_trigger()) {
+            std::lock_guard<std::mutex> trigger_lock(group.trigger_mutex);
+        }
+    }
 
 public:
+    /**
+     * Constructs an empty predicate container.
+     * @param num_evaluation_groups The number of independent evaluation
+     * groups, which is also the number of detector threads the owning SST
+     * will run. Must be at least 1.
+     */
+    Predicates(uint32_t num_evaluation_groups = 1) {
+        assert(num_evaluation_groups >= 1);
+        for(uint32_t i = 0; i < num_evaluation_groups; ++i) {
+            evaluation_groups.emplace_back(std::make_unique<evaluation_group>());
+        }
+    }
+
     class pred_handle {
         bool valid;
         typename pred_list::iterator iter;
         PredicateType type;
+        uint32_t group;
         friend class Predicates;
 
     public:
-        pred_handle() : valid(false), type(PredicateType::ONE_TIME) {}
-        pred_handle(typename pred_list::iterator iter, PredicateType type)
-                : valid{true}, iter{iter}, type{type} {}
+        pred_handle() : valid(false), type(PredicateType::ONE_TIME), group(0) {}
+        pred_handle(typename pred_list::iterator iter, PredicateType type, uint32_t group)
+                : valid{true}, iter{iter}, type{type}, group{group} {}
         pred_handle(pred_handle&) = delete;
         pred_handle(pred_handle&& other)
-                : pred_handle(std::move(other.iter), other.type) {
+                : pred_handle(std::move(other.iter), other.type, other.group) {
             other.valid = false;
         }
         pred_handle& operator=(pred_handle&) = delete;
         pred_handle& operator=(pred_handle&& other) {
             iter = std::move(other.iter);
             type = other.type;
+            group = other.group;
             valid = true;
             other.valid = false;
             return *this;
@@ -74,17 +171,19 @@ public:
 
     /** Inserts a single (predicate, trigger) pair to the appropriate predicate list. */
     pred_handle insert(pred predicate, trig trigger,
-                       PredicateType type = PredicateType::ONE_TIME);
+                       PredicateType type = PredicateType::ONE_TIME,
+                       uint32_t affinity = 0);
 
     /** Inserts a predicate with a list of triggers (which will be run in
      * sequence) to the appropriate predicate list. */
     pred_handle insert(pred predicate, const std::list<trig>& triggers,
-                       PredicateType type = PredicateType::ONE_TIME) {
+                       PredicateType type = PredicateType::ONE_TIME,
+                       uint32_t affinity = 0) {
         return insert(predicate, [triggers](DerivedSST& t) {
             for(const auto& trigger : triggers)
                 trigger(t);
         },
-                      type);
+                      type, affinity);
     }
 
     /** Removes a (predicate, trigger) pair previously registered with insert(). */
@@ -92,6 +191,15 @@ public:
 
     /** Deletes all predicates, including evolvers and their triggers. */
     void clear();
+
+    /** Returns the number of evaluation groups (and hence detector threads). */
+    uint32_t num_evaluation_groups() const { return evaluation_groups.size(); }
+
+    /**
+     * Returns a snapshot of the counters of a registered predicate, or
+     * all-zero counters if the handle is no longer valid.
+     */
+    PredicateCounters get_counters(const pred_handle& handle);
 };
 
 /**
@@ -103,46 +211,77 @@ public:
  * @param trigger The trigger to execute when the predicate is true.
  * @param type The type of predicate being inserted; default is
  * PredicateType::ONE_TIME
+ * @param affinity A hint that selects the evaluation group (detector thread)
+ * this predicate will run on; predicates with the same affinity are always
+ * evaluated by the same thread, in insertion order. Default is 0.
  */
 template <class DerivedSST>
-auto Predicates<DerivedSST>::insert(pred predicate, trig trigger, PredicateType type) -> pred_handle {
-    std::lock_guard<std::mutex> lock(predicate_mutex);
+auto Predicates<DerivedSST>::insert(pred predicate, trig trigger, PredicateType type,
+                                    uint32_t affinity) -> pred_handle {
+    const uint32_t group_index = affinity % evaluation_groups.size();
+    evaluation_group& group = *evaluation_groups[group_index];
+    std::lock_guard<std::mutex> lock(group.predicate_mutex);
     if(type == PredicateType::ONE_TIME) {
-        one_time_predicates.push_back(std::make_unique<std::pair<pred, std::shared_ptr<trig>>>(
-                predicate, std::make_shared<trig>(trigger)));
-        return pred_handle(--one_time_predicates.end(), type);
+        group.one_time_predicates.push_back(std::make_unique<pred_entry>(
+                pred_entry{predicate, std::make_shared<trig>(trigger), {}}));
+        return pred_handle(--group.one_time_predicates.end(), type, group_index);
     } else if(type == PredicateType::RECURRENT) {
-        recurrent_predicates.push_back(std::make_unique<std::pair<pred, std::shared_ptr<trig>>>(
-                predicate, std::make_shared<trig>(trigger)));
-        return pred_handle(--recurrent_predicates.end(), type);
+        group.recurrent_predicates.push_back(std::make_unique<pred_entry>(
+                pred_entry{predicate, std::make_shared<trig>(trigger), {}}));
+        return pred_handle(--group.recurrent_predicates.end(), type, group_index);
     } else {
-        transition_predicates.push_back(std::make_unique<std::pair<pred, std::shared_ptr<trig>>>(
-                predicate, std::make_shared<trig>(trigger)));
-        transition_predicate_states.push_back(false);
-        return pred_handle(--transition_predicates.end(), type);
+        group.transition_predicates.push_back(std::make_unique<pred_entry>(
+                pred_entry{predicate, std::make_shared<trig>(trigger), {}}));
+        group.transition_predicate_states.push_back(false);
+        return pred_handle(--group.transition_predicates.end(), type, group_index);
     }
 }
 
+/**
+ * Removes a predicate. If the predicate's detector thread is currently running
+ * a trigger, this waits for that trigger to finish, so that once remove()
+ * returns no trigger of the removed predicate can still be executing. When
+ * called from inside a trigger it does not wait; the running trigger, if any,
+ * completes on the detector thread that owns the predicate.
+ */
 template <class DerivedSST>
 void Predicates<DerivedSST>::remove(pred_handle& handle) {
-    std::lock_guard<std::mutex> lock(predicate_mutex);
-    if(!handle.is_valid()) {
-        return;
+    evaluation_group& group = *evaluation_groups[handle.group];
+    {
+        std::lock_guard<std::mutex> lock(group.predicate_mutex);
+        if(!handle.is_valid()) {
+            return;
+        }
+        handle.iter->reset();
+        handle.valid = false;
     }
-    handle.iter->reset();
-    handle.valid = false;
+    wait_for_trigger_completion(group);
 }
 
 template <class DerivedSST>
 void Predicates<DerivedSST>::clear() {
-    std::lock_guard<std::mutex> lock(predicate_mutex);
-    using ptr_to_pred = std::unique_ptr<std::pair<pred, std::shared_ptr<trig>>>;
-    std::for_each(one_time_predicates.begin(), one_time_predicates.end(),
-                  [](ptr_to_pred& ptr) { ptr.reset(); });
-    std::for_each(recurrent_predicates.begin(), recurrent_predicates.end(),
-                  [](ptr_to_pred& ptr) { ptr.reset(); });
-    std::for_each(transition_predicates.begin(), transition_predicates.end(),
-                  [](ptr_to_pred& ptr) { ptr.reset(); });
+    using ptr_to_pred = std::unique_ptr<pred_entry>;
+    for(auto& group_ptr : evaluation_groups) {
+        {
+            std::lock_guard<std::mutex> lock(group_ptr->predicate_mutex);
+            std::for_each(group_ptr->one_time_predicates.begin(), group_ptr->one_time_predicates.end(),
+                          [](ptr_to_pred& ptr) { ptr.reset(); });
+            std::for_each(group_ptr->recurrent_predicates.begin(), group_ptr->recurrent_predicates.end(),
+                          [](ptr_to_pred& ptr) { ptr.reset(); });
+            std::for_each(group_ptr->transition_predicates.begin(), group_ptr->transition_predicates.end(),
+                          [](ptr_to_pred& ptr) { ptr.reset(); });
+        }
+        wait_for_trigger_completion(*group_ptr);
+    }
+}
+
+template <class DerivedSST>
+PredicateCounters Predicates<DerivedSST>::get_counters(const pred_handle& handle) {
+    std::lock_guard<std::mutex> lock(evaluation_groups[handle.group]->predicate_mutex);
+    if(!handle.is_valid()) {
+        return {};
+    }
+    return (*handle.iter)->counters;
 }
 
 } /* namespace sst */
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <atomic>
 #include <bitset>
 #include <cassert>
@@ -7,6 +8,7 @@
 #include <functional>
 #include <iostream>
 #include <list>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <numeric>
@@ -14,6 +16,7 @@
 #include <string.h>
 #include <string>
 #include <thread>
+#include <utility>
 #include <vector>
 
 #include "predicates.h"
@@ -119,6 +122,31 @@ public:
 
 typedef std::function<void(uint32_t)> failure_upcall_t;
 
+/** Counters describing how well deferred puts were combined by flush(). */
+struct WriteCombiningCounters {
+    /** The number of (range, remote row) pairs recorded by put_deferred(). */
+    uint64_t num_deferred_writes = 0;
+    /** The number of RDMA writes flush() actually posted for them. */
+    uint64_t num_posted_writes = 0;
+};
+
+/**
+ * Controls what a detector thread does when no predicate has fired for a
+ * while. It first busy-spins (with a CPU pause between passes), then yields
+ * the CPU between passes, and finally parks for a bounded time between
+ * passes. Longer spinning lowers the latency of noticing a change at the cost
+ * of CPU time.
+ */
+struct IdlePolicy {
+    /** How long, in microseconds, to keep spinning after the last firing. */
+    uint32_t spin_us = 1000;
+    /** How long, in microseconds, to yield between passes after spinning. */
+    uint32_t yield_us = 0;
+    /** How long, in microseconds, to park between passes once both the spin
+     * and yield periods have elapsed. */
+    uint32_t park_us = 1000;
+};
+
 /** Constructor parameter pack for SST. */
 struct SSTParams {
     const std::vector<uint32_t>& members;
@@ -126,6 +154,9 @@ struct SSTParams {
     const failure_upcall_t failure_upcall;
     const std::vector<char> already_failed;
     const bool start_predicate_thread;
+    const uint32_t num_detector_threads;
+    const IdlePolicy idle_policy;
+    const bool write_combining;
 
     /**
      *
@@ -142,17 +173,31 @@ struct SSTParams {
      * should be started immediately on construction of the SST. If false,
      * predicate evaluation will not start until start_predicate_evalution()
      * is called.
+     * @param num_detector_threads The number of threads that will evaluate
+     * predicates. Predicates are assigned to a thread by the affinity given
+     * to Predicates::insert(), so predicates with different affinities can
+     * be evaluated in parallel.
+     * @param idle_policy How detector threads wait when no predicate fires.
+     * @param write_combining Whether put_deferred() should record dirty
+     * ranges to be merged and written by flush(), rather than writing
+     * immediately like put().
      */
     SSTParams(const std::vector<uint32_t>& _members,
               const uint32_t my_node_id,
               const failure_upcall_t failure_upcall = nullptr,
               const std::vector<char> already_failed = {},
-              const bool start_predicate_thread = true)
+              const bool start_predicate_thread = true,
+              const uint32_t num_detector_threads = 1,
+              const IdlePolicy idle_policy = {},
+              const bool write_combining = false)
             : members(_members),
               my_node_id(my_node_id),
               failure_upcall(failure_upcall),
               already_failed(already_failed),
-              start_predicate_thread(start_predicate_thread) {}
+              start_predicate_thread(start_predicate_thread),
+              num_detector_threads(std::max(num_detector_threads, 1u)),
+              idle_policy(idle_policy),
+              write_combining(write_combining) {}
 };
 
 template <class DerivedSST>
@@ -173,7 +218,7 @@ private:
     std::vector<std::thread> background_threads;
     std::atomic<bool> thread_shutdown;
 
-    void detect();
+    void detect(uint32_t group_index);
 
 public:
     Predicates<DerivedSST> predicates;
@@ -212,6 +257,30 @@ private:
     /** RDMA resources vector, one for each member. */
     std::vector<std::unique_ptr<resources>> res_vec;
 
+    /** How the detector threads wait when no predicate fires. */
+    const IdlePolicy idle_policy;
+
+    /** True if put_deferred() defers writes until flush(). */
+    const bool write_combining;
+    /** For each row index, the [offset, offset + size) ranges of the local
+     * row that must be written to that row's node at the next flush(). */
+    std::vector<std::vector<std::pair<long long int, long long int>>> dirty_ranges;
+    /** True if dirty_ranges is not empty; lets flush() return without locking. */
+    std::atomic<bool> has_dirty_ranges{false};
+    /** True from the time a range is deferred until a flush() has posted it,
+     * including while a flush() that took it is still posting; lets put()
+     * skip post_mutex when no deferred write could be overtaken. */
+    std::atomic<bool> has_unposted_ranges{false};
+    /** Write-combining statistics, protected by dirty_ranges_mutex. */
+    WriteCombiningCounters write_combining_counters;
+    /** Protects dirty_ranges and write_combining_counters. */
+    std::mutex dirty_ranges_mutex;
+    /** Held by flush() from taking the dirty ranges until they are posted,
+     * and by put() across its own flush and posting when deferred ranges are
+     * pending, so that an immediate write is never posted ahead of deferred
+     * writes taken before it. */
+    std::mutex post_mutex;
+
     /** Indicates whether the predicate evaluation thread should start after being
      * forked in the constructor. */
     bool thread_start;
@@ -224,6 +293,7 @@ public:
     SST(DerivedSST* derived_class_pointer, const SSTParams& params)
             : derived_this(derived_class_pointer),
               thread_shutdown(false),
+              predicates(params.num_detector_threads),
               members(params.members),
               num_members(members.size()),
               all_indices(num_members),
@@ -231,6 +301,9 @@ public:
               row_is_frozen(num_members),
               failure_upcall(params.failure_upcall),
               res_vec(num_members),
+              idle_policy(params.idle_policy),
+              write_combining(params.write_combining),
+              dirty_ranges(num_members),
               thread_start(params.start_predicate_thread) {
         //Figure out my SST index
         my_index = (uint)-1;
@@ -288,8 +361,10 @@ public:
             }
         }
 
-        std::thread detector(&SST::detect, this);
-        background_threads.push_back(std::move(detector));
+        for(uint32_t group_index = 0; group_index < predicates.num_evaluation_groups(); ++group_index) {
+            std::thread detector(&SST::detect, this, group_index);
+            background_threads.push_back(std::move(detector));
+        }
     }
 
     ~SST();
@@ -310,6 +385,13 @@ public:
     /** Returns the total number of rows in the table. */
     unsigned int get_num_rows() const { return num_members; }
 
+    /**
+     * Returns a snapshot of the idle-time and CPU-time counters of one
+     * detector thread.
+     * @param group_index The evaluation group served by that thread.
+     */
+    DetectorCounters get_detector_counters(uint32_t group_index);
+
     /** Gets the index of the local row in the table. */
     unsigned int get_local_index() const { return my_index; }
 
@@ -349,6 +431,41 @@ public:
 
     void put_with_completion(const std::vector<uint32_t> receiver_ranks, long long int offset, long long int size);
 
+    /**
+     * Marks a contiguous subset of the local row as dirty for some of the
+     * remote nodes. In write-combining mode the write is postponed until the
+     * next flush(), which merges it with the range deferred just before it
+     * when the two are contiguous; otherwise this is the same as put().
+     * Deferred ranges are posted in the order they were recorded, and any
+     * call to put() flushes first, so deferred writes are never overtaken by
+     * a later immediate one. Only writes made by a trigger are held until the
+     * end of the detector pass; a thread that is not running a trigger
+     * flushes its write right away, so it is not delayed until the next pass.
+     */
+    void put_deferred(const std::vector<uint32_t>& receiver_ranks, long long int offset, long long int size);
+
+    /** Marks a contiguous subset of the local row as dirty for all remote nodes. */
+    void put_deferred(long long int offset, long long int size) {
+        put_deferred(all_indices, offset, size);
+    }
+
+    /**
+     * Writes all ranges recorded by put_deferred() since the last flush, in
+     * the order they were recorded, posting one RDMA write per run of
+     * consecutively recorded ranges that are adjacent or overlapping for each
+     * remote node. The detector threads call this at the end of every
+     * evaluation pass.
+     */
+    void flush();
+
+private:
+    /** flush() for a caller that holds post_mutex. */
+    void flush_locked();
+
+public:
+    /** Returns a snapshot of the write-combining statistics. */
+    WriteCombiningCounters get_write_combining_counters();
+
 private:
     using char_p = volatile char*;
 
@@ -6,11 +6,13 @@
 
 #pragma once
 
+#include <algorithm>
 #include <chrono>
 #include <condition_variable>
 #include <memory>
 #include <mutex>
 #include <pthread.h>
+#include <string>
 #include <sys/time.h>
 #include <thread>
 #include <time.h>
@@ -50,99 +52,185 @@ void SST<DerivedSST>::start_predicate_evaluation() {
     thread_start_cv.notify_all();
 }
 
+/** Returns the current time of the given clock in nanoseconds. */
+inline uint64_t clock_ns(clockid_t clock_id) {
+    struct timespec now;
+    clock_gettime(clock_id, &now);
+    return now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+/** Hints to the CPU that the caller is busy-waiting. */
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
 /**
- * This function is run in a detached background thread to detect predicate
- * events. It continuously evaluates predicates one by one, and runs the
- * trigger functions for each predicate that fires. In addition, it
- * continuously evaluates named functions one by one, and updates the local
- * row's observed values of those functions.
+ * This function is run in a background thread to detect predicate events. One
+ * instance runs for each evaluation group of the predicates container, and it
+ * only evaluates the predicates of its own group. It continuously evaluates
+ * predicates one by one, and runs the trigger functions for each predicate
+ * that fires. When nothing fires, it waits according to the idle policy:
+ * spinning, then yielding, then parking for a bounded time.
+ * @param group_index The index of the evaluation group this thread serves.
  */
 template <typename DerivedSST>
-void SST<DerivedSST>::detect() {
-    pthread_setname_np(pthread_self(), "sst_detect");
+void SST<DerivedSST>::detect(uint32_t group_index) {
+    if(group_index == 0) {
+        pthread_setname_np(pthread_self(), "sst_detect");
+    } else {
+        pthread_setname_np(pthread_self(), ("sst_detect_" + std::to_string(group_index)).c_str());
+    }
+    typename Predicates<DerivedSST>::evaluation_group& group = *predicates.evaluation_groups[group_index];
     if(!thread_start) {
         std::unique_lock<std::mutex> lock(thread_start_mutex);
         thread_start_cv.wait(lock, [this]() { return thread_start; });
     }
-    struct timespec last_time, cur_time;
-    clock_gettime(CLOCK_REALTIME, &last_time);
+    const uint64_t spin_ns = idle_policy.spin_us * 1000ull;
+    const uint64_t yield_ns = spin_ns + idle_policy.yield_us * 1000ull;
+    const std::chrono::microseconds park_duration(idle_policy.park_us);
+    uint64_t last_fired_time = clock_ns(CLOCK_MONOTONIC);
+    // Nonzero if the previous pass ended by parking; holds how long it parked
+    uint64_t last_park_ns = 0;
+
+    // Runs a trigger with the predicate lock released, holding the group's
+    // trigger lock so that remove() from other threads can wait for it.
+    // The entry may be removed while the lock is released, so it is passed
+    // by reference to its owning pointer and checked again afterwards.
+    auto run_trigger = [this, &group, &last_park_ns](std::unique_lock<std::mutex>& predicates_lock,
+                                                     std::unique_ptr<typename Predicates<DerivedSST>::pred_entry>& entry) {
+        // Copy the trigger pointer locally, so it can continue running without
+        // segfaulting even if this predicate gets deleted when we unlock predicates_lock
+        std::shared_ptr<typename Predicates<DerivedSST>::trig> trigger(entry->trigger);
+        predicates_lock.unlock();
+        uint64_t start_time = clock_ns(CLOCK_MONOTONIC);
+        {
+            std::lock_guard<std::mutex> trigger_lock(group.trigger_mutex);
+            running_trigger() = true;
+            (*trigger)(*derived_this);
+            running_trigger() = false;
+        }
+        uint64_t trigger_time = clock_ns(CLOCK_MONOTONIC) - start_time;
+        predicates_lock.lock();
+        if(entry) {
+            PredicateCounters& counters = entry->counters;
+            counters.num_fired++;
+            counters.trigger_time_ns += trigger_time;
+            if(last_park_ns) {
+                counters.num_wakeups++;
+                counters.total_wakeup_latency_ns += last_park_ns;
+                counters.max_wakeup_latency_ns = std::max(counters.max_wakeup_latency_ns, last_park_ns);
+            }
+        }
+    };
+    auto evaluate = [this](std::unique_ptr<typename Predicates<DerivedSST>::pred_entry>& entry) {
+        entry->counters.num_evaluations++;
+        return entry->predicate(*derived_this);
+    };
 
     while(!thread_shutdown) {
         bool predicate_fired = false;
         // Take the predicate lock before reading the predicate lists
-        std::unique_lock<std::mutex> predicates_lock(predicates.predicate_mutex);
+        std::unique_lock<std::mutex> predicates_lock(group.predicate_mutex);
+        group.detector_counters.num_passes++;
 
         // one time predicates need to be evaluated only until they become true
-        for(auto& pred : predicates.one_time_predicates) {
-            if(pred != nullptr && (pred->first(*derived_this) == true)) {
+        for(auto& pred : group.one_time_predicates) {
+            if(pred != nullptr && evaluate(pred) == true) {
                 predicate_fired = true;
-                // Copy the trigger pointer locally, so it can continue running without
-                // segfaulting even if this predicate gets deleted when we unlock predicates_lock
-                std::shared_ptr<typename Predicates<DerivedSST>::trig> trigger(pred->second);
-                predicates_lock.unlock();
-                (*trigger)(*derived_this);
-                predicates_lock.lock();
+                run_trigger(predicates_lock, pred);
                 // erase the predicate as it was just found to be true
                 pred.reset();
             }
         }
 
         // recurrent predicates are evaluated each time they are found to be true
-        for(auto& pred : predicates.recurrent_predicates) {
-            if(pred != nullptr && (pred->first(*derived_this) == true)) {
+        for(auto& pred : group.recurrent_predicates) {
+            if(pred != nullptr && evaluate(pred) == true) {
                 predicate_fired = true;
-                std::shared_ptr<typename Predicates<DerivedSST>::trig> trigger(pred->second);
-                predicates_lock.unlock();
-                (*trigger)(*derived_this);
-                predicates_lock.lock();
+                run_trigger(predicates_lock, pred);
             }
         }
 
         // transition predicates are only evaluated when they change from false to true
         // We need to use iterators here because we need to iterate over two lists in parallel
-        auto pred_it = predicates.transition_predicates.begin();
-        auto pred_state_it = predicates.transition_predicate_states.begin();
-        while(pred_it != predicates.transition_predicates.end()) {
+        auto pred_it = group.transition_predicates.begin();
+        auto pred_state_it = group.transition_predicate_states.begin();
+        while(pred_it != group.transition_predicates.end()) {
             if(*pred_it != nullptr) {
                 //*pred_state_it is the previous state of the predicate at *pred_it
-                bool curr_pred_state = (*pred_it)->first(*derived_this);
+                bool curr_pred_state = evaluate(*pred_it);
                 if(curr_pred_state == true && *pred_state_it == false) {
                     predicate_fired = true;
-                    std::shared_ptr<typename Predicates<DerivedSST>::trig> trigger(
-                            (*pred_it)->second);
-                    predicates_lock.unlock();
-                    (*trigger)(*derived_this);
-                    predicates_lock.lock();
+                    run_trigger(predicates_lock, *pred_it);
                 }
                 *pred_state_it = curr_pred_state;
-
-                ++pred_it;
-                ++pred_state_it;
             }
+            ++pred_it;
+            ++pred_state_it;
         }
+        last_park_ns = 0;
+        // post the writes deferred by this pass's triggers
+        flush();
 
         if(predicate_fired) {
-            // update last time
-            clock_gettime(CLOCK_REALTIME, &last_time);
+            last_fired_time = clock_ns(CLOCK_MONOTONIC);
+            continue;
+        }
+        group.detector_counters.num_idle_passes++;
+        // check how long the system has been inactive to choose how to wait
+        uint64_t idle_time = clock_ns(CLOCK_MONOTONIC) - last_fired_time;
+        if(idle_time < spin_ns) {
+            predicates_lock.unlock();
+            cpu_relax();
+        } else if(idle_time < yield_ns) {
+            group.detector_counters.num_yields++;
+            predicates_lock.unlock();
+            std::this_thread::yield();
         } else {
-            clock_gettime(CLOCK_REALTIME, &cur_time);
-            // check if the system has been inactive for enough time to induce sleep
-            double time_elapsed_in_ms = (cur_time.tv_sec - last_time.tv_sec) * 1e3
-                                        + (cur_time.tv_nsec - last_time.tv_nsec) / 1e6;
-            if(time_elapsed_in_ms > 1) {
-                predicates_lock.unlock();
-                using namespace std::chrono_literals;
-                std::this_thread::sleep_for(1ms);
-                predicates_lock.lock();
-            }
+            predicates_lock.unlock();
+            uint64_t park_start = clock_ns(CLOCK_MONOTONIC);
+            std::this_thread::sleep_for(park_duration);
+            last_park_ns = clock_ns(CLOCK_MONOTONIC) - park_start;
+            predicates_lock.lock();
+            group.detector_counters.num_parks++;
+            group.detector_counters.parked_time_ns += last_park_ns;
         }
         //Still to do: Clean up deleted predicates
     }
 }
 
+template <typename DerivedSST>
+DetectorCounters SST<DerivedSST>::get_detector_counters(uint32_t group_index) {
+    DetectorCounters counters;
+    {
+        auto& group = *predicates.evaluation_groups.at(group_index);
+        std::lock_guard<std::mutex> lock(group.predicate_mutex);
+        counters = group.detector_counters;
+    }
+    clockid_t cpu_clock;
+    if(group_index < background_threads.size()
+       && pthread_getcpuclockid(background_threads[group_index].native_handle(), &cpu_clock) == 0) {
+        counters.cpu_time_ns = clock_ns(cpu_clock);
+    }
+    return counters;
+}
+
 template <typename DerivedSST>
 void SST<DerivedSST>::put(const std::vector<uint32_t> receiver_ranks, long long int offset, long long int size) {
     assert(offset + size <= rowLen);
+    // Write out anything deferred earlier, so it cannot arrive after this
+    // write. post_mutex also makes this write wait for a flush() of another
+    // thread that has taken the deferred ranges but not posted them yet.
+    // Without pending deferred ranges puts do not take the lock at all.
+    std::unique_lock<std::mutex> post_lock(post_mutex, std::defer_lock);
+    if(write_combining && has_unposted_ranges) {
+        post_lock.lock();
+        flush_locked();
+    }
     for(auto index : receiver_ranks) {
         // don't write to yourself or a frozen row
         if(index == my_index || row_is_frozen[index]) {
@@ -154,9 +242,96 @@ void SST<DerivedSST>::put(const std::vector<uint32_t> receiver_ranks, long long
     return;
 }
 
+template <typename DerivedSST>
+void SST<DerivedSST>::put_deferred(const std::vector<uint32_t>& receiver_ranks, long long int offset, long long int size) {
+    assert(offset + size <= rowLen);
+    if(!write_combining) {
+        put(receiver_ranks, offset, size);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(dirty_ranges_mutex);
+        for(auto index : receiver_ranks) {
+            if(index == my_index || row_is_frozen[index]) {
+                continue;
+            }
+            auto& ranges = dirty_ranges[index];
+            // extend the previous range if this one continues or overlaps it
+            if(!ranges.empty() && offset >= ranges.back().first && offset <= ranges.back().second) {
+                ranges.back().second = std::max(ranges.back().second, offset + size);
+            } else {
+                ranges.emplace_back(offset, offset + size);
+            }
+            write_combining_counters.num_deferred_writes++;
+        }
+        has_unposted_ranges = true;
+        has_dirty_ranges = true;
+    }
+    // no detector pass will flush for a thread outside a trigger
+    if(!running_trigger()) {
+        flush();
+    }
+}
+
+template <typename DerivedSST>
+void SST<DerivedSST>::flush() {
+    if(!has_dirty_ranges) {
+        return;
+    }
+    std::lock_guard<std::mutex> post_lock(post_mutex);
+    flush_locked();
+}
+
+template <typename DerivedSST>
+void SST<DerivedSST>::flush_locked() {
+    std::vector<std::vector<std::pair<long long int, long long int>>> ranges_to_write(num_members);
+    {
+        std::lock_guard<std::mutex> lock(dirty_ranges_mutex);
+        if(!has_dirty_ranges) {
+            return;
+        }
+        ranges_to_write.swap(dirty_ranges);
+        dirty_ranges.resize(num_members);
+        has_dirty_ranges = false;
+    }
+    uint64_t num_posted = 0;
+    std::vector<std::pair<long long int, long long int>> writes;
+    for(uint32_t index = 0; index < num_members; ++index) {
+        auto& ranges = ranges_to_write[index];
+        if(ranges.empty() || row_is_frozen[index]) {
+            continue;
+        }
+        // post the [start, end) ranges as (offset, size), in program order;
+        // put_deferred() already merged the contiguous ones
+        writes.clear();
+        for(const auto& range : ranges) {
+            writes.emplace_back(range.first, range.second - range.first);
+        }
+        res_vec[index]->post_remote_writes(writes);
+        num_posted += writes.size();
+    }
+    std::lock_guard<std::mutex> lock(dirty_ranges_mutex);
+    write_combining_counters.num_posted_writes += num_posted;
+    // ranges deferred while these were posted are still waiting for a flush
+    if(!has_dirty_ranges) {
+        has_unposted_ranges = false;
+    }
+}
+
+template <typename DerivedSST>
+WriteCombiningCounters SST<DerivedSST>::get_write_combining_counters() {
+    std::lock_guard<std::mutex> lock(dirty_ranges_mutex);
+    return write_combining_counters;
+}
+
 template <typename DerivedSST>
 void SST<DerivedSST>::put_with_completion(const std::vector<uint32_t> receiver_ranks, long long int offset, long long int size) {
     assert(offset + size <= rowLen);
+    std::unique_lock<std::mutex> post_lock(post_mutex, std::defer_lock);
+    if(write_combining && has_unposted_ranges) {
+        post_lock.lock();
+        flush_locked();
+    }
     unsigned int num_writes_posted = 0;
     std::vector<bool> posted_write_to(num_members, false);
 
@@ -182,6 +357,10 @@ void SST<DerivedSST>::put_with_completion(const std::vector<uint32_t> receiver_r
         posted_write_to[index] = true;
         num_writes_posted++;
     }
+    // the writes are posted; waiting for their completions need not hold up other puts
+    if(post_lock.owns_lock()) {
+        post_lock.unlock();
+    }
 
     // track which nodes haven't failed yet
     std::vector<bool> polled_successfully_from(num_members, false);
@@ -0,0 +1,30 @@
+#ifndef TEST_CHECK_HPP
+#define TEST_CHECK_HPP
+
+#include <iostream>
+
+// A minimal check harness for the test programs: a failed CHECK() is
+// reported with its line and counted, and the test goes on.
+
+// the number of failed checks
+inline int check_failures = 0;
+
+#define CHECK(cond)                                                                     \
+    do {                                                                                \
+        if(!(cond)) {                                                                   \
+            std::cout << "\tFAILED at line " << __LINE__ << ": " << #cond << std::endl; \
+            check_failures++;                                                           \
+        }                                                                               \
+    } while(0)
+
+// Prints the outcome of the checks, and returns the exit code of the test.
+inline int check_results() {
+    if(check_failures > 0) {
+        std::cout << check_failures << " checks failed." << std::endl;
+        return -1;
+    }
+    std::cout << "all tests passed." << std::endl;
+    return 0;
+}
+
+#endif  // TEST_CHECK_HPP